@@ -0,0 +1,325 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+:Purpose:   This module provides the vulnerability advisory providers
+            to the project.
+
+            A provider looks up the reported vulnerabilities for every
+            package (name and version) in the bundle, and returns the
+            number of vulnerabilities in each severity category (C, H,
+            M, L), along with the report lines to be displayed. These
+            map directly onto the ``dv_c,dv_h,dv_m,dv_l`` log columns.
+
+            The following providers are available, and are selected by
+            the ``vuln_provider`` key in ``config.json``:
+
+                - ``osv``: The OSV.dev API. All packages are queried in
+                  a single ``querybatch`` request (the default).
+                - ``snyk``: The Snyk.io package pages; one (or two)
+                  requests per package.
+
+:Platform:  Linux/Windows | Python 3.6+
+:Developer: J Berendt
+:Email:     development@s3dev.uk
+
+:Comments:  To add a provider, subclass :class:`Provider`, implement
+            the :meth:`Provider.lookup` method, and register the class
+            in the ``_PROVIDERS`` dictionary.
+
+"""
+# pylint: disable=import-error
+
+import json
+import math
+import re
+from concurrent.futures import ThreadPoolExecutor
+# locals
+from lib.utilities import utilities
+from lib.vtests import Tests
+
+
+class Provider:
+    """Base class for the vulnerability advisory providers."""
+
+    # Number of lookups run concurrently, for providers which cannot batch.
+    _WORKERS = 16
+    _TMPL = '{:10}{:40}{:25}'
+    _DETAIL = 'Versions'  # Heading of the report's third column.
+
+    def lookup(self, packages: list) -> dict:
+        """Look up the reported vulnerabilities for the given packages.
+
+        Args:
+            packages (list): A list of (name, version) tuples.
+
+        Returns:
+            dict: A dictionary keyed by :meth:`key`, whose values are
+            tuples of: a tuple of the number of vulnerabilities in each
+            category (C, H, M, L), and the list of report lines.
+
+        """
+        raise NotImplementedError
+
+    @staticmethod
+    def key(name: str, version: str) -> tuple:
+        """Return the results key for a package.
+
+        The name is normalised per PEP 503, so the names parsed from
+        wheel and sdist filenames compare equal.
+
+        """
+        return re.sub(r'[-_.]+', '-', name).lower(), version
+
+    def _report(self, name: str, version: str, rows: list) -> list:
+        """Build the report lines for a package.
+
+        Args:
+            name (str): Package name.
+            version (str): Package version.
+            rows (list): A list of (severity, title, detail) tuples; one
+                for each reported vulnerability.
+
+        Returns:
+            list: The report lines.
+
+        """
+        if not rows:
+            return [f'{name} v{version} has no reported direct vulnerabilities.']
+        return [f'\n{name} v{version} has the following reported direct vulnerabilities:',
+                '',
+                self._TMPL.format('Severity', 'Title', self._DETAIL),
+                self._TMPL.format('--------', '-----', '-' * len(self._DETAIL)),
+                *(self._TMPL.format(*i) for i in rows),
+                '']
+
+
+class OSV(Provider):
+    """Query the OSV.dev API for reported vulnerabilities.
+
+    All packages are sent in a single ``querybatch`` request (or one
+    request per 1000 packages), which returns the IDs of the
+    vulnerabilities affecting each package. Each vulnerability's record
+    is then fetched once, however many packages it affects, and is
+    cached on disk (see :meth:`utilities.fetch`), so the severities are
+    normally read from the cache on subsequent runs.
+
+    """
+
+    _URL = 'https://api.osv.dev/v1'
+    _BATCH = 1000  # Maximum number of queries per querybatch request.
+    _DETAIL = 'ID'
+    _SEVERITY = {'CRITICAL': 0, 'HIGH': 1, 'MODERATE': 2, 'MEDIUM': 2, 'LOW': 3}
+
+    def lookup(self, packages: list) -> dict:
+        """Look up the reported vulnerabilities for the given packages.
+
+        Args:
+            packages (list): A list of (name, version) tuples.
+
+        Returns:
+            dict: A dictionary keyed by :meth:`key`, as described by
+            :meth:`Provider.lookup`.
+
+        """
+        ids = {}
+        for i in range(0, len(packages), self._BATCH):
+            ids.update(self._querybatch(packages=packages[i:i+self._BATCH]))
+        allids = sorted(set().union(*ids.values())) if ids else []
+        with ThreadPoolExecutor(max_workers=self._WORKERS) as pool:
+            vulns = dict(zip(allids, pool.map(self._vuln, allids)))
+        results = {}
+        for name, version in packages:
+            counts = [0, 0, 0, 0]
+            rows = []
+            seen = set()
+            for id_ in sorted(ids.get((name, version), ())):
+                # The same advisory is often published under several IDs
+                # (e.g. PYSEC and GHSA); count it once.
+                vuln = vulns[id_]
+                aliases = {id_, *vuln.get('aliases', ())}
+                if aliases & seen:
+                    continue
+                seen |= aliases
+                label = self._severity(vuln=vuln)
+                counts[self._SEVERITY[label]] += 1
+                rows.append((label.title(), (vuln.get('summary') or id_)[:39], id_))
+            results[self.key(name, version)] = (tuple(counts), self._report(name, version, rows))
+        return results
+
+    def _querybatch(self, packages: list) -> dict:
+        """Send a querybatch request for the given packages.
+
+        Any results which are paged (i.e. a package with many reported
+        vulnerabilities) are requested again, using the page token,
+        until complete.
+
+        Args:
+            packages (list): A list of (name, version) tuples.
+
+        Returns:
+            dict: A dictionary of the set of vulnerability IDs for each
+            (name, version) tuple.
+
+        """
+        ids = {p: set() for p in packages}
+        queries = {p: {'package': {'name': self.key(*p)[0], 'ecosystem': 'PyPI'}, 'version': p[1]}
+                   for p in packages}
+        pending = list(packages)
+        while pending:
+            with utilities.session().post(f'{self._URL}/querybatch',
+                                          json={'queries': [queries[p] for p in pending]},
+                                          timeout=30) as r:
+                if r.status_code != 200:
+                    raise RuntimeWarning(f'\nThe OSV querybatch request failed with status code: '
+                                         f'{r.status_code}\n')
+                data = r.json()
+            paged = []
+            for p, result in zip(pending, data.get('results', [])):
+                ids[p].update(v['id'] for v in result.get('vulns', []))
+                if result.get('next_page_token'):
+                    queries[p]['page_token'] = result['next_page_token']
+                    paged.append(p)
+            pending = paged
+        return ids
+
+    def _severity(self, vuln: dict) -> str:
+        """Derive the severity category for a vulnerability record.
+
+        The categorical severity published with the record (e.g. by the
+        GitHub advisory database) is preferred. Otherwise, the category
+        is derived from the CVSS v3 base score. A (fetched) record with
+        neither is categorised as moderate.
+
+        Args:
+            vuln (dict): The OSV vulnerability record.
+
+        Returns:
+            str: A key from the ``_SEVERITY`` dictionary.
+
+        """
+        label = str((vuln.get('database_specific') or {}).get('severity', '')).upper()
+        if label in self._SEVERITY:
+            return label
+        for sev in vuln.get('severity', []):
+            if sev.get('type') == 'CVSS_V3':
+                score = self._cvss3(vector=sev.get('score', ''))
+                if score is not None:
+                    if score >= 9.0:
+                        return 'CRITICAL'
+                    if score >= 7.0:
+                        return 'HIGH'
+                    return 'MODERATE' if score >= 4.0 else 'LOW'
+        return 'MODERATE'
+
+    @staticmethod
+    def _cvss3(vector: str) -> float:
+        """Calculate the base score from a CVSS v3.x vector string.
+
+        Args:
+            vector (str): CVSS vector; for example,
+                ``CVSS:3.1/AV:N/AC:L/PR:N/UI:N/S:U/C:H/I:H/A:H``.
+
+        Returns:
+            float: The base score, or None if the vector is not valid.
+
+        """
+        # pylint: disable=invalid-name
+        try:
+            m = dict(i.split(':') for i in vector.split('/')[1:])
+            changed = m['S'] == 'C'
+            av = {'N': 0.85, 'A': 0.62, 'L': 0.55, 'P': 0.2}[m['AV']]
+            ac = {'L': 0.77, 'H': 0.44}[m['AC']]
+            pr = {'N': 0.85, 'L': 0.68 if changed else 0.62, 'H': 0.5 if changed else 0.27}[m['PR']]
+            ui = {'N': 0.85, 'R': 0.62}[m['UI']]
+            c, i, a = ({'H': 0.56, 'L': 0.22, 'N': 0}[m[k]] for k in ('C', 'I', 'A'))
+        except (KeyError, ValueError):
+            return None
+        iss = 1 - (1 - c) * (1 - i) * (1 - a)
+        if changed:
+            impact = 7.52 * (iss - 0.029) - 3.25 * (iss - 0.02) ** 15
+        else:
+            impact = 6.42 * iss
+        if impact <= 0:
+            return 0.0
+        exploit = 8.22 * av * ac * pr * ui
+        score = (impact + exploit) * (1.08 if changed else 1)
+        return math.ceil(min(score, 10) * 10 - 1e-9) / 10
+
+    def _vuln(self, id_: str) -> dict:
+        """Fetch (or read from the cache) a vulnerability record.
+
+        A record which cannot be fetched is an error, rather than an
+        empty record, so an unknown severity is never counted as
+        moderate.
+
+        Args:
+            id_ (str): OSV vulnerability ID.
+
+        Raises:
+            RuntimeWarning: If the record could not be fetched.
+
+        Returns:
+            dict: The vulnerability record.
+
+        """
+        status, text = utilities.fetch(url=f'{self._URL}/vulns/{id_}', key=f'osv/{id_}', timeout=10)
+        if status != 200:
+            raise RuntimeWarning(f'\nThe OSV vulnerability request failed with status code: {status} ({id_})\n')
+        return json.loads(text)
+
+
+class Snyk(Provider):
+    """Use the Snyk.io package pages to look up reported vulnerabilities.
+
+    The pages are scraped by :meth:`Tests.snyk`, one package at a time,
+    so the packages are looked up concurrently.
+
+    """
+
+    def lookup(self, packages: list) -> dict:
+        """Look up the reported vulnerabilities for the given packages.
+
+        Args:
+            packages (list): A list of (name, version) tuples.
+
+        Returns:
+            dict: A dictionary keyed by :meth:`key`, as described by
+            :meth:`Provider.lookup`.
+
+        """
+        with ThreadPoolExecutor(max_workers=self._WORKERS) as pool:
+            return dict(pool.map(self._lookup, packages))
+
+    def _lookup(self, package: tuple) -> tuple:
+        """Look up a single package; run concurrently by :meth:`lookup`."""
+        name, version = package
+        report = []
+        _, *counts = Tests.snyk(name=name, version=version, report=report)
+        # A version missing from the page has no counts; report it as clean.
+        counts = (tuple(counts) + (0, 0, 0, 0))[:4]
+        return self.key(name, version), (counts, report)
+
+
+_PROVIDERS = {'osv': OSV, 'snyk': Snyk}
+
+
+def get_provider(name: str=None) -> Provider:
+    """Return an instance of the named vulnerability advisory provider.
+
+    Args:
+        name (str, optional): Name of the provider; a key of the
+            ``_PROVIDERS`` dictionary. Defaults to None, which selects
+            the OSV provider.
+
+    Raises:
+        ValueError: If the provider is not known.
+
+    Returns:
+        Provider: An instance of the provider class.
+
+    """
+    name = (name or 'osv').lower()
+    if name not in _PROVIDERS:
+        raise ValueError(f'Unknown vulnerability provider ({name}). '
+                         f'Expected one of: {", ".join(_PROVIDERS)}')
+    return _PROVIDERS[name]()
@@ -43,7 +43,8 @@ class ArgParser:
                'If *downloading* from requirements (i.e. pip freeze):\n'
                '  - The full path to the requirements.txt file to be used.\n'
                'If *unpacking*:\n'
-               '  - The full path to the .7z file to be unpacked.\n\n'
+               '  - The full path to the .7z file to be unpacked, or the\n'
+               '    .chunks index file of a chunked archive.\n\n'
 
                'If the path to a .txt file is received, the packer will assume\n'
                'this is a requirements file (as generated by \'pip freeze\'), and\n'
@@ -54,15 +55,39 @@ class ArgParser:
                'the environment\'s pip repository is automatically refreshed.'
               )
     _H_PLAT = ('Download only wheels compatible with <platform>.\n'
-               'Defaults to the platform of the running system.')
+               'Defaults to the platform of the running system.\n'
+               'If several platforms (or Python versions) are given, the\n'
+               'packages are downloaded for each combination (target), and\n'
+               'the files shared by the targets are tested only once.')
     _H_PVER = ('The Python interpreter version, used for the downloaded\n'
                'wheel(s).\n'
                'Defaults to a version derived from the running\n'
                'interpreter. The version can be specified using\n'
                'a major-minor version given as a string without dots\n'
-               '(e.g. "37" for 3.7.0, or "312" for 3.12.0).')
+               '(e.g. "37" for 3.7.0, or "312" for 3.12.0).\n'
+               'Several versions may be given; see --platform.')
     _H_NOCL = ('Disable the automatic temp file cleanup. Leaves all\n'
                'files in place.')
+    _H_EXPA = ('Export the offline advisory snapshot to the given path,\n'
+               'for the unpacker\'s vulnerability re-check on the secured\n'
+               'side. The snapshot covers all PyPI projects, and is\n'
+               'installed into the repo as .ppk/.advisories, or passed to\n'
+               'upack with --advisories.')
+    _H_INVT = ('Build a delta archive; omit the files already held by the\n'
+               'secured repo, as listed in the repo inventory exported by\n'
+               'upack --inventory. The log lists every package, so the\n'
+               'unpacker verifies the omitted packages against its repo.')
+    _H_CHNK = ('Split the archive into N chunks of a similar size; each a\n'
+               'complete, encrypted archive, listed with its digest in an\n'
+               'index (.chunks) file. The unpacker verifies and unpacks the\n'
+               'chunks concurrently, and names any chunk which is damaged.')
+    _H_PROF = ('Write a JSON run report beside the archive on the desktop\n'
+               '(<archive>__profile.json); the latency histogram of each\n'
+               'test and HTTP request phase, the bytes hashed and the\n'
+               'cache hits and misses.')
+    _H_SPLT = ('If several targets are downloaded, create an archive for\n'
+               'each target, rather than a single combined archive. Each\n'
+               'archive holds the rows of the shared log for its packages.')
     _H_USEL = ('Force pip to use the local repository, rather than PyPI.\n'
                     'Generally, this is used for testing only.')
 
@@ -96,8 +121,13 @@ class ArgParser:
         parser.add_argument('package', nargs=1, type=str, help=self._H_PKGN)
         parser.add_argument('--license', action='store_true', help=self._H_LICS)
         parser.add_argument('--only_binary', action='store_true', help=self._H_BINR)
-        parser.add_argument('--platform', choices=self._C_PLAT, nargs=1, type=str, help=self._H_PLAT)
-        parser.add_argument('--python_version', choices=self._C_PVER, nargs=1, type=str, help=self._H_PVER)
+        parser.add_argument('--platform', choices=self._C_PLAT, nargs='+', type=str, help=self._H_PLAT)
+        parser.add_argument('--python_version', choices=self._C_PVER, nargs='+', type=str, help=self._H_PVER)
+        parser.add_argument('--export_advisories', nargs=1, type=str, metavar='PATH', help=self._H_EXPA)
+        parser.add_argument('--chunks', nargs=1, type=int, metavar='N', help=self._H_CHNK)
+        parser.add_argument('--inventory', nargs=1, type=str, metavar='PATH', help=self._H_INVT)
+        parser.add_argument('--split_targets', action='store_true', help=self._H_SPLT)
+        parser.add_argument('--profile', action='store_true', help=self._H_PROF)
         parser.add_argument('-n', '--no_cleanup', action='store_true', help=self._H_NOCL)
         parser.add_argument('-u', '--use_local', action='store_true', help=self._H_USEL)
         parser.add_argument('-v', '--version', action='version', version=self._VERS)
@@ -105,6 +135,8 @@ class ArgParser:
             self._display_license()
         else:
             self._args = parser.parse_args()
+            if self._args.split_targets and self._args.chunks:
+                parser.error('argument --split_targets: not allowed with argument --chunks')
             self._add_other_arguments()
             self._test_package()
 
@@ -159,7 +191,8 @@ class ArgParser:
               *and* the file exists, the new 'from_req' argument is set
               to True; otherwise it remains as False.
             - If the argument provided to the ``package`` parameter has a
-              ``.7z`` file extension (indicating an archive to be passed
+              ``.7z`` or ``.chunks`` file extension (indicating an
+              archive, or the index of a chunked archive, to be passed
               to the unpacker) *and* the file exists, the new 'unpack'
               argument is set to True; otherwise it remains as False.
 
@@ -175,7 +208,7 @@ class ArgParser:
             if not os.path.exists(arg):
                 raise FileNotFoundError(f'The requested requirements file was not found: {arg}')
             self._args.from_req = True
-        elif os.path.splitext(arg)[1].lower() == '.7z':
+        elif os.path.splitext(arg)[1].lower() in ('.7z', '.chunks'):
             if not os.path.exists(arg):
                 raise FileNotFoundError(f'The requested archive was not found: {arg}')
             self._args.unpack = True
@@ -6,9 +6,9 @@
             and verify the integrity of these packages to ensure they
             are deemed 'safe' for use in a sensitive environment.
 
-            Essentially, this program wraps ``pip download`` and runs
-            MD5 integrity and vulnerability checks for the package and
-            its downloaded dependencies.
+            Essentially, this program wraps pip's resolver and runs
+            integrity (digest) and vulnerability checks for the package
+            and its downloaded dependencies.
 
             If the package and its dependencies have passed the checks,
             they - along with the testing report/log - are added to an
@@ -26,19 +26,29 @@
 
 import hashlib
 import itertools
+import json
+import lzma
 import os
 import re
 import socket
 import shutil
 import subprocess as sp
 import sys
+import threading
+import time
 from argparse import Namespace
-from collections import defaultdict
+from concurrent.futures import ThreadPoolExecutor
 from datetime import datetime as dt
 from glob import glob
+from urllib.parse import unquote, urlsplit
+import requests
 from utils4.crypto import crypto
 from utils4.user_interface import ui
 # locals
+from lib.advisories import get_provider
+from lib import snapshot
+from lib.config import config
+from lib.profiler import profiler
 from lib.utilities import utilities
 from lib.vtests import Tests
 
@@ -54,22 +64,39 @@ class PPKPacker:
 
     # List the tests to be run here. These are method names from the
     # libs.tests.Tests class.
-    _TESTS = ['md5', 'snyk']
+    _TESTS = ['md5', 'vuln']
+    # Extensions of the already compressed formats, which are stored
+    # (encrypted only) in the archive, rather than compressed again.
+    _STORED = ('.whl', '.tar.gz', '.tgz', '.tar.bz2', '.tar.xz', '.zip', '.egg')
+    # Number of files verified concurrently. The tests are mostly spent
+    # waiting on the network, so this exceeds the CPU count.
+    _WORKERS = 16
+    # Number of attempts made to download a file, each resuming the last.
+    _RETRIES = 3
 
     def __init__(self, args: Namespace):
         """Package check class initialiser."""
         self._args = args           # All arguments parsed from the CLI
         self._abi = None            # The ABI tag, as parsed from the package filename.
+        self._advisories = {}       # Reported vulnerabilities for each package, per the provider.
+        self._bundles = []          # Full paths to the archives, if an archive is created per target.
+        self._chunks = []           # Full paths to the archive chunks, if the bundle is chunked.
+        self._digests = {}          # Digest and size of each file, as calculated while downloading.
+        self._files = {}            # Filenames downloaded for each target.
+        self._lock = threading.Lock()  # Serialises the requirements file updates.
         self._ofname = None         # The name of the outfile (no extension).
         self._md5 = None            # Package's MD5 digest from PyPI
+        self._nobinary = set()      # Packages added to the requirements file as --no-binary.
         self._pass = False          # *Overall* passing flag for the entire test.
         self._passflags = []        # *Overall* passing flag from each test.
         self._pkg = None            # Name of the primary package (per CLI).
         self._pkg_version = None    # Package version, as parsed from the filename.
         self._py_version = None     # Python version for which the packages are downloaded.
+        self._stamp = None          # Datetime stamp used in the name of a requirements file's outfiles.
         self._platform = None       # Platform for which the packages are downloaded.
         self._p_key = None          # Full path to the key file.
         self._p_log = None          # Full path to the log file.
+        self._targets = []          # (platform, Python version) of each target; None if not given.
         self._tmpdir = None         # Full path to the temp directory
 
     def main(self) -> int:
@@ -80,7 +107,8 @@ class PPKPacker:
             - Parse the command line arguments.
             - Create the temporary download / working directory.
             - Run ``pip download`` via a subprocess call, using the
-              arguments passed into the CLI by the user.
+              arguments passed into the CLI by the user; for each target
+              (platform and Python version) requested.
             - Obtain the package's version number, and ABI by parsing the
               filename of the downloaded wheel.
             - Build the name of the output files: archive, log and key.
@@ -88,6 +116,8 @@ class PPKPacker:
             - Write a log file containing the results of the tests.
             - If the tests pass, bundle the package and its dependencies
               into an encrypted archive file on the user's desktop.
+            - If requested, export the offline advisory snapshot.
+            - If requested, write the profiling run report.
             - Remove the temporary download directory.
             - Print a summary report to the terminal.
 
@@ -97,18 +127,76 @@ class PPKPacker:
 
         """
         self._parse_args()
+        profiler.enabled = self._args.profile
         self._make_download_directory()
-        self._pip_download()
+        with profiler.timer(name='stage/download'):
+            self._pip_download()
         self._get_package_version_number()
         self._build_outfile_name()
-        self._verify_wheels()
+        with profiler.timer(name='stage/verify'):
+            self._verify_wheels()
         self._log_summary()
         self._copy_requirements_file()
-        self._create_archive()
+        with profiler.timer(name='stage/archive'):
+            self._create_archive()
+        self._export_advisories()
+        self._write_profile()
         self._cleanup()
         self._print_summary()
         return 0 if self._pass else 1
 
+    @staticmethod
+    def _7z_add(opath: str, password: str, files: list, level: int=3):
+        """Add files to the (new or existing) encrypted archive.
+
+        Args:
+            opath (str): Full path to the archive.
+            password (str): The archive's password.
+            files (list): List of full paths to the files to be added.
+            level (int, optional): The 7z compression level, where 0
+                stores the files (encryption only). Defaults to 3.
+
+        Raises:
+            RuntimeError: If the 7z subprocess returns a non-zero exit
+            code.
+
+        """
+        cmd = ['7z', 'a', f'-mx{level}', '-mhe=on', '-mmt=on', f'-p{password}', opath]
+        cmd_ = cmd + files
+        with sp.Popen(cmd_, stdout=sp.PIPE, stderr=sp.PIPE) as proc:
+            stdout, stderr = proc.communicate()
+        if proc.returncode:
+            ui.print_alert(('\nAn error occurred while creating the archive. '
+                            f'Exit code: {proc.returncode}'), style='bold')
+            raise RuntimeError('\n'.join(('Output from subprocess ...',
+                                          stdout.decode(),
+                                          stderr.decode())))
+
+    @classmethod
+    def _7z_bundle(cls, opath: str, password: str, verification: list, packages: list):
+        """Create a (new) encrypted archive of the verification files and
+        packages.
+
+        The verification files are added first, in their own pass,
+        followed by the packages, which are stored if already compressed
+        (see ``_STORED``), otherwise compressed, in a pass of their own.
+
+        Args:
+            opath (str): Full path to the archive. If the archive already
+                exists, it is *deleted* and replaced.
+            password (str): The archive's password.
+            verification (list): Full paths to the verification files.
+            packages (list): Full paths to the packages.
+
+        """
+        if os.path.exists(opath):
+            os.unlink(opath)
+        stored = [f for f in packages if f.lower().endswith(cls._STORED)]
+        compressed = [f for f in packages if f not in stored]
+        for files_, level in ((verification, 3), (compressed, 3), (stored, 0)):
+            if files_:
+                cls._7z_add(opath=opath, password=password, files=files_, level=level)
+
     def _build_outfile_name(self):
         """Build the outfile name, based on platform compatibility tags.
 
@@ -122,20 +210,16 @@ class PPKPacker:
 
             frz-username-datetime-python_version-python_version-platform_tag
 
+        .. versionchanged: 0.3.0.dev1
+           If several targets are downloaded, the Python version, ABI and
+           platform tags are compressed tag sets (per PEP 425) of the
+           targets' tags; for example::
+
+               pkg_name-pkg_version-cp39.cp311-cp39.cp311-platform_tag
+
         """
-        if self._args.from_req:
-            self._ofname = (f'frz-'
-                            f'{utilities.get_username()}-'
-                            f'{dt.now().strftime("%Y%m%d%H%M%S")}-'
-                            f'cp{self._py_version}-'
-                            f'cp{self._py_version}-'
-                            f'{self._platform}')
-        else:
-            self._ofname = (f'{self._pkg}-'
-                            f'{self._pkg_version}-'
-                            f'cp{self._py_version}-'
-                            f'{self._abi}-'
-                            f'{self._platform}')
+        self._stamp = dt.now().strftime("%Y%m%d%H%M%S")
+        self._ofname = self._outfile_name(targets=self._targets)
 
     def _cleanup(self, force: bool=False):
         """Class tear-down and internal cleanup method.
@@ -189,10 +273,16 @@ class PPKPacker:
             The flags used in the 7z command are as follows:
 
                 - ``a``: *Add* files to the archive.
-                - ``-mx3``: Use compression level 3. This should be
-                  faster than the default (5), with relatively the same
-                  size on disk, as ``.whl`` files are already
-                  compressed.
+                - ``-mx3``: Use compression level 3 for the
+                  verification files (and any package which is not in
+                  an already compressed format). This should be faster
+                  than the default (5), with relatively the same size
+                  on disk.
+                - ``-mx0``: Store the packages in an already compressed
+                  format (see ``_STORED``); e.g. ``.whl`` and
+                  ``.tar.gz`` files. These are only encrypted, as
+                  compressing them again gains next to nothing, so the
+                  unpacker decodes them at the speed of decryption.
                 - ``-mhe=on``: Encrypt the header data so the contents
                   of the archive cannot be viewed without entering the
                   decryption password.
@@ -203,32 +293,336 @@ class PPKPacker:
            Updated to create an encrypted, password protected, archive
            file.
 
+        .. versionchanged: 0.3.0.dev1
+           The verification files (log, key and requirements file) are
+           added to the archive *first*, in their own pass, followed by
+           the packages. This allows the unpacker to verify the archive
+           as soon as these small files are decoded, and abort early on
+           failure, rather than after the whole archive is unpacked.
+
+           If a repo inventory is passed (``--inventory``), the packages
+           already held by the secured repo are omitted from the archive
+           (see :meth:`_omit_inventory`).
+
+           The already compressed packages are stored, rather than
+           compressed, in a final pass of their own.
+
+           If more than one chunk is requested (``--chunks``), the
+           bundle is split into chunks (see :meth:`_create_chunks`).
+
+           If several targets are downloaded, and ``--split_targets`` is
+           passed, an archive is created for each target (see
+           :meth:`_create_target_bundles`).
+
         """
         if self._pass:
-            print('\nCreating archive ... ', end='')
             files = glob(os.path.join(self._tmpdir, '*'))
+            verification = [self._p_log, self._p_key] + [f for f in files if f.endswith('.txt')]
+            packages = [f for f in files if f not in verification]
+            if self._args.inventory:
+                packages = self._omit_inventory(packages=packages)
+            if self._args.chunks and self._args.chunks[0] > 1:
+                self._create_chunks(verification=verification, packages=packages)
+                return
+            if self._args.split_targets and len(self._targets) > 1:
+                self._create_target_bundles(verification=verification, packages=packages)
+                return
+            print('\nCreating archive ... ', end='')
             fname, hash_ = self._generate_archive_filename()
-            opath = os.path.join(utilities.get_desktop(), fname)
-            cmd = ['7z', 'a', '-mx3', '-mhe=on', '-mmt=on', f'-p{hash_}', opath]
-            cmd_ = cmd + files
-            if os.path.exists(opath):  # If the archive already exists, delete it.
-                os.unlink(opath)
-            with sp.Popen(cmd_, stdout=sp.PIPE, stderr=sp.PIPE) as proc:
-                stdout, stderr = proc.communicate()
-            if proc.returncode:
-                ui.print_alert(('\nAn error occurred while creating the archive. '
-                                f'Exit code: {proc.returncode}'), style='bold')
-                raise RuntimeError('\n'.join(('Output from subprocess ...',
-                                              stdout.decode(),
-                                              stderr.decode())))
+            self._7z_bundle(opath=os.path.join(utilities.get_desktop(), fname), password=hash_,
+                            verification=verification, packages=packages)
             print('Done.')
 
-    def _fix_missing(self, msg: bytes):
+    def _create_chunks(self, verification: list, packages: list):
+        """Create a chunked bundle; several smaller archives, and an index.
+
+        The packages are split across the chunks by size, so the chunks
+        are of a similar size. Each chunk is a complete archive, with
+        its own log (holding the rows of its own packages) and key, so
+        the unpacker verifies and unpacks the chunks concurrently, and a
+        chunk damaged in transfer is the only chunk to be sent again.
+        The rows of the packages omitted by ``--inventory``, and the
+        requirements file (if any), are carried by the first chunk.
+
+        The index (``<ofname>.chunks``) lists the SHA-256 digest, size
+        and filename of each chunk, followed by the digest of the
+        preceding lines::
+
+            ppk-chunks 1
+            <sha256> <size> <fname>
+            ...
+            sha256 <sha256>
+
+        Args:
+            verification (list): Full paths to the verification files;
+                the log, key and requirements file.
+            packages (list): Full paths to the packages to be archived.
+
+        """
+        n = max(1, min(self._args.chunks[0], len(packages)))
+        print(f'\nCreating {n} archive chunks ... ', end='')
+        # Largest first, into the smallest chunk.
+        groups = [[] for _ in range(n)]
+        sizes = [0] * n
+        for path in sorted(packages, key=os.path.getsize, reverse=True):
+            i = sizes.index(min(sizes))
+            groups[i].append(path)
+            sizes[i] += os.path.getsize(path)
+        packed = {os.path.basename(p) for p in packages}
+        omitted = set(self._digests) - packed  # Every file listed in the log was hashed by _log.
+        other = [f for f in verification if f not in (self._p_log, self._p_key)]
+        desktop = utilities.get_desktop()
+        index = 'ppk-chunks 1\n'
+        self._chunks = []
+        for i, group in enumerate(groups, 1):
+            ofname = f'{self._ofname}.part{i:03d}'
+            names = {os.path.basename(p) for p in group}
+            p_log, p_key = self._write_part_log(ofname=ofname, names=names | (omitted if i == 1 else set()))
+            fname = f'{ofname}.7z'
+            opath = os.path.join(desktop, fname)
+            self._7z_bundle(opath=opath, password=hashlib.sha256(fname.encode()).hexdigest(),
+                            verification=[p_log, p_key] + (other if i == 1 else []), packages=group)
+            sha256, size = self._sha256(opath)
+            index += f'{sha256} {size} {fname}\n'
+            self._chunks.append(opath)
+        index += f'sha256 {hashlib.sha256(index.encode()).hexdigest()}\n'
+        with open(os.path.join(desktop, f'{self._ofname}.chunks'), 'w', encoding='utf-8', newline='\n') as f:
+            f.write(index)
+        print('Done.')
+
+    def _create_target_bundles(self, verification: list, packages: list):
+        """Create an archive for each target.
+
+        The files were tested once, and are listed in the shared log.
+        Each target's archive holds the target's packages, and its own
+        log (holding the shared log's rows for these packages) and key,
+        as the unpacker requires every row of a log to be held by the
+        archive (or the repo). A package shared by several targets is
+        held by each of their archives. The requirements file (if any)
+        is held by every archive.
+
+        Each archive is named for its own target (see
+        :meth:`_outfile_name`); for example::
+
+            pkg_name-pkg_version-cp311-cp311-manylinux2014_x86_64.7z
+
+        Args:
+            verification (list): Full paths to the verification files;
+                the log, key and requirements file.
+            packages (list): Full paths to the packages to be archived.
+
+        """
+        print(f'\nCreating {len(self._targets)} target archives ... ', end='')
+        other = [f for f in verification if f not in (self._p_log, self._p_key)]
+        desktop = utilities.get_desktop()
+        self._bundles = []
+        for target in self._targets:
+            ofname = self._outfile_name(targets=[target])
+            names = set(self._files[target])
+            p_log, p_key = self._write_part_log(ofname=ofname, names=names)
+            fname = f'{ofname}.7z'
+            opath = os.path.join(desktop, fname)
+            self._7z_bundle(opath=opath, password=hashlib.sha256(fname.encode()).hexdigest(),
+                            verification=[p_log, p_key] + other,
+                            packages=[p for p in packages if os.path.basename(p) in names])
+            self._bundles.append(opath)
+        print('Done.')
+
+    def _digest_files(self, fnames: list) -> dict:
+        """Calculate the SHA256 digest and size of each downloaded file.
+
+        Files which were hashed as they were downloaded (see
+        :meth:`_fetch_file`) are not read again. Any others are hashed
+        concurrently, as :mod:`hashlib` releases the GIL while hashing.
+
+        Args:
+            fnames (list): Filenames (in the temp directory) to be
+                hashed.
+
+        Returns:
+            dict: A dictionary of ``{fname: (hexdigest, size)}``.
+
+        """
+        digests = {f: self._digests[f] for f in fnames if f in self._digests}
+        fnames_ = [f for f in fnames if f not in digests]
+        paths = [os.path.join(self._tmpdir, f) for f in fnames_]
+        with ThreadPoolExecutor(max_workers=os.cpu_count()) as pool:
+            digests.update(zip(fnames_, pool.map(self._sha256, paths)))
+        return digests
+
+    def _export_advisories(self):
+        """Export the offline advisory snapshot, if requested.
+
+        The snapshot is used by the unpacker to re-check the archive's
+        packages against the reported vulnerabilities, on the secured
+        side (see the :mod:`lib.snapshot` module).
+
+        """
+        if self._args.export_advisories:
+            snapshot.export(path=os.path.realpath(self._args.export_advisories[0]))
+
+    def _fetch_file(self, file: tuple) -> tuple:
+        """Download a single file, using the shared file cache.
+
+        The files are cached in the ``files`` directory of the cache
+        (see :meth:`Utilities.get_cache_dir`), by their published SHA256
+        digest, so each file is downloaded once and shared by every
+        later run. A cached file is linked (or copied) into the download
+        directory, and hashed again, so a damaged cache entry is never
+        packed; it is downloaded again instead.
+
+        A download is hashed as it is written to a partial file in the
+        cache, named for this process and thread, so concurrent runs do
+        not share it. An interrupted download is retried (see
+        :meth:`_fetch_retry`), and resumed from the end of the partial
+        file, using an HTTP range request. If the download fails, the
+        partial file is kept (as ``<digest>.part``) and is claimed, and
+        resumed, by a later run. If a resumed download does not match
+        its published digest, it is downloaded once more, in full.
+
+        Args:
+            file (tuple): A tuple containing the file's URL and its
+                expected SHA256 digest, as published by the index.
+
+        Raises:
+            ValueError: If the published digest is missing or malformed.
+
+        Returns:
+            tuple: A tuple containing the filename, its SHA256 digest and
+            size, and a flag which is True if the digest matches the
+            published digest.
+
+        """
+        url, expected = file
+        expected = (expected or '').lower()
+        # The digest names the cache entry.
+        if not re.fullmatch(r'[0-9a-f]{64}', expected):
+            raise ValueError('The index did not publish a valid SHA256 digest.')
+        fname = self._url_fname(url=url)
+        dst = os.path.join(self._tmpdir, fname)
+        blob = os.path.join(utilities.get_cache_dir(), 'files', expected[:2], expected)
+        if os.path.exists(blob):
+            self._link(src=blob, dst=dst)
+            sha256, size = self._sha256(dst)
+            if sha256 == expected:
+                profiler.count(name='cache/files/hit')
+                return fname, sha256, size, True
+            profiler.count(name='cache/files/bad')
+            os.unlink(blob)
+            os.unlink(dst)
+        profiler.count(name='cache/files/miss')
+        os.makedirs(os.path.dirname(blob), exist_ok=True)
+        shared = f'{blob}.part'
+        part = f'{blob}.{os.getpid()}.{threading.get_ident()}.part'
+        try:
+            # Claim an interrupted download's partial file; only one claimant succeeds.
+            os.replace(shared, part)
+        except FileNotFoundError:
+            pass
+        try:
+            sha256, size, resumed = self._fetch_retry(url=url, part=part, fname=fname)
+            if sha256 != expected and resumed:
+                # The partial file may be stale or damaged; download once more, in full.
+                profiler.count(name='download/restarted')
+                os.unlink(part)
+                sha256, size, _ = self._fetch_retry(url=url, part=part, fname=fname)
+        except BaseException:  # Including an interrupted run.
+            # Keep the partial file, to be resumed by a later run.
+            if os.path.exists(part):
+                os.replace(part, shared)
+            raise
+        if sha256 == expected:
+            os.replace(part, blob)
+            self._link(src=blob, dst=dst)
+        else:
+            # A file which does not match its published digest is not cached.
+            shutil.move(part, dst)
+        return fname, sha256, size, sha256 == expected
+
+    @staticmethod
+    def _fetch_part(url: str, part: str) -> tuple:
+        """Download a file into its partial file, resuming if possible.
+
+        The bytes already in the partial file are hashed first, then the
+        remainder is requested with a ``Range`` header. If the server
+        does not honour the range, the file is downloaded again in full.
+
+        Args:
+            url (str): URL of the file.
+            part (str): Full path to the partial file.
+
+        Returns:
+            tuple: A tuple containing the SHA256 digest and size of the
+            complete file, and a flag which is True if the download was
+            resumed from the partial file.
+
+        """
+        h = hashlib.sha256()
+        size = 0
+        if os.path.exists(part):
+            with open(part, 'rb') as f:
+                for chunk in iter(lambda: f.read(1 << 20), b''):
+                    h.update(chunk)
+                    size += len(chunk)
+            profiler.count(name='hash/bytes', n=size)
+        headers = {'Range': f'bytes={size}-'} if size else {}
+        with utilities.session().get(url, stream=True, timeout=30, headers=headers) as r:
+            if r.status_code == 416 and size:
+                # The partial file is already complete.
+                return h.hexdigest(), size, True
+            r.raise_for_status()
+            resumed = r.status_code == 206
+            if resumed:
+                profiler.count(name='download/resumed')
+            else:
+                h = hashlib.sha256()
+                size = 0
+            with open(part, 'ab' if resumed else 'wb') as f:
+                for chunk in r.iter_content(chunk_size=1 << 20):
+                    h.update(chunk)
+                    f.write(chunk)
+                    size += len(chunk)
+                    profiler.count(name='hash/bytes', n=len(chunk))
+            # A response cut short is an interrupted download; it is retried, and resumed.
+            if 'Content-Length' in r.headers and r.raw.tell() != int(r.headers['Content-Length']):
+                raise requests.exceptions.ChunkedEncodingError('The response ended before its Content-Length.')
+        return h.hexdigest(), size, resumed
+
+    def _fetch_retry(self, url: str, part: str, fname: str) -> tuple:
+        """Download a file into its partial file, retrying on failure.
+
+        A failed attempt is retried (up to ``_RETRIES`` attempts in all),
+        each resuming the last, if the failure is transient (see
+        :meth:`_retryable`). Any other failure is raised immediately.
+
+        Args:
+            url (str): URL of the file.
+            part (str): Full path to the partial file.
+            fname (str): Filename, used to label the timings.
+
+        Returns:
+            tuple: The tuple returned by :meth:`_fetch_part`.
+
+        """
+        for attempt in range(1, self._RETRIES + 1):
+            try:
+                with profiler.timer(name='download/file', label=fname):
+                    return self._fetch_part(url=url, part=part)
+            except Exception as err:
+                if attempt == self._RETRIES or not self._retryable(err=err):
+                    raise
+                profiler.count(name='download/retries')
+                time.sleep(attempt)
+        return None  # Not reached.
+
+    def _fix_missing(self, msg: bytes, retried: set) -> bool:
         """Update the requirements file to fix the missing binary library.
 
         Args:
             msg (bytes): Error message thrown by pip to stderr, directly
                 from the ``subprocess.Popen.communicate`` call.
+            retried (set): The packages for which the caller (i.e. a
+                target) has already tried again; updated by this call.
 
         Using pip's error message, the offending package name is
         extracted. Then, a line (as shown below) is appended to the
@@ -237,18 +631,43 @@ class PPKPacker:
 
             --no-binary=<pkg_name>
 
-        Finally, re-call :meth:`_pip_download` to re-try the download
-        with the modified requirements file.
+        The caller then re-tries the resolution (or download) with the
+        modified requirements file. The files already downloaded are
+        taken from the file cache (see :meth:`_fetch_file`), so only the
+        offending package is downloaded again.
+
+        As the targets are resolved concurrently, the requirements file
+        is updated under a lock, and each package is added only once. A
+        target tries again only once for each package; so, if the source
+        distribution does not fix the error either, the caller fails,
+        rather than trying again indefinitely.
+
+        .. versionchanged: 0.3.0.dev1
+           Returns a flag, rather than re-calling :meth:`_pip_download`.
+
+        Returns:
+            bool: True if the requirements file was modified for the
+            package (by this call, or by another target since the caller
+            last tried), otherwise False; for example, if the caller has
+            already tried again for the package.
 
         """
         pkg = self._parse_err__no_matching_dist(msg=msg)
-        # Path exists test to version a requirements file is being used.
-        if pkg and os.path.exists(self._args.package[0]):
-            ui.print_(f'Modifying the requirements file and trying again for {pkg} ...',
-                      fore='brightcyan')
-            with open(self._args.package[0], 'a', encoding='utf-8') as f:
-                f.write(f'--no-binary={pkg}')
-            self._pip_download()
+        if not pkg or pkg in retried:
+            return False
+        retried.add(pkg)
+        with self._lock:
+            if pkg in self._nobinary:
+                return True  # Added by another target; this target has not yet tried again.
+            # Path exists test to version a requirements file is being used.
+            if pkg and os.path.exists(self._args.package[0]):
+                ui.print_(f'Modifying the requirements file and trying again for {pkg} ...',
+                          fore='brightcyan')
+                with open(self._args.package[0], 'a', encoding='utf-8') as f:
+                    f.write(f'\n--no-binary={pkg}\n')
+                self._nobinary.add(pkg)
+                return True
+        return False
 
     def _generate_archive_filename(self) -> tuple[str, str]:
         """Generate the filename for the output archive.
@@ -290,6 +709,24 @@ class PPKPacker:
             else:
                 _, self._pkg_version, _, self._abi, *_ = base.split('-')
 
+    @staticmethod
+    def _link(src: str, dst: str):
+        """Hard link a cached file into the download directory.
+
+        If the cache is on another filesystem, the file is copied.
+
+        Args:
+            src (str): Full path to the cached file.
+            dst (str): Full path to the destination file.
+
+        """
+        if os.path.exists(dst):
+            os.unlink(dst)
+        try:
+            os.link(src, dst)
+        except OSError:
+            shutil.copyfile(src, dst)
+
     def _log(self, results: dict[list]):
         """Create a log file for this package's verification.
 
@@ -303,14 +740,20 @@ class PPKPacker:
 
                     {'tzdata-2023.3-py2.py3-none-any.whl': [True, True]}
 
+        .. versionchanged: 0.3.0.dev1
+           Added the ``sha256`` and ``size`` columns, which are verified
+           by the unpacker for each file before it is published.
+
         """
-        header = 'datetime,host,user,package,md5,vuln,dv_c,dv_h,dv_m,dv_l,result\n'
+        header = 'datetime,host,user,package,md5,vuln,dv_c,dv_h,dv_m,dv_l,sha256,size,result\n'
         # Set the filenames for the *.key and *.log files.
         self._p_key = os.path.join(self._tmpdir, f'{self._ofname}__verification.key')
         self._p_log = os.path.join(self._tmpdir, f'{self._ofname}__verification.log')
         dtme = dt.now().strftime('%Y-%m-%d %H:%M')
         host = socket.gethostname()
         user = utilities.get_username()
+        digests = self._digest_files(fnames=list(results))
+        self._digests.update(digests)  # Used again to omit the inventory's files.
         with open(self._p_log, 'w', encoding='utf-8') as f:
             f.write(header)
             for k, v in results.items():
@@ -320,7 +763,12 @@ class PPKPacker:
                 # following elements are supporting data.
                 _pass = 'pass' if all(v_[:2]) else 'fail'
                 self._passflags.extend(v_[:2])
-                line = f'{dtme},{host},{user},{k},{",".join(map(str, v_))},{_pass}\n'
+                # Every row has the header's four dv_* counts; zero if the
+                # version is not listed by the provider.
+                dv = (v_[2:] + [0]*4)[:4]
+                sha256, size = digests[k]
+                line = (f'{dtme},{host},{user},{k},{v_[0]},{v_[1]},{",".join(map(str, dv))},'
+                        f'{sha256},{size},{_pass}\n')
                 f.write(line)
 
     def _log_summary(self):
@@ -349,29 +797,107 @@ class PPKPacker:
         self._tmpdir = os.path.join(os.path.realpath('/tmp'), os.urandom(8).hex())
         os.makedirs(self._tmpdir)
 
+    def _omit_inventory(self, packages: list) -> list:
+        """Omit the packages already held by the secured repo.
+
+        The repo inventory is exported by ``upack --inventory`` as xz
+        compressed text; a ``ppk-inventory 1`` header line, followed by
+        a ``<sha256> <size> <name>`` line for each file in the repo. A
+        package is omitted only if a file of the same name, size and
+        digest is listed, so an updated file of the same name is always
+        packed.
+
+        The omitted packages are still listed in the log, and are
+        verified by the unpacker against the files in its repo.
+
+        Args:
+            packages (list): Full paths to the packages to be archived.
+
+        Raises:
+            ValueError: If the inventory file is not in the expected
+            format.
+
+        Returns:
+            list: The packages which are not held by the secured repo.
+
+        """
+        with lzma.open(self._args.inventory[0], 'rt', encoding='utf-8') as f:
+            if f.readline().strip() != 'ppk-inventory 1':
+                raise ValueError(f'Not a repo inventory: {self._args.inventory[0]}')
+            held = {tuple(line.split(' ', 2)) for line in f.read().splitlines()}
+        keep = []
+        nbytes = 0
+        for path in packages:
+            fname = os.path.basename(path)
+            sha256, size = self._digests.get(fname) or self._sha256(path)
+            if (sha256, str(size), fname) in held:
+                nbytes += size
+            else:
+                keep.append(path)
+        print(f'\nOmitted {len(packages) - len(keep)} of {len(packages)} packages '
+              f'({nbytes / 1e6:.1f} MB) already held by the secured repo.')
+        return keep
+
+    def _outfile_name(self, targets: list) -> str:
+        """Return the outfile name for the given targets.
+
+        See :meth:`_build_outfile_name` for the naming convention. If
+        several targets were downloaded, the ABI tag is the Python
+        version tag, as the ABI of each target's wheel may differ.
+
+        Args:
+            targets (list): A list of (platform, Python version) targets,
+                per :meth:`_parse_args`.
+
+        Returns:
+            str: The outfile name (no extension).
+
+        """
+        tags = [self._target_tags(target=t) for t in targets]
+        platform = '.'.join(dict.fromkeys(p for p, _ in tags))
+        py_version = '.'.join(dict.fromkeys(f'cp{v}' for _, v in tags))
+        abi = self._abi if len(self._targets) == 1 else py_version
+        if self._args.from_req:
+            return (f'frz-'
+                    f'{utilities.get_username()}-'
+                    f'{self._stamp}-'
+                    f'{py_version}-'
+                    f'{py_version}-'
+                    f'{platform}')
+        return (f'{self._pkg}-'
+                f'{self._pkg_version}-'
+                f'{py_version}-'
+                f'{abi}-'
+                f'{platform}')
+
     def _parse_args(self):
         """Parse command line arguments.
 
         If the platform and Python version are not provided as CLI args,
         the values are derived from the local system.
 
+        .. versionchanged: 0.3.0.dev1
+           A target is built for each combination of the platforms and
+           Python versions passed, so several targets (a matrix) can be
+           downloaded in a single run.
+
         """
         # pylint: disable=line-too-long
         chars = ('<', '>', '=')  # Version control chars to be removed.
         self._pkg = self._args.package[0].replace('-', '_')
-        self._platform = self._args.platform
-        self._py_version = self._args.python_version
+        self._targets = list(itertools.product(dict.fromkeys(self._args.platform or [None]),
+                                               dict.fromkeys(self._args.python_version or [None])))
         # Populate with the current system's values, if not provided.
-        self._platform = self._platform[0] if self._platform else utilities.get_platform()
-        self._py_version = self._py_version[0] if self._py_version else utilities.get_python_version()
+        self._platform, self._py_version = self._target_tags(target=self._targets[0])
         # Clean: Remove the requested version from the package name.
         if set(chars).intersection(self._pkg):
             self._pkg = re.split(f'[{"".join(chars)}]', self._pkg, maxsplit=1)[0]
 
-    def _pip_download(self):
-        """Using a subprocess call, download the package via pip.
+    def _pip_args(self, target: tuple) -> list:
+        """Build the pip arguments, as requested by the user from the CLI.
 
-        By design, the output from ``pip`` is streamed to the terminal.
+        These arguments are shared by the resolver (:meth:`_pip_resolve`)
+        and the ``pip download`` fallback.
 
         The ``--only-binary=:all:`` argument is added to the pip command
         if *any* of the following arguments are passed, as this is a
@@ -381,51 +907,243 @@ class PPKPacker:
             - ``--platform``
             - ``--python_version``
 
-        If the ``pip download`` fails for any reason (returning a
-        non-zero exit code), the program is exited with an exit code of 1
-        and a force cleanup is performed.
+        Args:
+            target (tuple): The (platform, Python version) target, as
+                built by :meth:`_parse_args`.
+
+        Returns:
+            list: A list of pip arguments.
 
         """
-        report_and_exit = False  # Escape if the pip error thrown is not expected.
         # Use the package name as passed into the CLI, as this *might* contain
         # a specific version to be downloaded. The version has been stripped
         # from the self._pkg attribute.
-        cmd = ['pip', 'download', '-d', self._tmpdir]
-        # Alter the pip command with user args from the CLI.
+        args = []
         if self._args.from_req:
             # Download from requirements file.
-            cmd.extend(['-r', self._args.package[0]])
+            args.extend(['-r', self._args.package[0]])
         else:
             # Download from package name.
             # _args is used here as the pkg might have a version number
             # requirement, which was stripped out of _pkg.
-            cmd.extend([self._args.package[0]])
+            args.extend([self._args.package[0]])
         if not self._args.use_local:
-            cmd.extend(['-i', 'https://pypi.org/simple/'])
-        if self._args.platform:
-            cmd.extend(['--platform', self._args.platform[0]])
-        if self._args.python_version:
-            cmd.extend(['--python-version', self._args.python_version[0]])
+            args.extend(['-i', 'https://pypi.org/simple/'])
+        platform, py_version = target
+        if platform:
+            args.extend(['--platform', platform])
+        if py_version:
+            args.extend(['--python-version', py_version])
         # Always add the ---only-binary=:all: arg if the platform or
         # py version are specified. This is a requirement by pip.
-        if any((self._args.only_binary, self._args.platform, self._args.python_version)):
-            cmd.extend(['--only-binary', ':all:'])
-        print('')  # Add blank line before pip output to aid readability.
-        # No stdout pipe is used so pip's output streams to the terminal.
-        with sp.Popen(cmd, stderr=sp.PIPE) as proc:
-            _, stderr = proc.communicate()
+        if any((self._args.only_binary, platform, py_version)):
+            args.extend(['--only-binary', ':all:'])
+        return args
+
+    def _pip_download(self):
+        """Download the package and its dependencies.
+
+        The files are resolved by pip, and downloaded directly (see
+        :meth:`_pip_fetch`). If this is not possible, the files are
+        downloaded using ``pip download``, via a subprocess call. By
+        design, the output from ``pip download`` is streamed to the
+        terminal.
+
+        If the ``pip download`` fails for any reason (returning a
+        non-zero exit code), the program is exited with an exit code of 1
+        and a force cleanup is performed.
+
+        .. versionchanged: 0.3.0.dev1
+           The files are resolved by pip, then downloaded and hashed
+           concurrently, rather than by ``pip download``. A missing
+           binary library is retried in a loop, rather than recursively.
+
+           If several targets are requested, each target is resolved
+           concurrently, and the files shared by the targets are
+           downloaded once, into the same temp directory.
+
+        """
+        with ThreadPoolExecutor(max_workers=len(self._targets)) as pool:
+            resolved = list(pool.map(self._pip_resolve, self._targets))
+        if None not in resolved and self._pip_fetch(resolved=resolved):
+            return
+        for target in self._targets:
+            self._pip_download_target(target=target)
+        print('')  # Add blank line after pip output to aid readability.
+
+    def _pip_download_target(self, target: tuple):
+        """Download the files for a target, using ``pip download``.
+
+        The files are downloaded into a hidden directory, then moved
+        into the temp directory, so the files of each target are known.
+        A file of the same name downloaded for another target is the
+        same file, as PyPI never replaces a published file.
+
+        Args:
+            target (tuple): The (platform, Python version) target, as
+                built by :meth:`_parse_args`.
+
+        """
+        ddir = os.path.join(self._tmpdir, '.download')
+        retried = set()
+        while True:
+            cmd = ['pip', 'download', '-d', ddir, *self._pip_args(target=target)]
+            print('')  # Add blank line before pip output to aid readability.
+            # No stdout pipe is used so pip's output streams to the terminal.
+            with sp.Popen(cmd, stderr=sp.PIPE) as proc:
+                _, stderr = proc.communicate()
             if proc.returncode:
                 print('', stderr.decode(), sep='\n')
-                if b'no matching distribution' in stderr.lower():
-                    # Fix the missing (library not found) issue.
-                    self._fix_missing(msg=stderr)
-                else:
-                    report_and_exit = True
-                if report_and_exit:
-                    ui.print_alert('\n[ERROR]: An error was thrown from pip. Exiting.\n')
+                # Fix the missing (library not found) issue, and try again.
+                if (b'no matching distribution' in stderr.lower()
+                        and self._fix_missing(msg=stderr, retried=retried)):
+                    continue
+                ui.print_alert('\n[ERROR]: An error was thrown from pip. Exiting.\n')
+                shutil.rmtree(ddir, ignore_errors=True)
+                self._cleanup(force=True)
+                sys.exit(1)
+            break
+        self._files[target] = []
+        for path in glob(os.path.join(ddir, '*')):
+            fname = os.path.basename(path)
+            os.replace(path, os.path.join(self._tmpdir, fname))
+            self._files[target].append(fname)
+        shutil.rmtree(ddir, ignore_errors=True)
+
+    def _pip_fetch(self, resolved: list) -> bool:
+        """Download the resolved files directly.
+
+        The files resolved for every target are downloaded once each,
+        by their published SHA256 digest, concurrently; and each is
+        hashed as it is fetched (see :meth:`_fetch_file`).
+
+        Args:
+            resolved (list): For each target, a list of ``(url, sha256)``
+                tuples, per :meth:`_pip_resolve`.
+
+        .. versionchanged: 0.3.0.dev1
+           The files are taken from the shared file cache, where present.
+           A file which cannot be downloaded is retried alone, using ``pip
+           download --no-deps``, rather than downloading every file
+           again.
+
+        Returns:
+            bool: True if the files were downloaded. False if the files
+            could not be downloaded this way, in which case ``pip
+            download`` should be used.
+
+        """
+        files = {}
+        for target, files_ in zip(self._targets, resolved):
+            self._files[target] = []
+            for url, hash_ in files_:
+                fname = self._url_fname(url=url)
+                if files.setdefault(fname, (url, hash_))[1] != hash_:
+                    ui.print_alert(f'\n[ERROR]: The targets resolved different files of the same name: {fname}\n')
                     self._cleanup(force=True)
                     sys.exit(1)
-        print('')  # Add blank line after pip output to aid readability.
+                self._files[target].append(fname)
+        print(f'\nDownloading {len(files)} files ...')
+        failed = []
+        with ThreadPoolExecutor(max_workers=self._WORKERS) as pool:
+            for file, future in [(f, pool.submit(self._fetch_file, f)) for f in files.values()]:
+                try:
+                    fname, sha256, size, ok = future.result()
+                except Exception as err:
+                    ui.print_warning(f'- {file[0]} [DOWNLOAD FAILED: {err}]')
+                    failed.append(file[0])
+                    continue
+                self._digests[fname] = sha256, size
+                print(f'- {fname} ({size:,} bytes){"" if ok else " [DIGEST MISMATCH]"}')
+        if failed and not self._pip_retry(urls=failed):
+            ui.print_warning('\nThe direct download failed, using pip download instead.')
+            for f in glob(os.path.join(self._tmpdir, '*')):
+                os.unlink(f)
+            self._digests.clear()
+            self._files.clear()
+            return False
+        print('')
+        return True
+
+    def _pip_resolve(self, target: tuple) -> list:
+        """Resolve the files for a target using pip.
+
+        pip's resolver is run without installing anything (``pip install
+        --dry-run --report``), which reports the URL and published SHA256
+        digest of each file. If pip reports a missing binary library, the
+        requirements file is fixed (see :meth:`_fix_missing`), and the
+        files are resolved again.
+
+        This method is run concurrently by :meth:`_pip_download`; one
+        call per target.
+
+        Args:
+            target (tuple): The (platform, Python version) target, as
+                built by :meth:`_parse_args`.
+
+        Returns:
+            list: A list of ``(url, sha256)`` tuples; one for each
+            file. None if the files could not be resolved this way (for
+            example, an older pip, or a local index), in which case
+            ``pip download`` should be used.
+
+        """
+        i = self._targets.index(target)
+        report = os.path.join(self._tmpdir, f'.report{i}.json')  # Hidden, so it is not archived.
+        tdir = os.path.join(self._tmpdir, f'.target{i}')
+        cmd = ['pip', 'install', '--dry-run', '--ignore-installed', '--quiet', '--report', report]
+        if any(target):
+            # Required by pip for a foreign platform; nothing is installed.
+            cmd.extend(['--target', tdir])
+        cmd.extend(self._pip_args(target=target))
+        retried = set()
+        while True:
+            with profiler.timer(name='resolve/target', label=' '.join(self._target_tags(target=target))):
+                with sp.Popen(cmd, stdout=sp.DEVNULL, stderr=sp.PIPE) as proc:
+                    _, stderr = proc.communicate()
+            shutil.rmtree(tdir, ignore_errors=True)
+            # Fix the missing (library not found) issue, and resolve again.
+            if not (proc.returncode
+                    and b'no matching distribution' in stderr.lower()
+                    and self._fix_missing(msg=stderr, retried=retried)):
+                break
+        if proc.returncode or not os.path.exists(report):
+            return None
+        with open(report, 'r', encoding='utf-8') as f:
+            items = json.load(f).get('install', [])
+        os.unlink(report)
+        files = []
+        for item in items:
+            info = item.get('download_info', {})
+            url = info.get('url', '')
+            archive = info.get('archive_info', {})
+            hash_ = archive.get('hashes', {}).get('sha256')
+            if not hash_ and archive.get('hash', '').startswith('sha256='):
+                hash_ = archive['hash'][7:]  # Older pip versions report a single hash.
+            if not url.startswith(('https://', 'http://')) or not hash_:
+                return None
+            files.append((url, hash_))
+        return files
+
+    def _pip_retry(self, urls: list) -> bool:
+        """Download the files which failed, using ``pip download``.
+
+        Only the failed files are downloaded, by URL, with ``--no-deps``,
+        as their dependencies were resolved already. These files are
+        hashed by :meth:`_digest_files`, as for a ``pip download``.
+
+        Args:
+            urls (list): URL of each file which could not be downloaded.
+
+        Returns:
+            bool: True if every file was downloaded, otherwise False.
+
+        """
+        print(f'\nRetrying {len(urls)} files using pip download ...')
+        cmd = ['pip', 'download', '--no-deps', '--quiet', '-d', self._tmpdir, *urls]
+        with sp.Popen(cmd) as proc:
+            proc.communicate()
+        return not proc.returncode
 
     @staticmethod
     def _parse_err__no_matching_dist(msg: bytes) -> str:
@@ -448,13 +1166,45 @@ class PPKPacker:
             pkg = s.groupdict().get('pkg')
         return pkg
 
+    @staticmethod
+    def _parse_fname(fname: str) -> tuple:
+        """Parse the package name and version from a filename.
+
+        Args:
+            fname (str): Filename of the wheel or source distribution.
+
+        Returns:
+            tuple: A tuple containing the package name and version.
+
+        """
+        # Parse .tar.gz files differently.
+        if os.path.splitext(fname)[1] == '.gz':
+            *pkg_, vers_ = fname[:fname.rfind('.tar.gz')].split('-')
+            return '-'.join(pkg_), vers_
+        pkg_, vers_, *_ = fname.split('-')
+        return pkg_, vers_
+
     def _print_summary(self):
         """Print an end-of-processing summary to the terminal."""
         flag = 'PASSED' if self._pass else 'FAILED'
         print('\nProcessing complete.',
               f'The {self._pkg} package has: {flag}\n',
               sep='\n')
-        if self._pass:
+        if self._pass and self._chunks:
+            print(f'There are {len(self._chunks)} *encrypted* .7z archive chunks on your desktop, which ',
+                  'contain the verified packages along with the integrity check log files, and ',
+                  f'their index: {self._ofname}.chunks. These files can be transferred to the ',
+                  'destination and unpacked, by passing the .chunks file to ppk.',
+                  '',
+                  sep='\n')
+        elif self._pass and self._bundles:
+            print(f'There are {len(self._bundles)} *encrypted* .7z archive files on your desktop; one for ',
+                  'each target. Each contains the verified packages for its target, along with ',
+                  'the integrity check log file. These files can be transferred to their ',
+                  'destinations and unpacked, using ppk.',
+                  '',
+                  sep='\n')
+        elif self._pass:
             print('There is an *encrypted* .7z archive file on your desktop which contains ',
                   'the verified packages along with the integrity check log file. This .7z ',
                   'file can be transferred to the destination and unpacked, using ppk.',
@@ -466,29 +1216,143 @@ class PPKPacker:
                   '',
                   sep='\n')
 
-    def _verify_wheels(self):
-        """Verify the hashes for all wheel files downloaded."""
+    @staticmethod
+    def _retryable(err: Exception) -> bool:
+        """Test if a download error is transient.
+
+        Connection errors (including an interrupted response body),
+        timeouts and server (5xx) errors are transient. Others, such as a
+        client (4xx) error, or an error writing the partial file, are
+        not.
+
+        Args:
+            err (Exception): The error raised by the download.
+
+        Returns:
+            bool: True if the download should be retried, otherwise
+            False.
+
+        """
+        if isinstance(err, requests.exceptions.HTTPError):
+            return err.response is not None and err.response.status_code >= 500
+        return isinstance(err, (requests.exceptions.ConnectionError,
+                                requests.exceptions.ChunkedEncodingError,
+                                requests.exceptions.Timeout))
+
+    @staticmethod
+    def _sha256(path: str) -> tuple:
+        """Calculate the SHA256 digest and size of a file.
+
+        Args:
+            path (str): Full path to the file to be hashed.
+
+        Returns:
+            tuple: A tuple containing the hex digest and the size of the
+            file, in bytes.
+
+        """
+        h = hashlib.sha256()
+        size = 0
+        with open(path, 'rb') as f:
+            for chunk in iter(lambda: f.read(1 << 20), b''):
+                h.update(chunk)
+                size += len(chunk)
+        profiler.count(name='hash/bytes', n=size)
+        return h.hexdigest(), size
+
+    @staticmethod
+    def _target_tags(target: tuple) -> tuple:
+        """Return a target's platform and Python version tags.
+
+        Args:
+            target (tuple): The (platform, Python version) target, as
+                built by :meth:`_parse_args`.
+
+        Returns:
+            tuple: A tuple containing the platform and Python version;
+            each derived from the local system, if not provided.
+
+        """
+        platform, py_version = target
+        return platform or utilities.get_platform(), py_version or utilities.get_python_version()
+
+    @staticmethod
+    def _url_fname(url: str) -> str:
+        """Return the filename of a file's URL.
+
+        Args:
+            url (str): URL of the file.
+
+        Returns:
+            str: The (unquoted) filename.
+
+        """
+        return unquote(os.path.basename(urlsplit(url).path))
+
+    def _verify_file(self, fpath: str) -> tuple:
+        """Run all listed tests for a single downloaded file.
+
+        This method is run concurrently by :meth:`_verify_wheels`; one
+        call per file. Any report output from the tests is collected,
+        rather than printed, so it can be displayed in order.
+
+        Args:
+            fpath (str): Full path to the file to be verified.
+
+        Returns:
+            tuple: A tuple containing the filename, the list of test
+            results and the list of report lines.
+
+        """
         # pylint: disable=unnecessary-dunder-call
-        results = defaultdict(list)
-        args = {}
-        pkgs = glob(os.path.join(self._tmpdir, '*'))
-        for fpath in pkgs:
-            fname = os.path.basename(fpath)
-            # Parse .tar.gz files differently.
-            if os.path.splitext(fname)[1] == '.gz':
-                *pkg_, vers_ = fname[:fname.rfind('.tar.gz')].split('-')
-                pkg_ = '-'.join(pkg_)
-            else:
-                pkg_, vers_, *_ = fname.split('-')
-            args = {'fpath': fpath, 'name': pkg_, 'version': vers_}
-            # ----------------------------------------------------------
-            #
-            #        The testing loop - perform all listed tests.
-            #
-            # ----------------------------------------------------------
-            for test in self._TESTS:
-                # Run test and update results for logging.
-                results[fname].append(Tests().__getattribute__(test)(**args))
+        fname = os.path.basename(fpath)
+        pkg_, vers_ = self._parse_fname(fname=fname)
+        report = []
+        sha256 = self._digests.get(fname, (None,))[0]  # If calculated while downloading.
+        args = {'fpath': fpath, 'name': pkg_, 'version': vers_, 'sha256': sha256, 'report': report,
+                'advisories': self._advisories}
+        # --------------------------------------------------------------
+        #
+        #        The testing loop - perform all listed tests.
+        #
+        # --------------------------------------------------------------
+        results = []
+        for test in self._TESTS:
+            with profiler.timer(name=f'test/{test}', label=fname):
+                results.append(Tests().__getattribute__(test)(**args))
+        return fname, results, report
+
+    def _verify_wheels(self):
+        """Verify the hashes for all wheel files downloaded.
+
+        The reported vulnerabilities for every package are looked up
+        first, in bulk, by the advisory provider named by the
+        ``vuln_provider`` key in ``config.json``.
+
+        The files are then verified concurrently by a bounded pool of
+        worker threads, so the PyPI lookups (which are mostly spent
+        waiting on the network) and the local hashing overlap. Each
+        worker thread reuses its own HTTP session.
+
+        The results and the test reports are collected in filename
+        order, so the log and the terminal output are deterministic.
+
+        .. versionchanged: 0.3.0.dev1
+           The files are verified concurrently, rather than in turn; and
+           the vulnerabilities are looked up for all packages at once.
+
+        """
+        results = {}
+        pkgs = sorted(glob(os.path.join(self._tmpdir, '*')))
+        names = sorted({self._parse_fname(fname=os.path.basename(p)) for p in pkgs})
+        provider = get_provider(name=getattr(config, 'vuln_provider', 'osv'))
+        with profiler.timer(name='stage/advisories'):
+            self._advisories = provider.lookup(packages=names)
+        with ThreadPoolExecutor(max_workers=self._WORKERS) as pool:
+            for fname, results_, report in pool.map(self._verify_file, pkgs):
+                results[fname] = results_
+                if report:
+                    print(*report, sep='\n')
         # Force failure for testing -- DEV ONLY.
         # results['six-1.16.0-py2.py3-none-any.whl'][0] = False,
         # results['six-1.16.0-py2.py3-none-any.whl'][1] = False,4,3,2,1
@@ -496,3 +1360,46 @@ class PPKPacker:
         self._log(results=results)
         # Calculate the *overall* pass/fail and store to attrib for summary.
         self._pass = all(self._passflags)
+
+    def _write_part_log(self, ofname: str, names: set) -> tuple:
+        """Write a log (and key) holding the rows of the given packages.
+
+        The rows are taken from the (passed) log, so the files are not
+        tested again. This is used for each archive of a chunked bundle,
+        and for each target's archive.
+
+        Args:
+            ofname (str): The outfile name of the archive.
+            names (set): Filenames of the packages to be listed.
+
+        Returns:
+            tuple: A tuple containing the full paths to the log and key
+            files.
+
+        """
+        with open(self._p_log, encoding='utf-8') as f:
+            header, *lines = f.read().split('\n')
+        rows = {line.split(',')[3]: line for line in lines if line.count(',') >= 3}
+        p_log = os.path.join(self._tmpdir, f'{ofname}__verification.log')
+        p_key = os.path.join(self._tmpdir, f'{ofname}__verification.key')
+        with open(p_log, 'w', encoding='utf-8') as f:
+            f.write(f'{header}\n')
+            f.writelines(f'{v}\n' for k, v in rows.items() if k in names)
+            f.write('\nResult: PASS\n')
+        with open(p_key, 'w', encoding='utf-8') as f:
+            f.write(crypto.checksum_sha256(path=p_log))
+        return p_log, p_key
+
+    def _write_profile(self):
+        """Write the profiling run report, if requested.
+
+        The report is written to the desktop, beside the archive, as
+        ``<ofname>__profile.json``; as the temp directory (holding the
+        log) is removed on cleanup, and is not archived. See the
+        :mod:`lib.profiler` module for the report's content.
+
+        """
+        if self._args.profile:
+            path = os.path.join(utilities.get_desktop(), f'{self._ofname}__profile.json')
+            profiler.write(path=path)
+            print(f'\nThe run report was written to: {path}')
@@ -0,0 +1,290 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+:Purpose:   This module provides the packer's profiling hooks; a
+            thread-safe collector of the run's timings and counters,
+            which is written as a JSON run report (``--profile``).
+
+            The following are collected:
+
+                - ``test/<name>``: Each test invocation, per file.
+                - ``fetch/<kind>``: Each cached lookup (e.g. PyPI and
+                  Snyk), whether or not a request is made.
+                - ``http/<host>/<phase>``: Each HTTP request; by host,
+                  and by phase: ``connect`` (including the DNS lookup)
+                  and ``tls`` (for a new connection), ``ttfb`` (request
+                  sent to response headers) and ``body`` (headers to
+                  close).
+                - Stage timings (resolve, download, verify, archive),
+                  and counters, such as the bytes hashed and the cache
+                  hits and misses.
+
+            Each timing is aggregated into its count, total, mean,
+            percentiles and a latency histogram. The slowest samples of
+            each timing are kept by label (e.g. the filename), so a
+            single large wheel, or a slow upstream, is easily found.
+
+:Platform:  Linux/Windows | Python 3.6+
+:Developer: J Berendt
+:Email:     development@s3dev.uk
+
+:Comments:  The HTTP phases are collected by :class:`TimedAdapter`,
+            and the :func:`record_response` hook, which are added to
+            each thread's session only when profiling (see
+            :meth:`lib.utilities.Utilities.session`). The connection
+            phases are recorded around urllib3's own connect, in the
+            requesting thread, so they are collected per request.
+
+"""
+# pylint: disable=import-error
+
+import bisect
+import json
+import os
+import threading
+import time
+from collections import Counter, defaultdict
+from contextlib import contextmanager
+from urllib.parse import urlsplit
+from requests.adapters import HTTPAdapter
+from urllib3.connection import HTTPConnection, HTTPSConnection
+
+_tls = threading.local()  # Connection phases of the calling thread's current request.
+
+
+class Profiler:
+    """Thread-safe collector of the run's timings and counters."""
+
+    # Upper bounds (in seconds) of the latency histogram buckets.
+    _BUCKETS = (0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1, 2, 5, 10, 30)
+    # Number of slowest (labelled) samples kept for each timing.
+    _SLOWEST = 5
+
+    def __init__(self):
+        """Profiler class initialiser."""
+        self.enabled = False  # Time the HTTP requests; set by --profile.
+        self._counters = Counter()
+        self._lock = threading.Lock()
+        self._slowest = defaultdict(list)
+        self._start = time.time()
+        self._timings = defaultdict(list)
+
+    def add(self, name: str, seconds: float, label: str=None):
+        """Record a timing.
+
+        Args:
+            name (str): Name of the timing; for example ``test/md5``.
+            seconds (float): The elapsed time, in seconds.
+            label (str, optional): Label of the sample (e.g. a filename),
+                kept if the sample is among the slowest. Defaults to
+                None.
+
+        """
+        with self._lock:
+            self._timings[name].append(seconds)
+            if label:
+                slowest = self._slowest[name]
+                slowest.append((seconds, label))
+                slowest.sort(reverse=True)
+                del slowest[self._SLOWEST:]
+
+    def count(self, name: str, n: int=1):
+        """Increment a counter.
+
+        Args:
+            name (str): Name of the counter; for example
+                ``hash/bytes``.
+            n (int, optional): The increment. Defaults to 1.
+
+        """
+        with self._lock:
+            self._counters[name] += n
+
+    @contextmanager
+    def timer(self, name: str, label: str=None):
+        """Time the enclosed block; see :meth:`add`.
+
+        Args:
+            name (str): Name of the timing.
+            label (str, optional): Label of the sample. Defaults to None.
+
+        """
+        t0 = time.perf_counter()
+        try:
+            yield
+        finally:
+            self.add(name=name, seconds=time.perf_counter() - t0, label=label)
+
+    def report(self) -> dict:
+        """Aggregate the timings and counters into the run report.
+
+        The histogram is keyed by each bucket's upper bound (in seconds),
+        and holds the number of samples in the bucket (not cumulative).
+
+        Returns:
+            dict: The run report.
+
+        """
+        with self._lock:
+            timings = {k: sorted(v) for k, v in self._timings.items()}
+            counters = dict(self._counters)
+            slowest = {k: list(v) for k, v in self._slowest.items()}
+        stats = {}
+        for name, samples in sorted(timings.items()):
+            n = len(samples)
+            hist = [0] * (len(self._BUCKETS) + 1)
+            for s in samples:
+                hist[bisect.bisect_left(self._BUCKETS, s)] += 1
+            stats[name] = {'count': n,
+                           'total': round(sum(samples), 6),
+                           'mean': round(sum(samples) / n, 6),
+                           'min': round(samples[0], 6),
+                           'p50': round(samples[(n - 1) // 2], 6),
+                           'p90': round(samples[int((n - 1) * 0.9)], 6),
+                           'p99': round(samples[int((n - 1) * 0.99)], 6),
+                           'max': round(samples[-1], 6),
+                           'histogram': dict(zip((*map(str, self._BUCKETS), '+Inf'), hist))}
+            if name in slowest:
+                stats[name]['slowest'] = [[label, round(s, 6)] for s, label in slowest[name]]
+        return {'version': 1,
+                'started': time.strftime('%Y-%m-%dT%H:%M:%S', time.localtime(self._start)),
+                'elapsed': round(time.time() - self._start, 3),
+                'timings': stats,
+                'counters': dict(sorted(counters.items()))}
+
+    def write(self, path: str):
+        """Write the run report, as JSON.
+
+        Args:
+            path (str): Full path to the report file.
+
+        """
+        tmp = f'{path}.{os.getpid()}.tmp'
+        with open(tmp, 'w', encoding='utf-8') as f:
+            json.dump(self.report(), f, indent=2)
+        os.replace(tmp, path)
+
+
+class _TimedConnectionMixin:
+    """Record the connect phase of a new connection.
+
+    urllib3's own :meth:`_new_conn` is timed, unchanged; so the phase
+    includes the DNS lookup. The TLS phase (HTTPS only) is the remainder
+    of the connect. The phases are stored for the calling thread, and
+    collected by :func:`record_response`.
+
+    """
+
+    def _new_conn(self):
+        """Create the connection's socket, timing the connect."""
+        t0 = time.perf_counter()
+        try:
+            return super()._new_conn()
+        finally:
+            getattr(_tls, 'phases', {})['connect'] = time.perf_counter() - t0
+
+
+class _TimedHTTPConnection(_TimedConnectionMixin, HTTPConnection):
+    """Timed HTTP connection."""
+
+
+class _TimedHTTPSConnection(_TimedConnectionMixin, HTTPSConnection):
+    """Timed HTTPS connection."""
+
+    def connect(self):
+        """Connect; the TLS handshake is the remainder of the connect."""
+        t0 = time.perf_counter()
+        super().connect()
+        phases = getattr(_tls, 'phases', {})
+        phases['tls'] = max(0.0, time.perf_counter() - t0 - phases.get('connect', 0))
+
+
+# The timed class of each of urllib3's stock connection classes.
+_TIMED = {HTTPConnection: _TimedHTTPConnection, HTTPSConnection: _TimedHTTPSConnection}
+
+
+def _timed_pool(pool):
+    """Create the pool's new connections as timed connections.
+
+    Only a pool of urllib3's stock connections is changed; any other
+    connection class is left as is, and is not timed.
+
+    """
+    pool.ConnectionCls = _TIMED.get(pool.ConnectionCls, pool.ConnectionCls)
+    return pool
+
+
+class TimedAdapter(HTTPAdapter):
+    """Transport adapter which records the connection phases of each
+    request, and counts the failed requests per host.
+
+    The adapter is only mounted when profiling (see
+    :meth:`lib.utilities.Utilities.session`). The remaining phases are
+    recorded by the :func:`record_response` hook.
+
+    """
+
+    def get_connection(self, *args, **kwargs):  # pylint: disable=arguments-differ
+        """Return the URL's connection pool, of timed connections."""
+        return _timed_pool(super().get_connection(*args, **kwargs))
+
+    def get_connection_with_tls_context(self, *args, **kwargs):  # pylint: disable=arguments-differ
+        """Return the request's connection pool, of timed connections."""
+        return _timed_pool(super().get_connection_with_tls_context(*args, **kwargs))
+
+    def send(self, request, **kwargs):  # pylint: disable=arguments-differ
+        """Send the request, collecting its connection phases."""
+        _tls.phases = {}
+        try:
+            return super().send(request, **kwargs)
+        except Exception:
+            _tls.phases = {}
+            profiler.count(name=f'http/{urlsplit(request.url).hostname}/errors')
+            raise
+
+
+def record_response(response, **kwargs):  # pylint: disable=unused-argument
+    """Response hook which records the phases of a request.
+
+    The ``ttfb`` phase is the response's ``elapsed`` time (the request
+    being sent to the response headers being received), less any new
+    connection. The ``body`` phase is from the hook to the response
+    being closed, so the response must be closed (e.g. used as a context
+    manager) for its body to be timed. The bytes received are counted
+    per host.
+
+    Args:
+        response (requests.Response): The response received.
+
+    Returns:
+        requests.Response: The response, unchanged.
+
+    """
+    t1 = time.perf_counter()
+    url = response.request.url
+    host = urlsplit(url).hostname
+    phases = getattr(_tls, 'phases', {})
+    _tls.phases = {}
+    setup = 0.0
+    for phase in ('connect', 'tls'):
+        if phase in phases:
+            profiler.add(name=f'http/{host}/{phase}', seconds=phases[phase])
+            setup += phases[phase]
+    profiler.add(name=f'http/{host}/ttfb', seconds=max(0.0, response.elapsed.total_seconds() - setup), label=url)
+    profiler.count(name=f'http/{host}/requests')
+    close = response.close
+
+    def _close():
+        if not getattr(response, '_ppk_timed', False):
+            response._ppk_timed = True  # pylint: disable=protected-access
+            profiler.add(name=f'http/{host}/body', seconds=time.perf_counter() - t1, label=url)
+            tell = getattr(response.raw, 'tell', None)
+            if tell:
+                profiler.count(name=f'http/{host}/bytes', n=tell())
+        close()
+
+    response.close = _close
+    return response
+
+
+profiler = Profiler()
@@ -0,0 +1,252 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+:Purpose:   This module provides the exporter for the offline advisory
+            snapshot; a compact table of the reported vulnerabilities
+            for every PyPI project, which is memory-mapped by the
+            unpacker to re-check the archive's packages on the secured
+            side, without network access.
+
+            The snapshot is compiled from the OSV.dev bulk export of the
+            PyPI ecosystem. For each project, the affected version
+            ranges of all advisories are flattened into sorted,
+            non-overlapping segments, each with the number of (C, H, M,
+            L) vulnerabilities affecting its versions. Therefore, a
+            lookup is two binary searches: by project, then by version.
+
+:Platform:  Linux/Windows | Python 3.6+
+:Developer: J Berendt
+:Email:     development@s3dev.uk
+
+:Comments:  The file format and the version key are described in the
+            unpacker's ``lib/upack.d/src/advisory.c`` module; the two
+            must be kept in step.
+
+"""
+# pylint: disable=import-error
+
+import json
+import os
+import re
+import struct
+import tempfile
+import time
+import zipfile
+# locals
+from lib.advisories import OSV, Provider
+from lib.utilities import utilities
+
+_URL = 'https://osv-vulnerabilities.storage.googleapis.com/PyPI/all.zip'
+_MAGIC = b'PPKADV01'
+_HEADER = struct.Struct('<8sIIQII')
+_PROJECT = struct.Struct('<III')
+_SEGMENT = struct.Struct('<II4H')
+_MAX = 0xffffffff
+_INF = b'\xff'  # Upper bound of an unfixed range; above every version key.
+# PEP 440 version pattern; per the packaging library.
+_RE_VERSION = re.compile(r"""
+    v?
+    (?:(?P<epoch>[0-9]+)!)?
+    (?P<release>[0-9]+(?:\.[0-9]+)*)
+    (?:[-_.]?(?P<pre_l>alpha|a|beta|b|preview|pre|c|rc)[-_.]?(?P<pre_n>[0-9]+)?)?
+    (?P<post>-(?P<post_n1>[0-9]+)|[-_.]?(?:post|rev|r)[-_.]?(?P<post_n2>[0-9]+)?)?
+    (?P<dev>[-_.]?dev[-_.]?(?P<dev_n>[0-9]+)?)?
+    (?:\+[a-z0-9]+(?:[-_.][a-z0-9]+)*)?
+    """, re.VERBOSE | re.IGNORECASE)
+_PRE = {'alpha': 1, 'a': 1, 'beta': 2, 'b': 2, 'preview': 3, 'pre': 3, 'c': 3, 'rc': 3}
+
+
+def version_key(version: str) -> bytes:
+    """Build the key for a PEP 440 version, which compares bytewise in
+    version order.
+
+    The key is a sequence of big-endian u32 words, as described in the
+    unpacker's ``advisory.c`` module.
+
+    Args:
+        version (str): Version string; for example, ``1.26.0rc1``.
+
+    Returns:
+        bytes: The version key, or None if the version is not a valid
+        PEP 440 version.
+
+    """
+    m = _RE_VERSION.fullmatch(version.strip())
+    if not m:
+        return None
+    release = [int(i) for i in m['release'].split('.')]
+    while release and not release[-1]:
+        release.pop()
+    post = m['post_n1'] or m['post_n2'] or 0
+    if m['pre_l']:
+        phase = _PRE[m['pre_l'].lower()]
+    else:
+        phase = 0 if m['dev'] and not m['post'] else 4
+    words = [int(m['epoch'] or 0),
+             *(i + 1 for i in release),
+             0,
+             phase,
+             int(m['pre_n'] or 0),
+             int(post) + 1 if m['post'] else 0,
+             int(m['dev_n'] or 0) if m['dev'] else _MAX]
+    if len(release) > 32 or any(w > _MAX for w in words) or any(i + 1 >= _MAX for i in release):
+        return None
+    return struct.pack(f'>{len(words)}I', *words)
+
+
+def export(path: str, source: str=None) -> int:
+    """Export the offline advisory snapshot.
+
+    Args:
+        path (str): Full path to the snapshot file to be written.
+        source (str, optional): Full path to a local copy of the OSV
+            PyPI bulk export (``all.zip``). Defaults to None, which
+            downloads the current export.
+
+    Returns:
+        int: The number of projects in the snapshot.
+
+    """
+    print('\nExporting the offline advisory snapshot ...')
+    with tempfile.TemporaryDirectory() as tmpdir:
+        if not source:
+            source = os.path.join(tmpdir, 'all.zip')
+            with utilities.session().get(_URL, timeout=60, stream=True) as r:
+                r.raise_for_status()
+                with open(source, 'wb') as f:
+                    for chunk in r.iter_content(chunk_size=1 << 20):
+                        f.write(chunk)
+        with zipfile.ZipFile(source) as zf:
+            records = [json.loads(zf.read(n)) for n in sorted(zf.namelist()) if n.endswith('.json')]
+    projects = _segments(records=records)
+    _write(path=path, projects=projects)
+    print(f'-- {len(projects)} projects, from {len(records)} advisories: {path}')
+    return len(projects)
+
+
+def _intervals(affected: dict) -> list:
+    """Return the affected version intervals for a package.
+
+    Only the ``ECOSYSTEM`` (i.e. PEP 440) ranges are used. If a package
+    has no such ranges, its explicitly listed versions are used.
+
+    Args:
+        affected (dict): An entry of the advisory's ``affected`` list.
+
+    Returns:
+        list: A list of (lo, hi) version key tuples, where lo is
+        inclusive and hi is exclusive.
+
+    """
+    intervals = []
+    for rng in affected.get('ranges', []):
+        if rng.get('type') != 'ECOSYSTEM':
+            continue
+        events = []
+        for event in rng.get('events', []):
+            (kind, vers), = event.items()
+            key = b'' if kind == 'introduced' and vers == '0' else version_key(vers)
+            if key is not None and kind in ('introduced', 'fixed', 'last_affected'):
+                events.append((key, kind))
+        lo = None
+        for key, kind in sorted(events):
+            if kind == 'introduced':
+                lo = key if lo is None else lo
+            elif lo is not None:
+                # A last affected version's successor is the key plus a trailing byte.
+                intervals.append((lo, key if kind == 'fixed' else key + b'\0'))
+                lo = None
+        if lo is not None:
+            intervals.append((lo, _INF))
+    if not intervals:
+        keys = (version_key(v) for v in affected.get('versions', []))
+        intervals = [(k, k + b'\0') for k in keys if k is not None]
+    return intervals
+
+
+def _segments(records: list) -> dict:
+    """Flatten the advisories into each project's version segments.
+
+    Advisories published under several IDs (e.g. PYSEC and GHSA) are
+    counted once per project, as are overlapping ranges of the same
+    advisory.
+
+    Args:
+        records (list): The OSV advisory records.
+
+    Returns:
+        dict: A dictionary, keyed by project name, of the list of
+        (key, counts) segments, sorted by key.
+
+    """
+    osv = OSV()
+    spans = {}
+    seen = {}
+    for rec in records:
+        if rec.get('withdrawn'):
+            continue
+        ids = {rec['id'], *rec.get('aliases', ())}
+        sev = OSV._SEVERITY[osv._severity(vuln=rec)]  # pylint: disable=protected-access
+        for affected in rec.get('affected', []):
+            pkg = affected.get('package', {})
+            if pkg.get('ecosystem') != 'PyPI' or not pkg.get('name'):
+                continue
+            name = Provider.key(pkg['name'], '')[0]
+            advisories = spans.setdefault(name, {})
+            if rec['id'] not in advisories:
+                if ids & seen.setdefault(name, set()):
+                    continue  # Already counted under an alias.
+                seen[name] |= ids
+                advisories[rec['id']] = (sev, [])
+            advisories[rec['id']][1].extend(_intervals(affected))
+    projects = {}
+    for name, advisories in spans.items():
+        bounds = sorted({b for _, ivs in advisories.values() for iv in ivs for b in iv} - {_INF})
+        segs = []
+        for b in bounds:
+            counts = [0, 0, 0, 0]
+            for sev, ivs in advisories.values():
+                if any(lo <= b < hi for lo, hi in ivs):
+                    counts[sev] += 1
+            if (segs and segs[-1][1] == counts) or (not segs and not any(counts)):
+                continue
+            segs.append((b, counts))
+        if segs:
+            projects[name] = segs
+    return projects
+
+
+def _write(path: str, projects: dict):
+    """Write the snapshot file.
+
+    The file is written to a temporary file, then replaced, so the
+    unpacker never maps a partial snapshot.
+
+    Args:
+        path (str): Full path to the snapshot file.
+        projects (dict): The project segments, per :func:`_segments`.
+
+    """
+    names = sorted(projects, key=lambda n: n.encode())
+    nsegs = sum(len(v) for v in projects.values())
+    p_off = _HEADER.size
+    s_off = p_off + len(names) * _PROJECT.size
+    strings = bytearray()
+    offset = s_off + nsegs * _SEGMENT.size
+    ptable = bytearray()
+    stable = bytearray()
+    first = 0
+    for name in names:
+        ptable += _PROJECT.pack(offset + len(strings), first, len(projects[name]))
+        strings += name.encode() + b'\0'
+        for key, counts in projects[name]:
+            stable += _SEGMENT.pack(offset + len(strings), len(key), *(min(c, 0xffff) for c in counts))
+            strings += key
+        first += len(projects[name])
+    tmp = f'{path}.{os.getpid()}.tmp'
+    with open(tmp, 'wb') as f:
+        f.write(_HEADER.pack(_MAGIC, len(names), nsegs, int(time.time()), p_off, s_off))
+        f.write(ptable)
+        f.write(stable)
+        f.write(strings)
+    os.replace(tmp, path)
@@ -0,0 +1,203 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+:Purpose:   This module provides the upack benchmark suite; invoked by
+            ``make bench``, from ``lib/upack.d/src``.
+
+            A synthetic bundle (see :mod:`mkbundle`) is unpacked into a
+            scratch repo several times, for each scenario, and the median
+            end to end (wall) time is reported with the median time of
+            each phase, as read from upack's ``--report``. The scenarios
+            are the product of:
+
+                - **Source:** The archive is read from the repo's file
+                  system (*same-fs*), or from another file system
+                  (*cross-fs*; by default, ``/dev/shm``).
+                - **Cache:** The archive's pages are dropped from the
+                  page cache before each run (*cold*), or read into it
+                  (*warm*).
+
+            The repo's own file system is set by the repo target, which
+            is passed to upack as ``--repo``. The Makefile runs the suite
+            for each of its ``BENCH_REPOS``; by default, one on disk and
+            one on tmpfs. The configuration (e.g. the buffer sizes) can
+            be varied with ``--set``, which is passed to upack.
+
+:Platform:  Linux | Python 3.6+
+:Developer: J Berendt
+:Email:     development@s3dev.uk
+
+:Comments:  The page cache is dropped via ``/proc/sys/vm/drop_caches``
+            where permitted (i.e. as root). Otherwise, the archive's
+            pages are evicted with ``posix_fadvise``, which has no effect
+            on tmpfs, so a tmpfs source is always *warm*.
+
+            The repo is deleted and re-created before each run, so every
+            run unpacks and moves every file. To guard against deleting a
+            real repo, a non-empty repo directory is only used if it was
+            created by the benchmark (i.e. contains the marker file).
+
+:Example:   Benchmark 200 wheels of 256K to 8M each, five runs per
+            scenario::
+
+                $ make bench BENCH_ARGS="--wheels 200 --size 256K-8M --runs 5"
+
+"""
+
+import argparse
+import json
+import os
+import shutil
+import statistics
+import subprocess as sp
+import sys
+import tempfile
+import time
+# locals
+import mkbundle
+
+_MARKER = '.ppk-bench'
+_PHASES = ('recover', 'unpack', 'tests', 'manifest', 'commit', 'cleanup')
+_TMPL = '{:10}{:6}{:>9}' + '{:>10}' * len(_PHASES) + '{:>10}{:>8}'
+
+
+def drop_cache(path: str) -> str:
+    """Evict a file from the page cache.
+
+    Returns:
+        str: The method used; ``'drop_caches'`` or ``'fadvise'``.
+
+    """
+    os.sync()
+    try:
+        with open('/proc/sys/vm/drop_caches', 'w', encoding='ascii') as f:
+            f.write('1\n')
+        return 'drop_caches'
+    except OSError:
+        fd = os.open(path, os.O_RDONLY)
+        try:
+            os.posix_fadvise(fd, 0, 0, os.POSIX_FADV_DONTNEED)
+        finally:
+            os.close(fd)
+        return 'fadvise'
+
+
+def warm_cache(path: str):
+    """Read a file into the page cache."""
+    with open(path, 'rb') as f:
+        while f.read(1 << 20):
+            pass
+
+
+def reset_repo(repo: str):
+    """Delete and re-create the scratch repo.
+
+    Raises:
+        RuntimeError: If the directory is not empty, and was not created
+        by the benchmark.
+
+    """
+    if os.path.isdir(repo) and os.listdir(repo) and not os.path.exists(os.path.join(repo, _MARKER)):
+        raise RuntimeError(f'Refusing to delete a repo not created by the benchmark: {repo}')
+    shutil.rmtree(repo, ignore_errors=True)
+    os.makedirs(repo)
+    with open(os.path.join(repo, _MARKER), 'w', encoding='ascii'):
+        pass
+
+
+def run(upack: str, repo: str, archive: str, cache: str, jobs: int=None, settings: list=()) -> dict:
+    """Unpack the archive into the (reset) scratch repo, once.
+
+    Returns:
+        dict: The upack run report, with the ``wall`` (end to end)
+        seconds and the ``drop`` (cache eviction) method added.
+
+    """
+    reset_repo(repo)
+    drop = drop_cache(archive) if cache == 'cold' else warm_cache(archive)
+    with tempfile.TemporaryDirectory() as tmpdir:
+        fpath = os.path.join(tmpdir, 'report.json')
+        cmd = [upack, '--repo', repo, '--report', fpath, *(['-j', str(jobs)] if jobs else [])]
+        cmd += [*(a for s in settings for a in ('--set', s)), archive]
+        start = time.monotonic()
+        proc = sp.run(cmd, stdout=sp.DEVNULL, stderr=sp.PIPE, check=False)
+        wall = time.monotonic() - start
+        if proc.returncode:
+            raise RuntimeError(f'upack failed with exit code {proc.returncode}:\n'
+                               f'{proc.stderr.decode()}')
+        with open(fpath, encoding='utf-8') as f:
+            report = json.load(f)
+    report['wall'] = wall
+    report['drop'] = drop
+    return report
+
+
+def summarise(reports: list) -> dict:
+    """Reduce a scenario's run reports to their medians."""
+    totals = [r['totals'] for r in reports]
+    unpack = [t['phases']['unpack'] for t in totals]
+    secs = statistics.median(p['seconds'] for p in unpack)
+    return {'wall': statistics.median(r['wall'] for r in reports),
+            'phases': {p: statistics.median(t['phases'][p]['seconds'] for t in totals) for p in _PHASES},
+            'unpack_mb_per_sec': unpack[0]['bytes'] / 1e6 / secs if secs else 0.0,
+            'copied': max(t['copied'] for t in totals),
+            'drop': reports[0]['drop'],
+            'runs': len(reports)}
+
+
+def main():
+    """Entry point for the benchmark's command line."""
+    argp = argparse.ArgumentParser(description='Benchmark upack on a synthetic bundle.')
+    argp.add_argument('--upack', required=True, help='Path to the upack binary under test.')
+    argp.add_argument('--repo', required=True, help='Scratch repo, passed to upack as --repo.')
+    argp.add_argument('--wheels', type=int, default=100, help='Number of wheels. (default: 100)')
+    argp.add_argument('--size', default='1M', help='Wheel size, or MIN-MAX range. (default: 1M)')
+    argp.add_argument('--runs', type=int, default=3, help='Runs per scenario. (default: 3)')
+    argp.add_argument('-j', '--jobs', type=int, help='Passed to upack as -j. (default: upack\'s)')
+    argp.add_argument('--set', action='append', default=[], metavar='KEY=VALUE',
+                      help='Passed to upack as --set; may be repeated.')
+    argp.add_argument('--altdir', default='/dev/shm/ppk-bench',
+                      help='Cross-fs source directory. (default: /dev/shm/ppk-bench)')
+    argp.add_argument('--sevenzip', default='7z', help='The 7z command. (default: 7z)')
+    argp.add_argument('--json', help='Also write the results, as JSON, to this path.')
+    args = argp.parse_args()
+    # The same-fs source sits beside the repo, so it shares the repo's file system.
+    srcdir = os.path.join(os.path.dirname(os.path.abspath(args.repo)), 'ppk-bench-src')
+    archive = mkbundle.generate(outdir=srcdir, wheels=args.wheels, size=mkbundle.parse_size(args.size),
+                                sevenzip=args.sevenzip)
+    sources = {'same-fs': archive}
+    os.makedirs(args.altdir, exist_ok=True)
+    if os.stat(args.altdir).st_dev != os.stat(srcdir).st_dev:
+        sources['cross-fs'] = shutil.copy(archive, args.altdir)
+    else:
+        print(f'\n{args.altdir} is on the repo\'s file system; the cross-fs scenario is skipped.')
+    print(f'\nupack: {args.upack}\nrepo:  {args.repo}\n'
+          f'{args.wheels} wheels of {args.size}; {os.path.getsize(archive) / 1e6:.1f} MB archive; '
+          f'median of {args.runs} runs (seconds)\n')
+    print(_TMPL.format('source', 'cache', 'wall', *_PHASES, 'MB/s', 'copied'))
+    results = {}
+    try:
+        for source, path in sources.items():
+            for cache in ('cold', 'warm'):
+                reports = [run(args.upack, args.repo, path, cache, args.jobs, args.set) for _ in range(args.runs)]
+                res = results[f'{source}/{cache}'] = summarise(reports)
+                print(_TMPL.format(source, cache, f'{res["wall"]:.3f}',
+                                   *(f'{res["phases"][p]:.3f}' for p in _PHASES),
+                                   f'{res["unpack_mb_per_sec"]:.1f}', res['copied']))
+    finally:
+        shutil.rmtree(args.repo, ignore_errors=True)
+        shutil.rmtree(srcdir, ignore_errors=True)
+        if 'cross-fs' in sources:
+            os.unlink(sources['cross-fs'])
+    drops = {r['drop'] for r in results.values() if r['drop']}
+    if drops:
+        print(f'\nCold cache by: {", ".join(sorted(drops))}')
+    if args.json:
+        with open(args.json, 'w', encoding='utf-8') as f:
+            json.dump({'upack': args.upack, 'repo': args.repo, 'wheels': args.wheels, 'size': args.size,
+                       'results': results}, f, indent=2)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+:Purpose:   This module provides the synthetic bundle generator for the
+            upack benchmark suite.
+
+            A bundle is built exactly as the packer builds one: N wheels
+            of (incompressible) random data, a ``__verification.log``
+            with a passing row, SHA-256 digest and size for each wheel,
+            and its ``__verification.key``, in an encrypted archive whose
+            password is the hash of the archive's filename. Therefore,
+            the archive passes every test run by ``upack``, and exercises
+            the same decode, hashing and move paths as a real bundle.
+
+:Platform:  Linux | Python 3.6+
+:Developer: J Berendt
+:Email:     development@s3dev.uk
+
+:Comments:  The 7z command must be installed on the host which generates
+            the bundles. The command and its flags are those used by
+            :meth:`lib.pack.PPKPacker._7z_add`, and must be kept in step.
+
+:Example:   Generate an archive of 500 wheels, of 64K to 4M each::
+
+                $ ./mkbundle.py --wheels 500 --size 64K-4M --outdir /tmp/bench
+
+"""
+
+import argparse
+import hashlib
+import os
+import random
+import socket
+import subprocess as sp
+import sys
+import tempfile
+from datetime import datetime as dt
+
+_HEADER = 'datetime,host,user,package,md5,vuln,dv_c,dv_h,dv_m,dv_l,sha256,size,result\n'
+_UNITS = {'': 1, 'K': 1 << 10, 'M': 1 << 20, 'G': 1 << 30}
+_CHUNK = 1 << 20
+
+
+def parse_size(size: str) -> tuple:
+    """Parse a wheel size argument.
+
+    Args:
+        size (str): A size in bytes, with an optional K, M or G suffix
+            (for example, ``256K``), or a range of sizes (for example,
+            ``64K-4M``), from which each wheel's size is drawn.
+
+    Returns:
+        tuple: The (minimum, maximum) size, in bytes.
+
+    """
+    def _bytes(s):
+        s = s.strip().upper()
+        unit = s[-1:] if s[-1:] in _UNITS else ''
+        return int(float(s[:len(s) - len(unit)]) * _UNITS[unit])
+    lo, _, hi = size.partition('-')
+    lo = _bytes(lo)
+    hi = _bytes(hi) if hi else lo
+    if not 0 < lo <= hi:
+        raise ValueError(f'Invalid wheel size: {size}')
+    return lo, hi
+
+
+def generate(outdir: str, wheels: int, size: tuple, name: str='bench', seed: int=0,
+             sevenzip: str='7z') -> str:
+    """Generate a synthetic bundle.
+
+    Args:
+        outdir (str): Directory into which the archive is written.
+        wheels (int): Number of wheels in the archive.
+        size (tuple): The (minimum, maximum) wheel size, in bytes, per
+            :func:`parse_size`.
+        name (str, optional): Project name of the archive. Defaults to
+            ``'bench'``.
+        seed (int, optional): Seed for the wheel sizes, so a bundle can
+            be rebuilt identically. Defaults to 0.
+        sevenzip (str, optional): The 7z command. Defaults to ``'7z'``.
+
+    Raises:
+        RuntimeError: If the 7z subprocess returns a non-zero exit code.
+
+    Returns:
+        str: Full path to the archive.
+
+    """
+    rng = random.Random(seed)
+    fname = f'{name}-1.0.0-cp311-cp311-manylinux2014_x86_64.7z'
+    opath = os.path.join(outdir, fname)
+    password = hashlib.sha256(fname.encode()).hexdigest()
+    os.makedirs(outdir, exist_ok=True)
+    if os.path.exists(opath):
+        os.unlink(opath)
+    with tempfile.TemporaryDirectory(dir=outdir) as tmpdir:
+        rows = []
+        packages = []
+        for i in range(wheels):
+            whl = os.path.join(tmpdir, f'{name}{i:05d}-1.0.{i}-py3-none-any.whl')
+            rows.append((os.path.basename(whl), *_write_wheel(whl, rng.randint(*size))))
+            packages.append(whl)
+        log = os.path.join(tmpdir, f'{fname[:-3]}__verification.log')
+        key = os.path.join(tmpdir, f'{fname[:-3]}__verification.key')
+        dtme = dt.now().strftime('%Y-%m-%d %H:%M')
+        host = socket.gethostname()
+        user = os.environ.get('USER', 'bench')
+        with open(log, 'w', encoding='utf-8') as f:
+            f.write(_HEADER)
+            for whl, sha256, nbytes in rows:
+                f.write(f'{dtme},{host},{user},{whl},True,True,0,0,0,0,{sha256},{nbytes},pass\n')
+            f.write('\nResult: PASS\n')
+        with open(log, 'rb') as f:
+            digest = hashlib.sha256(f.read()).hexdigest()
+        with open(key, 'w', encoding='utf-8') as f:
+            f.write(digest)
+        # As the packer; the verification files first, in their own pass, then the (stored) wheels.
+        for files, level in (([log, key], 3), (packages, 0)):
+            cmd = [sevenzip, 'a', f'-mx{level}', '-mhe=on', '-mmt=on', f'-p{password}', opath, *files]
+            with sp.Popen(cmd, stdout=sp.PIPE, stderr=sp.PIPE) as proc:
+                stdout, stderr = proc.communicate()
+            if proc.returncode:
+                raise RuntimeError('\n'.join((f'7z failed with exit code: {proc.returncode}',
+                                              stdout.decode(),
+                                              stderr.decode())))
+    return opath
+
+
+def _write_wheel(path: str, size: int) -> tuple:
+    """Write a wheel of random data.
+
+    Random data is used as a wheel is already compressed, so the archive
+    is (near enough) the same size as its contents, as in production.
+
+    Returns:
+        tuple: The SHA-256 hex digest and size of the file.
+
+    """
+    hash_ = hashlib.sha256()
+    with open(path, 'wb') as f:
+        for i in range(0, size, _CHUNK):
+            chunk = os.urandom(min(_CHUNK, size - i))
+            hash_.update(chunk)
+            f.write(chunk)
+    return hash_.hexdigest(), size
+
+
+def main():
+    """Entry point for the generator's command line."""
+    argp = argparse.ArgumentParser(description='Generate a synthetic ppk bundle for benchmarking.')
+    argp.add_argument('--wheels', type=int, default=100, help='Number of wheels. (default: 100)')
+    argp.add_argument('--size', default='1M', help='Wheel size, or MIN-MAX range. (default: 1M)')
+    argp.add_argument('--outdir', default='.', help='Output directory. (default: .)')
+    argp.add_argument('--name', default='bench', help='Project name of the archive. (default: bench)')
+    argp.add_argument('--seed', type=int, default=0, help='Seed for the wheel sizes. (default: 0)')
+    argp.add_argument('--sevenzip', default='7z', help='The 7z command. (default: 7z)')
+    args = argp.parse_args()
+    print(generate(outdir=args.outdir, wheels=args.wheels, size=parse_size(args.size), name=args.name,
+                   seed=args.seed, sevenzip=args.sevenzip))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,470 @@
+/**
+    Purpose:    This module provides the offline advisory snapshot; a
+                compact, memory-mapped table of the reported
+                vulnerabilities for each project, used to re-check the
+                archive's packages on the secured side, without network
+                access.
+
+    Developer:  J Berendt
+    Email:      development@s3dev.uk
+
+    Comments:   The snapshot is exported by the packer (lib/snapshot.py)
+                and is read-only here. All integers are little-endian,
+                and all offsets are from the start of the file:
+
+                    header      magic[8] "PPKADV01", u32 nprojects,
+                                u32 nsegments, u64 created (seconds
+                                since the epoch), u32 offset of the
+                                project table, u32 offset of the
+                                segment table.
+                    projects    nprojects x { u32 name offset,
+                                u32 first segment, u32 nsegments },
+                                sorted by (normalised) name.
+                    segments    nsegments x { u32 key offset,
+                                u32 key length, u16 counts[4] },
+                                sorted by version key within each
+                                project.
+                    strings     NULL terminated project names, and the
+                                version keys.
+
+                Each segment covers the versions from its key, up to the
+                next segment's key; with the number of (C, H, M, L)
+                vulnerabilities affecting those versions. Therefore, a
+                lookup is two binary searches.
+
+                A version key is a sequence of big-endian u32 words,
+                which compares with memcmp(3) in PEP 440 order:
+
+                    epoch, release (each part + 1, trailing zeros
+                    removed), 0, pre-release phase (0: dev only,
+                    1: a, 2: b, 3: rc, 4: none), pre-release number,
+                    post-release (number + 1, or 0), dev-release
+                    (number, or 0xffffffff).
+
+                The local version label is ignored.
+
+    Copyright (C) 73rd Street Development
+    This file is part of the ppk project's upack program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "base.h"
+#include "advisory.h"
+#include "job.h"
+#include "simple.h"
+#include "utils.h"
+
+#define ADVISORY_MAGIC "PPKADV01"
+#define ADVISORY_HEADER_SIZE 32
+#define ADVISORY_PROJECT_SIZE 12
+#define ADVISORY_SEGMENT_SIZE 16
+#define ADVISORY_MAX_PARTS 32   // Maximum number of release parts in a version.
+#define ADVISORY_WORD_MAX 0xffffffffu  // Dev-release word of a version without one.
+
+/**
+    The snapshot, as mapped into memory.
+*/
+struct advisory {
+    const unsigned char *map;
+    size_t              size;
+    uint32_t            nprojects;
+    uint32_t            nsegments;
+    uint64_t            created;
+    const unsigned char *projects;
+    const unsigned char *segments;
+};
+
+// Function prototypes
+void advisory_close(struct advisory *adv);
+uint64_t advisory_created(const struct advisory *adv);
+int advisory_lookup(const struct advisory *adv, const char *fname, unsigned int *counts);
+struct advisory *advisory_open(const char *fpath);
+
+/**
+    Read a little-endian u16 from the snapshot.
+*/
+static uint16_t get16(const unsigned char *p) {
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+/**
+    Read a little-endian u32 from the snapshot.
+*/
+static uint32_t get32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/**
+    Append a big-endian u32 word to a version key.
+
+    @return     0 on success, otherwise 1 if the key buffer is full.
+*/
+static int put_word(unsigned char *key, size_t size, size_t *len, uint32_t w) {
+    if ( *len + 4 > size ) return EXIT_FAILURE;
+    key[(*len)++] = w >> 24;
+    key[(*len)++] = w >> 16;
+    key[(*len)++] = w >> 8;
+    key[(*len)++] = w;
+    return EXIT_SUCCESS;
+}
+
+/**
+    Parse a run of digits from a version.
+
+    @return     0 on success, otherwise 1 if there are no digits, or the
+                number exceeds the key's range.
+*/
+static int parse_number(const char **p, uint32_t *n) {
+
+    uint64_t    v = 0;
+
+    if ( !isdigit((unsigned char)**p) ) return EXIT_FAILURE;
+    for ( ; isdigit((unsigned char)**p); ++*p ) {
+        if ( (v = v * 10 + (**p - '0')) >= ADVISORY_WORD_MAX ) return EXIT_FAILURE;
+    }
+    *n = (uint32_t)v;
+    return EXIT_SUCCESS;
+}
+
+/**
+    Match a (case insensitive) label from a NULL terminated list, with
+    an optional leading separator.
+
+    @return     Index of the label matched, or -1; in which case the
+                position is not advanced.
+*/
+static int parse_label(const char **p, const char **labels) {
+
+    const char  *s = *p;
+
+    if ( *s && strchr("-_.", *s) ) ++s;
+    for ( int i = 0; labels[i]; ++i ) {
+        if ( !strncasecmp(s, labels[i], strlen(labels[i])) ) {
+            *p = s + strlen(labels[i]);
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+    Parse the optional number following a pre, post or dev label, with
+    an optional leading separator. The number defaults to zero.
+
+    @return     0 on success, otherwise 1 if the number exceeds the key's
+                range.
+*/
+static int parse_label_number(const char **p, uint32_t *n) {
+
+    const char  *s = *p;
+
+    *n = 0;
+    if ( *s && strchr("-_.", *s) ) ++s;
+    if ( !isdigit((unsigned char)*s) ) return EXIT_SUCCESS;
+    *p = s;
+    return parse_number(p, n);
+}
+
+/**
+    Derive the version from a distribution's filename.
+
+    @return     0 on success, otherwise 1.
+*/
+static int dist_version(const char *fname, char *version, size_t size) {
+
+    size_t      len = strlen(fname);
+    size_t      extlen;
+    const char  *start = NULL;
+    const char  *end = NULL;
+
+    if ( len > 4 && !strcmp(fname + len - 4, ".whl") ) {
+        if ( (start = strchr(fname, '-')) == NULL || (end = strchr(++start, '-')) == NULL ) return EXIT_FAILURE;
+    } else {
+        if ( (extlen = job_sdist_ext(fname)) == 0 ) return EXIT_FAILURE;
+        end = fname + len - extlen;
+        for ( const char *p = fname; p < end; ++p ) {
+            if ( *p == '-' && isdigit((unsigned char)p[1]) ) start = p + 1;
+        }
+        if ( start == NULL ) return EXIT_FAILURE;
+    }
+    if ( (size_t)(end - start) >= size ) return EXIT_FAILURE;
+    memcpy(version, start, end - start);
+    version[end - start] = '\0';
+    return EXIT_SUCCESS;
+}
+
+/**
+    Build the version key for a PEP 440 version, which compares with
+    memcmp(3) in version order.
+
+    @param[in]  version Version string; for example, '1.26.0rc1'.
+    @param[out] key     Buffer to receive the key.
+    @param[in]  size    Size of the key buffer, in bytes.
+
+    @return             Length of the key, in bytes, or -1 if the version
+                        is not a valid PEP 440 version.
+*/
+static int version_key(const char *version, unsigned char *key, size_t size) {
+
+    static const char   *pre_labels[] = { "alpha", "a", "beta", "b", "preview", "pre", "c", "rc", NULL };
+    static const int    pre_phase[] = { 1, 1, 2, 2, 3, 3, 3, 3 };
+    static const char   *post_labels[] = { "post", "rev", "r", NULL };
+    static const char   *dev_labels[] = { "dev", NULL };
+    const char          *p = version;
+    const char          *s;
+    int                 pre;
+    int                 nparts = 0;
+    size_t              len = 0;
+    uint32_t            epoch = 0;
+    uint32_t            parts[ADVISORY_MAX_PARTS];
+    uint32_t            pre_n = 0;
+    uint32_t            post = 0;
+    uint32_t            dev = 0;
+    bool                has_post = false;
+    bool                has_dev = false;
+
+    while ( isspace((unsigned char)*p) ) ++p;
+    if ( *p == 'v' || *p == 'V' ) ++p;
+    // The epoch, if present, is followed by a '!'.
+    s = p;
+    if ( !parse_number(&s, &epoch) && *s == '!' ) {
+        p = s + 1;
+    } else {
+        epoch = 0;
+    }
+    do {
+        if ( nparts == ADVISORY_MAX_PARTS || parse_number(&p, &parts[nparts++]) ) return -1;
+    } while ( *p == '.' && isdigit((unsigned char)p[1]) && ++p );
+    if ( (pre = parse_label(&p, pre_labels)) >= 0 && parse_label_number(&p, &pre_n) ) return -1;
+    if ( *p == '-' && isdigit((unsigned char)p[1]) ) {
+        ++p;
+        if ( parse_number(&p, &post) ) return -1;
+        has_post = true;
+    } else if ( parse_label(&p, post_labels) >= 0 ) {
+        if ( parse_label_number(&p, &post) ) return -1;
+        has_post = true;
+    }
+    if ( parse_label(&p, dev_labels) >= 0 ) {
+        if ( parse_label_number(&p, &dev) ) return -1;
+        has_dev = true;
+    }
+    // The local version label is not significant.
+    if ( *p == '+' ) {
+        for ( ++p; isalnum((unsigned char)*p) || (*p && strchr("-_.", *p)); ++p );
+    }
+    while ( isspace((unsigned char)*p) ) ++p;
+    if ( *p ) return -1;
+    while ( nparts && parts[nparts - 1] == 0 ) --nparts;
+    if ( put_word(key, size, &len, epoch) ) return -1;
+    for ( int i = 0; i < nparts; ++i ) {
+        if ( put_word(key, size, &len, parts[i] + 1) ) return -1;
+    }
+    if ( put_word(key, size, &len, 0) ||
+         put_word(key, size, &len, ( pre >= 0 ) ? pre_phase[pre] : ( has_dev && !has_post ) ? 0 : 4) ||
+         put_word(key, size, &len, pre_n) ||
+         put_word(key, size, &len, ( has_post ) ? post + 1 : 0) ||
+         put_word(key, size, &len, ( has_dev ) ? dev : ADVISORY_WORD_MAX) ) {
+        return -1;
+    }
+    return (int)len;
+}
+
+/**
+    Release the snapshot.
+
+    @param[in]  adv     Pointer to the snapshot, or NULL.
+*/
+void advisory_close(struct advisory *adv) {
+    if ( adv == NULL ) return;
+    munmap((void *)adv->map, adv->size);
+    free(adv);
+}
+
+/**
+    Return the time at which the snapshot was created.
+
+    @param[in]  adv     Pointer to the snapshot.
+
+    @return             Creation time, in seconds since the epoch.
+*/
+uint64_t advisory_created(const struct advisory *adv) {
+    return adv->created;
+}
+
+/**
+    Look up the reported vulnerabilities for a distribution.
+
+    The project name and version are parsed from the filename. The
+    project is found by a binary search of the project table, then the
+    version by a binary search of the project's segments.
+
+    This function is thread-safe.
+
+    @param[in]  adv     Pointer to the snapshot.
+    @param[in]  fname   Base filename of the wheel or source distribution.
+    @param[out] counts  Array of four integers to receive the number of
+                        vulnerabilities in each category, of descending
+                        severity (i.e. C, H, M, L).
+
+    @return             0 on success, otherwise 1 if the filename or its
+                        version could not be parsed.
+*/
+int advisory_lookup(const struct advisory *adv, const char *fname, unsigned int *counts) {
+
+    char                project[256];
+    char                version[128];
+    unsigned char       key[(ADVISORY_MAX_PARTS + 8) * 4];
+    int                 c;
+    int                 keylen;
+    size_t              lo = 0;
+    size_t              hi = adv->nprojects;
+    size_t              mid;
+    uint32_t            first;
+    uint32_t            nseg;
+    uint32_t            off;
+    uint32_t            len;
+    const unsigned char *rec = NULL;
+    const unsigned char *seg;
+
+    memset(counts, 0, 4 * sizeof(unsigned int));
+    if ( simple_project(fname, project, sizeof(project)) || dist_version(fname, version, sizeof(version)) ||
+         (keylen = version_key(version, key, sizeof(key))) < 0 ) {
+        return EXIT_FAILURE;
+    }
+    while ( lo < hi ) {
+        mid = lo + (hi - lo) / 2;
+        rec = adv->projects + (size_t)mid * ADVISORY_PROJECT_SIZE;
+        if ( (c = strcmp(project, (const char *)adv->map + get32(rec))) == 0 ) break;
+        if ( c > 0 ) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+        rec = NULL;
+    }
+    if ( rec == NULL ) return EXIT_SUCCESS;  // No reported vulnerabilities.
+    first = get32(rec + 4);
+    nseg = get32(rec + 8);
+    // Find the last segment starting at (or before) the version.
+    lo = 0;
+    hi = nseg;
+    while ( lo < hi ) {
+        mid = lo + (hi - lo) / 2;
+        seg = adv->segments + ((size_t)first + mid) * ADVISORY_SEGMENT_SIZE;
+        off = get32(seg);
+        len = get32(seg + 4);
+        c = memcmp(adv->map + off, key, ( len < (uint32_t)keylen ) ? len : (uint32_t)keylen);
+        if ( c < 0 || (c == 0 && len <= (uint32_t)keylen) ) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if ( lo == 0 ) return EXIT_SUCCESS;
+    seg = adv->segments + ((size_t)first + lo - 1) * ADVISORY_SEGMENT_SIZE;
+    for ( int i = 0; i < 4; ++i ) counts[i] = get16(seg + 8 + i * 2);
+    return EXIT_SUCCESS;
+}
+
+/**
+    Map the advisory snapshot into memory, and validate its tables.
+
+    Every offset in the project and segment tables is checked against
+    the size of the file, so a lookup never reads outside the mapping.
+
+    @param[in]  fpath   Explicit path to the snapshot file.
+
+    @return             Pointer to the snapshot, or NULL if the file could
+                        not be read or is not a valid snapshot; in which
+                        case an error is reported. The snapshot must be
+                        released by advisory_close().
+*/
+struct advisory *advisory_open(const char *fpath) {
+
+    char                msgbuff[PATH_MAX + 128];
+    const char          *err = NULL;
+    int                 fd;
+    uint32_t            off;
+    uint32_t            len;
+    struct advisory     *adv;
+    struct stat         st;
+    void                *map;
+
+    if ( (fd = open(fpath, O_RDONLY)) < 0 || fstat(fd, &st) ) {
+        snprintf(msgbuff, sizeof(msgbuff), "%s: %s", strerror(errno), fpath);
+        reporterror(msgbuff, false, false);
+        if ( fd >= 0 ) close(fd);
+        return NULL;
+    }
+    if ( (size_t)st.st_size < ADVISORY_HEADER_SIZE || (uint64_t)st.st_size > UINT32_MAX ) {
+        close(fd);
+        snprintf(msgbuff, sizeof(msgbuff), "The file is not an advisory snapshot: %s", fpath);
+        reporterror(msgbuff, false, false);
+        return NULL;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ( map == MAP_FAILED ) {
+        snprintf(msgbuff, sizeof(msgbuff), "%s: %s", strerror(errno), fpath);
+        reporterror(msgbuff, false, false);
+        return NULL;
+    }
+    if ( (adv = calloc(1, sizeof(struct advisory))) == NULL ) {
+        munmap(map, st.st_size);
+        reporterror("Error occurred while allocating memory for the advisory snapshot.", false, false);
+        return NULL;
+    }
+    adv->map = map;
+    adv->size = st.st_size;
+    adv->nprojects = get32(adv->map + 8);
+    adv->nsegments = get32(adv->map + 12);
+    adv->created = (uint64_t)get32(adv->map + 16) | (uint64_t)get32(adv->map + 20) << 32;
+    if ( memcmp(adv->map, ADVISORY_MAGIC, 8) ) {
+        err = "The file is not an advisory snapshot";
+    } else if ( (uint64_t)get32(adv->map + 24) + (uint64_t)adv->nprojects * ADVISORY_PROJECT_SIZE > adv->size ||
+                (uint64_t)get32(adv->map + 28) + (uint64_t)adv->nsegments * ADVISORY_SEGMENT_SIZE > adv->size ) {
+        err = "The advisory snapshot is truncated";
+    } else {
+        adv->projects = adv->map + get32(adv->map + 24);
+        adv->segments = adv->map + get32(adv->map + 28);
+        for ( uint32_t i = 0; i < adv->nprojects && !err; ++i ) {
+            off = get32(adv->projects + (size_t)i * ADVISORY_PROJECT_SIZE);
+            len = get32(adv->projects + (size_t)i * ADVISORY_PROJECT_SIZE + 8);
+            if ( off >= adv->size || memchr(adv->map + off, '\0', adv->size - off) == NULL ||
+                 (uint64_t)get32(adv->projects + (size_t)i * ADVISORY_PROJECT_SIZE + 4) + len > adv->nsegments ) {
+                err = "The advisory snapshot is corrupt";
+            }
+        }
+        for ( uint32_t i = 0; i < adv->nsegments && !err; ++i ) {
+            off = get32(adv->segments + (size_t)i * ADVISORY_SEGMENT_SIZE);
+            len = get32(adv->segments + (size_t)i * ADVISORY_SEGMENT_SIZE + 4);
+            if ( (uint64_t)off + len > adv->size ) err = "The advisory snapshot is corrupt";
+        }
+    }
+    if ( err ) {
+        snprintf(msgbuff, sizeof(msgbuff), "%s: %s", err, fpath);
+        reporterror(msgbuff, false, false);
+        advisory_close(adv);
+        return NULL;
+    }
+    return adv;
+}
@@ -0,0 +1,61 @@
+/**
+    Header file for the advisory.c module.
+*/
+
+#ifndef _ADVISORY_H
+#define _ADVISORY_H
+
+struct advisory;
+
+/**
+    Release the snapshot.
+
+    @param[in]  adv     Pointer to the snapshot, or NULL.
+*/
+void advisory_close(struct advisory *adv);
+
+/**
+    Return the time at which the snapshot was created.
+
+    @param[in]  adv     Pointer to the snapshot.
+
+    @return             Creation time, in seconds since the epoch.
+*/
+uint64_t advisory_created(const struct advisory *adv);
+
+/**
+    Look up the reported vulnerabilities for a distribution.
+
+    The project name and version are parsed from the filename. The
+    project is found by a binary search of the project table, then the
+    version by a binary search of the project's segments.
+
+    This function is thread-safe.
+
+    @param[in]  adv     Pointer to the snapshot.
+    @param[in]  fname   Base filename of the wheel or source distribution.
+    @param[out] counts  Array of four integers to receive the number of
+                        vulnerabilities in each category, of descending
+                        severity (i.e. C, H, M, L).
+
+    @return             0 on success, otherwise 1 if the filename or its
+                        version could not be parsed.
+*/
+int advisory_lookup(const struct advisory *adv, const char *fname, unsigned int *counts);
+
+/**
+    Map the advisory snapshot into memory, and validate its tables.
+
+    Every offset in the project and segment tables is checked against
+    the size of the file, so a lookup never reads outside the mapping.
+
+    @param[in]  fpath   Explicit path to the snapshot file.
+
+    @return             Pointer to the snapshot, or NULL if the file could
+                        not be read or is not a valid snapshot; in which
+                        case an error is reported. The snapshot must be
+                        released by advisory_close().
+*/
+struct advisory *advisory_open(const char *fpath);
+
+#endif /* _ADVISORY_H */
@@ -0,0 +1,1385 @@
+/**
+    Purpose:    This module provides an in-process reader for the
+                encrypted 7z archives created by ppk's packer.
+
+                The archive is decrypted, decoded and CRC checked in a
+                single streaming pass, with each entry being passed to
+                the caller's sink as its data is decoded. This replaces
+                the previous two-pass 'system("7z t ...")' and
+                'system("7z e ...")' approach.
+
+    Developer:  J Berendt
+    Email:      development@s3dev.uk
+
+    Comments:   Reference: 7-Zip's DOC/7zFormat.txt and 7zAES.cpp.
+
+                Decompression is provided by liblzma and decryption by
+                libcrypto; both are statically linked.
+
+    Copyright (C) 73rd Street Development
+    This file is part of the ppk project's upack program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fcntl.h>
+#include <limits.h>
+#include <lzma.h>
+#include <openssl/evp.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "base.h"
+#include "archive.h"
+#include "arena.h"
+#include "config.h"
+#include "hash.h"
+#include "utils.h"
+
+// Limits
+#define SZ_MAX_CODERS   4
+#define SZ_MAX_ENTRIES  (1 << 22)
+#define SZ_MAX_HEADER   (64*1024*1024)
+#define SZ_KEY_BATCH    1024                // Key derivation rounds hashed per update.
+#define SZ_SIGSZ        32
+// Property IDs
+#define SZ_ID_END               0x00
+#define SZ_ID_HEADER            0x01
+#define SZ_ID_ARCHIVEPROPS      0x02
+#define SZ_ID_ADDSTREAMSINFO    0x03
+#define SZ_ID_MAINSTREAMSINFO   0x04
+#define SZ_ID_FILESINFO         0x05
+#define SZ_ID_PACKINFO          0x06
+#define SZ_ID_UNPACKINFO        0x07
+#define SZ_ID_SUBSTREAMSINFO    0x08
+#define SZ_ID_SIZE              0x09
+#define SZ_ID_CRC               0x0a
+#define SZ_ID_FOLDER            0x0b
+#define SZ_ID_CODERSUNPACKSIZE  0x0c
+#define SZ_ID_NUMUNPACKSTREAM   0x0d
+#define SZ_ID_EMPTYSTREAM       0x0e
+#define SZ_ID_EMPTYFILE         0x0f
+#define SZ_ID_NAME              0x11
+#define SZ_ID_MTIME             0x14
+#define SZ_ID_WINATTRIB         0x15
+#define SZ_ID_ENCODEDHEADER     0x17
+// Coder (method) IDs
+#define SZ_M_COPY       0x00
+#define SZ_M_DELTA      0x03
+#define SZ_M_ARM64      0x0a
+#define SZ_M_LZMA2      0x21
+#define SZ_M_LZMA       0x030101
+#define SZ_M_BCJ        0x03030103
+#define SZ_M_BCJ2       0x0303011b
+#define SZ_M_PPC        0x03030205
+#define SZ_M_IA64       0x03030401
+#define SZ_M_ARM        0x03030501
+#define SZ_M_ARMT       0x03030701
+#define SZ_M_SPARC      0x03030805
+#define SZ_M_AES        0x06f10701
+// Windows file attribute flag for a directory.
+#define SZ_ATTRIB_DIR   0x10
+
+static const unsigned char _SZ_SIGNATURE[6] = {'7', 'z', 0xbc, 0xaf, 0x27, 0x1c};
+
+struct sz_coder {
+    uint64_t                method;
+    const unsigned char     *props;     // Points into the header buffer.
+    size_t                  propsz;
+    uint64_t                nin;
+    uint64_t                nout;
+};
+
+struct sz_folder {
+    struct sz_coder     coders[SZ_MAX_CODERS];
+    uint64_t            unpack[SZ_MAX_CODERS];  // Unpack size of each coder's output.
+    uint64_t            bond_in[SZ_MAX_CODERS];
+    uint64_t            bond_out[SZ_MAX_CODERS];
+    uint64_t            ncoders;
+    uint64_t            nbonds;
+    uint64_t            packidx;    // Index of the folder's (first) pack stream.
+    uint64_t            mainout;    // Index of the coder producing the folder's output.
+    uint64_t            nsub;       // Number of substreams (entries) in the folder.
+    uint32_t            crc;
+    bool                has_crc;
+};
+
+struct sz_streams {
+    uint64_t            packpos;
+    uint64_t            npack;
+    uint64_t            *packsizes;
+    uint64_t            nfolders;
+    struct sz_folder    *folders;
+    uint64_t            nsub;
+    uint64_t            *subsizes;
+    uint32_t            *subcrcs;
+    bool                *subhascrc;
+};
+
+struct sz_reader {
+    const unsigned char *p;
+    size_t              size;
+    size_t              pos;
+};
+
+struct sz_archive {
+    int                     fd;
+    uint64_t                fsize;
+    const char              *password;
+    unsigned char           *header;    // Decoded header, owned.
+    struct sz_streams       streams;
+    uint64_t                nfiles;
+    struct archive_entry    *files;
+    struct arena            *names;     // The entry names.
+    // Derived key cache, as all folders generally share a salt.
+    bool                    has_key;
+    int                     key_cycles;
+    size_t                  key_saltsz;
+    unsigned char           key_salt[16];
+    unsigned char           key[32];
+};
+
+// Output callback used by the folder decoder.
+typedef int (*sz_output)(void *ctx, const unsigned char *buff, size_t size);
+
+// Function prototypes
+int archive_extract(const char *fpath, const char *password, const struct archive_sink *sink);
+
+/* ----------------------------------------------------------------------
+    Header parsing helpers.
+   ---------------------------------------------------------------------- */
+
+/**
+    Read a single byte from the reader.
+
+    @return     0 on success, otherwise -1 if the buffer is exhausted.
+*/
+static int read_byte(struct sz_reader *r, unsigned char *b) {
+    if ( r->pos >= r->size ) return -1;
+    *b = r->p[r->pos++];
+    return 0;
+}
+
+/**
+    Read a little-endian integer of nbytes (<= 8) from the reader.
+
+    @return     0 on success, otherwise -1 if the buffer is exhausted.
+*/
+static int read_uint(struct sz_reader *r, int nbytes, uint64_t *value) {
+    if ( r->size - r->pos < (size_t)nbytes ) return -1;
+    *value = 0;
+    for ( int i = 0; i < nbytes; ++i ) {
+        *value |= (uint64_t)r->p[r->pos++] << (8 * i);
+    }
+    return 0;
+}
+
+/**
+    Read a 7z variable length NUMBER from the reader.
+
+    The count of leading set bits in the first byte gives the number of
+    additional (little-endian) bytes which follow.
+
+    @return     0 on success, otherwise -1 if the buffer is exhausted.
+*/
+static int read_number(struct sz_reader *r, uint64_t *value) {
+
+    unsigned char   first;
+    unsigned char   mask = 0x80;
+    unsigned char   b;
+
+    if ( read_byte(r, &first) ) return -1;
+    *value = 0;
+    for ( int i = 0; i < 8; ++i ) {
+        if ( (first & mask) == 0 ) {
+            *value |= (uint64_t)(first & (mask - 1)) << (8 * i);
+            return 0;
+        }
+        if ( read_byte(r, &b) ) return -1;
+        *value |= (uint64_t)b << (8 * i);
+        mask >>= 1;
+    }
+    return 0;
+}
+
+/**
+    Read a count NUMBER, which must not exceed SZ_MAX_ENTRIES.
+
+    @return     0 on success, otherwise -1.
+*/
+static int read_count(struct sz_reader *r, uint64_t *value) {
+    if ( read_number(r, value) ) return -1;
+    return ( *value > SZ_MAX_ENTRIES ) ? -1 : 0;
+}
+
+/**
+    Skip a property's data, the size of which is given by a NUMBER.
+
+    @return     0 on success, otherwise -1.
+*/
+static int skip_data(struct sz_reader *r) {
+
+    uint64_t size;
+
+    if ( read_number(r, &size) || size > r->size - r->pos ) return -1;
+    r->pos += size;
+    return 0;
+}
+
+/**
+    Read a bit vector of n items; the MSB of each byte is the first item.
+
+    @return     0 on success, otherwise -1.
+*/
+static int read_bits(struct sz_reader *r, uint64_t n, bool *bits) {
+
+    unsigned char b = 0;
+
+    for ( uint64_t i = 0; i < n; ++i ) {
+        if ( (i % 8) == 0 && read_byte(r, &b) ) return -1;
+        bits[i] = (b & (0x80 >> (i % 8))) != 0;
+    }
+    return 0;
+}
+
+/**
+    Read a 'defined' vector: an all-defined byte, optionally followed by
+    a bit vector of n items.
+
+    @return     0 on success, otherwise -1.
+*/
+static int read_defined(struct sz_reader *r, uint64_t n, bool *defined) {
+
+    unsigned char all;
+
+    if ( read_byte(r, &all) ) return -1;
+    if ( all ) {
+        for ( uint64_t i = 0; i < n; ++i ) defined[i] = true;
+        return 0;
+    }
+    return read_bits(r, n, defined);
+}
+
+/**
+    Read a digests structure of n items.
+
+    @return     0 on success, otherwise -1.
+*/
+static int read_digests(struct sz_reader *r, uint64_t n, bool *defined, uint32_t *crcs) {
+
+    uint64_t value;
+
+    if ( read_defined(r, n, defined) ) return -1;
+    for ( uint64_t i = 0; i < n; ++i ) {
+        if ( defined[i] ) {
+            if ( read_uint(r, 4, &value) ) return -1;
+            crcs[i] = (uint32_t)value;
+        }
+    }
+    return 0;
+}
+
+/**
+    Parse a PackInfo block.
+
+    @return     0 on success, otherwise -1.
+*/
+static int parse_packinfo(struct sz_reader *r, struct sz_streams *s) {
+
+    uint64_t id;
+
+    if ( read_number(r, &s->packpos) || read_count(r, &s->npack) ) return -1;
+    if ( (s->packsizes = calloc(s->npack + 1, sizeof(uint64_t))) == NULL ) return -1;
+    for (;;) {
+        if ( read_number(r, &id) ) return -1;
+        if ( id == SZ_ID_END ) break;
+        if ( id == SZ_ID_SIZE ) {
+            for ( uint64_t i = 0; i < s->npack; ++i ) {
+                if ( read_number(r, &s->packsizes[i]) ) return -1;
+            }
+        } else if ( id == SZ_ID_CRC ) {
+            // Pack stream CRCs are not used; the unpacked data is verified instead.
+            bool        *defined = calloc(s->npack + 1, sizeof(bool));
+            uint32_t    *crcs = calloc(s->npack + 1, sizeof(uint32_t));
+            int         excode = ( defined && crcs ) ? read_digests(r, s->npack, defined, crcs) : -1;
+            free(defined);
+            free(crcs);
+            if ( excode ) return -1;
+        } else if ( skip_data(r) ) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+    Parse a Folder structure.
+
+    @return     0 on success, otherwise -1.
+*/
+static int parse_folder(struct sz_reader *r, struct sz_folder *f) {
+
+    bool            bound;
+    unsigned char   flags;
+    unsigned char   b;
+    uint64_t        nin = 0;
+    uint64_t        nout = 0;
+    uint64_t        npacked;
+    uint64_t        value;
+
+    if ( read_number(r, &f->ncoders) || f->ncoders == 0 || f->ncoders > SZ_MAX_CODERS ) return -1;
+    for ( uint64_t i = 0; i < f->ncoders; ++i ) {
+        struct sz_coder *c = &f->coders[i];
+        if ( read_byte(r, &flags) || (flags & 0x80) || (flags & 0x0f) > 8 ) return -1;
+        c->method = 0;
+        for ( int j = 0; j < (flags & 0x0f); ++j ) {
+            if ( read_byte(r, &b) ) return -1;
+            c->method = (c->method << 8) | b;
+        }
+        c->nin = c->nout = 1;
+        if ( flags & 0x10 ) {
+            if ( read_number(r, &c->nin) || read_number(r, &c->nout) ) return -1;
+            if ( c->nin > SZ_MAX_CODERS || c->nout > SZ_MAX_CODERS ) return -1;
+        }
+        c->props = NULL;
+        c->propsz = 0;
+        if ( flags & 0x20 ) {
+            if ( read_number(r, &value) || value > r->size - r->pos ) return -1;
+            c->props = r->p + r->pos;
+            c->propsz = value;
+            r->pos += value;
+        }
+        nin += c->nin;
+        nout += c->nout;
+    }
+    // Only chains of simple (single in / single out) coders are supported.
+    if ( nin != f->ncoders || nout != f->ncoders ) return -2;
+    f->nbonds = nout - 1;
+    for ( uint64_t i = 0; i < f->nbonds; ++i ) {
+        if ( read_number(r, &f->bond_in[i]) || read_number(r, &f->bond_out[i]) ) return -1;
+        if ( f->bond_in[i] >= nin || f->bond_out[i] >= nout ) return -1;
+    }
+    npacked = nin - f->nbonds;
+    if ( npacked != 1 ) return -2;
+    // A single packed stream is implied; its index is not stored.
+    // Locate the folder's main output: the coder output which is not bound.
+    f->mainout = nout;
+    for ( uint64_t i = 0; i < nout; ++i ) {
+        bound = false;
+        for ( uint64_t j = 0; j < f->nbonds; ++j ) {
+            if ( f->bond_out[j] == i ) bound = true;
+        }
+        if ( !bound ) {
+            f->mainout = i;
+            break;
+        }
+    }
+    return ( f->mainout < nout ) ? 0 : -1;
+}
+
+/**
+    Parse an UnpackInfo (CodersInfo) block.
+
+    @return     0 on success, -1 if the block is corrupt, or -2 if the
+                block uses unsupported coders.
+*/
+static int parse_unpackinfo(struct sz_reader *r, struct sz_streams *s) {
+
+    int             excode;
+    unsigned char   external;
+    uint64_t        id;
+    uint64_t        packidx = 0;
+
+    if ( read_number(r, &id) || id != SZ_ID_FOLDER ) return -1;
+    if ( read_count(r, &s->nfolders) || read_byte(r, &external) || external ) return -1;
+    if ( (s->folders = calloc(s->nfolders + 1, sizeof(struct sz_folder))) == NULL ) return -1;
+    for ( uint64_t i = 0; i < s->nfolders; ++i ) {
+        if ( (excode = parse_folder(r, &s->folders[i])) ) return excode;
+        s->folders[i].packidx = packidx++;
+        s->folders[i].nsub = 1;
+    }
+    if ( packidx > s->npack ) return -1;
+    if ( read_number(r, &id) || id != SZ_ID_CODERSUNPACKSIZE ) return -1;
+    for ( uint64_t i = 0; i < s->nfolders; ++i ) {
+        for ( uint64_t j = 0; j < s->folders[i].ncoders; ++j ) {
+            if ( read_number(r, &s->folders[i].unpack[j]) ) return -1;
+        }
+    }
+    for (;;) {
+        if ( read_number(r, &id) ) return -1;
+        if ( id == SZ_ID_END ) break;
+        if ( id == SZ_ID_CRC ) {
+            bool        *defined = calloc(s->nfolders + 1, sizeof(bool));
+            uint32_t    *crcs = calloc(s->nfolders + 1, sizeof(uint32_t));
+            excode = ( defined && crcs ) ? read_digests(r, s->nfolders, defined, crcs) : -1;
+            for ( uint64_t i = 0; !excode && i < s->nfolders; ++i ) {
+                s->folders[i].has_crc = defined[i];
+                s->folders[i].crc = crcs[i];
+            }
+            free(defined);
+            free(crcs);
+            if ( excode ) return -1;
+        } else if ( skip_data(r) ) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+    Allocate the substream arrays, and assign the defaults of one
+    substream per folder, which carries the folder's size and CRC.
+
+    @return     0 on success, otherwise -1.
+*/
+static int alloc_substreams(struct sz_streams *s) {
+
+    s->nsub = 0;
+    for ( uint64_t i = 0; i < s->nfolders; ++i ) {
+        s->nsub += s->folders[i].nsub;
+        if ( s->nsub > SZ_MAX_ENTRIES ) return -1;
+    }
+    free(s->subsizes);
+    free(s->subcrcs);
+    free(s->subhascrc);
+    s->subsizes = calloc(s->nsub + 1, sizeof(uint64_t));
+    s->subcrcs = calloc(s->nsub + 1, sizeof(uint32_t));
+    s->subhascrc = calloc(s->nsub + 1, sizeof(bool));
+    if ( s->subsizes == NULL || s->subcrcs == NULL || s->subhascrc == NULL ) return -1;
+    for ( uint64_t i = 0, k = 0; i < s->nfolders; ++i ) {
+        struct sz_folder *f = &s->folders[i];
+        if ( f->nsub == 1 ) {
+            s->subsizes[k] = f->unpack[f->mainout];
+            s->subhascrc[k] = f->has_crc;
+            s->subcrcs[k] = f->crc;
+        }
+        k += f->nsub;
+    }
+    return 0;
+}
+
+/**
+    Parse a SubStreamsInfo block.
+
+    @return     0 on success, otherwise -1.
+*/
+static int parse_substreams(struct sz_reader *r, struct sz_streams *s) {
+
+    uint64_t    id;
+    uint64_t    k;
+    uint64_t    ndigests = 0;
+    uint64_t    sum;
+
+    if ( read_number(r, &id) ) return -1;
+    if ( id == SZ_ID_NUMUNPACKSTREAM ) {
+        for ( uint64_t i = 0; i < s->nfolders; ++i ) {
+            if ( read_count(r, &s->folders[i].nsub) ) return -1;
+        }
+        if ( read_number(r, &id) ) return -1;
+    }
+    if ( alloc_substreams(s) ) return -1;
+    k = 0;
+    for ( uint64_t i = 0; i < s->nfolders; ++i ) {
+        struct sz_folder *f = &s->folders[i];
+        if ( f->nsub == 0 ) continue;
+        sum = 0;
+        if ( id == SZ_ID_SIZE ) {
+            for ( uint64_t j = 1; j < f->nsub; ++j ) {
+                if ( read_number(r, &s->subsizes[k]) ) return -1;
+                sum += s->subsizes[k++];
+            }
+        } else if ( f->nsub > 1 ) {
+            return -1;
+        }
+        if ( sum > f->unpack[f->mainout] ) return -1;
+        s->subsizes[k++] = f->unpack[f->mainout] - sum;
+        if ( !(f->nsub == 1 && f->has_crc) ) ndigests += f->nsub;
+    }
+    if ( id == SZ_ID_SIZE && read_number(r, &id) ) return -1;
+    for (;;) {
+        if ( id == SZ_ID_END ) break;
+        if ( id == SZ_ID_CRC ) {
+            bool        *defined = calloc(ndigests + 1, sizeof(bool));
+            uint32_t    *crcs = calloc(ndigests + 1, sizeof(uint32_t));
+            int         excode = ( defined && crcs ) ? read_digests(r, ndigests, defined, crcs) : -1;
+            // Assign the digests to all substreams not covered by a folder CRC.
+            for ( uint64_t i = 0, d = 0, n = 0; !excode && i < s->nfolders; ++i ) {
+                struct sz_folder *f = &s->folders[i];
+                if ( f->nsub == 1 && f->has_crc ) {
+                    ++n;
+                    continue;
+                }
+                for ( uint64_t j = 0; j < f->nsub; ++j, ++n, ++d ) {
+                    s->subhascrc[n] = defined[d];
+                    s->subcrcs[n] = crcs[d];
+                }
+            }
+            free(defined);
+            free(crcs);
+            if ( excode ) return -1;
+        } else if ( skip_data(r) ) {
+            return -1;
+        }
+        if ( read_number(r, &id) ) return -1;
+    }
+    return 0;
+}
+
+/**
+    Parse a StreamsInfo block.
+
+    @return     0 on success, -1 if the block is corrupt, or -2 if the
+                block uses unsupported coders.
+*/
+static int parse_streams(struct sz_reader *r, struct sz_streams *s) {
+
+    bool        has_sub = false;
+    int         excode;
+    uint64_t    id;
+
+    for (;;) {
+        if ( read_number(r, &id) ) return -1;
+        if ( id == SZ_ID_END ) break;
+        switch ( id ) {
+            case SZ_ID_PACKINFO:
+                if ( parse_packinfo(r, s) ) return -1;
+                break;
+            case SZ_ID_UNPACKINFO:
+                if ( (excode = parse_unpackinfo(r, s)) ) return excode;
+                break;
+            case SZ_ID_SUBSTREAMSINFO:
+                if ( parse_substreams(r, s) ) return -1;
+                has_sub = true;
+                break;
+            default:
+                return -1;
+        }
+    }
+    if ( !has_sub && alloc_substreams(s) ) return -1;
+    return 0;
+}
+
+/**
+    Convert a UTF-16LE string of n code units into a new UTF-8 string.
+
+    @return     Pointer to the new string (allocated from the arena), or
+                NULL on error.
+*/
+static char *utf16_to_utf8(struct arena *arena, const unsigned char *src, size_t n) {
+
+    char        *dst;
+    char        *p;
+    uint32_t    cp;
+    uint32_t    lo;
+
+    if ( (dst = arena_alloc(arena, n * 3 + 1)) == NULL ) return NULL;
+    p = dst;
+    for ( size_t i = 0; i < n; ++i ) {
+        cp = src[i*2] | (src[i*2+1] << 8);
+        if ( cp >= 0xd800 && cp < 0xdc00 && i + 1 < n ) {
+            lo = src[(i+1)*2] | (src[(i+1)*2+1] << 8);
+            if ( lo >= 0xdc00 && lo < 0xe000 ) {
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                ++i;
+            }
+        }
+        if ( cp < 0x80 ) {
+            *p++ = cp;
+        } else if ( cp < 0x800 ) {
+            *p++ = 0xc0 | (cp >> 6);
+            *p++ = 0x80 | (cp & 0x3f);
+        } else if ( cp < 0x10000 ) {
+            *p++ = 0xe0 | (cp >> 12);
+            *p++ = 0x80 | ((cp >> 6) & 0x3f);
+            *p++ = 0x80 | (cp & 0x3f);
+        } else {
+            *p++ = 0xf0 | (cp >> 18);
+            *p++ = 0x80 | ((cp >> 12) & 0x3f);
+            *p++ = 0x80 | ((cp >> 6) & 0x3f);
+            *p++ = 0x80 | (cp & 0x3f);
+        }
+    }
+    *p = '\0';
+    return dst;
+}
+
+/**
+    Parse the entry names (kName property) into the archive's files.
+
+    Only the base name of each entry is retained, as the archive is
+    extracted flat (as with '7z e'). The names are allocated from the
+    archive's arena.
+
+    @return     0 on success, otherwise -1.
+*/
+static int parse_names(struct sz_reader *r, struct sz_archive *arc) {
+
+    char            *base;
+    char            *name;
+    unsigned char   external;
+    size_t          n;
+
+    if ( read_byte(r, &external) || external ) return -1;
+    if ( arc->names == NULL && (arc->names = arena_create()) == NULL ) return -1;
+    for ( uint64_t i = 0; i < arc->nfiles; ++i ) {
+        for ( n = 0; ; ++n ) {
+            if ( r->size - r->pos < (n + 1) * 2 ) return -1;
+            if ( r->p[r->pos + n*2] == 0 && r->p[r->pos + n*2 + 1] == 0 ) break;
+        }
+        if ( (name = utf16_to_utf8(arc->names, r->p + r->pos, n)) == NULL ) return -1;
+        r->pos += (n + 1) * 2;
+        for ( char *c = name; *c; ++c ) {
+            if ( *c == '\\' ) *c = '/';
+        }
+        base = strrchr(name, '/');
+        base = ( base ) ? base + 1 : name;
+        arc->files[i].name = base;
+    }
+    return 0;
+}
+
+/**
+    Parse a FilesInfo block.
+
+    @return     0 on success, otherwise -1.
+*/
+static int parse_files(struct sz_reader *r, struct sz_archive *arc) {
+
+    bool                *defined = NULL;
+    bool                *emptyfile = NULL;
+    bool                *emptystream = NULL;
+    int                 excode = -1;
+    unsigned char       external;
+    uint64_t            id;
+    uint64_t            nempty = 0;
+    uint64_t            size;
+    uint64_t            value;
+    struct sz_reader    sub;
+
+    if ( read_count(r, &arc->nfiles) ) return -1;
+    if ( (arc->files = calloc(arc->nfiles + 1, sizeof(struct archive_entry))) == NULL ) return -1;
+    emptystream = calloc(arc->nfiles + 1, sizeof(bool));
+    emptyfile = calloc(arc->nfiles + 1, sizeof(bool));
+    defined = calloc(arc->nfiles + 1, sizeof(bool));
+    if ( emptystream == NULL || emptyfile == NULL || defined == NULL ) goto done;
+    for (;;) {
+        if ( read_number(r, &id) ) goto done;
+        if ( id == SZ_ID_END ) break;
+        if ( read_number(r, &size) || size > r->size - r->pos ) goto done;
+        sub.p = r->p + r->pos;
+        sub.size = size;
+        sub.pos = 0;
+        r->pos += size;
+        switch ( id ) {
+            case SZ_ID_EMPTYSTREAM:
+                if ( read_bits(&sub, arc->nfiles, emptystream) ) goto done;
+                nempty = 0;
+                for ( uint64_t i = 0; i < arc->nfiles; ++i ) nempty += emptystream[i];
+                break;
+            case SZ_ID_EMPTYFILE:
+                if ( read_bits(&sub, nempty, emptyfile) ) goto done;
+                break;
+            case SZ_ID_NAME:
+                if ( parse_names(&sub, arc) ) goto done;
+                break;
+            case SZ_ID_MTIME:
+                if ( read_defined(&sub, arc->nfiles, defined) || read_byte(&sub, &external) || external ) goto done;
+                for ( uint64_t i = 0; i < arc->nfiles; ++i ) {
+                    if ( !defined[i] ) continue;
+                    if ( read_uint(&sub, 8, &arc->files[i].mtime) ) goto done;
+                    arc->files[i].has_mtime = true;
+                }
+                break;
+            case SZ_ID_WINATTRIB:
+                if ( read_defined(&sub, arc->nfiles, defined) || read_byte(&sub, &external) || external ) goto done;
+                for ( uint64_t i = 0; i < arc->nfiles; ++i ) {
+                    if ( !defined[i] ) continue;
+                    if ( read_uint(&sub, 4, &value) ) goto done;
+                    arc->files[i].is_dir = (value & SZ_ATTRIB_DIR) != 0;
+                }
+                break;
+            default:
+                // Other properties (times, dummy padding, etc.) are not used.
+                break;
+        }
+    }
+    // Derive the stream and directory flags.
+    for ( uint64_t i = 0, e = 0; i < arc->nfiles; ++i ) {
+        if ( arc->files[i].name == NULL ) goto done;
+        arc->files[i].has_stream = !emptystream[i];
+        if ( emptystream[i] ) {
+            if ( !emptyfile[e++] ) arc->files[i].is_dir = true;
+        }
+    }
+    excode = 0;
+done:
+    free(emptystream);
+    free(emptyfile);
+    free(defined);
+    return excode;
+}
+
+/**
+    Parse a (decoded) Header block.
+
+    @return     0 on success, -1 if the block is corrupt, or -2 if the
+                block uses unsupported coders.
+*/
+static int parse_header(struct sz_reader *r, struct sz_archive *arc) {
+
+    int         excode;
+    uint64_t    id;
+
+    if ( read_number(r, &id) ) return -1;
+    if ( id == SZ_ID_ARCHIVEPROPS ) {
+        for (;;) {
+            if ( read_number(r, &id) ) return -1;
+            if ( id == SZ_ID_END ) break;
+            if ( skip_data(r) ) return -1;
+        }
+        if ( read_number(r, &id) ) return -1;
+    }
+    if ( id == SZ_ID_ADDSTREAMSINFO ) return -2;
+    if ( id == SZ_ID_MAINSTREAMSINFO ) {
+        if ( (excode = parse_streams(r, &arc->streams)) ) return excode;
+        if ( read_number(r, &id) ) return -1;
+    }
+    if ( id == SZ_ID_FILESINFO ) {
+        if ( parse_files(r, arc) ) return -1;
+        if ( read_number(r, &id) ) return -1;
+    }
+    return ( id == SZ_ID_END ) ? 0 : -1;
+}
+
+/**
+    Release the memory held by a streams structure.
+*/
+static void free_streams(struct sz_streams *s) {
+    free(s->packsizes);
+    free(s->folders);
+    free(s->subsizes);
+    free(s->subcrcs);
+    free(s->subhascrc);
+    memset(s, 0, sizeof(*s));
+}
+
+/* ----------------------------------------------------------------------
+    Decoding.
+   ---------------------------------------------------------------------- */
+
+/**
+    Read exactly size bytes from the archive at the given offset.
+
+    @return     0 on success, otherwise -1.
+*/
+static int read_at(struct sz_archive *arc, unsigned char *buff, size_t size, uint64_t offset) {
+
+    ssize_t n;
+
+    while ( size ) {
+        if ( (n = pread(arc->fd, buff, size, offset)) <= 0 ) {
+            if ( n < 0 && errno == EINTR ) continue;
+            return -1;
+        }
+        buff += n;
+        size -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+/**
+    Derive the AES-256 key from the password, per 7zAES.
+
+    The key is the SHA-256 digest of (salt + UTF-16LE password + 64-bit
+    counter), iterated for 2^cycles rounds. The derived key is cached on
+    the archive, as it is shared by all folders using the same salt.
+
+    @return     0 on success, otherwise -1.
+*/
+static int derive_key(struct sz_archive *arc, int cycles, const unsigned char *salt, size_t saltsz) {
+
+    int             excode = 0;
+    size_t          pwlen = strlen(arc->password);
+    size_t          blocksz = saltsz + pwlen * 2 + 8;
+    uint64_t        nrounds = (uint64_t)1 << cycles;
+    uint64_t        nbatch;
+    unsigned char   *batch;
+    unsigned char   *block;
+    unsigned char   *ctr;
+    struct hash     h;
+
+    if ( arc->has_key && arc->key_cycles == cycles && arc->key_saltsz == saltsz
+         && !memcmp(arc->key_salt, salt, saltsz) ) {
+        return 0;
+    }
+    memset(arc->key, 0, sizeof(arc->key));
+    if ( cycles == 0x3f ) {
+        // No hashing; the key is the salt followed by the password.
+        for ( size_t i = 0; i < saltsz && i < 32; ++i ) arc->key[i] = salt[i];
+        for ( size_t i = 0; i < pwlen * 2 && saltsz + i < 32; ++i ) {
+            arc->key[saltsz + i] = ( i % 2 ) ? 0 : arc->password[i / 2];
+        }
+    } else {
+        /* The rounds are hashed in batches of consecutive blocks, as a
+           single update per round (of ~150 bytes) is dominated by the call
+           overhead, rather than the hashing itself. */
+        nbatch = ( nrounds < SZ_KEY_BATCH ) ? nrounds : SZ_KEY_BATCH;
+        if ( (batch = calloc(nbatch, blocksz)) == NULL ) return -1;
+        memcpy(batch, salt, saltsz);
+        for ( size_t i = 0; i < pwlen; ++i ) batch[saltsz + i*2] = arc->password[i];
+        for ( uint64_t i = 1; i < nbatch; ++i ) memcpy(batch + i * blocksz, batch, blocksz);
+        if ( hash_init(&h) ) excode = -1;
+        for ( uint64_t round = 0; round < nrounds && !excode; round += nbatch ) {
+            for ( uint64_t i = 0; i < nbatch; ++i ) {
+                // Set the little-endian round counter.
+                block = batch + i * blocksz;
+                ctr = block + saltsz + pwlen * 2;
+                for ( int j = 0; j < 8; ++j ) ctr[j] = (unsigned char)((round + i) >> (8 * j));
+            }
+            if ( hash_update(&h, batch, nbatch * blocksz) ) excode = -1;
+        }
+        if ( !excode && hash_final(&h, arc->key) ) excode = -1;
+        hash_free(&h);
+        free(batch);
+        if ( excode ) return -1;
+    }
+    arc->has_key = true;
+    arc->key_cycles = cycles;
+    arc->key_saltsz = saltsz;
+    memcpy(arc->key_salt, salt, saltsz);
+    return 0;
+}
+
+/**
+    Initialise the AES-256-CBC decryption context from the coder's
+    properties.
+
+    @return     0 on success, otherwise -1.
+*/
+static int init_aes(struct sz_archive *arc, const struct sz_coder *c, EVP_CIPHER_CTX *ctx) {
+
+    int             cycles;
+    size_t          saltsz = 0;
+    size_t          ivsz = 0;
+    unsigned char   iv[16] = {0};
+
+    if ( arc->password == NULL ) {
+        reporterror("The archive is encrypted, but no password was provided.", false, false);
+        return -1;
+    }
+    if ( c->propsz < 1 ) return -1;
+    cycles = c->props[0] & 0x3f;
+    if ( c->props[0] & 0xc0 ) {
+        if ( c->propsz < 2 ) return -1;
+        saltsz = ((c->props[0] >> 7) & 1) + (c->props[1] >> 4);
+        ivsz = ((c->props[0] >> 6) & 1) + (c->props[1] & 0x0f);
+        if ( c->propsz != 2 + saltsz + ivsz ) return -1;
+        memcpy(iv, c->props + 2 + saltsz, ivsz);
+    }
+    if ( cycles > 24 && cycles != 0x3f ) return -1;
+    if ( derive_key(arc, cycles, c->props + 2, saltsz) ) return -1;
+    if ( EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, arc->key, iv) != 1 ) return -1;
+    EVP_CIPHER_CTX_set_padding(ctx, 0);
+    return 0;
+}
+
+/**
+    Map a 7z coder onto a liblzma filter.
+
+    @return     0 on success, otherwise -1 for an unsupported coder.
+*/
+static int init_filter(const struct sz_coder *c, lzma_filter *filter) {
+
+    switch ( c->method ) {
+        case SZ_M_LZMA:  filter->id = LZMA_FILTER_LZMA1; break;
+        case SZ_M_LZMA2: filter->id = LZMA_FILTER_LZMA2; break;
+        case SZ_M_DELTA: filter->id = LZMA_FILTER_DELTA; break;
+        case SZ_M_BCJ:   filter->id = LZMA_FILTER_X86; break;
+        case SZ_M_PPC:   filter->id = LZMA_FILTER_POWERPC; break;
+        case SZ_M_IA64:  filter->id = LZMA_FILTER_IA64; break;
+        case SZ_M_ARM:   filter->id = LZMA_FILTER_ARM; break;
+        case SZ_M_ARMT:  filter->id = LZMA_FILTER_ARMTHUMB; break;
+        case SZ_M_SPARC: filter->id = LZMA_FILTER_SPARC; break;
+    #ifdef LZMA_FILTER_ARM64
+        case SZ_M_ARM64: filter->id = LZMA_FILTER_ARM64; break;
+    #endif
+        default: return -1;
+    }
+    filter->options = NULL;
+    return ( lzma_properties_decode(filter, NULL, c->props, c->propsz) == LZMA_OK ) ? 0 : -1;
+}
+
+/**
+    Decode a single folder, passing the decoded data to the output
+    callback.
+
+    The folder's coders are resolved into a linear chain, from the pack
+    stream to the output: an optional AES decryption stage, followed by
+    an optional liblzma raw decoder chain. The folder's CRC (if
+    present) is verified over the decoded output.
+
+    @return     0 on success, -1 if decoding failed, -2 if the folder
+                uses an unsupported coder, or the non-zero value returned
+                by the output callback.
+*/
+static int decode_folder(struct sz_archive *arc, const struct sz_streams *s, uint64_t fidx,
+                         sz_output output, void *ctx) {
+
+    const struct sz_folder  *f = &s->folders[fidx];
+    const unsigned char     *mid = NULL;
+    bool                    has_aes = false;
+    int                     excode = -1;
+    int                     nfilters = 0;
+    int                     outl;
+    size_t                  chunk;
+    size_t                  consumed;
+    size_t                  midsz = 0;
+    size_t                  buffsz = config_get()->read_buffsz;
+    size_t                  produced;
+    uint32_t                crc = 0;
+    uint64_t                aes_left = 0;
+    uint64_t                chain[SZ_MAX_CODERS];
+    uint64_t                cur;
+    uint64_t                nchain = 0;
+    uint64_t                offset;
+    uint64_t                out_left;
+    uint64_t                pack_left;
+    unsigned char           *inbuf = NULL;
+    unsigned char           *aesbuf = NULL;
+    unsigned char           *outbuf = NULL;
+    EVP_CIPHER_CTX          *aes = NULL;
+    lzma_filter             filters[LZMA_FILTERS_MAX + 1];
+    lzma_ret                ret;
+    lzma_stream             strm = LZMA_STREAM_INIT;
+
+    // Resolve the coder chain; from the output back to the pack stream.
+    cur = f->mainout;
+    for (;;) {
+        chain[nchain++] = cur;
+        uint64_t next = f->ncoders;
+        for ( uint64_t i = 0; i < f->nbonds; ++i ) {
+            if ( f->bond_in[i] == cur ) next = f->bond_out[i];
+        }
+        if ( next == f->ncoders ) break;
+        if ( nchain == f->ncoders ) return -1;  // Cyclic bindings.
+        cur = next;
+    }
+    if ( nchain != f->ncoders ) return -1;
+    // Build the stages. AES can only be the first stage (at the pack stream).
+    for ( uint64_t i = 0; i < nchain; ++i ) {
+        const struct sz_coder *c = &f->coders[chain[i]];
+        if ( c->method == SZ_M_AES && i == nchain - 1 ) {
+            has_aes = true;
+            aes_left = f->unpack[chain[i]];
+        } else if ( c->method == SZ_M_AES || c->method == SZ_M_BCJ2 || nfilters == LZMA_FILTERS_MAX ) {
+            excode = -2;
+            goto cleanup_filters;
+        } else if ( c->method != SZ_M_COPY ) {
+            if ( init_filter(c, &filters[nfilters]) ) {
+                excode = -2;
+                goto cleanup_filters;
+            }
+            ++nfilters;
+        }
+    }
+    filters[nfilters].id = LZMA_VLI_UNKNOWN;
+    inbuf = malloc(buffsz);
+    aesbuf = malloc(buffsz);
+    outbuf = malloc(buffsz);
+    if ( inbuf == NULL || aesbuf == NULL || outbuf == NULL ) goto cleanup;
+    if ( has_aes ) {
+        if ( (aes = EVP_CIPHER_CTX_new()) == NULL ) goto cleanup;
+        const struct sz_coder *c = &f->coders[chain[nchain-1]];
+        if ( init_aes(arc, c, aes) ) goto cleanup;
+    }
+    if ( nfilters && lzma_raw_decoder(&strm, filters) != LZMA_OK ) {
+        excode = -2;
+        goto cleanup;
+    }
+    // Locate the folder's pack stream.
+    offset = SZ_SIGSZ + s->packpos;
+    for ( uint64_t i = 0; i < f->packidx; ++i ) offset += s->packsizes[i];
+    pack_left = s->packsizes[f->packidx];
+    out_left = f->unpack[f->mainout];
+    if ( offset > arc->fsize || pack_left > arc->fsize - offset ) goto cleanup;
+    posix_fadvise(arc->fd, offset, pack_left, POSIX_FADV_SEQUENTIAL);
+    while ( out_left ) {
+        // Refill the intermediate (decrypted) buffer.
+        if ( midsz == 0 && pack_left ) {
+            chunk = ( pack_left < buffsz ) ? pack_left : buffsz;
+            if ( read_at(arc, inbuf, chunk, offset) ) goto cleanup;
+            offset += chunk;
+            pack_left -= chunk;
+            if ( has_aes ) {
+                if ( chunk % 16 ) goto cleanup;
+                if ( EVP_DecryptUpdate(aes, aesbuf, &outl, inbuf, chunk) != 1 ) goto cleanup;
+                // Drop the block padding beyond the AES stage's unpack size.
+                midsz = ( (uint64_t)outl < aes_left ) ? (size_t)outl : aes_left;
+                aes_left -= midsz;
+                mid = aesbuf;
+            } else {
+                midsz = chunk;
+                mid = inbuf;
+            }
+        }
+        if ( nfilters ) {
+            strm.next_in = mid;
+            strm.avail_in = midsz;
+            strm.next_out = outbuf;
+            strm.avail_out = ( out_left < buffsz ) ? out_left : buffsz;
+            ret = lzma_code(&strm, LZMA_RUN);
+            consumed = midsz - strm.avail_in;
+            produced = strm.next_out - outbuf;
+            mid += consumed;
+            midsz -= consumed;
+            if ( ret != LZMA_OK && ret != LZMA_STREAM_END ) goto cleanup;
+            if ( ret == LZMA_STREAM_END && produced < out_left ) goto cleanup;
+            if ( !consumed && !produced && !midsz && !pack_left ) goto cleanup;  // Truncated.
+            if ( produced ) {
+                crc = lzma_crc32(outbuf, produced, crc);
+                if ( (excode = output(ctx, outbuf, produced)) ) goto cleanup;
+                excode = -1;
+            }
+            out_left -= produced;
+        } else {
+            if ( !midsz ) goto cleanup;  // Truncated.
+            produced = ( midsz < out_left ) ? midsz : out_left;
+            crc = lzma_crc32(mid, produced, crc);
+            if ( (excode = output(ctx, mid, produced)) ) goto cleanup;
+            excode = -1;
+            mid += produced;
+            midsz -= produced;
+            out_left -= produced;
+        }
+    }
+    excode = ( f->has_crc && crc != f->crc ) ? -1 : 0;
+cleanup:
+    lzma_end(&strm);
+    EVP_CIPHER_CTX_free(aes);
+    free(inbuf);
+    free(aesbuf);
+    free(outbuf);
+cleanup_filters:
+    for ( int i = 0; i < nfilters; ++i ) free(filters[i].options);
+    return excode;
+}
+
+// In-memory output buffer, used to decode an encoded header.
+struct sz_membuf {
+    unsigned char   *data;
+    size_t          size;
+    size_t          capacity;
+};
+
+/**
+    Output callback used to decode an encoded header into memory.
+
+    @return     0 on success, otherwise -1 if the buffer would overflow.
+*/
+static int output_membuf(void *ctx, const unsigned char *buff, size_t size) {
+
+    struct sz_membuf *m = ctx;
+
+    if ( size > m->capacity - m->size ) return -1;
+    memcpy(m->data + m->size, buff, size);
+    m->size += size;
+    return 0;
+}
+
+/**
+    Dispatcher state, used to split a folder's decoded output into its
+    entries (substreams) for the sink.
+*/
+struct sz_dispatch {
+    struct sz_archive           *arc;
+    const struct archive_sink   *sink;
+    uint64_t                    *streamfile;    // File index for each substream.
+    uint64_t                    sub;            // Current substream index.
+    uint64_t                    sub_end;        // End substream index (exclusive) of the folder.
+    uint64_t                    left;           // Bytes remaining in the current substream.
+    uint32_t                    crc;            // Running CRC of the current substream.
+    bool                        is_open;
+};
+
+/**
+    Return the entry for a substream, with its size and CRC assigned.
+*/
+static struct archive_entry *dispatch_entry(struct sz_dispatch *d, uint64_t sub) {
+
+    struct archive_entry    *e = &d->arc->files[d->streamfile[sub]];
+
+    e->size = d->arc->streams.subsizes[sub];
+    e->has_crc = d->arc->streams.subhascrc[sub];
+    e->crc = d->arc->streams.subcrcs[sub];
+    return e;
+}
+
+/**
+    Skip the current folder, if the sink does not need any of its
+    entries. Each skipped entry is passed to the sink's open and close
+    callbacks, without data.
+
+    @return     0 if the folder was skipped, -1 if the folder must be
+                decoded, otherwise 1 if aborted by the sink.
+*/
+static int dispatch_skip(struct sz_dispatch *d) {
+
+    struct archive_entry    *e;
+
+    if ( d->sink->skip == NULL ) return -1;
+    for ( uint64_t i = d->sub; i < d->sub_end; ++i ) {
+        if ( !d->sink->skip(d->sink->ctx, dispatch_entry(d, i)) ) return -1;
+    }
+    for ( ; d->sub < d->sub_end; ++d->sub ) {
+        e = dispatch_entry(d, d->sub);
+        e->skipped = true;
+        if ( d->sink->open(d->sink->ctx, e) || d->sink->close(d->sink->ctx, e, true) ) return 1;
+    }
+    return 0;
+}
+
+/**
+    Open the current substream's entry, closing all empty substreams
+    along the way.
+
+    @return     0 on success, otherwise 1 if aborted by the sink.
+*/
+static int dispatch_open(struct sz_dispatch *d) {
+
+    struct archive_entry    *e;
+
+    while ( !d->is_open && d->sub < d->sub_end ) {
+        e = dispatch_entry(d, d->sub);
+        if ( d->sink->open(d->sink->ctx, e) ) return 1;
+        d->left = e->size;
+        d->crc = 0;
+        d->is_open = true;
+        if ( d->left == 0 ) {
+            d->is_open = false;
+            ++d->sub;
+            if ( d->sink->close(d->sink->ctx, e, !e->has_crc || e->crc == 0) ) return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+    Output callback used to split a folder's output into its entries.
+
+    @return     0 on success, -1 if the data overruns the folder's
+                substreams, otherwise 1 if aborted by the sink.
+*/
+static int output_dispatch(void *ctx, const unsigned char *buff, size_t size) {
+
+    int                     excode;
+    size_t                  n;
+    struct sz_dispatch      *d = ctx;
+    struct archive_entry    *e;
+
+    while ( size ) {
+        if ( (excode = dispatch_open(d)) ) return excode;
+        if ( !d->is_open ) return -1;  // More data than substreams.
+        e = &d->arc->files[d->streamfile[d->sub]];
+        n = ( size < d->left ) ? size : d->left;
+        d->crc = lzma_crc32(buff, n, d->crc);
+        if ( d->sink->write(d->sink->ctx, buff, n) ) return 1;
+        buff += n;
+        size -= n;
+        d->left -= n;
+        if ( d->left == 0 ) {
+            d->is_open = false;
+            ++d->sub;
+            if ( d->sink->close(d->sink->ctx, e, !e->has_crc || d->crc == e->crc) ) return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+    Read the archive's signature header and (possibly encoded) header.
+
+    @return     0 on success, otherwise -1 (with the error reported).
+*/
+static int read_headers(struct sz_archive *arc) {
+
+    int                 excode;
+    uint64_t            id;
+    uint64_t            nextcrc;
+    uint64_t            nextoff;
+    uint64_t            nextsz;
+    uint64_t            startcrc;
+    unsigned char       sig[SZ_SIGSZ];
+    struct sz_membuf    mem;
+    struct sz_reader    r;
+    struct sz_streams   enc;
+
+    r.p = sig;
+    r.size = SZ_SIGSZ;
+    r.pos = 8;
+    if ( arc->fsize < SZ_SIGSZ || read_at(arc, sig, SZ_SIGSZ, 0) || memcmp(sig, _SZ_SIGNATURE, 6) ) {
+        reporterror("The file is not a 7z archive.", false, false);
+        return -1;
+    }
+    read_uint(&r, 4, &startcrc);
+    read_uint(&r, 8, &nextoff);
+    read_uint(&r, 8, &nextsz);
+    read_uint(&r, 4, &nextcrc);
+    if ( lzma_crc32(sig + 12, 20, 0) != startcrc ) {
+        reporterror("The archive's start header is corrupt.", false, false);
+        return -1;
+    }
+    if ( nextsz == 0 ) return 0;  // Empty archive.
+    if ( nextsz > SZ_MAX_HEADER || nextoff > arc->fsize - SZ_SIGSZ
+         || nextsz > arc->fsize - SZ_SIGSZ - nextoff ) {
+        reporterror("The archive is truncated.", false, false);
+        return -1;
+    }
+    if ( (arc->header = malloc(nextsz)) == NULL ) return -1;
+    if ( read_at(arc, arc->header, nextsz, SZ_SIGSZ + nextoff) || lzma_crc32(arc->header, nextsz, 0) != nextcrc ) {
+        reporterror("The archive's header is corrupt.", false, false);
+        return -1;
+    }
+    for (;;) {
+        r.p = arc->header;
+        r.size = nextsz;
+        r.pos = 0;
+        if ( read_number(&r, &id) ) goto corrupt;
+        if ( id == SZ_ID_HEADER ) break;
+        if ( id != SZ_ID_ENCODEDHEADER ) goto corrupt;
+        // The header is packed (and likely encrypted); decode it into memory.
+        memset(&enc, 0, sizeof(enc));
+        if ( (excode = parse_streams(&r, &enc)) || enc.nfolders == 0 ) {
+            free_streams(&enc);
+            if ( excode == -2 ) goto unsupported;
+            goto corrupt;
+        }
+        mem.size = 0;
+        mem.capacity = 0;
+        for ( uint64_t i = 0; i < enc.nfolders; ++i ) {
+            mem.capacity += enc.folders[i].unpack[enc.folders[i].mainout];
+        }
+        if ( mem.capacity > SZ_MAX_HEADER || (mem.data = malloc(mem.capacity + 1)) == NULL ) {
+            free_streams(&enc);
+            goto corrupt;
+        }
+        excode = 0;
+        for ( uint64_t i = 0; i < enc.nfolders && !excode; ++i ) {
+            excode = decode_folder(arc, &enc, i, output_membuf, &mem);
+        }
+        free_streams(&enc);
+        free(arc->header);
+        arc->header = mem.data;
+        nextsz = mem.size;
+        if ( excode == -2 ) goto unsupported;
+        if ( excode ) {
+            reporterror("The archive's header cannot be decoded. Is the password correct?", false, false);
+            return -1;
+        }
+    }
+    if ( (excode = parse_header(&r, arc)) == 0 ) return 0;
+    if ( excode == -2 ) goto unsupported;
+corrupt:
+    reporterror("The archive's header is corrupt.", false, false);
+    return -1;
+unsupported:
+    reporterror("The archive uses an unsupported compression method.", false, false);
+    return -1;
+}
+
+/**
+    Decrypt and decode a (7z) archive in a single pass, passing each
+    entry to the sink as it is decoded.
+
+    Supported coders are AES-256 + SHA-256 (7zAES), LZMA, LZMA2, Copy,
+    Delta and the BCJ branch converters. Encrypted headers (-mhe=on) are
+    supported. The CRC of each entry is verified as it is decoded.
+
+    @param[in]  fpath       Explicit path to the .7z file to be extracted.
+    @param[in]  password    Password used for decryption (ASCII), or NULL
+                            if the archive is not encrypted.
+    @param[in]  sink        Callbacks which receive the decoded entries.
+
+    @return                 0 if the archive was read, verified and passed
+                            to the sink successfully, otherwise 1.
+*/
+int archive_extract(const char *fpath, const char *password, const struct archive_sink *sink) {
+
+    char                msgbuff[PATH_MAX + 64];
+    int                 excode = EXIT_FAILURE;
+    int                 ex;
+    uint64_t            nstreams = 0;
+    struct stat         st;
+    struct sz_archive   arc;
+    struct sz_dispatch  d;
+
+    memset(&arc, 0, sizeof(arc));
+    memset(&d, 0, sizeof(d));
+    arc.password = password;
+    if ( (arc.fd = open(fpath, O_RDONLY)) < 0 || fstat(arc.fd, &st) ) {
+        snprintf(msgbuff, sizeof(msgbuff), "%s: %s", strerror(errno), fpath);
+        reporterror(msgbuff, false, false);
+        goto done;
+    }
+    arc.fsize = st.st_size;
+    if ( read_headers(&arc) ) goto done;
+    // Map each substream onto its file.
+    for ( uint64_t i = 0; i < arc.nfiles; ++i ) nstreams += arc.files[i].has_stream;
+    if ( nstreams != arc.streams.nsub ) {
+        reporterror("The archive's header is corrupt.", false, false);
+        goto done;
+    }
+    if ( (d.streamfile = calloc(nstreams + 1, sizeof(uint64_t))) == NULL ) goto done;
+    for ( uint64_t i = 0, k = 0; i < arc.nfiles; ++i ) {
+        if ( arc.files[i].has_stream ) d.streamfile[k++] = i;
+    }
+    // Empty files carry no data, so are passed to the sink first.
+    for ( uint64_t i = 0; i < arc.nfiles; ++i ) {
+        struct archive_entry *e = &arc.files[i];
+        if ( e->has_stream || e->is_dir ) continue;
+        if ( sink->open(sink->ctx, e) || sink->close(sink->ctx, e, true) ) goto done;
+    }
+    // Decode each folder, dispatching its substreams to the sink.
+    d.arc = &arc;
+    d.sink = sink;
+    for ( uint64_t i = 0; i < arc.streams.nfolders; ++i ) {
+        d.sub_end = d.sub + arc.streams.folders[i].nsub;
+        d.is_open = false;
+        // Folders holding only entries which the sink does not need are not decoded.
+        if ( (ex = dispatch_skip(&d)) < 0 &&
+             (ex = decode_folder(&arc, &arc.streams, i, output_dispatch, &d)) == 0 ) {
+            ex = dispatch_open(&d);  // Flush any trailing empty substreams.
+        }
+        if ( ex == 0 && (d.is_open || d.sub != d.sub_end) ) ex = -1;
+        if ( ex == -2 ) {
+            reporterror("The archive uses an unsupported compression method.", false, false);
+            goto done;
+        } else if ( ex < 0 ) {
+            reporterror("The archive test has failed. Data error or CRC mismatch.", false, false);
+            goto done;
+        } else if ( ex > 0 ) {
+            goto done;  // Aborted by the sink.
+        }
+    }
+    excode = EXIT_SUCCESS;
+done:
+    if ( arc.fd >= 0 ) close(arc.fd);
+    arena_destroy(arc.names);
+    free(arc.files);
+    free(arc.header);
+    free(d.streamfile);
+    free_streams(&arc.streams);
+    OPENSSL_cleanse(arc.key, sizeof(arc.key));
+    return excode;
+}
+
@@ -0,0 +1,66 @@
+/**
+    Header file for the archive.c module.
+*/
+
+#ifndef _ARCHIVE_H
+#define _ARCHIVE_H
+
+/**
+    Description of a single archive entry, as passed to an archive_sink.
+*/
+struct archive_entry {
+    char        *name;          // Base filename of the entry (UTF-8).
+    uint64_t    size;           // Unpacked size, in bytes.
+    uint64_t    mtime;          // Modification time (Windows FILETIME).
+    uint32_t    crc;            // CRC32 of the unpacked data.
+    bool        has_crc;        // The archive stores a CRC for the entry.
+    bool        has_mtime;      // The archive stores a mtime for the entry.
+    bool        has_stream;     // The entry has data (i.e. not an empty file).
+    bool        is_dir;         // The entry is a directory.
+    bool        skipped;        // The entry was skipped (not decoded) at the sink's request.
+};
+
+/**
+    Set of callbacks used to receive the entries as they are decoded.
+
+    Each callback returns 0 to continue the extraction; any other value
+    aborts the extraction.
+
+    - open:     Called once at the start of each (non-directory) entry.
+    - write:    Called zero or more times with the entry's decoded data.
+    - close:    Called once the entry is complete. The crc_ok flag
+                reports the result of the entry's CRC check.
+    - skip:     Optional (may be NULL). Called before each folder is
+                decoded, for each of the folder's entries. If the sink
+                does not need any of the folder's entries, the folder is
+                not decoded; each entry is passed to open and close
+                (with no data) with the skipped flag set.
+*/
+struct archive_sink {
+    int     (*open)(void *ctx, const struct archive_entry *entry);
+    int     (*write)(void *ctx, const unsigned char *buff, size_t size);
+    int     (*close)(void *ctx, const struct archive_entry *entry, bool crc_ok);
+    bool    (*skip)(void *ctx, const struct archive_entry *entry);
+    void    *ctx;
+};
+
+/**
+    Decrypt and decode a (7z) archive in a single pass, passing each
+    entry to the sink as it is decoded.
+
+    Supported coders are AES-256 + SHA-256 (7zAES), LZMA, LZMA2, Copy,
+    Delta and the BCJ branch converters. Encrypted headers (-mhe=on) are
+    supported. The CRC of each entry is verified as it is decoded.
+
+    @param[in]  fpath       Explicit path to the .7z file to be extracted.
+    @param[in]  password    Password used for decryption (ASCII), or NULL
+                            if the archive is not encrypted.
+    @param[in]  sink        Callbacks which receive the decoded entries.
+
+    @return                 0 if the archive was read, verified and passed
+                            to the sink successfully, otherwise 1.
+*/
+int archive_extract(const char *fpath, const char *password, const struct archive_sink *sink);
+
+#endif /* _ARCHIVE_H */
+
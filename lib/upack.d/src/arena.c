@@ -0,0 +1,147 @@
+/**
+    Purpose:    This module provides a simple arena (region) allocator,
+                from which a job's per-entry allocations (e.g. the entry
+                and manifest names) are carved, so an archive of
+                thousands of files costs a handful of heap allocations,
+                which are released together once the archive is done.
+
+    Developer:  J Berendt
+    Email:      development@s3dev.uk
+
+    Comments:   Memory is carved from ARENA_BLOCKSZ blocks. A request
+                larger than a block is given a block of its own. An
+                arena is not thread safe; it is owned by a single job,
+                which is run by a single thread.
+
+    Copyright (C) 73rd Street Development
+    This file is part of the ppk project's upack program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stddef.h>
+#include "base.h"
+#include "arena.h"
+
+#define ARENA_BLOCKSZ   (64*1024)
+#define ARENA_ALIGN     _Alignof(max_align_t)
+
+/**
+    A block of arena memory; the allocations follow the header.
+*/
+struct arena_block {
+    struct arena_block  *next;
+    size_t              size;   // Usable bytes in the block.
+    size_t              used;   // Bytes allocated from the block.
+    _Alignas(max_align_t) unsigned char data[];
+};
+
+/**
+    A region from which small allocations are carved, and released
+    together.
+*/
+struct arena {
+    struct arena_block  *head;  // Most recently allocated block.
+};
+
+// Function prototypes
+void *arena_alloc(struct arena *arena, size_t size);
+struct arena *arena_create(void);
+void arena_destroy(struct arena *arena);
+char *arena_strndup(struct arena *arena, const char *s, size_t n);
+
+/**
+    Allocate memory from the arena.
+
+    The memory is aligned for any type. It is not released individually;
+    it is only released with the arena, by arena_destroy().
+
+    @param[in]  arena   Pointer to the arena.
+    @param[in]  size    Number of bytes required.
+
+    @return             Pointer to the memory, or NULL if it could not be
+                        allocated.
+*/
+void *arena_alloc(struct arena *arena, size_t size) {
+
+    size_t              blocksz;
+    struct arena_block  *b = arena->head;
+
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if ( b && b->size - b->used >= size ) {
+        b->used += size;
+        return b->data + b->used - size;
+    }
+    blocksz = ( size > ARENA_BLOCKSZ ) ? size : ARENA_BLOCKSZ;
+    if ( (b = malloc(sizeof(*b) + blocksz)) == NULL ) return NULL;
+    b->size = blocksz;
+    b->used = size;
+    // An oversize block is full, so it is linked behind the current block, which stays in use.
+    if ( size > ARENA_BLOCKSZ && arena->head ) {
+        b->next = arena->head->next;
+        arena->head->next = b;
+    } else {
+        b->next = arena->head;
+        arena->head = b;
+    }
+    return b->data;
+}
+
+/**
+    Create an (empty) arena.
+
+    @return     Pointer to the new arena, or NULL on error. The arena must
+                be released by arena_destroy().
+*/
+struct arena *arena_create(void) {
+    return calloc(1, sizeof(struct arena));
+}
+
+/**
+    Release the arena, and all memory allocated from it.
+
+    @param[in]  arena   Pointer to the arena, or NULL.
+*/
+void arena_destroy(struct arena *arena) {
+
+    struct arena_block  *next;
+
+    if ( arena == NULL ) return;
+    for ( struct arena_block *b = arena->head; b; b = next ) {
+        next = b->next;
+        free(b);
+    }
+    free(arena);
+}
+
+/**
+    Copy (up to) the first n bytes of a string into the arena.
+
+    @param[in]  arena   Pointer to the arena.
+    @param[in]  s       String to be copied.
+    @param[in]  n       Maximum number of bytes to be copied.
+
+    @return             Pointer to the (null terminated) copy, or NULL if
+                        the memory could not be allocated.
+*/
+char *arena_strndup(struct arena *arena, const char *s, size_t n) {
+
+    char    *p;
+
+    n = strnlen(s, n);
+    if ( (p = arena_alloc(arena, n + 1)) == NULL ) return NULL;
+    memcpy(p, s, n);
+    p[n] = '\0';
+    return p;
+}
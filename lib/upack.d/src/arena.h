@@ -0,0 +1,51 @@
+/**
+    Header file for the arena.c module.
+*/
+
+#ifndef _ARENA_H
+#define _ARENA_H
+
+struct arena;
+
+/**
+    Allocate memory from the arena.
+
+    The memory is aligned for any type. It is not released individually;
+    it is only released with the arena, by arena_destroy().
+
+    @param[in]  arena   Pointer to the arena.
+    @param[in]  size    Number of bytes required.
+
+    @return             Pointer to the memory, or NULL if it could not be
+                        allocated.
+*/
+void *arena_alloc(struct arena *arena, size_t size);
+
+/**
+    Create an (empty) arena.
+
+    @return     Pointer to the new arena, or NULL on error. The arena must
+                be released by arena_destroy().
+*/
+struct arena *arena_create(void);
+
+/**
+    Release the arena, and all memory allocated from it.
+
+    @param[in]  arena   Pointer to the arena, or NULL.
+*/
+void arena_destroy(struct arena *arena);
+
+/**
+    Copy (up to) the first n bytes of a string into the arena.
+
+    @param[in]  arena   Pointer to the arena.
+    @param[in]  s       String to be copied.
+    @param[in]  n       Maximum number of bytes to be copied.
+
+    @return             Pointer to the (null terminated) copy, or NULL if
+                        the memory could not be allocated.
+*/
+char *arena_strndup(struct arena *arena, const char *s, size_t n);
+
+#endif /* _ARENA_H */
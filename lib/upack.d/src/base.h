@@ -8,6 +8,20 @@
 
     v0.2.0.dev2: Updated the default production repo path to 
     /tmp/pip/repo.
+
+    v0.3.0.dev1: The archive is decrypted and decoded in-process, by the
+    archive module. Added limits.h and stdint.h to the common includes.
+    Added PATH_STAGE; archives are staged inside the repo, and committed
+    using the journal module. Added PATH_CATALOG, the content-addressed
+    index of the repo's files. Added PATH_INDEX, the repo's PEP 503
+    simple index. Added PATH_ADVISORIES, the offline advisory snapshot.
+    PATH_REPO may be set at build time (make REPO=/path), which is used by
+    the benchmark to build upack against a scratch repo. Removed
+    PATH_TMP_PPK; nothing is staged in /tmp, and the stage may be moved
+    (on the repo's file system) at runtime, with --stage. PATH_REPO is
+    now the default repo, which is set at runtime by the config module;
+    the repo's paths are derived from DIR_META, NAME_CATALOG,
+    NAME_ADVISORIES and DIR_INDEX. Added PATH_CONFIG.
 */
 
 
@@ -15,7 +29,9 @@
     #define _BASE_H
     // Include statements
     #include <errno.h>
+    #include <limits.h>
     #include <stdbool.h>
+    #include <stdint.h>
     #include <stdio.h>
     #include <stdlib.h>
     #include <string.h>
@@ -30,18 +46,30 @@
     #define ANSI_RST "\033[0m"
     // Paths
     #define PATH_TMP "/tmp/"
-    #define PATH_TMP_PPK PATH_TMP ".ppk"
-    #ifdef __DEV_MODE
+    #if defined(PATH_REPO)
+        // Build-time path; set by: $ make REPO=/path
+    #elif defined(__DEV_MODE)
         // Development paths
         #define PATH_REPO PATH_TMP "pip/repo"
     #else
         // Production paths
         #define PATH_REPO "/tmp/pip/repo"
     #endif /* __DEV_MODE */
+    // Configuration file, loaded (if present) unless --config is passed.
+    #define PATH_CONFIG "/etc/ppk/upack.conf"
+    // Hidden directory in the repo; the default stage, on the repo's file system (see --stage).
+    #define DIR_META ".ppk"
+    // Catalog of the repo's files, by digest, in DIR_META (hidden, so it cannot clash with a stage).
+    #define NAME_CATALOG ".catalog"
+    // Offline advisory snapshot in DIR_META, loaded (if present) unless --advisories is passed.
+    #define NAME_ADVISORIES ".advisories"
+    // PEP 503 simple index in the repo, updated for the changed projects (--index).
+    #define DIR_INDEX "simple"
     // Constants
+    #define DIGEST_SIZE 32  // SHA-256 digest size, in bytes.
     static const char *_APP_DESC = "PyPI library archive validation and unpacking utility.";
     static const char *_APP_LONG_NAME = "PPK: Archive Unpacker";
     static const char *_APP_NAME = "upack";
-    static const char *_VERSION = "0.2.0.dev2";
+    static const char *_VERSION = "0.3.0.dev1";
 #endif /* _BASE_H  */
 
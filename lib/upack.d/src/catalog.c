@@ -0,0 +1,466 @@
+/**
+    Purpose:    This module provides the repo's catalog; a persistent,
+                content-addressed index of the files in the pip repo,
+                used to skip archive entries which are already present.
+
+    Developer:  J Berendt
+    Email:      development@s3dev.uk
+
+    Comments:   The catalog is a text file, sorted by digest (then name),
+                in the format:
+
+                    ppk-catalog 1
+                    <sha256 hex digest> <size> <mtime (ns)> <name>
+                    ...
+
+                The catalog is a cache: a record is only trusted while
+                the repo file's size and modification time match it.
+                Therefore, a missing, stale or deleted catalog is only a
+                performance concern.
+
+    Copyright (C) 73rd Street Development
+    This file is part of the ppk project's upack program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "base.h"
+#include "catalog.h"
+#include "hash.h"
+
+#define CATALOG_MAGIC "ppk-catalog 1"
+
+/**
+    A single file recorded in the catalog.
+*/
+struct catalog_record {
+    unsigned char   sha256[DIGEST_SIZE];
+    uint64_t        size;
+    int64_t         mtime;      // Modification time, in nanoseconds since the epoch.
+    char            *name;
+};
+
+/**
+    The catalog, as held in memory.
+*/
+struct catalog {
+    char                    repo[PATH_MAX];
+    char                    fpath[PATH_MAX];
+    struct catalog_record   *recs;      // In insertion order; sorted by digest, then name, when saved.
+    size_t                  nrecs;
+    size_t                  capacity;
+    size_t                  *index;     // Hash table of record positions (plus one; 0 is empty), by name.
+    size_t                  nslots;     // Size of the index; a power of two.
+    bool                    dirty;      // Changed since loaded, or last saved.
+    pthread_mutex_t         lock;
+};
+
+// Function prototypes
+int catalog_add(struct catalog *cat, const char *name, const unsigned char *digest);
+int catalog_close(struct catalog *cat);
+bool catalog_contains(struct catalog *cat, const char *name, uint64_t size, const unsigned char *digest);
+int catalog_digest(struct catalog *cat, const char *name, unsigned char *digest);
+struct catalog *catalog_open(const char *repo, const char *fpath);
+int catalog_save(struct catalog *cat);
+
+/**
+    Compare a (digest, name) key with a record.
+*/
+static int compare_key(const unsigned char *digest, const char *name, const struct catalog_record *r) {
+
+    int c;
+
+    if ( (c = memcmp(digest, r->sha256, DIGEST_SIZE)) ) return c;
+    return strcmp(name, r->name);
+}
+
+/**
+    qsort(3) comparison callback for an array of record pointers.
+*/
+static int compare_records(const void *a, const void *b) {
+
+    const struct catalog_record *ra = *(const struct catalog_record * const *)a;
+
+    return compare_key(ra->sha256, ra->name, *(const struct catalog_record * const *)b);
+}
+
+/**
+    Hash a filename for the index (FNV-1a).
+*/
+static size_t hash_name(const char *name) {
+
+    uint64_t h = 14695981039346656037ULL;
+
+    for ( const unsigned char *c = (const unsigned char *)name; *c; ++c ) h = (h ^ *c) * 1099511628211ULL;
+    return (size_t)h;
+}
+
+/**
+    Find the index slot for a filename; either the slot holding its
+    record, or the empty slot at which it would be inserted. The index
+    must not be empty.
+*/
+static size_t *find_slot(const struct catalog *cat, const char *name) {
+
+    size_t  i = hash_name(name) & (cat->nslots - 1);
+
+    // Linear probing; records are replaced, never removed, so there are no tombstones.
+    while ( cat->index[i] && strcmp(cat->recs[cat->index[i] - 1].name, name) ) i = (i + 1) & (cat->nslots - 1);
+    return &cat->index[i];
+}
+
+/**
+    Find the record for a filename. A name has at most one record.
+
+    @return     Pointer to the record, or NULL if not found.
+*/
+static struct catalog_record *find_name(const struct catalog *cat, const char *name) {
+
+    size_t  *slot;
+
+    if ( !cat->nslots || !*(slot = find_slot(cat, name)) ) return NULL;
+    return &cat->recs[*slot - 1];
+}
+
+/**
+    Convert a file's modification time to nanoseconds since the epoch.
+*/
+static int64_t mtime_ns(const struct stat *st) {
+    return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+/**
+    Ensure the records array has room for one more record.
+
+    @return     0 on success, otherwise 1.
+*/
+static int grow_records(struct catalog *cat) {
+
+    size_t                  capacity;
+    struct catalog_record   *recs;
+
+    if ( cat->nrecs < cat->capacity ) return EXIT_SUCCESS;
+    capacity = ( cat->capacity ) ? cat->capacity * 2 : 1024;
+    if ( (recs = realloc(cat->recs, capacity * sizeof(*recs))) == NULL ) return EXIT_FAILURE;
+    cat->recs = recs;
+    cat->capacity = capacity;
+    return EXIT_SUCCESS;
+}
+
+/**
+    Ensure the index has room for one more record, at a load factor of
+    no more than one half.
+
+    @return     0 on success, otherwise 1.
+*/
+static int grow_index(struct catalog *cat) {
+
+    size_t  nslots;
+    size_t  *old = cat->index;
+
+    if ( (cat->nrecs + 1) * 2 <= cat->nslots ) return EXIT_SUCCESS;
+    nslots = ( cat->nslots ) ? cat->nslots * 2 : 2048;
+    if ( (cat->index = calloc(nslots, sizeof(*cat->index))) == NULL ) {
+        cat->index = old;
+        return EXIT_FAILURE;
+    }
+    cat->nslots = nslots;
+    for ( size_t i = 0; i < cat->nrecs; ++i ) *find_slot(cat, cat->recs[i].name) = i + 1;
+    free(old);
+    return EXIT_SUCCESS;
+}
+
+/**
+    Insert (or replace) the record for a file. The caller must hold the
+    catalog's lock.
+
+    @return     0 on success, otherwise 1.
+*/
+static int insert_record(struct catalog *cat, const char *name, const unsigned char *digest,
+                         uint64_t size, int64_t mtime) {
+
+    char                    *dup = NULL;
+    struct catalog_record   *r;
+
+    cat->dirty = true;
+    // An existing record for the same name is replaced.
+    if ( (r = find_name(cat, name)) == NULL ) {
+        if ( grow_records(cat) || grow_index(cat) || (dup = strdup(name)) == NULL ) return EXIT_FAILURE;
+        r = &cat->recs[cat->nrecs];
+        r->name = dup;
+        *find_slot(cat, name) = ++cat->nrecs;
+    }
+    memcpy(r->sha256, digest, DIGEST_SIZE);
+    r->size = size;
+    r->mtime = mtime;
+    return EXIT_SUCCESS;
+}
+
+/**
+    Load the records from the catalog file. A malformed line ends the
+    load; the records read so far are kept.
+*/
+static void load_records(struct catalog *cat) {
+
+    char                    *line = NULL;
+    int                     n;
+    size_t                  len = 0;
+    ssize_t                 nread;
+    struct catalog_record   r;
+    FILE                    *fp;
+
+    if ( (fp = fopen(cat->fpath, "r")) == NULL ) return;
+    if ( getline(&line, &len, fp) < 0 || strcmp(line, CATALOG_MAGIC "\n") ) {
+        free(line);
+        fclose(fp);
+        return;
+    }
+    while ( (nread = getline(&line, &len, fp)) > DIGEST_SIZE * 2 ) {
+        if ( line[nread - 1] == '\n' ) line[--nread] = '\0';
+        for ( int j = 0; j < DIGEST_SIZE; ++j ) {
+            if ( sscanf(line + j * 2, "%2hhx", &r.sha256[j]) != 1 ) goto done;
+        }
+        if ( sscanf(line + DIGEST_SIZE * 2, " %" SCNu64 " %" SCNd64 "%n", &r.size, &r.mtime, &n) != 2 ||
+             line[DIGEST_SIZE * 2 + n] != ' ' || !line[DIGEST_SIZE * 2 + n + 1] ) break;
+        if ( insert_record(cat, line + DIGEST_SIZE * 2 + n + 1, r.sha256, r.size, r.mtime) ) break;
+    }
+done:
+    cat->dirty = false;
+    free(line);
+    fclose(fp);
+}
+
+/**
+    Write the catalog, sorted by digest (then name), to a temporary file,
+    then rename it into place.
+
+    @return     0 on success, otherwise 1.
+*/
+static int save_records(const struct catalog *cat) {
+
+    char                            hex[DIGEST_SIZE * 2 + 1];
+    char                            tmp[PATH_MAX + 8];
+    int                             excode = EXIT_SUCCESS;
+    const struct catalog_record     **sorted;
+    FILE                            *fp;
+
+    if ( (sorted = malloc((cat->nrecs + 1) * sizeof(*sorted))) == NULL ) return EXIT_FAILURE;
+    for ( size_t i = 0; i < cat->nrecs; ++i ) sorted[i] = &cat->recs[i];
+    qsort(sorted, cat->nrecs, sizeof(*sorted), compare_records);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", cat->fpath);
+    if ( (fp = fopen(tmp, "w")) == NULL ) {
+        free(sorted);
+        return EXIT_FAILURE;
+    }
+    fprintf(fp, CATALOG_MAGIC "\n");
+    for ( size_t i = 0; i < cat->nrecs; ++i ) {
+        hash_tohex(sorted[i]->sha256, hex);
+        fprintf(fp, "%s %" PRIu64 " %" PRId64 " %s\n", hex, sorted[i]->size, sorted[i]->mtime, sorted[i]->name);
+    }
+    free(sorted);
+    if ( fclose(fp) ) excode = EXIT_FAILURE;
+    if ( excode || rename(tmp, cat->fpath) ) {
+        unlink(tmp);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+    Record a file in the repo, with its digest, in the catalog.
+
+    The file's size and modification time are recorded from the repo,
+    so later changes to the file are detected. An existing record for
+    the same name is replaced.
+
+    @param[in]  cat     Pointer to the catalog.
+    @param[in]  name    Base filename of the file in the repo.
+    @param[in]  digest  SHA-256 digest of the file.
+
+    @return             0 on success, otherwise 1.
+*/
+int catalog_add(struct catalog *cat, const char *name, const unsigned char *digest) {
+
+    char        fpath[PATH_MAX];
+    int         excode;
+    struct stat st;
+
+    if ( snprintf(fpath, sizeof(fpath), "%s/%s", cat->repo, name) >= (int)sizeof(fpath) ) return EXIT_FAILURE;
+    if ( stat(fpath, &st) || !S_ISREG(st.st_mode) ) return EXIT_FAILURE;
+    pthread_mutex_lock(&cat->lock);
+    excode = insert_record(cat, name, digest, st.st_size, mtime_ns(&st));
+    pthread_mutex_unlock(&cat->lock);
+    return excode;
+}
+
+/**
+    Save the catalog (if changed) and release it.
+
+    @param[in]  cat     Pointer to the catalog, or NULL.
+
+    @return             0 on success, otherwise 1 if the catalog could not
+                        be saved.
+*/
+int catalog_close(struct catalog *cat) {
+
+    int excode = EXIT_SUCCESS;
+
+    if ( cat == NULL ) return EXIT_SUCCESS;
+    if ( cat->dirty ) excode = save_records(cat);
+    for ( size_t i = 0; i < cat->nrecs; ++i ) free(cat->recs[i].name);
+    free(cat->recs);
+    free(cat->index);
+    pthread_mutex_destroy(&cat->lock);
+    free(cat);
+    return excode;
+}
+
+/**
+    Test if a file is already present in the repo, with the given digest.
+
+    If the catalog holds a record for the file, and the repo file's size
+    and modification time still match the record, the recorded digest is
+    used. Otherwise, if a file of the same name and size is present in
+    the repo, it is hashed and recorded in the catalog. Therefore, the
+    catalog is populated as archives are unpacked, and no full scan of
+    the repo is ever required.
+
+    This function is thread-safe.
+
+    @param[in]  cat     Pointer to the catalog.
+    @param[in]  name    Base filename of the file.
+    @param[in]  size    Expected size of the file, in bytes.
+    @param[in]  digest  Expected SHA-256 digest of the file.
+
+    @return             True if the repo holds an identical file of the
+                        same name, otherwise false.
+*/
+bool catalog_contains(struct catalog *cat, const char *name, uint64_t size, const unsigned char *digest) {
+
+    bool                    current = false;
+    bool                    found = false;
+    char                    fpath[PATH_MAX];
+    struct catalog_record   *r;
+    struct stat             st;
+    unsigned char           actual[DIGEST_SIZE];
+
+    if ( snprintf(fpath, sizeof(fpath), "%s/%s", cat->repo, name) >= (int)sizeof(fpath) ) return false;
+    if ( stat(fpath, &st) || !S_ISREG(st.st_mode) || (uint64_t)st.st_size != size ) return false;
+    pthread_mutex_lock(&cat->lock);
+    if ( (r = find_name(cat, name)) && r->size == size && r->mtime == mtime_ns(&st) ) {
+        // A current record, with another digest, is a different file.
+        current = true;
+        found = ( !memcmp(r->sha256, digest, DIGEST_SIZE) );
+    }
+    pthread_mutex_unlock(&cat->lock);
+    if ( current ) return found;
+    // Not recorded, or the file has changed; hash and record it.
+    if ( hash_file(fpath, actual) ) return false;
+    pthread_mutex_lock(&cat->lock);
+    insert_record(cat, name, actual, st.st_size, mtime_ns(&st));
+    pthread_mutex_unlock(&cat->lock);
+    return ( !memcmp(actual, digest, DIGEST_SIZE) );
+}
+
+/**
+    Return the digest of a file in the repo.
+
+    The recorded digest is used while the repo file's size and
+    modification time match the record. Otherwise, the file is hashed
+    and recorded in the catalog.
+
+    This function is thread-safe.
+
+    @param[in]  cat     Pointer to the catalog.
+    @param[in]  name    Base filename of the file in the repo.
+    @param[out] digest  Buffer of DIGEST_SIZE bytes to receive the digest.
+
+    @return             0 on success, otherwise 1 if the file could not be
+                        read.
+*/
+int catalog_digest(struct catalog *cat, const char *name, unsigned char *digest) {
+
+    bool                    found = false;
+    char                    fpath[PATH_MAX];
+    struct catalog_record   *r;
+    struct stat             st;
+
+    if ( snprintf(fpath, sizeof(fpath), "%s/%s", cat->repo, name) >= (int)sizeof(fpath) ) return EXIT_FAILURE;
+    if ( stat(fpath, &st) || !S_ISREG(st.st_mode) ) return EXIT_FAILURE;
+    pthread_mutex_lock(&cat->lock);
+    if ( (r = find_name(cat, name)) && r->size == (uint64_t)st.st_size && r->mtime == mtime_ns(&st) ) {
+        memcpy(digest, r->sha256, DIGEST_SIZE);
+        found = true;
+    }
+    pthread_mutex_unlock(&cat->lock);
+    if ( found ) return EXIT_SUCCESS;
+    if ( hash_file(fpath, digest) ) return EXIT_FAILURE;
+    pthread_mutex_lock(&cat->lock);
+    insert_record(cat, name, digest, st.st_size, mtime_ns(&st));
+    pthread_mutex_unlock(&cat->lock);
+    return EXIT_SUCCESS;
+}
+
+/**
+    Load the repo's catalog: a persistent index of the repo's files,
+    keyed by SHA-256 digest.
+
+    If the catalog file does not exist (or cannot be read), an empty
+    catalog is returned, and is populated as it is used.
+
+    @param[in]  repo    Explicit path to the repo directory.
+    @param[in]  fpath   Explicit path to the catalog file.
+
+    @return             Pointer to the catalog, or NULL if the memory could
+                        not be allocated. The catalog must be released by
+                        catalog_close().
+*/
+struct catalog *catalog_open(const char *repo, const char *fpath) {
+
+    struct catalog  *cat;
+
+    if ( (cat = calloc(1, sizeof(*cat))) == NULL ) return NULL;
+    snprintf(cat->repo, sizeof(cat->repo), "%s", repo);
+    snprintf(cat->fpath, sizeof(cat->fpath), "%s", fpath);
+    pthread_mutex_init(&cat->lock, NULL);
+    load_records(cat);
+    return cat;
+}
+
+/**
+    Save the catalog, if changed since it was loaded or last saved.
+
+    Used by a long-running process (i.e. --watch), which keeps the
+    catalog in memory between batches of archives.
+
+    This function is thread-safe.
+
+    @param[in]  cat     Pointer to the catalog.
+
+    @return             0 on success, otherwise 1 if the catalog could not
+                        be saved.
+*/
+int catalog_save(struct catalog *cat) {
+
+    int excode = EXIT_SUCCESS;
+
+    pthread_mutex_lock(&cat->lock);
+    if ( cat->dirty && (excode = save_records(cat)) == EXIT_SUCCESS ) cat->dirty = false;
+    pthread_mutex_unlock(&cat->lock);
+    return excode;
+}
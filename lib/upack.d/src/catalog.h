@@ -0,0 +1,106 @@
+/**
+    Header file for the catalog.c module.
+*/
+
+#ifndef _CATALOG_H
+#define _CATALOG_H
+
+struct catalog;
+
+/**
+    Record a file in the repo, with its digest, in the catalog.
+
+    The file's size and modification time are recorded from the repo,
+    so later changes to the file are detected. An existing record for
+    the same name is replaced.
+
+    @param[in]  cat     Pointer to the catalog.
+    @param[in]  name    Base filename of the file in the repo.
+    @param[in]  digest  SHA-256 digest of the file.
+
+    @return             0 on success, otherwise 1.
+*/
+int catalog_add(struct catalog *cat, const char *name, const unsigned char *digest);
+
+/**
+    Save the catalog (if changed) and release it.
+
+    @param[in]  cat     Pointer to the catalog, or NULL.
+
+    @return             0 on success, otherwise 1 if the catalog could not
+                        be saved.
+*/
+int catalog_close(struct catalog *cat);
+
+/**
+    Test if a file is already present in the repo, with the given digest.
+
+    If the catalog holds a record for the file, and the repo file's size
+    and modification time still match the record, the recorded digest is
+    used. Otherwise, if a file of the same name and size is present in
+    the repo, it is hashed and recorded in the catalog. Therefore, the
+    catalog is populated as archives are unpacked, and no full scan of
+    the repo is ever required.
+
+    This function is thread-safe.
+
+    @param[in]  cat     Pointer to the catalog.
+    @param[in]  name    Base filename of the file.
+    @param[in]  size    Expected size of the file, in bytes.
+    @param[in]  digest  Expected SHA-256 digest of the file.
+
+    @return             True if the repo holds an identical file of the
+                        same name, otherwise false.
+*/
+bool catalog_contains(struct catalog *cat, const char *name, uint64_t size, const unsigned char *digest);
+
+/**
+    Return the digest of a file in the repo.
+
+    The recorded digest is used while the repo file's size and
+    modification time match the record. Otherwise, the file is hashed
+    and recorded in the catalog.
+
+    This function is thread-safe.
+
+    @param[in]  cat     Pointer to the catalog.
+    @param[in]  name    Base filename of the file in the repo.
+    @param[out] digest  Buffer of DIGEST_SIZE bytes to receive the digest.
+
+    @return             0 on success, otherwise 1 if the file could not be
+                        read.
+*/
+int catalog_digest(struct catalog *cat, const char *name, unsigned char *digest);
+
+/**
+    Load the repo's catalog: a persistent index of the repo's files,
+    keyed by SHA-256 digest.
+
+    If the catalog file does not exist (or cannot be read), an empty
+    catalog is returned, and is populated as it is used.
+
+    @param[in]  repo    Explicit path to the repo directory.
+    @param[in]  fpath   Explicit path to the catalog file.
+
+    @return             Pointer to the catalog, or NULL if the memory could
+                        not be allocated. The catalog must be released by
+                        catalog_close().
+*/
+struct catalog *catalog_open(const char *repo, const char *fpath);
+
+/**
+    Save the catalog, if changed since it was loaded or last saved.
+
+    Used by a long-running process (i.e. --watch), which keeps the
+    catalog in memory between batches of archives.
+
+    This function is thread-safe.
+
+    @param[in]  cat     Pointer to the catalog.
+
+    @return             0 on success, otherwise 1 if the catalog could not
+                        be saved.
+*/
+int catalog_save(struct catalog *cat);
+
+#endif /* _CATALOG_H */
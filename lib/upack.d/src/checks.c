@@ -25,120 +25,182 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include <openssl/sha.h>
 #include "base.h"
-#include "filesys.h"
+#include "advisory.h"
+#include "catalog.h"
+#include "checks.h"
+#include "hash.h"
+#include "job.h"
 #include "ui.h"
 #include "utils.h"
 
+#define MANIFEST_MAX_FIELDS 64  // Maximum number of fields in a log row.
+#define MANIFEST_MIN_FIELDS 9   // datetime,host,user,package,md5,vuln,sha256,size,result
+
+/**
+    A field of a log row; not NULL terminated.
+*/
+struct log_field {
+    const char  *p;
+    size_t      len;
+};
+
 // Function prototypes
-int run_tests(void);
-int test_key(const char *fpath_key, const char *fpath_log);
-int test_log(const char *fpath);
+int parse_manifest(struct job *job);
+int run_tests(struct job *job);
+int test_advisories(const struct job *job);
+int test_key(const unsigned char *key, size_t keysz, const unsigned char *digest);
+int test_log(const unsigned char *log, size_t logsz);
+int test_manifest(struct job *job);
+int test_rows(const struct job *job);
 
 /**
     Run the archive verification tests.
 
+    The tests are run against the job's in-memory copies of the .key and
+    .log files, and the log's digest, as captured while the archive was
+    being decoded. Therefore, neither file is re-read from disk.
+
+    Once the key is verified, every row of the log is parsed (in a single
+    pass) into the job's manifest table, which is used by the later
+    stages to identify the files already in the repo, and to verify the
+    unpacked files.
+
     :Tests:
         - Verify the log has not been tampered with.
         - Verify the Snyk library vulnerability checks pass for all 
           libraries.
+        - Verify the packer's checks passed for each library listed in
+          the log, so a row's failure is reported by name.
+        - If an advisory snapshot was loaded, re-check the libraries
+          listed in the log against it.
+
+    @param[in]  job     Pointer to the job whose archive is tested. The
+                        job's tested and verified flags are set and, if
+                        the key is verified, the log's manifest is parsed.
 
     @return     0 if all tests pass successfully, otherwise 1.
 */
-int run_tests(void) {
+int run_tests(struct job *job) {
 
-    bool    passed = true;
-    char    *path_key;
-    char    *path_log;
-    int     ex;
+    bool        passed = true;
+    bool        trusted;
+    int         ex;
+    uint64_t    start = clock_ns();
 
-    // Obtain the paths to the log and key files.
-    path_key = findfile(PATH_TMP_PPK, ".key");
-    path_log = findfile(PATH_TMP_PPK, ".log");
     // Run the tests.
     print_start("\nVerifying the integrity of the archive ..."); 
-    if ( (ex = test_key(path_key, path_log)) ) {
+    if ( (ex = test_key(job->key, job->keysz, ( job->log ) ? job->log_sha256 : NULL)) ) {
         if ( ex > 0 )
             print_warning("-- [TEST FAILURE]: The log file has been altered and is no longer reliable.");
         passed = false;
     }
-    if ( (ex = test_log(path_log)) ) {
+    // The manifest is only parsed from a log which is protected by the key.
+    if ( (trusted = passed) ) job->manifest_status = parse_manifest(job);
+    if ( (ex = test_log(job->log, job->logsz)) ) {
         if ( ex > 0 )
             print_warning("-- [TEST FAILURE]: Snyk vulnerability checks failed.");
         passed = false;
     }
+    if ( trusted && job->manifest_status >= 0 && test_rows(job) ) passed = false;
+    // An archive without a manifest is failed by test_manifest().
+    if ( passed && job->advisories && job->manifest_status >= 0 && test_advisories(job) ) passed = false;
     if ( passed ) {
         print_done(0);
     } else {
         print_alert("\nVerification failures found. Libraries will *not* be transferred.");
     }
-    free(path_key);
-    free(path_log);
+    job->tested = true;
+    job->verified = passed;
+    job_time(job, PHASE_TESTS, start, job->keysz + job->logsz, job->nmanifest);
     return ( passed ) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
+/**
+    Re-check the packages listed in the log against the offline advisory
+    snapshot.
+
+    The packer's vulnerability checks are recorded in the log, which is
+    protected by the key file. This test repeats the checks on the
+    secured side, using the advisories known when the snapshot was
+    exported, rather than trusting the packer's result alone. No network
+    access is required.
+
+    :Test:
+        - A package fails if any 'Critical' or 'High' vulnerabilities
+          are reported for its version, as for the packer's checks.
+        - A package whose version cannot be parsed is reported, but does
+          not fail the test.
+
+    @param[in]  job     Pointer to the job, whose manifest has been
+                        parsed.
+
+    @return             0 if all packages pass, otherwise the number of
+                        packages which failed.
+*/
+int test_advisories(const struct job *job) {
+
+    char            msgbuff[PATH_MAX + 128];
+    int             nfailed = 0;
+    unsigned int    counts[4];
+
+    for ( size_t i = 0; i < job->nmanifest; ++i ) {
+        if ( advisory_lookup(job->advisories, job->manifest[i].name, counts) ) {
+            snprintf(msgbuff, sizeof(msgbuff), "-- The version could not be checked against the advisories: %s",
+                     job->manifest[i].name);
+            print_warning(msgbuff);
+        } else if ( counts[0] || counts[1] ) {
+            snprintf(msgbuff, sizeof(msgbuff),
+                     "-- [TEST FAILURE]: Vulnerabilities reported (C: %u, H: %u, M: %u, L: %u): %s",
+                     counts[0], counts[1], counts[2], counts[3], job->manifest[i].name);
+            print_warning(msgbuff);
+            ++nfailed;
+        }
+    }
+    return nfailed;
+}
+
 /**
     Test the log file key matches that of the log file.
 
     :Test:
-        - A SHA256 hash is calculated against the log file and compared
-          to the *.key file present in the archive. If the hashes match,
-          the test passes. Otherwise the test fails.
-
-    @param[in]  fpath_key   Explicit path to the key file.
-    @param[in]  fpath_log   Explicit path to the log file.
-
-    @return                 0 if the log file passes validation.
-                            Otherwise, -1 if the file was not found, -2 for
-                            a read failure, or -3 if the log file was not 
-                            found. Any non-zero positive integer for a 
-                            validation failure.
-*/
-int test_key(const char *fpath_key, const char *fpath_log) {
-
-    int             buffsz = 1024;
-    int             bytes;
-    int             hash_size = SHA256_DIGEST_LENGTH*2;
-    char            key[hash_size + 1];
-    char            hexdigest[hash_size + 1];
-    char            msgbuff[127];
-    unsigned char   _hash[SHA256_DIGEST_LENGTH];
-    unsigned char   *buff = malloc(buffsz);
-    FILE            *fp;
-    SHA256_CTX      ctx;
-    
-    // Read the key file.
-    if ( (fp = fopen(fpath_key, "r")) == NULL ) {
+        - The SHA256 hash of the log file (calculated as it was decoded)
+          is compared to the *.key file present in the archive. If the
+          hashes match, the test passes. Otherwise the test fails.
+
+    @param[in]  key     Contents of the key file, or NULL if not found.
+    @param[in]  keysz   Size of the key file, in bytes.
+    @param[in]  digest  SHA256 digest of the log file, or NULL if the log
+                        file was not found.
+
+    @return             0 if the log file passes validation.
+                        Otherwise, -1 if the file was not found, -2 for
+                        a read failure, or -3 if the log file was not 
+                        found. Any non-zero positive integer for a 
+                        validation failure.
+*/
+int test_key(const unsigned char *key, size_t keysz, const unsigned char *digest) {
+
+    int     hash_size = DIGEST_SIZE*2;
+    char    hexdigest[hash_size + 1];
+    char    msgbuff[127];
+
+    if ( key == NULL ) {
         reporterror("Key file not found.", false, false);
         return -1;
     }
-    bytes = fread(key, sizeof(char), hash_size, fp);
-    if ( bytes != hash_size ) {
-        sprintf(msgbuff, "%d bytes read from key file, expected %d", bytes, SHA256_DIGEST_LENGTH*2);
+    if ( keysz < (size_t)hash_size ) {
+        snprintf(msgbuff, sizeof(msgbuff), "%zu bytes read from key file, expected %d", keysz, hash_size);
         reporterror(msgbuff, false, false);
         return -2;
     }
-    key[hash_size] = '\0';
-    fclose(fp);
-    // Read and hash the log file.
-    if ( (fp = fopen(fpath_log, "r")) == NULL ) {
+    if ( digest == NULL ) {
         reporterror("The log file cannot be found.", false, false);
         return -3;
     }
-    SHA256_Init(&ctx);
-    while ( (bytes = fread(buff, sizeof(char), buffsz, fp)) ) {
-        SHA256_Update(&ctx, buff, bytes);
-    }
-    SHA256_Final(_hash, &ctx);
-    for ( int i = 0; i < SHA256_DIGEST_LENGTH; ++i ) {
-        sprintf(hexdigest + (i * 2), "%02x", _hash[i]);
-    }
-    hexdigest[hash_size] = '\0';
-    fclose(fp);
-    free(buff);
+    hash_tohex(digest, hexdigest);
     // Compare the log file's hex digest with the key.
-    return strcmp(hexdigest, key);
+    return memcmp(hexdigest, key, hash_size) ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
 /**
@@ -148,33 +210,362 @@ int test_key(const char *fpath_key, const char *fpath_log) {
         - If the 'Results:' tag in the file is PASS, the test will pass,
           otherwise the test will fail.
 
-    @param[in]  fpath   Explicit path to the log file to be tested.
+    @param[in]  log     Contents of the log file, or NULL if not found.
+    @param[in]  logsz   Size of the log file, in bytes.
 
     @return             0 if the log file passes validation.
                         Otherwise, -1 if the file was not found or -2 for a
                         read failure. Any non-zero positive integer for a 
                         validation failure.
 */
-int test_log(const char *fpath) {
+int test_log(const unsigned char *log, size_t logsz) {
 
-    int     bytes;
     int     size = 4;
-    char    buff[size+1];
     char    msgbuff[127];
-    FILE    *fp;
 
-    if ( (fp = fopen(fpath, "r")) == NULL ) {
+    if ( log == NULL ) {
         reporterror("Log file not found.", false, false);
         return -1;
     }
-    fseek(fp, -size-1, SEEK_END);  // End and back 5 chars (four+EOF)
-    memset(buff, 0, sizeof(buff));  // Initialise he array to NULL.
-    if ( (bytes = fread(buff, sizeof(char), size, fp)) != size ) {
-        sprintf(msgbuff, "Expected %d bytes read, got %d.", size, bytes);
+    // End and back 5 chars (four+newline).
+    if ( logsz < (size_t)size + 1 ) {
+        snprintf(msgbuff, sizeof(msgbuff), "Expected %d bytes read, got %zu.", size, logsz);
         reporterror(msgbuff, false, false);
         return -2;
     }
-    fclose(fp);
-    return strcmp(buff, "PASS") ? EXIT_FAILURE : EXIT_SUCCESS;
+    return memcmp(log + logsz - size - 1, "PASS", size) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+    Split a log row into its comma separated fields.
+
+    @return     The number of fields, or 0 if the row has too many fields.
+*/
+static int split_row(const char *line, size_t len, struct log_field *fields) {
+
+    int         n = 0;
+    const char  *end = line + len;
+    const char  *sep;
+
+    while ( n < MANIFEST_MAX_FIELDS ) {
+        sep = memchr(line, ',', end - line);
+        fields[n].p = line;
+        fields[n].len = ( sep ) ? (size_t)(sep - line) : (size_t)(end - line);
+        ++n;
+        if ( sep == NULL ) return n;
+        line = sep + 1;
+    }
+    return 0;
+}
+
+/**
+    Test if a log field matches a string.
+*/
+static bool field_is(const struct log_field *f, const char *s) {
+    return ( f->len == strlen(s) && !memcmp(f->p, s, f->len) );
+}
+
+/**
+    Parse a log field of the given true or false values.
+
+    @return     0 on success, otherwise 1 if the field is neither value.
+*/
+static int parse_flag(const struct log_field *f, const char *yes, const char *no, bool *value) {
+    if ( field_is(f, yes) ) *value = true;
+    else if ( field_is(f, no) ) *value = false;
+    else return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+/**
+    Parse a log field of decimal digits, without a sign or spaces.
+
+    @return     0 on success, otherwise 1 if the field is not a number,
+                or exceeds max.
+*/
+static int parse_uint(const struct log_field *f, uint64_t max, uint64_t *value) {
+
+    uint64_t    n = 0;
+
+    if ( f->len == 0 || f->len > 19 ) return EXIT_FAILURE;
+    for ( size_t i = 0; i < f->len; ++i ) {
+        if ( f->p[i] < '0' || f->p[i] > '9' ) return EXIT_FAILURE;
+        n = n * 10 + (f->p[i] - '0');
+    }
+    if ( n > max ) return EXIT_FAILURE;
+    *value = n;
+    return EXIT_SUCCESS;
+}
+
+/**
+    Parse a log field of a SHA-256 hex digest.
+
+    @return     0 on success, otherwise 1 if the field is not a digest.
+*/
+static int parse_digest(const struct log_field *f, unsigned char *digest) {
+    return ( f->len != DIGEST_SIZE * 2 ) ? EXIT_FAILURE : hash_fromhex(f->p, digest);
+}
+
+/**
+    Parse a (split) log row into a manifest row.
+
+    The row's fields are: datetime, host, user, package, md5, vuln, the
+    dv_c, dv_h, dv_m and dv_l counts (if the header has them), sha256,
+    size and result. A row must have the same number of fields as the
+    header, so a count is never read from the wrong column.
+
+    @return     0 on success, otherwise 1 if the row is malformed.
+*/
+static int parse_row(const struct log_field *fields, int nf, int nhdr, struct job_manifest *row) {
+
+    uint64_t    n;
+
+    if ( nf != nhdr || fields[3].len == 0 ||
+         parse_flag(&fields[4], "True", "False", &row->md5) ||
+         parse_flag(&fields[5], "True", "False", &row->vuln) ||
+         parse_digest(&fields[nf - 3], row->sha256) ||
+         parse_uint(&fields[nf - 2], UINT64_MAX, &row->size) ||
+         parse_flag(&fields[nf - 1], "pass", "fail", &row->pass) ) {
+        return EXIT_FAILURE;
+    }
+    memset(row->dv, 0, sizeof(row->dv));
+    for ( int k = 0; k < nf - MANIFEST_MIN_FIELDS; ++k ) {
+        if ( parse_uint(&fields[6 + k], UINT16_MAX, &n) ) return EXIT_FAILURE;
+        row->dv[k] = (uint16_t)n;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+    Test if an entry is exempt from the manifest: the verification files
+    themselves, and the requirements (.txt) files.
+*/
+static bool manifest_exempt(const struct job_entry *e) {
+    return ( e->role == ROLE_KEY || e->role == ROLE_LOG || e->role == ROLE_REQUIREMENTS );
+}
+
+/**
+    qsort(3) comparison callback for the manifest rows.
+*/
+static int compare_rows(const void *a, const void *b) {
+    return strcmp(((const struct job_manifest *)a)->name, ((const struct job_manifest *)b)->name);
+}
+
+/**
+    Parse the manifest from the job's (verified) log into the job's
+    manifest table, sorted by name.
+
+    Every row is parsed and validated, in a single pass over the
+    in-memory log. The packer records the results of its checks (the
+    md5, vuln and dv_* columns), and the SHA-256 digest and size of each
+    package (the sha256 and size columns), in its log row. Malformed and
+    duplicate rows are dropped, and reported by test_manifest().
+
+    @param[in]  job     Pointer to the job, whose log has been verified.
+
+    @return             0 if the manifest was parsed successfully.
+                        Otherwise, -1 if the log does not contain a
+                        manifest, or -2 for a memory error. Any non-zero
+                        positive integer is the number of rows dropped.
+*/
+int parse_manifest(struct job *job) {
+
+    const char          *end = (const char *)job->log + job->logsz;
+    const char          *line = (const char *)job->log;
+    const char          *eol;
+    int                 dropped = 0;
+    int                 nf;
+    int                 nhdr;
+    size_t              capacity = 0;
+    size_t              n = 0;
+    struct job_manifest *rows;
+    struct job_manifest *m = NULL;
+    struct log_field    fields[MANIFEST_MAX_FIELDS];
+
+    if ( line == NULL || (eol = memchr(line, '\n', end - line)) == NULL ||
+         ((nhdr = split_row(line, eol - line, fields)) != MANIFEST_MIN_FIELDS &&
+          nhdr != MANIFEST_MIN_FIELDS + 4) ||
+         !field_is(&fields[3], "package") || !field_is(&fields[4], "md5") || !field_is(&fields[5], "vuln") ||
+         !field_is(&fields[nhdr - 3], "sha256") || !field_is(&fields[nhdr - 2], "size") ||
+         !field_is(&fields[nhdr - 1], "result") ) {
+        return -1;
+    }
+    // One row per package, up to the blank line before the result.
+    for ( line = eol + 1; line < end && *line != '\n'; line = eol + 1 ) {
+        if ( (eol = memchr(line, '\n', end - line)) == NULL ) eol = end;
+        if ( n == capacity ) {
+            capacity = ( capacity ) ? capacity * 2 : 64;
+            if ( (rows = realloc(m, capacity * sizeof(*m))) == NULL ) goto nomem;
+            m = rows;
+        }
+        if ( (nf = split_row(line, eol - line, fields)) == 0 || parse_row(fields, nf, nhdr, &m[n]) ) {
+            ++dropped;
+            continue;
+        }
+        if ( (m[n].name = job_strndup(job, fields[3].p, fields[3].len)) == NULL ) goto nomem;
+        ++n;
+    }
+    if ( n ) qsort(m, n, sizeof(*m), compare_rows);
+    // A package listed twice is ambiguous; drop both rows.
+    for ( size_t i = 0, j; i < n; i = j ) {
+        for ( j = i + 1; j < n && !strcmp(m[i].name, m[j].name); ++j );
+        if ( j - i > 1 ) {
+            memmove(&m[i], &m[j], (n - j) * sizeof(*m));
+            dropped += j - i;
+            n -= j - i;
+            j = i;
+        }
+    }
+    job->manifest = m;
+    job->nmanifest = n;
+    return dropped;
+nomem:
+    free(m);
+    return -2;
+}
+
+/**
+    Test the unpacked files against the digest manifest in the log.
+
+    The packer records the SHA-256 digest and size of each package in
+    its log row (the sha256 and size columns). As the log is protected
+    by the key file, this ties each published file to the file which was
+    tested by the packer.
+
+    Each staged file is tested using the digest calculated as it was
+    decoded and written (see pipeline.c), so the files are not read
+    again. Entries which were already present in the repo were matched
+    to the same manifest digest by the catalog, so are not staged here.
+
+    A delta archive omits the packages which the repo already holds (as
+    listed in the repo inventory, via --inventory), while its log lists
+    every package tested by the packer. A package which is listed in the
+    log, but is not in the archive, is accepted only if the repo holds a
+    file of the same name, size and digest. These are counted in the
+    job's nomitted field.
+
+    :Tests:
+        - Each package listed in the log is present in the archive (or
+          the repo), with the same size and SHA-256 digest.
+        - Each file in the archive (other than the verification and
+          requirements files) is listed in the log.
+
+    @param[in]  job     Pointer to the job, whose archive has been
+                        unpacked into its stage, and whose manifest has
+                        been parsed by run_tests().
+
+    @return             0 if all files pass validation.
+                        Otherwise, -1 if the log does not contain a
+                        manifest, or -2 for a memory error. Any non-zero
+                        positive integer for a validation failure.
+*/
+int test_manifest(struct job *job) {
+
+    bool                        passed = true;
+    bool                        *listed;
+    char                        msgbuff[PATH_MAX + 256];
+    size_t                      j;
+    struct job_entry            *e;
+    struct job_manifest         *row;
+
+    print_start("\nVerifying the unpacked files against the log's digests ...");
+    if ( job->manifest_status == -1 ) {
+        reporterror("The log does not contain file digests. The archive must be packed using ppk v0.3+.",
+                    false, false);
+        return -1;
+    }
+    if ( job->manifest_status > 0 ) {
+        print_warning("-- [TEST FAILURE]: The log contains a malformed or duplicate row.");
+        passed = false;
+    }
+    listed = calloc(job->nmanifest + 1, sizeof(bool));
+    if ( job->manifest_status == -2 || listed == NULL ) {
+        reporterror("Error occurred while allocating memory for the manifest.", false, false);
+        free(listed);
+        return -2;
+    }
+    for ( j = 0; j < job->nentries; ++j ) {
+        e = &job->entries[j];
+        if ( (row = job_find_manifest(job, e->name)) == NULL ) {
+            if ( manifest_exempt(e) ) continue;
+            snprintf(msgbuff, sizeof(msgbuff), "-- [TEST FAILURE]: Not listed in the log: %s", e->name);
+            print_warning(msgbuff);
+            passed = false;
+            continue;
+        }
+        if ( listed[row - job->manifest] ) {
+            snprintf(msgbuff, sizeof(msgbuff), "-- [TEST FAILURE]: The archive contains a duplicate file: %s",
+                     e->name);
+            print_warning(msgbuff);
+            passed = false;
+            continue;
+        }
+        listed[row - job->manifest] = true;
+        if ( row->size != e->size ) {
+            snprintf(msgbuff, sizeof(msgbuff), "-- [TEST FAILURE]: Size does not match the log: %s", e->name);
+            print_warning(msgbuff);
+            passed = false;
+            continue;
+        }
+        // An entry present in the repo was matched to the log's digest by the catalog.
+        if ( !e->present && memcmp(e->sha256, row->sha256, DIGEST_SIZE) ) {
+            snprintf(msgbuff, sizeof(msgbuff), "-- [TEST FAILURE]: Digest does not match the log: %s", e->name);
+            print_warning(msgbuff);
+            passed = false;
+        }
+    }
+    for ( j = 0; j < job->nmanifest; ++j ) {
+        if ( !listed[j] ) {
+            row = &job->manifest[j];
+            if ( job->catalog && catalog_contains(job->catalog, row->name, row->size, row->sha256) ) {
+                ++job->nomitted;
+                continue;
+            }
+            snprintf(msgbuff, sizeof(msgbuff),
+                     "-- [TEST FAILURE]: Listed in the log, but not in the archive or the repo: %s", row->name);
+            print_warning(msgbuff);
+            passed = false;
+        }
+    }
+    free(listed);
+    if ( passed ) {
+        print_done(0);
+    } else {
+        print_alert("\nVerification failures found. Libraries will *not* be transferred.");
+    }
+    return ( passed ) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
+/**
+    Test the results of the packer's checks, for each library listed in
+    the log.
+
+    :Test:
+        - Each row's MD5 and vulnerability checks passed, and its result
+          is 'pass'. These determine the log's overall result, so this
+          test identifies the failed libraries, and fails a log whose
+          overall result is inconsistent with its rows.
+
+    @param[in]  job     Pointer to the job, whose manifest has been
+                        parsed.
+
+    @return             0 if all rows pass, otherwise the number of rows
+                        which failed.
+*/
+int test_rows(const struct job *job) {
+
+    char                        msgbuff[PATH_MAX + 128];
+    int                         nfailed = 0;
+    const struct job_manifest   *row;
+
+    for ( size_t i = 0; i < job->nmanifest; ++i ) {
+        row = &job->manifest[i];
+        if ( row->md5 && row->vuln && row->pass ) continue;
+        snprintf(msgbuff, sizeof(msgbuff), "-- [TEST FAILURE]: The packer's %s failed (C: %u, H: %u): %s",
+                 ( !row->md5 ) ? "MD5 check" : ( !row->vuln ) ? "vulnerability check" : "checks",
+                 row->dv[0], row->dv[1], row->name);
+        print_warning(msgbuff);
+        ++nfailed;
+    }
+    return nfailed;
+}
@@ -5,36 +5,100 @@
 #ifndef _CHECKS_H
 #define _CHECKS_H
 
+struct job;
+
+/**
+    Parse the manifest from the job's (verified) log into the job's
+    manifest table, sorted by name.
+
+    Every row is parsed and validated, in a single pass over the
+    in-memory log. The packer records the results of its checks (the
+    md5, vuln and dv_* columns), and the SHA-256 digest and size of each
+    package (the sha256 and size columns), in its log row. Malformed and
+    duplicate rows are dropped, and reported by test_manifest().
+
+    @param[in]  job     Pointer to the job, whose log has been verified.
+
+    @return             0 if the manifest was parsed successfully.
+                        Otherwise, -1 if the log does not contain a
+                        manifest, or -2 for a memory error. Any non-zero
+                        positive integer is the number of rows dropped.
+*/
+int parse_manifest(struct job *job);
+
 /**
     Run the archive verification tests.
 
+    The tests are run against the job's in-memory copies of the .key and
+    .log files, and the log's digest, as captured while the archive was
+    being decoded. Therefore, neither file is re-read from disk.
+
+    Once the key is verified, every row of the log is parsed (in a single
+    pass) into the job's manifest table, which is used by the later
+    stages to identify the files already in the repo, and to verify the
+    unpacked files.
+
     :Tests:
         - Verify the log has not been tampered with.
         - Verify the Snyk library vulnerability checks pass for all 
           libraries.
+        - Verify the packer's checks passed for each library listed in
+          the log, so a row's failure is reported by name.
+        - If an advisory snapshot was loaded, re-check the libraries
+          listed in the log against it.
+
+    @param[in]  job     Pointer to the job whose archive is tested. The
+                        job's tested and verified flags are set and, if
+                        the key is verified, the log's manifest is parsed.
 
     @return     0 if all tests pass successfully, otherwise 1.
 */
-int run_tests(void);
+int run_tests(struct job *job);
+
+/**
+    Re-check the packages listed in the log against the offline advisory
+    snapshot.
+
+    The packer's vulnerability checks are recorded in the log, which is
+    protected by the key file. This test repeats the checks on the
+    secured side, using the advisories known when the snapshot was
+    exported, rather than trusting the packer's result alone. No network
+    access is required.
+
+    :Test:
+        - A package fails if any 'Critical' or 'High' vulnerabilities
+          are reported for its version, as for the packer's checks.
+        - A package whose version cannot be parsed is reported, but does
+          not fail the test.
+
+    @param[in]  job     Pointer to the job, whose manifest has been
+                        parsed.
+
+    @return             0 if all packages pass, otherwise the number of
+                        packages which failed.
+*/
+int test_advisories(const struct job *job);
 
 /**
     Test the log file key matches that of the log file.
 
     :Test:
-        - A SHA256 hash is calculated against the log file and compared
-          to the *.key file present in the archive. If the hashes match,
-          the test passes. Otherwise the test fails.
+        - The SHA256 hash of the log file (calculated as it was decoded)
+          is compared to the *.key file present in the archive. If the
+          hashes match, the test passes. Otherwise the test fails.
 
-    @param[in]  fpath_key   Explicit path to the key file.
-    @param[in]  fpath_log   Explicit path to the log file.
+    @param[in]  key     Contents of the key file, or NULL if not found.
+    @param[in]  keysz   Size of the key file, in bytes.
+    @param[in]  digest  SHA256 digest of the log file, or NULL if the log
+                        file was not found.
 
-    @return                 0 if the log file passes validation.
-                            Otherwise, -1 if the file was not found, -2 for
-                            a read failure, or -3 if the log file was not 
-                            found. Any non-zero positive integer for a 
-                            validation failure.
+    @return             0 if the log file passes validation.
+                        Otherwise, -1 if the file was not found, -2 for
+                        a read failure, or -3 if the log file was not 
+                        found. Any non-zero positive integer for a 
+                        validation failure.
 */
-int test_key(const char *fpath_key, const char *fpath_log);
+int test_key(const unsigned char *key, size_t keysz, const unsigned char *digest);
 
 /**
     Test the verification log results.
@@ -43,14 +107,63 @@ int test_key(const char *fpath_key, const char *fpath_log);
         - If the 'Results:' tag in the file is PASS, the test will pass,
           otherwise the test will fail.
 
-    @param[in]  fpath   Explicit path to the log file to be tested.
+    @param[in]  log     Contents of the log file, or NULL if not found.
+    @param[in]  logsz   Size of the log file, in bytes.
 
     @return             0 if the log file passes validation.
                         Otherwise, -1 if the file was not found or -2 for a
                         read failure. Any non-zero positive integer for a 
                         validation failure.
 */
-int test_log(const char *fpath);
+int test_log(const unsigned char *log, size_t logsz);
+
+/**
+    Test the unpacked files against the digest manifest in the log.
+
+    The packer records the SHA-256 digest and size of each package in
+    its log row (the sha256 and size columns). As the log is protected
+    by the key file, this ties each published file to the file which was
+    tested by the packer.
+
+    Each staged file is tested using the digest calculated as it was
+    decoded and written (see pipeline.c), so the files are not read
+    again. Entries which were already present in the repo were matched
+    to the same manifest digest by the catalog, so are not staged here.
+
+    :Tests:
+        - Each package listed in the log is present in the archive, with
+          the same size and SHA-256 digest.
+        - Each file in the archive (other than the verification and
+          requirements files) is listed in the log.
+
+    @param[in]  job     Pointer to the job, whose archive has been
+                        unpacked into its stage, and whose manifest has
+                        been parsed by run_tests().
+
+    @return             0 if all files pass validation.
+                        Otherwise, -1 if the log does not contain a
+                        manifest, or -2 for a memory error. Any non-zero
+                        positive integer for a validation failure.
+*/
+int test_manifest(struct job *job);
+
+/**
+    Test the results of the packer's checks, for each library listed in
+    the log.
+
+    :Test:
+        - Each row's MD5 and vulnerability checks passed, and its result
+          is 'pass'. These determine the log's overall result, so this
+          test identifies the failed libraries, and fails a log whose
+          overall result is inconsistent with its rows.
+
+    @param[in]  job     Pointer to the job, whose manifest has been
+                        parsed.
+
+    @return             0 if all rows pass, otherwise the number of rows
+                        which failed.
+*/
+int test_rows(const struct job *job);
 
 #endif /* _CHECKS_H */
 
@@ -0,0 +1,227 @@
+/**
+    Purpose:    This module provides the chunked bundle support; a bundle
+                split by the packer (--chunks) into several independently
+                encrypted archives, listed in a small index with the size
+                and SHA-256 digest of each. The chunks are verified against
+                the index concurrently, so a chunk damaged in transfer is
+                named, and only that chunk need be transferred again.
+
+    Developer:  J Berendt
+    Email:      development@s3dev.uk
+
+    Comments:   The index (.chunks) file is in the format:
+
+                    ppk-chunks 1
+                    <sha256 hex digest> <size> <chunk filename>
+                    ...
+                    sha256 <sha256 hex digest of the preceding lines>
+
+                Each chunk is a complete archive, with its own log and key,
+                so the chunks are then unpacked as separate archives, in
+                parallel, by the worker pool.
+
+    Copyright (C) 73rd Street Development
+    This file is part of the ppk project's upack program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ctype.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include "base.h"
+#include "chunks.h"
+#include "hash.h"
+#include "ui.h"
+
+#define CHUNKS_MAGIC    "ppk-chunks 1"
+#define CHUNKS_TRAILER  "sha256 "
+
+// Function prototypes
+int chunks_load(const char *fpath, struct chunk **chunks, size_t *nchunks);
+size_t chunks_verify(struct chunk *chunks, size_t nchunks, struct pool *pool);
+
+/**
+    Parse an index row into a chunk.
+
+    @return     0 on success, otherwise 1 if the row is not valid.
+*/
+static int parse_row(char *line, const char *dpath, struct chunk *c) {
+
+    char                *end;
+    char                *name;
+    char                *ext;
+    unsigned long long  size;
+
+    if ( strlen(line) < DIGEST_SIZE * 2 + 4 || line[DIGEST_SIZE * 2] != ' ' ) return EXIT_FAILURE;
+    line[DIGEST_SIZE * 2] = '\0';
+    if ( hash_fromhex(line, c->sha256) ) return EXIT_FAILURE;
+    if ( !isdigit((unsigned char)line[DIGEST_SIZE * 2 + 1]) ) return EXIT_FAILURE;
+    size = strtoull(&line[DIGEST_SIZE * 2 + 1], &end, 10);
+    if ( *end != ' ' ) return EXIT_FAILURE;
+    name = end + 1;
+    // A chunk is named by its base filename only, so it can only be read from beside the index.
+    if ( *name == '\0' || *name == '.' || strchr(name, '/') ||
+         (ext = strrchr(name, '.')) == NULL || strcmp(ext, ".7z") ) {
+        return EXIT_FAILURE;
+    }
+    if ( snprintf(c->fpath, PATH_MAX, "%s/%s", dpath, name) >= PATH_MAX ) return EXIT_FAILURE;
+    c->size = size;
+    c->status = CHUNK_OK;
+    return EXIT_SUCCESS;
+}
+
+/**
+    Load a bundle's chunk index.
+
+    The chunks are expected in the same directory as the index.
+
+    @param[in]  fpath   Explicit path to the index (.chunks) file.
+    @param[out] chunks  Receives the array of chunks, which must be
+                        released by free(3).
+    @param[out] nchunks Receives the number of chunks.
+
+    @return             0 on success, otherwise -1 if the file could not be
+                        opened (see errno), -2 for a memory error, -3 if
+                        the index's digest does not match its content, or
+                        the (1-based) number of the first invalid line.
+*/
+int chunks_load(const char *fpath, struct chunk **chunks, size_t *nchunks) {
+
+    bool            trailer = false;
+    char            buff[PATH_MAX];
+    char            dpath[PATH_MAX];
+    char            line[PATH_MAX + 128];
+    int             excode = -2;
+    int             lineno = 0;
+    size_t          capacity = 0;
+    size_t          len;
+    size_t          n = 0;
+    unsigned char   digest[DIGEST_SIZE];
+    unsigned char   expected[DIGEST_SIZE];
+    struct chunk    *c = NULL;
+    struct chunk    *tmp;
+    struct hash     h = {0};
+    FILE            *fp;
+
+    snprintf(buff, sizeof(buff), "%s", fpath);
+    snprintf(dpath, sizeof(dpath), "%s", dirname(buff));
+    if ( (fp = fopen(fpath, "r")) == NULL ) return -1;
+    if ( hash_init(&h) ) goto cleanup;
+    while ( fgets(line, sizeof(line), fp) != NULL ) {
+        ++lineno;
+        len = strlen(line);
+        excode = lineno;
+        // Nothing may follow the trailer, and every line must be complete.
+        if ( trailer || len == 0 || line[len - 1] != '\n' ) goto cleanup;
+        if ( !strncmp(line, CHUNKS_TRAILER, strlen(CHUNKS_TRAILER)) ) {
+            line[len - 1] = '\0';
+            if ( strlen(line) != strlen(CHUNKS_TRAILER) + DIGEST_SIZE * 2 ||
+                 hash_fromhex(line + strlen(CHUNKS_TRAILER), expected) ) {
+                goto cleanup;
+            }
+            trailer = true;
+            continue;
+        }
+        if ( hash_update(&h, line, len) ) {
+            excode = -2;
+            goto cleanup;
+        }
+        line[len - 1] = '\0';
+        if ( lineno == 1 ) {
+            if ( strcmp(line, CHUNKS_MAGIC) ) goto cleanup;
+            continue;
+        }
+        if ( n == capacity ) {
+            capacity = ( capacity ) ? capacity * 2 : 16;
+            if ( (tmp = realloc(c, capacity * sizeof(*c))) == NULL ) {
+                excode = -2;
+                goto cleanup;
+            }
+            c = tmp;
+        }
+        if ( parse_row(line, dpath, &c[n]) ) goto cleanup;
+        ++n;
+    }
+    excode = -3;
+    if ( !trailer || n == 0 || hash_final(&h, digest) || memcmp(digest, expected, DIGEST_SIZE) ) goto cleanup;
+    *chunks = c;
+    *nchunks = n;
+    c = NULL;
+    excode = EXIT_SUCCESS;
+cleanup:
+    hash_free(&h);
+    fclose(fp);
+    free(c);
+    return excode;
+}
+
+/**
+    Verify each chunk's size and digest against the index.
+
+    The chunks are hashed concurrently, one chunk per task. Each failed
+    chunk is reported by name, and its status is set.
+
+    @param[in]  chunks  Array of chunks, per chunks_load().
+    @param[in]  nchunks Number of chunks.
+    @param[in]  pool    Worker pool, or NULL to hash the chunks in turn.
+
+    @return             The number of chunks which failed verification.
+*/
+size_t chunks_verify(struct chunk *chunks, size_t nchunks, struct pool *pool) {
+
+    char                msgbuff[PATH_MAX + 128];
+    const char          *reason;
+    size_t              nfailed = 0;
+    size_t              ntasks = 0;
+    struct hash_task    *tasks;
+    struct stat         st;
+
+    if ( (tasks = calloc(nchunks, sizeof(*tasks))) == NULL ) {
+        for ( size_t i = 0; i < nchunks; ++i ) chunks[i].status = CHUNK_MISSING;
+        return nchunks;
+    }
+    // The sizes are checked first, so a truncated chunk is not hashed.
+    for ( size_t i = 0; i < nchunks; ++i ) {
+        if ( stat(chunks[i].fpath, &st) || !S_ISREG(st.st_mode) ) {
+            chunks[i].status = CHUNK_MISSING;
+        } else if ( (uint64_t)st.st_size != chunks[i].size ) {
+            chunks[i].status = CHUNK_SIZE;
+        } else {
+            tasks[ntasks++].fpath = chunks[i].fpath;
+        }
+    }
+    hash_files(pool, tasks, ntasks);
+    for ( size_t i = 0, j = 0; i < nchunks; ++i ) {
+        if ( chunks[i].status == CHUNK_OK && tasks[j].fpath == chunks[i].fpath ) {
+            if ( tasks[j].excode ) {
+                chunks[i].status = CHUNK_MISSING;
+            } else if ( memcmp(tasks[j].digest, chunks[i].sha256, DIGEST_SIZE) ) {
+                chunks[i].status = CHUNK_DIGEST;
+            }
+            ++j;
+        }
+        switch ( chunks[i].status ) {
+            case CHUNK_MISSING: reason = "The chunk could not be read"; break;
+            case CHUNK_SIZE:    reason = "Size does not match the index"; break;
+            case CHUNK_DIGEST:  reason = "Digest does not match the index"; break;
+            default: continue;
+        }
+        snprintf(msgbuff, sizeof(msgbuff), "-- [CHUNK FAILURE]: %s: %s", reason, chunks[i].fpath);
+        print_warning(msgbuff);
+        ++nfailed;
+    }
+    free(tasks);
+    return nfailed;
+}
@@ -0,0 +1,61 @@
+/**
+    Header file for the chunks.c module.
+*/
+
+#ifndef _CHUNKS_H
+#define _CHUNKS_H
+
+struct pool;
+
+/**
+    Result of a chunk's verification, by chunks_verify().
+*/
+enum chunk_status {
+    CHUNK_OK = 0,       // The chunk matches the index.
+    CHUNK_MISSING,      // The chunk could not be read.
+    CHUNK_SIZE,         // The chunk's size does not match the index.
+    CHUNK_DIGEST,       // The chunk's digest does not match the index.
+};
+
+/**
+    A chunk (archive) of a chunked bundle, as listed in its index.
+*/
+struct chunk {
+    char                fpath[PATH_MAX];        // Explicit path to the chunk, beside the index.
+    uint64_t            size;                   // Size in bytes, per the index.
+    unsigned char       sha256[DIGEST_SIZE];    // Digest, per the index.
+    enum chunk_status   status;
+};
+
+/**
+    Load a bundle's chunk index.
+
+    The chunks are expected in the same directory as the index.
+
+    @param[in]  fpath   Explicit path to the index (.chunks) file.
+    @param[out] chunks  Receives the array of chunks, which must be
+                        released by free(3).
+    @param[out] nchunks Receives the number of chunks.
+
+    @return             0 on success, otherwise -1 if the file could not be
+                        opened (see errno), -2 for a memory error, -3 if
+                        the index's digest does not match its content, or
+                        the (1-based) number of the first invalid line.
+*/
+int chunks_load(const char *fpath, struct chunk **chunks, size_t *nchunks);
+
+/**
+    Verify each chunk's size and digest against the index.
+
+    The chunks are hashed concurrently, one chunk per task. Each failed
+    chunk is reported by name, and its status is set.
+
+    @param[in]  chunks  Array of chunks, per chunks_load().
+    @param[in]  nchunks Number of chunks.
+    @param[in]  pool    Worker pool, or NULL to hash the chunks in turn.
+
+    @return             The number of chunks which failed verification.
+*/
+size_t chunks_verify(struct chunk *chunks, size_t nchunks, struct pool *pool);
+
+#endif /* _CHUNKS_H */
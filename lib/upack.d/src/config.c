@@ -0,0 +1,227 @@
+/**
+    Purpose:    This module provides the program's runtime configuration;
+                the repo and staging paths, the number of workers and the
+                I/O buffer sizes, so the placement and parallelism can be
+                tuned per host without rebuilding the (static) binary.
+
+    Developer:  J Berendt
+    Email:      development@s3dev.uk
+
+    Comments:   The settings are applied in order of precedence, from the
+                compiled defaults, then the configuration file (--config,
+                or PATH_CONFIG if present), then the command line options.
+
+                The configuration file is in the format:
+
+                    # Comment
+                    repo = /srv/pip/repo
+                    stage = /srv/pip/repo/.stage
+                    jobs = 8
+                    read_buffer = 4M
+                    copy_buffer = 1M
+                    hash_buffer = 4M
+                    stale_stage = 86400
+
+    Copyright (C) 73rd Street Development
+    This file is part of the ppk project's upack program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ctype.h>
+#include "base.h"
+#include "config.h"
+
+// Buffer limits; the read buffer must also be a multiple of the AES block size.
+#define CONFIG_MIN_BUFFSZ   (64*1024)
+#define CONFIG_MAX_BUFFSZ   (1024*1024*1024)
+#define CONFIG_AES_BLOCK    16
+
+static struct config _config = {
+    .repo = PATH_REPO,
+    .njobs = 0,
+    .read_buffsz = 1024*1024,       // 1 Mb
+    .copy_buffsz = 1024*1024,       // 1 Mb
+    .hash_buffsz = 4*1024*1024,     // 4 Mb
+    .stale_stage = 24*60*60,        // 1 day
+};
+
+// Function prototypes
+const struct config *config_get(void);
+int config_load(const char *fpath);
+int config_resolve(void);
+int config_set(const char *key, const char *value);
+
+/**
+    Parse a buffer size, with an optional K, M or G suffix.
+
+    @return     0 on success, otherwise 1 if the size is not valid.
+*/
+static int parse_size(const char *value, size_t *size) {
+
+    char                *end;
+    unsigned long long  n;
+
+    if ( !isdigit((unsigned char)*value) ) return EXIT_FAILURE;
+    if ( (n = strtoull(value, &end, 10)) > CONFIG_MAX_BUFFSZ ) return EXIT_FAILURE;
+    switch ( toupper((unsigned char)*end) ) {
+        case 'G': n <<= 10; /* fall through */
+        case 'M': n <<= 10; /* fall through */
+        case 'K': n <<= 10; ++end; break;
+        default: break;
+    }
+    if ( *end || n < CONFIG_MIN_BUFFSZ || n > CONFIG_MAX_BUFFSZ ) return EXIT_FAILURE;
+    *size = n;
+    return EXIT_SUCCESS;
+}
+
+/**
+    Copy a path setting, without a trailing slash.
+
+    @return     0 on success, otherwise 1 if the path is empty or too long.
+*/
+static int set_path(char *dst, const char *value) {
+
+    size_t  len = strlen(value);
+
+    while ( len > 1 && value[len - 1] == '/' ) --len;
+    if ( len == 0 || len >= PATH_MAX ) return EXIT_FAILURE;
+    memcpy(dst, value, len);
+    dst[len] = '\0';
+    return EXIT_SUCCESS;
+}
+
+/**
+    Return the program's configuration.
+
+    The configuration is set while the arguments are verified, before
+    any worker thread is started, and is read-only thereafter.
+
+    @return     Pointer to the configuration.
+*/
+const struct config *config_get(void) {
+    return &_config;
+}
+
+/**
+    Load the settings from a configuration file.
+
+    The file contains one 'key = value' setting per line, as accepted by
+    config_set(). Blank lines, and lines starting with '#', are ignored.
+
+    @param[in]  fpath   Explicit path to the configuration file.
+
+    @return             0 on success, otherwise -1 if the file could not be
+                        opened (see errno), or the (1-based) number of the
+                        first line which holds an invalid setting.
+*/
+int config_load(const char *fpath) {
+
+    char    line[PATH_MAX + 64];
+    char    *key;
+    char    *value;
+    char    *end;
+    int     lineno = 0;
+    FILE    *fp;
+
+    if ( (fp = fopen(fpath, "r")) == NULL ) return -1;
+    while ( fgets(line, sizeof(line), fp) != NULL ) {
+        ++lineno;
+        for ( key = line; isspace((unsigned char)*key); ++key );
+        if ( *key == '\0' || *key == '#' ) continue;
+        // Split at the '=', and trim the key and the value.
+        if ( (value = strchr(key, '=')) != NULL ) {
+            for ( end = value; end > key && isspace((unsigned char)end[-1]); --end );
+            *end = '\0';
+            for ( ++value; isspace((unsigned char)*value); ++value );
+            for ( end = value + strlen(value); end > value && isspace((unsigned char)end[-1]); --end );
+            *end = '\0';
+        }
+        if ( value == NULL || config_set(key, value) ) {
+            fclose(fp);
+            return lineno;
+        }
+    }
+    fclose(fp);
+    return EXIT_SUCCESS;
+}
+
+/**
+    Derive the repo's paths from the configured repo, and set the stage
+    to the repo's hidden directory, if not configured.
+
+    @return     0 on success, otherwise 1 if a path is too long.
+*/
+int config_resolve(void) {
+
+    struct config   *c = &_config;
+
+    if ( snprintf(c->meta, PATH_MAX, "%s/" DIR_META, c->repo) >= PATH_MAX ||
+         snprintf(c->catalog, PATH_MAX, "%s/" DIR_META "/" NAME_CATALOG, c->repo) >= PATH_MAX ||
+         snprintf(c->advisories, PATH_MAX, "%s/" DIR_META "/" NAME_ADVISORIES, c->repo) >= PATH_MAX ||
+         snprintf(c->index, PATH_MAX, "%s/" DIR_INDEX, c->repo) >= PATH_MAX ) {
+        return EXIT_FAILURE;
+    }
+    if ( *c->stage == '\0' ) memcpy(c->stage, c->meta, PATH_MAX);
+    return EXIT_SUCCESS;
+}
+
+/**
+    Set a configuration value.
+
+    :Keys:
+        - repo: Path to the pip repo.
+        - stage: Staging directory, on the repo's file system.
+        - jobs: Number of worker threads; 0 for the number of CPUs.
+        - read_buffer, copy_buffer, hash_buffer: Buffer sizes, in
+          bytes, with an optional K, M or G suffix (e.g. 4M).
+        - stale_stage: Age, in seconds, after which a stage left by an
+          earlier run is purged; 0 to keep the stages.
+
+    @param[in]  key     Name of the setting.
+    @param[in]  value   Value of the setting.
+
+    @return             0 on success, otherwise 1 if the key is not known
+                        or the value is not valid.
+*/
+int config_set(const char *key, const char *value) {
+
+    char    *end;
+    long    n;
+    size_t  size;
+
+    if ( !strcmp(key, "repo") ) return set_path(_config.repo, value);
+    if ( !strcmp(key, "stage") ) return set_path(_config.stage, value);
+    if ( !strcmp(key, "jobs") ) {
+        n = strtol(value, &end, 10);
+        if ( !*value || *end || n < 0 || n > 1024 ) return EXIT_FAILURE;
+        _config.njobs = (int)n;
+        return EXIT_SUCCESS;
+    }
+    if ( !strcmp(key, "read_buffer") ) {
+        // The pack stream is decrypted in place, a whole number of blocks at a time.
+        if ( parse_size(value, &size) || size % CONFIG_AES_BLOCK ) return EXIT_FAILURE;
+        _config.read_buffsz = size;
+        return EXIT_SUCCESS;
+    }
+    if ( !strcmp(key, "copy_buffer") ) return parse_size(value, &_config.copy_buffsz);
+    if ( !strcmp(key, "hash_buffer") ) return parse_size(value, &_config.hash_buffsz);
+    if ( !strcmp(key, "stale_stage") ) {
+        n = strtol(value, &end, 10);
+        if ( !*value || *end || n < 0 ) return EXIT_FAILURE;
+        _config.stale_stage = n;
+        return EXIT_SUCCESS;
+    }
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,77 @@
+/**
+    Header file for the config.c module.
+*/
+
+#ifndef _CONFIG_H
+#define _CONFIG_H
+
+/**
+    The program's runtime configuration.
+*/
+struct config {
+    char        repo[PATH_MAX];         // The pip repo, into which the archives are unpacked.
+    char        stage[PATH_MAX];        // Directory in which the archives are staged.
+    char        meta[PATH_MAX];         // The repo's hidden (.ppk) directory; the default stage.
+    char        catalog[PATH_MAX];      // Catalog of the repo's files.
+    char        index[PATH_MAX];        // The repo's PEP 503 simple index.
+    char        advisories[PATH_MAX];   // Installed offline advisory snapshot.
+    int         njobs;                  // Number of worker threads, or 0 for the number of CPUs.
+    size_t      read_buffsz;            // Archive read and decode buffer, in bytes.
+    size_t      copy_buffsz;            // Cross-device copy buffer, in bytes.
+    size_t      hash_buffsz;            // Hash buffer, for files which cannot be mapped, in bytes.
+    long        stale_stage;            // Age (seconds) of a stale stage, which is purged; 0 to keep.
+};
+
+/**
+    Return the program's configuration.
+
+    The configuration is set while the arguments are verified, before
+    any worker thread is started, and is read-only thereafter.
+
+    @return     Pointer to the configuration.
+*/
+const struct config *config_get(void);
+
+/**
+    Load the settings from a configuration file.
+
+    The file contains one 'key = value' setting per line, as accepted by
+    config_set(). Blank lines, and lines starting with '#', are ignored.
+
+    @param[in]  fpath   Explicit path to the configuration file.
+
+    @return             0 on success, otherwise -1 if the file could not be
+                        opened (see errno), or the (1-based) number of the
+                        first line which holds an invalid setting.
+*/
+int config_load(const char *fpath);
+
+/**
+    Derive the repo's paths from the configured repo, and set the stage
+    to the repo's hidden directory, if not configured.
+
+    @return     0 on success, otherwise 1 if a path is too long.
+*/
+int config_resolve(void);
+
+/**
+    Set a configuration value.
+
+    :Keys:
+        - repo: Path to the pip repo.
+        - stage: Staging directory, on the repo's file system.
+        - jobs: Number of worker threads; 0 for the number of CPUs.
+        - read_buffer, copy_buffer, hash_buffer: Buffer sizes, in
+          bytes, with an optional K, M or G suffix (e.g. 4M).
+        - stale_stage: Age, in seconds, after which a stage left by an
+          earlier run is purged; 0 to keep the stages.
+
+    @param[in]  key     Name of the setting.
+    @param[in]  value   Value of the setting.
+
+    @return             0 on success, otherwise 1 if the key is not known
+                        or the value is not valid.
+*/
+int config_set(const char *key, const char *value);
+
+#endif /* _CONFIG_H */
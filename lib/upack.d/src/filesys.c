@@ -24,18 +24,157 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+// Required for copy_file_range(2) and fallocate(2).
+#define _GNU_SOURCE
+
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <libgen.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include "base.h"
+#include "config.h"
+#include "filesys.h"
+#include "pool.h"
 #include "ui.h"
 #include "utils.h"
 
+
+/**
+    A single file move, as run by a moveall() or movefiles() worker.
+*/
+struct move_task {
+    char        src[PATH_MAX];  // Explicit path to the source file.
+    char        dst[PATH_MAX];  // Explicit path to the destination file.
+    const char  *dir;           // Destination directory.
+    const char  *label;         // Caller's message label (see ui_set_label).
+    bool        xdev;           // The directories are on different file systems.
+    bool        synced;         // The source file's data has already been flushed.
+    bool        verbose;
+    bool        copied;         // The file was copied, rather than renamed.
+    uint64_t    size;           // Size of the file moved, in bytes.
+    int         excode;
+};
+
+// Function prototypes
+int copyfile(const char *src, const char *dst);
+int makedir(const char *dpath, mode_t mode, bool verbose);
+int moveall(const char *src, const char *dst, bool verbose, struct pool *pool, struct move_stats *stats);
+int movefiles(const char *src, const char *dst, const char **names, size_t nnames, bool synced,
+              bool verbose, struct pool *pool, struct move_stats *stats);
+int removeall(const char *dpath, bool rmvdir, bool verbose);
+
+/* ----------------------------------------------------------------------
+    Copy engine helpers.
+
+    Each method copies the remainder of the file from the current file
+    offsets, so a method which is found to be unsupported part way
+    through a copy simply hands over to the next method.
+
+    Return codes: 0 on success, 1 on error, or -1 if the method is not
+    supported by the file system(s) involved.
+   ---------------------------------------------------------------------- */
+
+/**
+    Test if an errno value indicates the copy method is not supported for
+    the given pair of files, rather than a genuine I/O error.
+*/
+static bool copy_unsupported(int err) {
+    return ( err == EXDEV || err == EINVAL || err == ENOSYS || err == EOPNOTSUPP ||
+             err == ENOTTY || err == EPERM || err == EBADF );
+}
+
+/**
+    Copy the remainder of the file using copy_file_range(2), which is
+    performed (or offloaded) by the kernel without a userspace copy.
+*/
+static int copy_range(int fdi, int fdo, off_t size, off_t *done) {
+
+    ssize_t n;
+
+    while ( *done < size ) {
+        if ( (n = copy_file_range(fdi, NULL, fdo, NULL, size - *done, 0)) < 0 ) {
+            if ( errno == EINTR ) continue;
+            return ( copy_unsupported(errno) ) ? -1 : 1;
+        }
+        if ( n == 0 ) break;  // Source was truncated during the copy.
+        *done += n;
+    }
+    return 0;
+}
+
+/**
+    Copy the remainder of the file using sendfile(2), which avoids the
+    userspace copy where copy_file_range(2) is not available.
+*/
+static int copy_sendfile(int fdi, int fdo, off_t size, off_t *done) {
+
+    ssize_t n;
+
+    while ( *done < size ) {
+        if ( (n = sendfile(fdo, fdi, NULL, size - *done)) < 0 ) {
+            if ( errno == EINTR ) continue;
+            return ( copy_unsupported(errno) ) ? -1 : 1;
+        }
+        if ( n == 0 ) break;
+        *done += n;
+    }
+    return 0;
+}
+
+/**
+    Copy the remainder of the file through a userspace buffer. This is
+    the last resort, and is always supported.
+*/
+static int copy_buffered(int fdi, int fdo, off_t *done) {
+
+    char    *buff;
+    size_t  buffsz = config_get()->copy_buffsz;
+    ssize_t n;
+    ssize_t w;
+
+    if ( (buff = malloc(buffsz)) == NULL ) return 1;
+    while ( (n = read(fdi, buff, buffsz)) != 0 ) {
+        if ( n < 0 ) {
+            if ( errno == EINTR ) continue;
+            free(buff);
+            return 1;
+        }
+        for ( ssize_t off = 0; off < n; off += w ) {
+            if ( (w = write(fdo, buff + off, n - off)) < 0 ) {
+                if ( errno == EINTR ) { w = 0; continue; }
+                free(buff);
+                return 1;
+            }
+        }
+        *done += n;
+    }
+    free(buff);
+    return 0;
+}
+
 /**
     Copy a single file from the source directory to the destination.
 
+    The fastest available method is used, in order of preference:
+
+        - FICLONE: A reflink (copy-on-write clone), where the source and
+          destination share a file system which supports it (e.g. XFS,
+          Btrfs). No data is copied.
+        - copy_file_range(2): Performed in the kernel, and offloaded to
+          the server for NFS v4.2.
+        - sendfile(2): Performed in the kernel.
+        - Buffered read(2) / write(2).
+
+    Unless cloned, the destination is preallocated using fallocate(2).
+    The source file's permissions are preserved. Its access /
+    modification times are not; so a file being copied is never mistaken
+    for a stale one (see move_file).
+
     Note: The destination directory *must* exist, otherwise file creation
           process the write will fail, and the function will return an 
           error code.
@@ -49,132 +188,338 @@
 */
 int copyfile(const char *src, const char *dst) {
 
-    int     sz = 1024*1024;  // 1 Mb
-    char    buff[sz];
-    char    msgbuff[256];
-    size_t  bytes;
-    FILE    *fpi, *fpo;
+    char            msgbuff[PATH_MAX + 256];
+    int             excode = -1;
+    int             fdi;
+    int             fdo;
+    off_t           done = 0;
+    struct stat     st;
 
-    if ( (fpi = fopen(src, "rb")) == NULL ) {
+    if ( (fdi = open(src, O_RDONLY)) < 0 || fstat(fdi, &st) ) {
         // Note: The basename function expects 'char *', so casting as such to drop the 'const' 
         //       qualifier.
-        sprintf(msgbuff, "An error occured while reading source file: %s", basename((char *)src));
+        snprintf(msgbuff, sizeof(msgbuff), "An error occured while reading source file: %s",
+                 basename((char *)src));
         reporterror(msgbuff, false, false);
+        if ( fdi >= 0 ) close(fdi);
         return EXIT_FAILURE;
     }
-    if ( (fpo = fopen(dst, "wb")) == NULL ) {
-        sprintf(msgbuff, 
-                "An error occured creating the destination file: %s\n"
-                "\t - %s", dst, strerror(errno));
+    if ( (fdo = open(dst, O_WRONLY | O_CREAT | O_TRUNC, st.st_mode & 07777)) < 0 ) {
+        snprintf(msgbuff, sizeof(msgbuff),
+                 "An error occured creating the destination file: %s\n"
+                 "\t - %s", dst, strerror(errno));
         reporterror(msgbuff, false, false);
+        close(fdi);
         return EXIT_FAILURE;
     }
-    while ( (bytes = fread(buff, sizeof(char), sz, fpi)) != 0 ) {
-        if ( (fwrite(buff, sizeof(char), bytes, fpo)) != bytes ) {
-            // Note: The basename function expects 'char *', so casting as such to drop the 'const' 
-            //       qualifier.
-            sprintf(msgbuff, "An error occurred while copying: %s -> %s", basename((char *)src), dst);
+    if ( ioctl(fdo, FICLONE, fdi) == 0 ) {
+        excode = 0;
+        done = st.st_size;
+    } else if ( st.st_size > 0 && fallocate(fdo, 0, 0, st.st_size) && !copy_unsupported(errno) ) {
+        // Out of space (or quota); there is no point attempting the copy.
+        excode = 1;
+    } else {
+        if ( excode < 0 ) excode = copy_range(fdi, fdo, st.st_size, &done);
+        if ( excode < 0 ) excode = copy_sendfile(fdi, fdo, st.st_size, &done);
+        /* Drain anything beyond the stat'd size (e.g. a file which grew, or
+           reports a zero size); this is a single read(2) at EOF, otherwise. */
+        if ( excode <= 0 ) excode = copy_buffered(fdi, fdo, &done);
+    }
+    // Trim the preallocation if the source was truncated during the copy.
+    if ( !excode && done < st.st_size && ftruncate(fdo, done) ) excode = 1;
+    // Preserve the permissions (not subject to the umask).
+    if ( !excode && fchmod(fdo, st.st_mode & 07777) ) excode = 1;
+    close(fdi);
+    if ( close(fdo) ) excode = 1;
+    if ( excode ) {
+        // Note: The basename function expects 'char *', so casting as such to drop the 'const' 
+        //       qualifier.
+        snprintf(msgbuff, sizeof(msgbuff), "An error occurred while copying: %s -> %s\n"
+                 "\t - %s", basename((char *)src), dst, strerror(errno));
+        reporterror(msgbuff, false, false);
+        unlink(dst);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+    Create a directory. 
+
+    Note: All parent directories must apready exist.
+
+    @param[in]  dpath   Path to the directory, for which the right-most 
+                        child will be created.
+    @param[in]  mode    Permissions mode assigned to the directory.
+    @param[in]  verbose Pass true to display error messages relating
+                        to the directory creation, error messages will be 
+                        suppressed.
+
+    @return             The exit code from the mkdir function. 
+*/
+int makedir(const char *dpath, mode_t mode, bool verbose) {
+
+    int excode;
+
+    if ( ((excode = mkdir(dpath, mode)) != 0) && (verbose) ) {
+        reporterror(strerror(errno), false, false);
+    }
+    return excode;
+}
+
+/* ----------------------------------------------------------------------
+    File mover helpers.
+   ---------------------------------------------------------------------- */
+
+/**
+    Flush a file's data to storage, so it is durable before the file is
+    (atomically) renamed into place.
+
+    @return     0 on success, otherwise 1.
+*/
+static int sync_file(const char *fpath) {
+
+    int fd;
+    int excode;
+
+    if ( (fd = open(fpath, O_RDONLY)) < 0 ) return EXIT_FAILURE;
+    excode = ( fdatasync(fd) ) ? EXIT_FAILURE : EXIT_SUCCESS;
+    close(fd);
+    return excode;
+}
+
+/**
+    Move a single file into the destination directory.
+
+    Within a file system, the file is renamed directly. Otherwise, the
+    file is copied to a hidden temporary name in the destination
+    directory (.<name>MOVE_TEMP_TAG<XXXXXX>) and renamed over the final
+    name, so a partially copied file is never visible under its final
+    name. The source file's access / modification times are applied
+    once the copy is renamed; so, until then, the temporary file's times
+    are those of the copy, and a copy in progress is never purged as
+    stale (see journal_purge).
+
+    In either case, the file's data is flushed before the rename, unless
+    the caller has already flushed the source file (and it is renamed).
+    The directory entries are flushed by the caller, once all files have
+    been moved.
+
+    @return     0 on success, otherwise 1.
+*/
+static int move_file(struct move_task *t) {
+
+    bool            statted;
+    char            msgbuff[PATH_MAX * 2 + 256];
+    char            tmp[PATH_MAX];
+    int             fd;
+    struct stat     st;
+    struct timespec times[2];
+
+    if ( t->verbose ) printf("Moving: %s -> %s\n", t->src, t->dst);
+    statted = ( stat(t->src, &st) == 0 );
+    t->size = ( statted ) ? (uint64_t)st.st_size : 0;
+    if ( !t->xdev ) {
+        if ( (t->synced || sync_file(t->src) == 0) && rename(t->src, t->dst) == 0 ) return EXIT_SUCCESS;
+        /* rename(2) does not work across file systems (or mount points), EXDEV
+           is thrown. In this case, perform a copy / unlink to 'move' the file. */
+        if ( errno != EXDEV ) {
+            snprintf(msgbuff, sizeof(msgbuff), "An error occurred while moving: %s to %s", t->src, t->dir);
             reporterror(msgbuff, false, false);
             return EXIT_FAILURE;
         }
     }
-    fclose(fpi);
-    fclose(fpo);
+    snprintf(tmp, sizeof(tmp), "%s/.%s" MOVE_TEMP_TAG "XXXXXX", t->dir, strrchr(t->src, '/') + 1);
+    if ( (fd = mkstemp(tmp)) < 0 ) {
+        snprintf(msgbuff, sizeof(msgbuff), "An error occurred creating a temporary file in: %s\n"
+                 "\t - %s", t->dir, strerror(errno));
+        reporterror(msgbuff, false, false);
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    t->copied = true;
+    if ( copyfile(t->src, tmp) ) {
+        unlink(tmp);
+        return EXIT_FAILURE;
+    }
+    if ( sync_file(tmp) || rename(tmp, t->dst) ) {
+        snprintf(msgbuff, sizeof(msgbuff), "An error occurred while moving: %s to %s\n"
+                 "\t - %s", t->src, t->dir, strerror(errno));
+        reporterror(msgbuff, false, false);
+        unlink(tmp);
+        return EXIT_FAILURE;
+    }
+    // The file is already published; its times are not worth failing the move for.
+    if ( statted ) {
+        times[0] = st.st_atim;
+        times[1] = st.st_mtim;
+        utimensat(AT_FDCWD, t->dst, times, 0);
+    }
+    // Delete the source file to complete the move.
+    unlink(t->src);
     return EXIT_SUCCESS;
 }
 
 /**
-    Search a directory for a given pattern.
+    Pool task wrapper for move_file(). The caller's message label is
+    carried to the worker thread.
+*/
+static void move_task_run(void *arg) {
 
-    This function returns the path to the *first* file matching the given
-    ipattern.
+    const char          *label = ui_label();
+    struct move_task    *t = arg;
 
-    @param[in]  dpath   Explicit path to the directory to be searched.
-    @param[in]  pattern A string pattern to search.
-                        If the pattern begins with a '.', this is 
-                        interpreted as an *extension* search. Otherwise.
-                        the string is searched using the strstr() function
-                        with the *first* hit being returned.
+    ui_set_label(t->label);
+    t->excode = move_file(t);
+    ui_set_label(label);
+}
 
-    @return             If found, the full path to the *first* match is
-                        returned.
+/**
+    Initialise a move task for the named file.
+*/
+static void init_task(struct move_task *t, const char *src, const char *dst, const char *name, bool xdev,
+                      bool synced, bool verbose) {
+    snprintf(t->src, sizeof(t->src), "%s/%s", src, name);
+    snprintf(t->dst, sizeof(t->dst), "%s/%s", dst, name);
+    t->dir = dst;
+    t->label = ui_label();
+    t->xdev = xdev;
+    t->synced = synced;
+    t->verbose = verbose;
+    t->copied = false;
+    t->excode = EXIT_FAILURE;
+}
 
-    Example:
+/**
+    Verify the source and destination directories exist, and test if
+    they are on different file systems.
 
-        char *file;
+    @return     0 on success, otherwise -2 if either directory could not
+                be accessed; in which case an error is reported.
+*/
+static int move_dirs(const char *src, const char *dst, bool *xdev) {
 
-        file = findfile("/path/to/directory", ".log");
-        free(file);
+    char        msgbuff[PATH_MAX + 256];
+    struct stat st_src;
+    struct stat st_dst;
 
-    Reminder: The memory allocated by this function **must be freed** by 
-              the caller.
+    if ( stat(dst, &st_dst) || (!S_ISDIR(st_dst.st_mode) && (errno = ENOTDIR)) ) {
+        snprintf(msgbuff, sizeof(msgbuff), "%s: %s", strerror(errno), dst);
+        reporterror(msgbuff, false, false);
+        return -2;
+    }
+    if ( stat(src, &st_src) || !S_ISDIR(st_src.st_mode) ) {
+        reporterror("The provided source directory does not exist.", false, false);
+        return -2;
+    }
+    *xdev = ( st_src.st_dev != st_dst.st_dev );
+    return EXIT_SUCCESS;
+}
 
+/**
+    Run the move tasks; concurrently, if a pool is provided. Then flush
+    the destination directory with a single fsync(2).
+
+    @return     0 if every file was moved, otherwise -1.
 */
-char *findfile(const char *dpath, const char *pattern) {
-
-    bool    found = false;
-    char    *ext;
-    char    *outpath = (char *)calloc(sizeof(char), PATH_MAX + 1);
-    int     use_ext = ( pattern[0] == '.' );
-    struct  dirent *ep;
-    DIR     *dp;
-    
-    if ( (dp = opendir(dpath)) == NULL ) {
-        reporterror("The provided directory does not exist", false, false);
-        return NULL;
+static int move_run(struct move_task *tasks, size_t ntasks, const char *dst, struct pool *pool,
+                    struct move_stats *stats) {
+
+    char                msgbuff[PATH_MAX + 256];
+    int                 excode = EXIT_SUCCESS;
+    int                 fd = -1;
+    size_t              count_mov = 0;  // Count of files successfully moved.
+    struct pool_batch   batch = {0};
+
+    for ( size_t i = 0; i < ntasks; ++i ) {
+        if ( pool == NULL || pool_submit(pool, &batch, move_task_run, &tasks[i]) ) {
+            move_task_run(&tasks[i]);
+        }
     }
-    while ( (ep = readdir(dp)) ) {
-        if ( ep->d_type == DT_REG ) {
-            if ( use_ext ) {
-                if ( (ext = strrchr(ep->d_name, '.')) && !(strcmp(ext, pattern)) ) {
-                    found = true;
-                    break;
-                } 
-            } else {
-                if ( strstr(ep->d_name, pattern) ) {
-                    found = true;
-                    break;
-                }
-            }
+    if ( pool ) pool_wait(pool, &batch);
+    for ( size_t i = 0; i < ntasks; ++i ) {
+        if ( tasks[i].excode ) continue;
+        ++count_mov;
+        if ( stats == NULL ) continue;
+        if ( tasks[i].copied ) {
+            ++stats->copied;
+        } else {
+            ++stats->renamed;
         }
+        stats->bytes += tasks[i].size;
     }
-    closedir(dp);
-    // Build complete file path for return.
-    if ( found )
-        sprintf(outpath, "%s/%s", dpath, ep->d_name);
-    return outpath;
+    // Flush the new directory entries (a single fsync for all files).
+    if ( count_mov && ((fd = open(dst, O_RDONLY | O_DIRECTORY)) < 0 || fsync(fd)) ) {
+        snprintf(msgbuff, sizeof(msgbuff), "%s: Error occurred while flushing: %s", strerror(errno), dst);
+        reporterror(msgbuff, false, false);
+        excode = -1;
+    }
+    if ( fd >= 0 ) close(fd);
+    if ( excode || count_mov != ntasks ) return -1;
+    print_done(false);
+    return EXIT_SUCCESS;
 }
 
 /**
-    Create a directory. 
-
-    Note: All parent directories must apready exist.
+    Move the named files from the source directory to the destination.
 
-    @param[in]  dpath   Path to the directory, for which the right-most 
-                        child will be created.
-    @param[in]  mode    Permissions mode assigned to the directory.
-    @param[in]  verbose Pass true to display error messages relating
-                        to the directory creation, error messages will be 
-                        suppressed.
+    The files are moved as by moveall(), but the source directory is not
+    read; the names are taken from the caller's table (e.g. the job's
+    entry table, as built while the archive was extracted). If the caller
+    has already flushed the files' data (e.g. as each was unpacked), the
+    files are renamed without flushing them again.
 
-    @return             The exit code from the mkdir function. 
+    @param[in] src      Pointer to a string containing the full path to
+                        the source directory.
+    @param[in] dst      Pointer to a string containing the full path to
+                        the destination directory.
+    @param[in] names    Array of the base filenames to be moved.
+    @param[in] nnames   Number of files to be moved.
+    @param[in] synced   The files' data has already been flushed.
+    @param[in] verbose  If true, a 'Moving src -> dst' message is
+                        displayed to the terminal.
+    @param[in] pool     Worker pool used to move the files concurrently,
+                        or NULL to move the files sequentially.
+    @param[out] stats   Counts of the files moved, added to the totals
+                        held, or NULL.
+
+    @return             - 0 if every named file was moved.
+                        - -1 if any file could not be moved, or the
+                          destination directory could not be flushed.
+                        - -2 if either directory could not be accessed.
 */
-int makedir(const char *dpath, mode_t mode, bool verbose) {
+int movefiles(const char *src, const char *dst, const char **names, size_t nnames, bool synced,
+              bool verbose, struct pool *pool, struct move_stats *stats) {
 
-    int excode;
+    bool                xdev;
+    int                 excode;
+    struct move_task    *tasks;
 
-    if ( ((excode = mkdir(dpath, mode)) != 0) && (verbose) ) {
-        reporterror(strerror(errno), false, false);
+    if ( move_dirs(src, dst, &xdev) ) return -2;
+    print_start("\nMoving files to the pip repo ...");
+    if ( (tasks = malloc((nnames + 1) * sizeof(*tasks))) == NULL ) {
+        reporterror("Error occurred while allocating memory for the file moves.", false, false);
+        return -1;
     }
+    for ( size_t i = 0; i < nnames; ++i ) init_task(&tasks[i], src, dst, names[i], xdev, synced, verbose);
+    excode = move_run(tasks, nnames, dst, pool, stats);
+    free(tasks);
     return excode;
 }
 
 /**
     Move *all* files from the source directory to the destination.
 
-    First, the move attempts to use rename(2). If this fails for 
-    EXDEV (18) (cannot move across file systems) a copy and delete are 
-    attempted.
+    Within a file system, each file is moved using rename(2). Across file
+    systems (EXDEV), each file is copied to a temporary name in the
+    destination, then atomically renamed into place, and the source is
+    deleted.
+
+    If a pool is provided, the files are moved concurrently by its
+    workers; as cross-device moves are latency bound (particularly onto
+    a network mount), this keeps several copies in flight. The
+    destination directory is flushed with a single fsync(2) once all
+    files have been moved.
 
     Note: If either directory does not exist, the function will exit in 
           error.
@@ -185,150 +530,150 @@ int makedir(const char *dpath, mode_t mode, bool verbose) {
                         the destination directory.
     @param[in] verbose  If true, a 'Moving src -> dst' message is 
                         displayed to the terminal.
+    @param[in] pool     Worker pool used to move the files concurrently,
+                        or NULL to move the files sequentially.
+    @param[out] stats   Counts of the files moved, added to the totals
+                        held, or NULL.
 
     @return             - 0 if the number of files moved equals the number
                           of files found in the directory.
                         - -1 if the number of encountered files is not 
-                          equal to the number of files moved.
+                          equal to the number of files moved, or the
+                          destination directory could not be flushed.
                         - -2 if opening either directory fails.
 */
-int moveall(const char *src, const char *dst, bool verbose) {
-
-    char    fnbuff_src[PATH_MAX];
-    char    fnbuff_dst[PATH_MAX];
-    char    msgbuff[PATH_MAX + 256];
-    int     count_act = 0;  // Actual count of files encountered.
-    int     count_mov = 0;  // Count of files successfully moved.
-    struct  dirent *ep;
-    DIR     *dp;
-
-    if ( (dp = opendir(dst)) == NULL ) {
-        sprintf(msgbuff, "%s: %s", strerror(errno), dst);
-        reporterror(msgbuff, false, false);
-        return -2;
-    } else {
-        closedir(dp);
-    }
+int moveall(const char *src, const char *dst, bool verbose, struct pool *pool, struct move_stats *stats) {
+
+    bool                xdev;
+    int                 excode = EXIT_SUCCESS;
+    size_t              capacity = 0;
+    size_t              ntasks = 0;     // Actual count of files encountered.
+    struct  dirent      *ep;
+    struct  move_task   *tasks = NULL;
+    struct  move_task   *tmp;
+    DIR                 *dp;
+
+    if ( move_dirs(src, dst, &xdev) ) return -2;
     if ( (dp = opendir(src)) == NULL ) {
         reporterror("The provided source directory does not exist.", false, false);
         return -2;
     }
     print_start("\nMoving files to the pip repo ...");
+    // Collect the files first, so the directory is not modified while it is read.
     while ( (ep = readdir(dp)) ) {
         if ( ep->d_type == DT_REG ) {
-            ++count_act;
-            sprintf(fnbuff_src, "%s/%s", src, ep->d_name);
-            sprintf(fnbuff_dst, "%s/%s", dst, ep->d_name);
-            if ( verbose ) printf("Moving: %s -> %s\n", fnbuff_src, fnbuff_dst);
-            if ( rename(fnbuff_src, fnbuff_dst) ) {
-                /* rename(2) does not work across file systems, EXDEV (18) is thrown.
-                   In this case, perform a copy / unlink to 'move' the file. */
-                if ( errno == 18 ) {
-                    if ( !copyfile(fnbuff_src, fnbuff_dst) ) {
-                        // Delete the file to simulate a move.
-                        unlink(fnbuff_src);
-                        ++count_mov;
-                    }
-                } else {
-                    sprintf(msgbuff, "An error occurred while moving: %s to %s", fnbuff_src, dst);
-                    reporterror(msgbuff, false, false);
+            if ( ntasks == capacity ) {
+                capacity = ( capacity ) ? capacity * 2 : 64;
+                if ( (tmp = realloc(tasks, capacity * sizeof(*tasks))) == NULL ) {
+                    reporterror("Error occurred while allocating memory for the file moves.", false, false);
+                    excode = -1;
+                    break;
                 }
-            } else {
-                ++count_mov;
+                tasks = tmp;
             }
+            init_task(&tasks[ntasks++], src, dst, ep->d_name, xdev, false, verbose);
         }
     }
     closedir(dp);
-    if ( count_act != count_mov ) {
-        return -1;
-    }
-    print_done(false);
-    return EXIT_SUCCESS;
+    if ( !excode ) excode = move_run(tasks, ntasks, dst, pool, stats);
+    free(tasks);
+    return excode;
 }
 
 /**
-    Remove all files under the given path, including subdirectories.
+    Remove the contents of an open directory, relative to its file
+    descriptor (which is closed), so no entry's path is looked up from
+    the root. A sub-directory is opened relative to its parent.
 
-    @param[in]  fpath   Pointer to a string containing the explicit path
-                        to be removed.
-    @param[in]  rmvdir  Remove the directory once empty.
+    An entry which is already gone (e.g. a file which was renamed into
+    the repo) is not an error.
+
+    @param[in]  fd      File descriptor of the directory.
+    @param[in]  dpath   Explicit path to the directory, for the messages.
     @param[in]  verbose Display the filenames are they are deleted.
 
-    @return             Number of files successfully removed, or -1 if 
-                        the function ended in error.
+    @return             Number of files removed, or -1 if the directory
+                        could not be read.
 */
-int removeall(const char *dpath, bool rmvdir, bool verbose) {
-    
-    char    msgbuff[PATH_MAX + 256];
-    char    fpath[PATH_MAX+1];
-    int     i = 0;
-    struct  dirent *ep;
-    DIR     *dp;
-
-    if ( (dp = opendir(dpath)) == NULL ) {
-        reporterror("Error opening directory, does not exist.", false, false);
+static int remove_at(int fd, const char *dpath, bool verbose) {
+
+    bool            isdir;
+    char            msgbuff[PATH_MAX + 256];
+    char            subpath[PATH_MAX];
+    int             i = 0;
+    int             n;
+    int             subfd;
+    struct dirent   *ep;
+    struct stat     st;
+    DIR             *dp;
+
+    if ( (dp = fdopendir(fd)) == NULL ) {
+        close(fd);
         return -1;
     }
     while ( (ep = readdir(dp)) ) {
-        sprintf(fpath, "%s/%s", dpath, ep->d_name);
-        if ( ep->d_type == DT_REG ) {
-            if ( verbose ) printf("  - Deleting: %s\n", ep->d_name);
-            if ( remove(fpath) ) {
-                sprintf(msgbuff, "Error occurred while removing: %s", fpath);
+        if ( !strcmp(ep->d_name, ".") || !strcmp(ep->d_name, "..") ) continue;
+        isdir = ( ep->d_type == DT_DIR );
+        if ( ep->d_type == DT_UNKNOWN ) {
+            isdir = ( !fstatat(fd, ep->d_name, &st, AT_SYMLINK_NOFOLLOW) && S_ISDIR(st.st_mode) );
+        }
+        if ( isdir ) {
+            // A sub-directory was found. Remove it.
+            snprintf(subpath, sizeof(subpath), "%s/%s", dpath, ep->d_name);
+            if ( (subfd = openat(fd, ep->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)) >= 0 &&
+                 (n = remove_at(subfd, subpath, false)) > 0 ) {
+                i += n;
+            }
+            if ( unlinkat(fd, ep->d_name, AT_REMOVEDIR) && errno != ENOENT ) {
+                snprintf(msgbuff, sizeof(msgbuff), "Error occurred while removing: %s", subpath);
                 reporterror(msgbuff, false, false);
-            } else {
-                ++i;
             }
-        } else if ( (ep->d_type == DT_DIR) && ( (strcmp(ep->d_name, ".")) && (strcmp(ep->d_name, "..")) ) ) {
-            // A sub-directory was found. Remove it.
-            i += removeall(fpath, 1, 0);
+            continue;
+        }
+        if ( verbose ) printf("  - Deleting: %s\n", ep->d_name);
+        if ( unlinkat(fd, ep->d_name, 0) == 0 ) {
+            ++i;
+        } else if ( errno != ENOENT ) {
+            snprintf(msgbuff, sizeof(msgbuff), "Error occurred while removing: %s/%s", dpath, ep->d_name);
+            reporterror(msgbuff, false, false);
         }
     }
     closedir(dp);
-    if ( rmvdir ) rmdir(dpath);
     return i;
 }
 
 /**
-    Unzip the archive file pointed to by fpath, into the directory pointed
-    to by opath.
-
-    If the o(ut)path directory does not exist, its right-most directory is
-    created. However, all parent directories must already exist.
+    Remove all files under the given path, including subdirectories.
 
-    Note: If the same filename already exists in the extraction location,
-          **it will be overwritten**.
+    The directory is opened once, and each entry is removed relative to
+    it (see remove_at). A directory which does not exist is already
+    removed.
 
-    @param[in]  fpath   Explicit file path to the .7z file to be tested 
-                        and unpacked.
-    @param[in]  opath   Output directory into which the archive is 
-                        unpacked.
+    @param[in]  fpath   Pointer to a string containing the explicit path
+                        to be removed.
+    @param[in]  rmvdir  Remove the directory once empty.
+    @param[in]  verbose Display the filenames are they are deleted.
 
-    @return             0 if the archive is tested and unpacked 
-                        successfully, otherwise 1.
+    @return             Number of files successfully removed, or -1 if 
+                        the function ended in error.
 */
-int unzip(const char *fpath, const char *opath) {
-
-    char cmd_ext[256];
-    char cmd_tst[256];
-    char *hash = sha256_digest(basename((char *)fpath));
-
-    sprintf(cmd_tst, "7z t %s -p%s > /dev/null", fpath, hash);
-    sprintf(cmd_ext, "7z e %s -p%s -y -o%s > /dev/null", fpath, hash, opath);
-    print_start("Preparing the archive for verification ...");
-    if ( (system(cmd_tst) == 0) ) {
-        makedir(opath, 0700, 0);
-        //print_start("Unpacking the archive for verification ...");
-        if ( (system(cmd_ext)) == 0 ) {
-            //print_ok("Archive unpacked successfully.");
-        } else {
-            reporterror("An error occurred while unpacking the .7z file.", false, true);
-        }
-    } else {
-        reporterror("The archive test has failed.", false, true);
+int removeall(const char *dpath, bool rmvdir, bool verbose) {
+    
+    char    msgbuff[PATH_MAX + 256];
+    int     fd;
+    int     i;
+
+    if ( (fd = open(dpath, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0 ) {
+        if ( errno == ENOENT ) return 0;
+        snprintf(msgbuff, sizeof(msgbuff), "Error opening directory: %s: %s", strerror(errno), dpath);
+        reporterror(msgbuff, false, false);
+        return -1;
     }
-    print_done(0);
-    free(hash);
-    return EXIT_SUCCESS;
+    if ( (i = remove_at(fd, dpath, verbose)) < 0 ) {
+        snprintf(msgbuff, sizeof(msgbuff), "Error reading directory: %s", dpath);
+        reporterror(msgbuff, false, false);
+        return -1;
+    }
+    if ( rmvdir ) rmdir(dpath);
+    return i;
 }
-
@@ -5,9 +5,38 @@
 #ifndef _FILESYS_H
 #define _FILESYS_H
 
+struct pool;
+
+// Tag of the temporary files created by a cross-file system move: .<name>.ppk-move.XXXXXX
+#define MOVE_TEMP_TAG ".ppk-move."
+
+/**
+    Counts of the files moved by moveall() or movefiles(), by method.
+*/
+struct move_stats {
+    uint64_t    renamed;    // Moved by rename(2), within a file system.
+    uint64_t    copied;     // Copied across file systems, then renamed into place.
+    uint64_t    bytes;      // Total size of the files moved.
+};
+
 /**
     Copy a single file from the source directory to the destination.
 
+    The fastest available method is used, in order of preference:
+
+        - FICLONE: A reflink (copy-on-write clone), where the source and
+          destination share a file system which supports it (e.g. XFS,
+          Btrfs). No data is copied.
+        - copy_file_range(2): Performed in the kernel, and offloaded to
+          the server for NFS v4.2.
+        - sendfile(2): Performed in the kernel.
+        - Buffered read(2) / write(2).
+
+    Unless cloned, the destination is preallocated using fallocate(2).
+    The source file's permissions are preserved. Its access /
+    modification times are not; so a file being copied is never mistaken
+    for a stale one (see move_file).
+
     Note: The destination directory *must* exist, otherwise file creation
           process the write will fail, and the function will return an 
           error code.
@@ -21,35 +50,6 @@
 */
 int copyfile(const char *src, const char *dst);
 
-/**
-    Search a directory for a given pattern.
-
-    This function returns the path to the *first* file matching the given
-    ipattern.
-
-    @param[in]  dpath   Explicit path to the directory to be searched.
-    @param[in]  pattern A string pattern to search.
-                        If the pattern begins with a '.', this is 
-                        interpreted as an *extension* search. Otherwise.
-                        the string is searched using the strstr() function
-                        with the *first* hit being returned.
-
-    @return             If found, the full path to the *first* match is
-                        returned.
-
-    Example:
-
-        char *file;
-
-        file = findfile("/path/to/directory", ".log");
-        free(file);
-
-    Reminder: The memory allocated by this function **must be freed** by 
-              the caller.
-
-*/
-char *findfile(const char *dpath, const char *pattern);
-
 /**
     Create a directory. 
 
@@ -69,9 +69,16 @@ int makedir(const char *dpath, mode_t mode, bool verbose);
 /**
     Move *all* files from the source directory to the destination.
 
-    First, the move attempts to use rename(2). If this fails for 
-    EXDEV (18) (cannot move across file systems) a copy and delete are 
-    attempted.
+    Within a file system, each file is moved using rename(2). Across file
+    systems (EXDEV), each file is copied to a temporary name in the
+    destination, then atomically renamed into place, and the source is
+    deleted.
+
+    If a pool is provided, the files are moved concurrently by its
+    workers; as cross-device moves are latency bound (particularly onto
+    a network mount), this keeps several copies in flight. The
+    destination directory is flushed with a single fsync(2) once all
+    files have been moved.
 
     Note: If either directory does not exist, the function will exit in 
           error.
@@ -82,18 +89,58 @@ int makedir(const char *dpath, mode_t mode, bool verbose);
                         the destination directory.
     @param[in] verbose  If true, a 'Moving src -> dst' message is 
                         displayed to the terminal.
+    @param[in] pool     Worker pool used to move the files concurrently,
+                        or NULL to move the files sequentially.
+    @param[out] stats   Counts of the files moved, added to the totals
+                        held, or NULL.
 
     @return             - 0 if the number of files moved equals the number
                           of files found in the directory.
                         - -1 if the number of encountered files is not 
-                          equal to the number of files moved.
+                          equal to the number of files moved, or the
+                          destination directory could not be flushed.
                         - -2 if opening either directory fails.
 */
-int moveall(const char *src, const char *dst, bool verbose);
+int moveall(const char *src, const char *dst, bool verbose, struct pool *pool, struct move_stats *stats);
+
+/**
+    Move the named files from the source directory to the destination.
+
+    The files are moved as by moveall(), but the source directory is not
+    read; the names are taken from the caller's table (e.g. the job's
+    entry table, as built while the archive was extracted). If the caller
+    has already flushed the files' data (e.g. as each was unpacked), the
+    files are renamed without flushing them again.
+
+    @param[in] src      Pointer to a string containing the full path to
+                        the source directory.
+    @param[in] dst      Pointer to a string containing the full path to
+                        the destination directory.
+    @param[in] names    Array of the base filenames to be moved.
+    @param[in] nnames   Number of files to be moved.
+    @param[in] synced   The files' data has already been flushed.
+    @param[in] verbose  If true, a 'Moving src -> dst' message is
+                        displayed to the terminal.
+    @param[in] pool     Worker pool used to move the files concurrently,
+                        or NULL to move the files sequentially.
+    @param[out] stats   Counts of the files moved, added to the totals
+                        held, or NULL.
+
+    @return             - 0 if every named file was moved.
+                        - -1 if any file could not be moved, or the
+                          destination directory could not be flushed.
+                        - -2 if either directory could not be accessed.
+*/
+int movefiles(const char *src, const char *dst, const char **names, size_t nnames, bool synced,
+              bool verbose, struct pool *pool, struct move_stats *stats);
 
 /**
     Remove all files under the given path, including subdirectories.
 
+    The directory is opened once, and each entry is removed relative to
+    it (see remove_at). A directory which does not exist is already
+    removed.
+
     @param[in]  fpath   Pointer to a string containing the explicit path
                         to be removed.
     @param[in]  rmvdir  Remove the directory once empty.
@@ -104,25 +151,5 @@ int moveall(const char *src, const char *dst, bool verbose);
 */
 int removeall(const char *dpath, bool rmvdir, bool verbose);
 
-/**
-    Unzip the archive file pointed to by fpath, into the directory pointed
-    to by opath.
-
-    If the o(ut)path directory does not exist, its right-most directory is
-    created. However, all parent directories must already exist.
-
-    Note: If the same filename already exists in the extraction location,
-          **it will be overwritten**.
-
-    @param[in]  fpath   Explicit file path to the .7z file to be tested 
-                        and unpacked.
-    @param[in]  opath   Output directory into which the archive is 
-                        unpacked.
-
-    @return             0 if the archive is tested and unpacked 
-                        successfully, otherwise 1.
-*/
-int unzip(const char *fpath, const char *opath);
-
 #endif /* _FILESYS_H */
 
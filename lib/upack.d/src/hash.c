@@ -0,0 +1,274 @@
+/**
+    Purpose:    This module provides the SHA-256 hashing functionality
+                shared by the unpacker's modules.
+
+    Developer:  J Berendt
+    Email:      development@s3dev.uk
+
+    Comments:   The digests are calculated using OpenSSL's EVP interface,
+                which selects the CPU's SHA extensions (e.g. Intel SHA-NI,
+                ARMv8 crypto extensions) at runtime, where available. The
+                low-level SHA256_* functions are deprecated as of OpenSSL
+                v3.
+
+    Copyright (C) 73rd Street Development
+    This file is part of the ppk project's upack program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fcntl.h>
+#include <openssl/evp.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "base.h"
+#include "config.h"
+#include "hash.h"
+#include "pool.h"
+
+// Function prototypes
+int hash_buffer(const void *buff, size_t size, unsigned char *digest);
+int hash_file(const char *fpath, unsigned char *digest);
+size_t hash_files(struct pool *pool, struct hash_task *tasks, size_t ntasks);
+int hash_final(struct hash *h, unsigned char *digest);
+void hash_free(struct hash *h);
+int hash_fromhex(const char *hex, unsigned char *digest);
+int hash_init(struct hash *h);
+void hash_tohex(const unsigned char *digest, char *hex);
+int hash_update(struct hash *h, const void *buff, size_t size);
+
+/**
+    Calculate the SHA-256 digest of a buffer.
+
+    @param[in]  buff    Data to be hashed.
+    @param[in]  size    Size of the data, in bytes.
+    @param[out] digest  Buffer of DIGEST_SIZE bytes to receive the digest.
+
+    @return             0 on success, otherwise 1.
+*/
+int hash_buffer(const void *buff, size_t size, unsigned char *digest) {
+    return ( EVP_Digest(buff, size, digest, NULL, EVP_sha256(), NULL) ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+    Hash an open file using buffered reads, for files which cannot be
+    memory mapped (e.g. pipes, or special files).
+
+    @return     0 on success, otherwise 1.
+*/
+static int hash_fd(int fd, unsigned char *digest) {
+
+    int             excode;
+    size_t          buffsz = config_get()->hash_buffsz;
+    ssize_t         n;
+    unsigned char   *buff;
+    struct hash     h;
+
+    if ( (buff = malloc(buffsz)) == NULL ) return EXIT_FAILURE;
+    if ( hash_init(&h) ) {
+        free(buff);
+        return EXIT_FAILURE;
+    }
+    while ( (n = read(fd, buff, buffsz)) != 0 ) {
+        if ( n < 0 && errno == EINTR ) continue;
+        if ( n < 0 || hash_update(&h, buff, n) ) break;
+    }
+    excode = ( n == 0 ) ? hash_final(&h, digest) : EXIT_FAILURE;
+    hash_free(&h);
+    free(buff);
+    return excode;
+}
+
+/**
+    Calculate the SHA-256 digest of a file.
+
+    The file is memory mapped where possible, otherwise it is hashed
+    using reads of the configured hash_buffer size (see config.h).
+
+    @param[in]  fpath   Explicit path to the file.
+    @param[out] digest  Buffer of DIGEST_SIZE bytes to receive the digest.
+
+    @return             0 on success, otherwise 1 if the file could not be
+                        read.
+*/
+int hash_file(const char *fpath, unsigned char *digest) {
+
+    int         excode;
+    int         fd;
+    void        *map;
+    struct stat st;
+
+    if ( (fd = open(fpath, O_RDONLY)) < 0 ) return EXIT_FAILURE;
+    if ( fstat(fd, &st) ) {
+        close(fd);
+        return EXIT_FAILURE;
+    }
+    if ( S_ISREG(st.st_mode) && st.st_size > 0 &&
+         (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED ) {
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        excode = hash_buffer(map, st.st_size, digest);
+        munmap(map, st.st_size);
+    } else {
+        excode = hash_fd(fd, digest);
+    }
+    close(fd);
+    return excode;
+}
+
+/**
+    Pool task wrapper for hash_file().
+*/
+static void hash_task_run(void *arg) {
+
+    struct hash_task *t = arg;
+
+    t->excode = hash_file(t->fpath, t->digest);
+}
+
+/**
+    Calculate the SHA-256 digests of many files at once.
+
+    The files are hashed concurrently by the pool's workers, one file
+    per task. Each task's exit code reports the result for its file.
+
+    @param[in]  pool    Worker pool, or NULL to hash the files in turn.
+    @param[in]  tasks   Array of files to be hashed.
+    @param[in]  ntasks  Number of files.
+
+    @return             The number of files which could not be hashed.
+*/
+size_t hash_files(struct pool *pool, struct hash_task *tasks, size_t ntasks) {
+
+    size_t              nfailed = 0;
+    struct pool_batch   batch = {0};
+
+    for ( size_t i = 0; i < ntasks; ++i ) {
+        if ( pool == NULL || pool_submit(pool, &batch, hash_task_run, &tasks[i]) ) {
+            hash_task_run(&tasks[i]);
+        }
+    }
+    if ( pool ) pool_wait(pool, &batch);
+    for ( size_t i = 0; i < ntasks; ++i ) {
+        if ( tasks[i].excode ) ++nfailed;
+    }
+    return nfailed;
+}
+
+/**
+    Finalise an incremental digest, and release its context.
+
+    @param[in]  h       Pointer to the digest.
+    @param[out] digest  Buffer of DIGEST_SIZE bytes to receive the digest.
+
+    @return             0 on success, otherwise 1.
+*/
+int hash_final(struct hash *h, unsigned char *digest) {
+
+    int excode;
+
+    excode = ( h->md && EVP_DigestFinal_ex(h->md, digest, NULL) ) ? EXIT_SUCCESS : EXIT_FAILURE;
+    hash_free(h);
+    return excode;
+}
+
+/**
+    Release an incremental digest's context, without finalising it.
+    Safe to call on a digest which has already been finalised or freed.
+
+    @param[in]  h       Pointer to the digest.
+*/
+void hash_free(struct hash *h) {
+    EVP_MD_CTX_free(h->md);
+    h->md = NULL;
+}
+
+/**
+    Return the value of a hexadecimal character, or -1.
+*/
+static int hexval(char c) {
+    if ( c >= '0' && c <= '9' ) return c - '0';
+    if ( c >= 'a' && c <= 'f' ) return c - 'a' + 10;
+    if ( c >= 'A' && c <= 'F' ) return c - 'A' + 10;
+    return -1;
+}
+
+/**
+    Convert a hexadecimal string (of either case) to a digest.
+
+    @param[in]  hex     String of (DIGEST_SIZE * 2) hexadecimal characters;
+                        need not be NULL terminated.
+    @param[out] digest  Buffer of DIGEST_SIZE bytes to receive the digest.
+
+    @return             0 on success, otherwise 1 if a character is not
+                        hexadecimal.
+*/
+int hash_fromhex(const char *hex, unsigned char *digest) {
+
+    int hi;
+    int lo;
+
+    for ( int i = 0; i < DIGEST_SIZE; ++i ) {
+        if ( (hi = hexval(hex[i * 2])) < 0 || (lo = hexval(hex[i * 2 + 1])) < 0 ) return EXIT_FAILURE;
+        digest[i] = (unsigned char)(hi << 4 | lo);
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+    Start an incremental SHA-256 digest.
+
+    @param[in]  h       Pointer to the digest to be initialised.
+
+    @return             0 on success, otherwise 1.
+*/
+int hash_init(struct hash *h) {
+    if ( (h->md = EVP_MD_CTX_new()) == NULL ) return EXIT_FAILURE;
+    if ( !EVP_DigestInit_ex(h->md, EVP_sha256(), NULL) ) {
+        hash_free(h);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+    Convert a digest to a lower case hexadecimal string.
+
+    @param[in]  digest  Digest of DIGEST_SIZE bytes.
+    @param[out] hex     Buffer of (DIGEST_SIZE * 2 + 1) characters to
+                        receive the NULL terminated string.
+*/
+void hash_tohex(const unsigned char *digest, char *hex) {
+
+    static const char   *chars = "0123456789abcdef";
+
+    for ( int i = 0; i < DIGEST_SIZE; ++i ) {
+        hex[i * 2] = chars[digest[i] >> 4];
+        hex[i * 2 + 1] = chars[digest[i] & 0x0f];
+    }
+    hex[DIGEST_SIZE * 2] = '\0';
+}
+
+/**
+    Add data to an incremental digest.
+
+    @param[in]  h       Pointer to the digest.
+    @param[in]  buff    Data to be hashed.
+    @param[in]  size    Size of the data, in bytes.
+
+    @return             0 on success, otherwise 1.
+*/
+int hash_update(struct hash *h, const void *buff, size_t size) {
+    return ( h->md && EVP_DigestUpdate(h->md, buff, size) ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
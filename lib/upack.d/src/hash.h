@@ -0,0 +1,125 @@
+/**
+    Header file for the hash.c module.
+*/
+
+#ifndef _HASH_H
+#define _HASH_H
+
+struct evp_md_ctx_st;
+struct pool;
+
+/**
+    An incremental SHA-256 digest.
+*/
+struct hash {
+    struct evp_md_ctx_st    *md;    // OpenSSL EVP digest context.
+};
+
+/**
+    A single file to be hashed by hash_files().
+*/
+struct hash_task {
+    const char      *fpath;                 // Explicit path to the file.
+    unsigned char   digest[DIGEST_SIZE];    // Digest of the file.
+    int             excode;                 // 0 if the file was hashed.
+};
+
+/**
+    Calculate the SHA-256 digest of a buffer.
+
+    @param[in]  buff    Data to be hashed.
+    @param[in]  size    Size of the data, in bytes.
+    @param[out] digest  Buffer of DIGEST_SIZE bytes to receive the digest.
+
+    @return             0 on success, otherwise 1.
+*/
+int hash_buffer(const void *buff, size_t size, unsigned char *digest);
+
+/**
+    Calculate the SHA-256 digest of a file.
+
+    The file is memory mapped where possible, otherwise it is hashed
+    using reads of the configured hash_buffer size (see config.h).
+
+    @param[in]  fpath   Explicit path to the file.
+    @param[out] digest  Buffer of DIGEST_SIZE bytes to receive the digest.
+
+    @return             0 on success, otherwise 1 if the file could not be
+                        read.
+*/
+int hash_file(const char *fpath, unsigned char *digest);
+
+/**
+    Calculate the SHA-256 digests of many files at once.
+
+    The files are hashed concurrently by the pool's workers, one file
+    per task. Each task's exit code reports the result for its file.
+
+    @param[in]  pool    Worker pool, or NULL to hash the files in turn.
+    @param[in]  tasks   Array of files to be hashed.
+    @param[in]  ntasks  Number of files.
+
+    @return             The number of files which could not be hashed.
+*/
+size_t hash_files(struct pool *pool, struct hash_task *tasks, size_t ntasks);
+
+/**
+    Finalise an incremental digest, and release its context.
+
+    @param[in]  h       Pointer to the digest.
+    @param[out] digest  Buffer of DIGEST_SIZE bytes to receive the digest.
+
+    @return             0 on success, otherwise 1.
+*/
+int hash_final(struct hash *h, unsigned char *digest);
+
+/**
+    Release an incremental digest's context, without finalising it.
+    Safe to call on a digest which has already been finalised or freed.
+
+    @param[in]  h       Pointer to the digest.
+*/
+void hash_free(struct hash *h);
+
+/**
+    Convert a hexadecimal string (of either case) to a digest.
+
+    @param[in]  hex     String of (DIGEST_SIZE * 2) hexadecimal characters;
+                        need not be NULL terminated.
+    @param[out] digest  Buffer of DIGEST_SIZE bytes to receive the digest.
+
+    @return             0 on success, otherwise 1 if a character is not
+                        hexadecimal.
+*/
+int hash_fromhex(const char *hex, unsigned char *digest);
+
+/**
+    Start an incremental SHA-256 digest.
+
+    @param[in]  h       Pointer to the digest to be initialised.
+
+    @return             0 on success, otherwise 1.
+*/
+int hash_init(struct hash *h);
+
+/**
+    Convert a digest to a lower case hexadecimal string.
+
+    @param[in]  digest  Digest of DIGEST_SIZE bytes.
+    @param[out] hex     Buffer of (DIGEST_SIZE * 2 + 1) characters to
+                        receive the NULL terminated string.
+*/
+void hash_tohex(const unsigned char *digest, char *hex);
+
+/**
+    Add data to an incremental digest.
+
+    @param[in]  h       Pointer to the digest.
+    @param[in]  buff    Data to be hashed.
+    @param[in]  size    Size of the data, in bytes.
+
+    @return             0 on success, otherwise 1.
+*/
+int hash_update(struct hash *h, const void *buff, size_t size);
+
+#endif /* _HASH_H */
@@ -0,0 +1,214 @@
+/**
+    Purpose:    This module provides the repo inventory (--inventory); the
+                name, size and SHA-256 digest of every file in the repo,
+                which is carried to the online side, so the packer can
+                build a delta archive which omits the files the repo
+                already holds.
+
+    Developer:  J Berendt
+    Email:      development@s3dev.uk
+
+    Comments:   The inventory is an xz compressed text file, sorted by
+                name, in the format:
+
+                    ppk-inventory 1
+                    <sha256 hex digest> <size> <name>
+                    ...
+
+                The digests are taken from the repo's catalog where its
+                records are current, so only the files which are new to
+                the catalog are hashed (concurrently, using the pool).
+                These are recorded in the catalog as they are hashed.
+
+    Copyright (C) 73rd Street Development
+    This file is part of the ppk project's upack program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <dirent.h>
+#include <inttypes.h>
+#include <lzma.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "base.h"
+#include "catalog.h"
+#include "hash.h"
+#include "inventory.h"
+#include "pool.h"
+#include "ui.h"
+#include "utils.h"
+
+#define INVENTORY_MAGIC "ppk-inventory 1"
+
+/**
+    A file in the repo; also the task which obtains its digest.
+*/
+struct inventory_item {
+    char            *name;
+    uint64_t        size;
+    unsigned char   sha256[DIGEST_SIZE];
+    struct catalog  *cat;
+    int             excode;
+};
+
+// Function prototypes
+int inventory_export(const char *fpath, const char *repo, struct catalog *cat, struct pool *pool);
+
+/**
+    qsort(3) comparison callback for the items, by name.
+*/
+static int compare_items(const void *a, const void *b) {
+    return strcmp(((const struct inventory_item *)a)->name, ((const struct inventory_item *)b)->name);
+}
+
+/**
+    Pool task: obtain an item's digest from the catalog.
+*/
+static void item_digest(void *arg) {
+
+    struct inventory_item   *item = arg;
+
+    item->excode = catalog_digest(item->cat, item->name, item->sha256);
+}
+
+/**
+    Compress the inventory text, and write it to the inventory file.
+
+    The file is written to a temporary file, then renamed into place.
+
+    @return     0 on success, otherwise 1.
+*/
+static int write_xz(const char *fpath, const char *text, size_t size) {
+
+    char            tmp[PATH_MAX];
+    int             excode = EXIT_FAILURE;
+    bool            written;
+    size_t          npos = 0;
+    size_t          nout = lzma_stream_buffer_bound(size);
+    uint8_t         *out;
+    FILE            *fp;
+
+    if ( (out = malloc(nout)) == NULL ) return EXIT_FAILURE;
+    if ( lzma_easy_buffer_encode(LZMA_PRESET_DEFAULT, LZMA_CHECK_CRC64, NULL, (const uint8_t *)text, size,
+                                 out, &npos, nout) != LZMA_OK ||
+         snprintf(tmp, sizeof(tmp), "%s.%d.tmp", fpath, (int)getpid()) >= (int)sizeof(tmp) ||
+         (fp = fopen(tmp, "wb")) == NULL ) {
+        free(out);
+        return EXIT_FAILURE;
+    }
+    // The file is closed exactly once, whether or not the write succeeded.
+    written = ( fwrite(out, 1, npos, fp) == npos );
+    if ( !fclose(fp) && written ) excode = ( rename(tmp, fpath) ) ? EXIT_FAILURE : EXIT_SUCCESS;
+    if ( excode ) unlink(tmp);
+    free(out);
+    return excode;
+}
+
+/**
+    Export the repo inventory.
+
+    Every regular file at the top level of the repo is listed; the
+    hidden files and directories (i.e. the stage and catalog), and the
+    simple index, are not.
+
+    @param[in]  fpath   Explicit path to the inventory file.
+    @param[in]  repo    Explicit path to the repo directory.
+    @param[in]  cat     Pointer to the repo's catalog.
+    @param[in]  pool    Worker pool, or NULL to hash the new files in turn.
+
+    @return             0 on success, otherwise 1; in which case an error
+                        is reported.
+*/
+int inventory_export(const char *fpath, const char *repo, struct catalog *cat, struct pool *pool) {
+
+    char                    hex[DIGEST_SIZE * 2 + 1];
+    char                    msgbuff[PATH_MAX + 128];
+    char                    path[PATH_MAX];
+    char                    *text = NULL;
+    int                     excode = EXIT_FAILURE;
+    size_t                  capacity = 0;
+    size_t                  n = 0;
+    size_t                  nfailed = 0;
+    size_t                  textsz = 0;
+    struct dirent           *ep;
+    struct inventory_item   *items = NULL;
+    struct inventory_item   *tmp;
+    struct pool_batch       batch = {0};
+    struct stat             st;
+    DIR                     *dp;
+    FILE                    *fp;
+
+    print_start("\nExporting the repo inventory ...");
+    if ( (dp = opendir(repo)) == NULL ) {
+        snprintf(msgbuff, sizeof(msgbuff), "%s: %s", strerror(errno), repo);
+        reporterror(msgbuff, false, false);
+        return EXIT_FAILURE;
+    }
+    while ( (ep = readdir(dp)) != NULL ) {
+        if ( ep->d_name[0] == '.' ) continue;
+        if ( snprintf(path, sizeof(path), "%s/%s", repo, ep->d_name) >= (int)sizeof(path) ) continue;
+        if ( stat(path, &st) || !S_ISREG(st.st_mode) ) continue;
+        if ( n == capacity ) {
+            capacity = ( capacity ) ? capacity * 2 : 256;
+            if ( (tmp = realloc(items, capacity * sizeof(*items))) == NULL ) goto nomem;
+            items = tmp;
+        }
+        if ( (items[n].name = strdup(ep->d_name)) == NULL ) goto nomem;
+        items[n].size = st.st_size;
+        items[n].cat = cat;
+        items[n].excode = 0;
+        ++n;
+    }
+    closedir(dp);
+    dp = NULL;
+    for ( size_t i = 0; i < n; ++i ) {
+        if ( pool == NULL || pool_submit(pool, &batch, item_digest, &items[i]) ) item_digest(&items[i]);
+    }
+    if ( pool ) pool_wait(pool, &batch);
+    if ( n ) qsort(items, n, sizeof(*items), compare_items);
+    if ( (fp = open_memstream(&text, &textsz)) == NULL ) goto nomem;
+    fprintf(fp, INVENTORY_MAGIC "\n");
+    for ( size_t i = 0; i < n; ++i ) {
+        // A file which cannot be read is left out; the packer will include it.
+        if ( items[i].excode ) {
+            ++nfailed;
+            continue;
+        }
+        hash_tohex(items[i].sha256, hex);
+        fprintf(fp, "%s %" PRIu64 " %s\n", hex, items[i].size, items[i].name);
+    }
+    if ( fclose(fp) ) goto nomem;
+    if ( write_xz(fpath, text, textsz) ) {
+        snprintf(msgbuff, sizeof(msgbuff), "The repo inventory could not be written: %s", fpath);
+        reporterror(msgbuff, false, false);
+        goto cleanup;
+    }
+    if ( nfailed ) {
+        snprintf(msgbuff, sizeof(msgbuff), "-- %zu files could not be read, and are not listed.", nfailed);
+        print_warning(msgbuff);
+    }
+    snprintf(msgbuff, sizeof(msgbuff), "-- %zu files listed: %s", n - nfailed, fpath);
+    print_ok(msgbuff);
+    excode = EXIT_SUCCESS;
+    goto cleanup;
+nomem:
+    reporterror("Error occurred while allocating memory for the repo inventory.", false, false);
+cleanup:
+    if ( dp ) closedir(dp);
+    for ( size_t i = 0; i < n; ++i ) free(items[i].name);
+    free(items);
+    free(text);
+    return excode;
+}
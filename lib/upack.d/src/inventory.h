@@ -0,0 +1,28 @@
+/**
+    Header file for the inventory.c module.
+*/
+
+#ifndef _INVENTORY_H
+#define _INVENTORY_H
+
+struct catalog;
+struct pool;
+
+/**
+    Export the repo inventory.
+
+    Every regular file at the top level of the repo is listed; the
+    hidden files and directories (i.e. the stage and catalog), and the
+    simple index, are not.
+
+    @param[in]  fpath   Explicit path to the inventory file.
+    @param[in]  repo    Explicit path to the repo directory.
+    @param[in]  cat     Pointer to the repo's catalog.
+    @param[in]  pool    Worker pool, or NULL to hash the new files in turn.
+
+    @return             0 on success, otherwise 1; in which case an error
+                        is reported.
+*/
+int inventory_export(const char *fpath, const char *repo, struct catalog *cat, struct pool *pool);
+
+#endif /* _INVENTORY_H */
@@ -0,0 +1,224 @@
+/**
+    Purpose:    This module provides the job structure, which carries
+                the state of a single archive's verification and
+                unpacking through each of upack's stages.
+    
+    Developer:  J Berendt
+    Email:      development@s3dev.uk
+
+    Comments:   n/a
+
+    Copyright (C) 73rd Street Development
+    This file is part of the ppk project's upack program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "base.h"
+#include "arena.h"
+#include "job.h"
+#include "utils.h"
+
+// Function prototypes
+struct job_entry *job_add_entry(struct job *job, const char *name, uint64_t size);
+enum job_role job_classify(const char *name);
+struct job_manifest *job_find_manifest(const struct job *job, const char *name);
+void job_free(struct job *job);
+int job_init(struct job *job, const char *fpath, const char *stage);
+size_t job_sdist_ext(const char *name);
+char *job_strndup(struct job *job, const char *s, size_t n);
+void job_time(struct job *job, enum job_phase phase, uint64_t start, uint64_t bytes, uint64_t files);
+
+/**
+    Add an entry to the job's entry table.
+
+    The entry is classified (see job_classify), and counted by role.
+
+    @param[in]  job     Pointer to the job.
+    @param[in]  name    Base filename of the entry (copied).
+    @param[in]  size    Size of the entry, in bytes.
+
+    @return             Pointer to the new entry, or NULL if the memory
+                        could not be allocated.
+*/
+struct job_entry *job_add_entry(struct job *job, const char *name, uint64_t size) {
+
+    size_t              capacity;
+    struct job_entry    *entries;
+    struct job_entry    *e;
+
+    if ( job->nentries == job->capacity ) {
+        capacity = ( job->capacity ) ? job->capacity * 2 : 64;
+        if ( (entries = realloc(job->entries, capacity * sizeof(struct job_entry))) == NULL ) return NULL;
+        job->entries = entries;
+        job->capacity = capacity;
+    }
+    e = &job->entries[job->nentries];
+    memset(e, 0, sizeof(*e));
+    if ( (e->name = job_strndup(job, name, SIZE_MAX)) == NULL ) return NULL;
+    e->size = size;
+    e->role = job_classify(name);
+    ++job->nroles[e->role];
+    ++job->nentries;
+    return e;
+}
+
+/**
+    Classify an archive entry by its filename.
+
+    @param[in]  name    Base filename of the entry.
+
+    @return             The entry's role: the .key and .log verification
+                        files, the requirements (.txt) files, the wheels,
+                        the source distributions, or other.
+*/
+enum job_role job_classify(const char *name) {
+
+    const char  *ext = strrchr(name, '.');
+
+    if ( ext == NULL ) return ROLE_OTHER;
+    if ( !strcmp(ext, ".key") ) return ROLE_KEY;
+    if ( !strcmp(ext, ".log") ) return ROLE_LOG;
+    if ( !strcmp(ext, ".txt") ) return ROLE_REQUIREMENTS;
+    if ( !strcmp(ext, ".whl") ) return ROLE_WHEEL;
+    return ( job_sdist_ext(name) ) ? ROLE_SDIST : ROLE_OTHER;
+}
+
+/**
+    bsearch(3) comparison callback for the manifest.
+*/
+static int compare_manifest(const void *key, const void *row) {
+    return strcmp(key, ((const struct job_manifest *)row)->name);
+}
+
+/**
+    Find a package in the job's manifest.
+
+    @param[in]  job     Pointer to the job.
+    @param[in]  name    Base filename of the package.
+
+    @return             Pointer to the manifest row, or NULL if the package
+                        is not listed.
+*/
+struct job_manifest *job_find_manifest(const struct job *job, const char *name) {
+    if ( job->manifest == NULL ) return NULL;
+    return bsearch(name, job->manifest, job->nmanifest, sizeof(*job->manifest), compare_manifest);
+}
+
+/**
+    Release the memory held by a job.
+
+    @param[in]  job     Pointer to the job to be released.
+*/
+void job_free(struct job *job) {
+    // The entry and manifest names are released with the arena.
+    arena_destroy(job->arena);
+    free(job->entries);
+    free(job->manifest);
+    free(job->key);
+    free(job->log);
+    job->arena = NULL;
+    job->entries = NULL;
+    job->manifest = NULL;
+    job->key = job->log = NULL;
+    job->nentries = job->capacity = job->nmanifest = job->keysz = job->logsz = 0;
+}
+
+/**
+    Initialise a job.
+
+    @param[in]  job     Pointer to the job to be initialised.
+    @param[in]  fpath   Explicit path to the archive.
+    @param[in]  stage   Staging directory into which the archive is
+                        unpacked (copied). If the path ends with
+                        'XXXXXX', a new, uniquely named directory is
+                        created using mkdtemp(3).
+
+    @return             0 on success, otherwise 1 if the staging directory
+                        could not be created.
+*/
+int job_init(struct job *job, const char *fpath, const char *stage) {
+
+    size_t  len = strlen(stage);
+
+    memset(job, 0, sizeof(*job));
+    job->lockfd = -1;
+    job->fpath = fpath;
+    job->label = ( strrchr(fpath, '/') ) ? strrchr(fpath, '/') + 1 : fpath;
+    if ( len >= sizeof(job->stage) ) return EXIT_FAILURE;
+    memcpy(job->stage, stage, len + 1);
+    if ( len >= 6 && !strcmp(job->stage + len - 6, "XXXXXX") && mkdtemp(job->stage) == NULL ) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+    Return the length of a source distribution's extension.
+
+    This is the single list of the source distribution extensions, used
+    to classify the entries, and to index and version the repo's files.
+
+    @param[in]  name    Base filename.
+
+    @return             Length of the extension (e.g. 7 for '.tar.gz'), or
+                        0 if the file is not a source distribution.
+*/
+size_t job_sdist_ext(const char *name) {
+
+    static const char   *sdists[] = { ".tar.gz", ".tgz", ".tar.bz2", ".tar.xz", ".zip", NULL };
+    size_t              len = strlen(name);
+
+    for ( int i = 0; sdists[i]; ++i ) {
+        if ( len > strlen(sdists[i]) && !strcmp(name + len - strlen(sdists[i]), sdists[i]) ) {
+            return strlen(sdists[i]);
+        }
+    }
+    return 0;
+}
+
+/**
+    Copy (up to) the first n bytes of a string into the job's arena,
+    which is created as required, and released by job_free().
+
+    @param[in]  job     Pointer to the job.
+    @param[in]  s       String to be copied.
+    @param[in]  n       Maximum number of bytes to be copied.
+
+    @return             Pointer to the copy, or NULL if the memory could
+                        not be allocated.
+*/
+char *job_strndup(struct job *job, const char *s, size_t n) {
+    if ( job->arena == NULL && (job->arena = arena_create()) == NULL ) return NULL;
+    return arena_strndup(job->arena, s, n);
+}
+
+/**
+    Record the time spent in a phase of a job, and the work done.
+
+    The time is added to the phase's total, as a phase may be entered
+    more than once.
+
+    @param[in]  job     Pointer to the job.
+    @param[in]  phase   The phase completed.
+    @param[in]  start   Monotonic time at which the phase started, per
+                        clock_ns().
+    @param[in]  bytes   Number of bytes processed.
+    @param[in]  files   Number of files processed.
+*/
+void job_time(struct job *job, enum job_phase phase, uint64_t start, uint64_t bytes, uint64_t files) {
+    job->timing[phase].ns += clock_ns() - start;
+    job->timing[phase].bytes += bytes;
+    job->timing[phase].files += files;
+}
@@ -0,0 +1,193 @@
+/**
+    Header file for the job.c module.
+*/
+
+#ifndef _JOB_H
+#define _JOB_H
+
+struct advisory;
+struct arena;
+struct catalog;
+struct pool;
+
+/**
+    The timed phases of a job, as written to the run report (--report).
+*/
+enum job_phase { PHASE_RECOVER, PHASE_UNPACK, PHASE_TESTS, PHASE_MANIFEST, PHASE_COMMIT, PHASE_CLEANUP,
+                 PHASE_COUNT };
+
+/**
+    The role of an archive entry, by its filename; the job's entries are
+    counted by role as they are extracted.
+*/
+enum job_role { ROLE_OTHER, ROLE_KEY, ROLE_LOG, ROLE_REQUIREMENTS, ROLE_WHEEL, ROLE_SDIST, ROLE_COUNT };
+
+/**
+    Elapsed time and work done by a phase of a job.
+*/
+struct job_timing {
+    uint64_t        ns;                     // Elapsed (monotonic) time, in nanoseconds.
+    uint64_t        bytes;                  // Bytes processed.
+    uint64_t        files;                  // Files processed.
+};
+
+/**
+    An entry extracted from the archive into the staging directory.
+*/
+struct job_entry {
+    char            *name;                  // Base filename.
+    uint64_t        size;                   // Size in bytes.
+    unsigned char   sha256[DIGEST_SIZE];    // Digest, calculated as the entry was decoded.
+    enum job_role   role;                   // Role of the entry, per job_classify().
+    bool            present;                // Already in the repo, so was not staged.
+};
+
+/**
+    A package listed in the archive's log, with its expected digest and
+    the results of the packer's checks.
+*/
+struct job_manifest {
+    char            *name;                  // Base filename.
+    uint64_t        size;                   // Size in bytes.
+    unsigned char   sha256[DIGEST_SIZE];    // Digest, as recorded by the packer.
+    uint16_t        dv[4];                  // Direct vulnerabilities (C, H, M, L) found by the packer.
+    bool            md5;                    // The packer's MD5 check passed.
+    bool            vuln;                   // The packer's vulnerability check passed.
+    bool            pass;                   // The row's result.
+};
+
+/**
+    State for the verification and unpacking of a single archive.
+*/
+struct job {
+    const char          *fpath;     // Explicit path to the archive.
+    const char          *label;     // Base filename of the archive, used in messages.
+    char                stage[PATH_MAX];    // Staging directory into which the archive is unpacked.
+    int                 lockfd;     // Lock held on the stage (see journal_lock), or -1.
+    struct job_entry    *entries;   // Entries extracted into the staging directory.
+    size_t              nentries;
+    size_t              capacity;
+    unsigned char       *key;       // In-memory copy of the archive's .key file.
+    size_t              keysz;
+    unsigned char       *log;       // In-memory copy of the archive's .log file.
+    size_t              logsz;
+    unsigned char       log_sha256[DIGEST_SIZE];    // Digest of the .log file.
+    size_t              nroles[ROLE_COUNT]; // Number of entries of each role.
+    bool                tested;     // The verification tests have been run.
+    bool                verified;   // The verification tests passed.
+    int                 excode;     // Overall exit code of the job.
+    struct pool         *pool;      // Worker pool for the job's file moves, or NULL.
+    struct catalog      *catalog;   // Catalog of the repo's files, or NULL to stage every file.
+    const struct advisory   *advisories;    // Offline advisory snapshot, or NULL to skip the re-check.
+    struct job_manifest *manifest;  // Packages listed in the (verified) log, sorted by name.
+    size_t              nmanifest;
+    int                 manifest_status;    // Result of parse_manifest().
+    size_t              npresent;   // Number of entries already present in the repo.
+    size_t              nomitted;   // Number of packages listed in the log, but omitted from a delta archive.
+    struct arena        *arena;     // The entry and manifest names; created as used, released by job_free().
+    struct job_timing   timing[PHASE_COUNT];    // Time spent in each phase, for the run report.
+    uint64_t            nrenamed;   // Files published by rename(2).
+    uint64_t            ncopied;    // Files published by a copy, as the stage is on another file system.
+};
+
+/**
+    Add an entry to the job's entry table.
+
+    The entry is classified (see job_classify), and counted by role.
+
+    @param[in]  job     Pointer to the job.
+    @param[in]  name    Base filename of the entry (copied).
+    @param[in]  size    Size of the entry, in bytes.
+
+    @return             Pointer to the new entry, or NULL if the memory
+                        could not be allocated.
+*/
+struct job_entry *job_add_entry(struct job *job, const char *name, uint64_t size);
+
+/**
+    Classify an archive entry by its filename.
+
+    @param[in]  name    Base filename of the entry.
+
+    @return             The entry's role: the .key and .log verification
+                        files, the requirements (.txt) files, the wheels,
+                        the source distributions, or other.
+*/
+enum job_role job_classify(const char *name);
+
+/**
+    Find a package in the job's manifest.
+
+    @param[in]  job     Pointer to the job.
+    @param[in]  name    Base filename of the package.
+
+    @return             Pointer to the manifest row, or NULL if the package
+                        is not listed.
+*/
+struct job_manifest *job_find_manifest(const struct job *job, const char *name);
+
+/**
+    Release the memory held by a job.
+
+    @param[in]  job     Pointer to the job to be released.
+*/
+void job_free(struct job *job);
+
+/**
+    Return the length of a source distribution's extension.
+
+    This is the single list of the source distribution extensions, used
+    to classify the entries, and to index and version the repo's files.
+
+    @param[in]  name    Base filename.
+
+    @return             Length of the extension (e.g. 7 for '.tar.gz'), or
+                        0 if the file is not a source distribution.
+*/
+size_t job_sdist_ext(const char *name);
+
+/**
+    Copy (up to) the first n bytes of a string into the job's arena,
+    which is created as required, and released by job_free().
+
+    @param[in]  job     Pointer to the job.
+    @param[in]  s       String to be copied.
+    @param[in]  n       Maximum number of bytes to be copied.
+
+    @return             Pointer to the copy, or NULL if the memory could
+                        not be allocated.
+*/
+char *job_strndup(struct job *job, const char *s, size_t n);
+
+/**
+    Record the time spent in a phase of a job, and the work done.
+
+    The time is added to the phase's total, as a phase may be entered
+    more than once.
+
+    @param[in]  job     Pointer to the job.
+    @param[in]  phase   The phase completed.
+    @param[in]  start   Monotonic time at which the phase started, per
+                        clock_ns().
+    @param[in]  bytes   Number of bytes processed.
+    @param[in]  files   Number of files processed.
+*/
+void job_time(struct job *job, enum job_phase phase, uint64_t start, uint64_t bytes, uint64_t files);
+
+/**
+    Initialise a job.
+
+    @param[in]  job     Pointer to the job to be initialised.
+    @param[in]  fpath   Explicit path to the archive.
+    @param[in]  stage   Staging directory into which the archive is
+                        unpacked (copied). If the path ends with
+                        'XXXXXX', a new, uniquely named directory is
+                        created using mkdtemp(3).
+
+    @return             0 on success, otherwise 1 if the staging directory
+                        could not be created.
+*/
+int job_init(struct job *job, const char *fpath, const char *stage);
+
+#endif /* _JOB_H */
+
@@ -0,0 +1,724 @@
+/**
+    Purpose:    This module provides the transactional commit of a
+                verified archive's files into the repo, using a
+                journal to roll an interrupted commit forward (or back).
+
+    Developer:  J Berendt
+    Email:      development@s3dev.uk
+
+    Comments:   The journal is a text file, written alongside the stage
+                as <stage>.journal. Its format is:
+
+                    ppk-journal 1
+                    <sha256 hex digest> <size> <name>
+                    ...
+
+                The journal is only ever created by an atomic rename of a
+                fully written (and flushed) temporary file, so it is
+                either complete, or absent.
+
+    Copyright (C) 73rd Street Development
+    This file is part of the ppk project's upack program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "base.h"
+#include "catalog.h"
+#include "filesys.h"
+#include "hash.h"
+#include "job.h"
+#include "journal.h"
+#include "pool.h"
+#include "ui.h"
+#include "utils.h"
+
+#define JOURNAL_LOCK ".lock"
+#define JOURNAL_MAGIC "ppk-journal 1"
+#define JOURNAL_PREV ".prev"    // Stage sub-directory holding the rollback copies.
+#define JOURNAL_TMP ".journal.tmp"
+
+/**
+    A stale stage, as removed by a journal_purge() worker.
+*/
+struct purge_task {
+    char    fpath[PATH_MAX];
+    char    lpath[PATH_MAX];    // The stage's lock file.
+    int     lockfd;             // Lock held on the stage, while it is removed.
+    int     nremoved;
+};
+
+// Function prototypes
+int journal_commit(struct job *job, const char *repo);
+int journal_lock(struct job *job);
+int journal_purge(const char *stage, const char *repo, time_t age, struct pool *pool);
+int journal_recover(struct job *job, const char *repo);
+void journal_unlock(struct job *job);
+
+/**
+    Build a path (of PATH_MAX) from a directory, and a filename.
+
+    @return     0 on success, otherwise 1 if the path is too long.
+*/
+static int join_path(char *buff, const char *dpath, const char *fname) {
+    return ( snprintf(buff, PATH_MAX, "%s/%s", dpath, fname) >= PATH_MAX ) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+    Build the path to the job's journal file, with an optional suffix.
+
+    @return     0 on success, otherwise 1 if the path is too long.
+*/
+static int journal_path(const struct job *job, const char *suffix, char *buff) {
+    return ( snprintf(buff, PATH_MAX, "%s.journal%s", job->stage, suffix) >= PATH_MAX ) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+    Take an exclusive lock on a stage's lock file, which is created as
+    required.
+
+    If the lock file is removed (by its holder) between the open and the
+    lock, the lock is taken again on the new file.
+
+    @param[in]  lpath   Explicit path to the lock file.
+
+    @return     The lock file's descriptor, otherwise -1 if the lock is
+                held by another process (EWOULDBLOCK), or on error.
+*/
+static int lock_file(const char *lpath) {
+
+    int         fd;
+    struct stat st;
+    struct stat st_path;
+
+    for ( ;; ) {
+        if ( (fd = open(lpath, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) < 0 ) return -1;
+        if ( flock(fd, LOCK_EX | LOCK_NB) ) {
+            close(fd);
+            return -1;
+        }
+        if ( fstat(fd, &st) == 0 && stat(lpath, &st_path) == 0 &&
+             st.st_dev == st_path.st_dev && st.st_ino == st_path.st_ino ) {
+            return fd;
+        }
+        close(fd);
+    }
+}
+
+/**
+    Release a lock taken by lock_file(), removing the lock file.
+
+    The file is removed while the lock is held, so another process never
+    takes the lock on a file which is being removed.
+*/
+static void unlock_file(const char *lpath, int fd) {
+    unlink(lpath);
+    close(fd);
+}
+
+/**
+    Flush the directory containing the given path (i.e. the directory
+    entries for the file, or sub-directory, at that path).
+
+    @return     0 on success, otherwise 1.
+*/
+static int sync_parent(const char *fpath) {
+
+    char    dpath[PATH_MAX];
+    char    *sep;
+    int     fd;
+    int     excode;
+
+    snprintf(dpath, sizeof(dpath), "%s", fpath);
+    if ( (sep = strrchr(dpath, '/')) == NULL ) return EXIT_FAILURE;
+    *sep = '\0';
+    if ( (fd = open(dpath, O_RDONLY | O_DIRECTORY)) < 0 ) return EXIT_FAILURE;
+    excode = ( fsync(fd) ) ? EXIT_FAILURE : EXIT_SUCCESS;
+    close(fd);
+    return excode;
+}
+
+/**
+    Hard link each repo file which is about to be replaced into the
+    stage's rollback directory, then flush the rollback directory and
+    the stage.
+
+    @return     0 on success, otherwise 1.
+*/
+static int backup_replaced(const struct job *job, const char *repo) {
+
+    char    prev[PATH_MAX];
+    char    src[PATH_MAX];
+    char    dst[PATH_MAX];
+
+    if ( join_path(prev, job->stage, JOURNAL_PREV) ) return EXIT_FAILURE;
+    if ( makedir(prev, 0700, 0) && errno != EEXIST ) return EXIT_FAILURE;
+    for ( size_t i = 0; i < job->nentries; ++i ) {
+        if ( job->entries[i].present ) continue;
+        if ( join_path(src, repo, job->entries[i].name) || join_path(dst, prev, job->entries[i].name) ) {
+            return EXIT_FAILURE;
+        }
+        if ( link(src, dst) && errno != ENOENT ) return EXIT_FAILURE;
+    }
+    // Flush the rollback copies' entries, and the staged files' entries (their data is flushed on unpack).
+    if ( join_path(dst, prev, "") || sync_parent(dst) || sync_parent(prev) ) return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+/**
+    Undo a partial publish: each published file is moved back into the
+    stage, and any file it replaced is restored from its rollback copy.
+
+    @return     Number of files which could not be moved back or restored.
+*/
+static int rollback(const struct job *job, const char *repo) {
+
+    char    staged[PATH_MAX];
+    char    published[PATH_MAX];
+    char    backup[PATH_MAX];
+    char    prev[PATH_MAX];
+    int     nfailed = 0;
+
+    if ( join_path(prev, job->stage, JOURNAL_PREV) ) return 1;
+    for ( size_t i = 0; i < job->nentries; ++i ) {
+        if ( job->entries[i].present ) continue;
+        if ( join_path(staged, job->stage, job->entries[i].name) ||
+             join_path(published, repo, job->entries[i].name) ||
+             join_path(backup, prev, job->entries[i].name) ) {
+            ++nfailed;
+            continue;
+        }
+        // The file is still staged, so was not published.
+        if ( access(staged, F_OK) == 0 ) continue;
+        if ( rename(published, staged) ) {
+            if ( errno != ENOENT ) ++nfailed;
+            continue;
+        }
+        // A file without a rollback copy was new to the repo.
+        if ( rename(backup, published) && errno != ENOENT ) ++nfailed;
+    }
+    // Flush the repo directory.
+    if ( !join_path(published, repo, "") ) sync_parent(published);
+    return nfailed;
+}
+
+/**
+    Write the job's journal to a temporary file, flush it, then rename it
+    into place.
+
+    @return     0 on success, otherwise 1.
+*/
+static int write_journal(const struct job *job) {
+
+    char    jpath[PATH_MAX];
+    char    tmp[PATH_MAX];
+    int     excode = EXIT_SUCCESS;
+    FILE    *fp;
+
+    if ( journal_path(job, "", jpath) || journal_path(job, ".tmp", tmp) ) return EXIT_FAILURE;
+    if ( (fp = fopen(tmp, "w")) == NULL ) return EXIT_FAILURE;
+    fprintf(fp, JOURNAL_MAGIC "\n");
+    for ( size_t i = 0; i < job->nentries && !excode; ++i ) {
+        // Files already in the repo are not published.
+        if ( job->entries[i].present ) continue;
+        // The journal is line based.
+        if ( strchr(job->entries[i].name, '\n') ) excode = EXIT_FAILURE;
+        for ( int j = 0; j < DIGEST_SIZE; ++j ) fprintf(fp, "%02x", job->entries[i].sha256[j]);
+        fprintf(fp, " %" PRIu64 " %s\n", job->entries[i].size, job->entries[i].name);
+    }
+    if ( fflush(fp) || fsync(fileno(fp)) ) excode = EXIT_FAILURE;
+    if ( fclose(fp) ) excode = EXIT_FAILURE;
+    if ( excode || rename(tmp, jpath) || sync_parent(jpath) ) {
+        unlink(tmp);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+    Read the job's journal into the job's entry table.
+
+    @return     0 on success, otherwise 1 if the journal cannot be read
+                or is malformed.
+*/
+static int read_journal(struct job *job, const char *jpath) {
+
+    char                *line = NULL;
+    int                 excode = EXIT_SUCCESS;
+    int                 n;
+    size_t              len = 0;
+    ssize_t             nread;
+    uint64_t            size;
+    struct job_entry    *e;
+    unsigned char       digest[DIGEST_SIZE];
+    FILE                *fp;
+
+    if ( (fp = fopen(jpath, "r")) == NULL ) return EXIT_FAILURE;
+    if ( getline(&line, &len, fp) < 0 || strcmp(line, JOURNAL_MAGIC "\n") ) excode = EXIT_FAILURE;
+    while ( !excode && (nread = getline(&line, &len, fp)) > 0 ) {
+        if ( line[nread - 1] == '\n' ) line[--nread] = '\0';
+        for ( int j = 0; j < DIGEST_SIZE && !excode; ++j ) {
+            if ( sscanf(line + j * 2, "%2hhx", &digest[j]) != 1 ) excode = EXIT_FAILURE;
+        }
+        if ( excode || sscanf(line + DIGEST_SIZE * 2, " %" SCNu64 "%n", &size, &n) != 1 ||
+             line[DIGEST_SIZE * 2 + n] != ' ' ) {
+            excode = EXIT_FAILURE;
+        } else if ( (e = job_add_entry(job, line + DIGEST_SIZE * 2 + n + 1, size)) == NULL ) {
+            excode = EXIT_FAILURE;
+        } else {
+            memcpy(e->sha256, digest, DIGEST_SIZE);
+        }
+    }
+    free(line);
+    fclose(fp);
+    return excode;
+}
+
+/**
+    Verify each of the job's files is present in the repo, and matches
+    its journalled digest. The files are hashed concurrently, using the
+    job's pool.
+
+    @return     0 if all files are verified, otherwise 1.
+*/
+static int verify_published(const struct job *job, const char *repo) {
+
+    char                msgbuff[PATH_MAX + 256];
+    char                (*fpaths)[PATH_MAX];
+    int                 excode = EXIT_SUCCESS;
+    struct hash_task    *tasks;
+
+    fpaths = malloc(job->nentries * sizeof(*fpaths) + 1);
+    tasks = calloc(job->nentries + 1, sizeof(*tasks));
+    if ( fpaths == NULL || tasks == NULL ) {
+        free(fpaths);
+        free(tasks);
+        return EXIT_FAILURE;
+    }
+    for ( size_t i = 0; i < job->nentries; ++i ) {
+        tasks[i].fpath = fpaths[i];
+        // An over-long path is hashed as an empty path, which fails.
+        if ( join_path(fpaths[i], repo, job->entries[i].name) ) fpaths[i][0] = '\0';
+    }
+    hash_files(job->pool, tasks, job->nentries);
+    for ( size_t i = 0; i < job->nentries; ++i ) {
+        if ( tasks[i].excode || memcmp(tasks[i].digest, job->entries[i].sha256, DIGEST_SIZE) ) {
+            snprintf(msgbuff, sizeof(msgbuff), "File is missing or does not match the journal: %s",
+                     job->entries[i].name);
+            reporterror(msgbuff, false, false);
+            excode = EXIT_FAILURE;
+        }
+    }
+    free(fpaths);
+    free(tasks);
+    return excode;
+}
+
+/**
+    Record the job's published files in the job's catalog, if any.
+*/
+static void record_published(const struct job *job) {
+    if ( job->catalog == NULL ) return;
+    for ( size_t i = 0; i < job->nentries; ++i ) {
+        if ( !job->entries[i].present ) catalog_add(job->catalog, job->entries[i].name, job->entries[i].sha256);
+    }
+}
+
+/**
+    Publish a verified job's staged files into the repo, as a single
+    transaction.
+
+    The job's stage *must* reside on the repo's file system (see
+    verify_stage), so the publish is a batch of rename(2) calls.
+
+    The steps are:
+
+        1. Any repo file which is about to be replaced is hard linked
+           into the stage's .prev directory, as a rollback copy. The
+           stage is then flushed; the staged files' data was flushed as
+           each was unpacked (see pipeline.c).
+        2. The journal, which lists the files to be published, is
+           written and flushed to a temporary name, then renamed into
+           place. From this point, the commit is rolled forward on
+           restart (see journal_recover).
+        3. The staged files are moved into the repo by movefiles(), as
+           listed in the job's entry table; the stage is not read,
+           and the files are not flushed again.
+        4. The stage is removed, then the journal.
+        5. The published files are recorded in the job's catalog.
+
+    Entries which are already present in the repo (see the catalog) are
+    neither journalled nor published.
+
+    If step 3 fails, the published files are moved back into the stage,
+    the replaced files are restored from the rollback copies, and the
+    journal is removed.
+
+    @param[in]  job     Pointer to the verified job.
+    @param[in]  repo    Explicit path to the repo directory.
+
+    @return             0 if the files were published successfully,
+                        otherwise 1.
+*/
+int journal_commit(struct job *job, const char *repo) {
+
+    char                jpath[PATH_MAX];
+    int                 excode;
+    int                 nremoved;
+    size_t              nnames = 0;
+    uint64_t            start = clock_ns();
+    const char          **names;
+    struct move_stats   stats = {0};
+
+    if ( (names = malloc((job->nentries + 1) * sizeof(*names))) == NULL ) {
+        reporterror("Error occurred while allocating memory for the file moves.", false, false);
+        return EXIT_FAILURE;
+    }
+    for ( size_t i = 0; i < job->nentries; ++i ) {
+        if ( !job->entries[i].present ) names[nnames++] = job->entries[i].name;
+    }
+    if ( journal_path(job, "", jpath) || backup_replaced(job, repo) || write_journal(job) ) {
+        reporterror("An error occurred while writing the commit journal.", false, false);
+        free(names);
+        return EXIT_FAILURE;
+    }
+    excode = movefiles(job->stage, repo, names, nnames, true, false, job->pool, &stats);
+    free(names);
+    if ( excode ) {
+        rollback(job, repo);
+        unlink(jpath);
+        sync_parent(jpath);
+        print_alert("\nThe files could not be published. The repo has been rolled back.");
+        return EXIT_FAILURE;
+    }
+    job_time(job, PHASE_COMMIT, start, stats.bytes, stats.renamed + stats.copied);
+    job->nrenamed += stats.renamed;
+    job->ncopied += stats.copied;
+    // Remove the stage first; a journal without a stage is simply completed on restart.
+    start = clock_ns();
+    nremoved = removeall(job->stage, 1, 0);
+    unlink(jpath);
+    sync_parent(jpath);
+    job_time(job, PHASE_CLEANUP, start, 0, ( nremoved > 0 ) ? nremoved : 0);
+    record_published(job);
+    return EXIT_SUCCESS;
+}
+
+/**
+    Recover an interrupted commit for a job, if any.
+
+    - If a journal exists for the job, the interrupted commit is rolled
+      forward; the archive was verified before the journal was written,
+      so it is not decrypted or verified again. The job's entry table is
+      populated from the journal. If a published file then does not
+      match the journal, the repo is rolled back from the rollback
+      copies, and the commit is discarded.
+    - Otherwise, if a stage exists for the job, it is an incomplete
+      (unverified) extraction, and is removed.
+
+    The job's stage *must* be locked by the caller (see journal_lock), so
+    a stage being written by another process is never removed.
+
+    @param[in]  job     Pointer to the (initialised) job.
+    @param[in]  repo    Explicit path to the repo directory.
+
+    @return             - 0 if there was nothing to recover.
+                        - 1 if an interrupted commit was completed.
+                        - -1 if an interrupted commit could not be
+                          completed. The journal is retained, unless the
+                          repo was rolled back.
+*/
+int journal_recover(struct job *job, const char *repo) {
+
+    char                jpath[PATH_MAX];
+    char                msgbuff[PATH_MAX + 256];
+    bool                staged;
+    struct stat         st;
+    struct move_stats   stats = {0};
+
+    if ( journal_path(job, "", jpath) ) return 0;
+    staged = ( stat(job->stage, &st) == 0 && S_ISDIR(st.st_mode) );
+    if ( access(jpath, F_OK) ) {
+        if ( staged ) removeall(job->stage, 1, 0);
+        return 0;
+    }
+    print_start("\nResuming an interrupted commit of this archive ...");
+    if ( read_journal(job, jpath) ) {
+        snprintf(msgbuff, sizeof(msgbuff), "The commit journal could not be read: %s", jpath);
+        reporterror(msgbuff, false, false);
+        return -1;
+    }
+    if ( staged && moveall(job->stage, repo, false, job->pool, &stats) ) return -1;
+    job->nrenamed += stats.renamed;
+    job->ncopied += stats.copied;
+    job->timing[PHASE_RECOVER].bytes += stats.bytes;
+    job->timing[PHASE_RECOVER].files += stats.renamed + stats.copied;
+    if ( verify_published(job, repo) ) {
+        /* The staged files did not survive the interruption intact. Roll the
+           repo back (the rollback copies are kept in the stage until it is
+           restored), then discard the commit, so the archive is unpacked and
+           verified again when re-run. */
+        if ( rollback(job, repo) ) {
+            snprintf(msgbuff, sizeof(msgbuff), "The interrupted commit could not be rolled back. The stage and "
+                     "journal are retained: %s", job->stage);
+            reporterror(msgbuff, false, false);
+            return -1;
+        }
+        if ( staged ) removeall(job->stage, 1, 0);
+        unlink(jpath);
+        sync_parent(jpath);
+        print_alert("\nThe interrupted commit could not be completed. The repo has been rolled back. Please "
+                    "re-run to unpack the archive again.");
+        return -1;
+    }
+    if ( staged ) removeall(job->stage, 1, 0);
+    unlink(jpath);
+    sync_parent(jpath);
+    record_published(job);
+    print_done(false);
+    return 1;
+}
+
+/**
+    Pool task: remove a stale stage.
+*/
+static void purge_stage(void *arg) {
+
+    struct purge_task   *task = arg;
+
+    task->nremoved = removeall(task->fpath, 1, 0);
+    unlock_file(task->lpath, task->lockfd);
+}
+
+/**
+    Test if a filename is that of a temporary file created by a
+    cross-file system move, in the form .<name>MOVE_TEMP_TAG<XXXXXX>
+    (see move_file).
+*/
+static bool is_move_temp(const char *name) {
+
+    size_t      len = strlen(name);
+    size_t      taglen = strlen(MOVE_TEMP_TAG);
+    const char  *suffix;
+
+    if ( name[0] != '.' || len < taglen + 8 ) return false;
+    suffix = name + len - 6;
+    if ( strncmp(suffix - taglen, MOVE_TEMP_TAG, taglen) ) return false;
+    for ( const char *c = suffix; *c; ++c ) {
+        if ( !isalnum((unsigned char)*c) ) return false;
+    }
+    return true;
+}
+
+/**
+    Remove the stale temporary files left in the repo by the cross-file
+    system moves of earlier (crashed) runs. A temporary file's times are
+    those of the copy, until it is renamed (see move_file), so a copy in
+    progress is never stale.
+
+    @return     Number of temporary files removed.
+*/
+static int purge_temps(const char *repo, time_t age) {
+
+    int             fd;
+    int             n = 0;
+    time_t          now = time(NULL);
+    struct dirent   *ep;
+    struct stat     st;
+    DIR             *dp;
+
+    if ( (fd = open(repo, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0 ) return 0;
+    if ( (dp = fdopendir(fd)) == NULL ) {
+        close(fd);
+        return 0;
+    }
+    while ( (ep = readdir(dp)) ) {
+        if ( !is_move_temp(ep->d_name) || fstatat(fd, ep->d_name, &st, AT_SYMLINK_NOFOLLOW) ||
+             !S_ISREG(st.st_mode) || now - st.st_mtime < age ) {
+            continue;
+        }
+        if ( unlinkat(fd, ep->d_name, 0) == 0 ) ++n;
+    }
+    closedir(dp);
+    return n;
+}
+
+/**
+    Remove the stale stages left in the staging directory by earlier
+    (crashed) runs.
+
+    A stage is stale if it has no journal, and has not been modified for
+    the given age; so it is an incomplete (unverified) extraction, and
+    not a stage being written by another run. A stage which is locked by
+    another run (see journal_lock) is never removed. A stage with a
+    journal is kept, and its commit is rolled forward when its archive is
+    re-run. The stale temporary journals, and the stale lock files, are
+    also removed. The hidden entries (e.g. the catalog) are never
+    removed, and no stage is removed if the staging directory is the
+    repo itself.
+
+    The stale temporary files (.<name>.ppk-move.XXXXXX) left in the repo
+    by an interrupted cross-file system move are also removed.
+
+    The stages are removed concurrently, one stage per task.
+
+    @param[in]  stage   Explicit path to the staging directory.
+    @param[in]  repo    Explicit path to the repo directory.
+    @param[in]  age     Minimum age of a stale stage, in seconds.
+    @param[in]  pool    Worker pool, or NULL to remove the stages in turn.
+
+    @return             Number of stale stages removed.
+*/
+int journal_purge(const char *stage, const char *repo, time_t age, struct pool *pool) {
+
+    char                jname[NAME_MAX + 1];
+    char                lpath[PATH_MAX];
+    char                msgbuff[128];
+    int                 fd;
+    int                 lockfd;
+    int                 nfiles = 0;
+    int                 ntemps;
+    size_t              capacity = 0;
+    size_t              len;
+    size_t              n = 0;
+    time_t              now = time(NULL);
+    struct dirent       *ep;
+    struct purge_task   *tasks = NULL;
+    struct purge_task   *tmp;
+    struct pool_batch   batch = {0};
+    struct stat         st;
+    struct stat         st_repo;
+    DIR                 *dp;
+
+    if ( (ntemps = purge_temps(repo, age)) ) {
+        snprintf(msgbuff, sizeof(msgbuff), "Removed %d stale temporary files from the repo, left by earlier "
+                 "runs.", ntemps);
+        print_ok(msgbuff);
+    }
+    if ( stat(repo, &st_repo) || stat(stage, &st) ||
+         (st.st_dev == st_repo.st_dev && st.st_ino == st_repo.st_ino) ) {
+        return 0;
+    }
+    if ( (fd = open(stage, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0 ) return 0;
+    if ( (dp = fdopendir(fd)) == NULL ) {
+        close(fd);
+        return 0;
+    }
+    while ( (ep = readdir(dp)) ) {
+        if ( ep->d_name[0] == '.' ) continue;
+        if ( fstatat(fd, ep->d_name, &st, AT_SYMLINK_NOFOLLOW) || now - st.st_mtime < age ) continue;
+        len = strlen(ep->d_name);
+        if ( S_ISREG(st.st_mode) ) {
+            if ( len > strlen(JOURNAL_TMP) && !strcmp(ep->d_name + len - strlen(JOURNAL_TMP), JOURNAL_TMP) ) {
+                unlinkat(fd, ep->d_name, 0);
+            } else if ( len > strlen(JOURNAL_LOCK) &&
+                        !strcmp(ep->d_name + len - strlen(JOURNAL_LOCK), JOURNAL_LOCK) &&
+                        !join_path(lpath, stage, ep->d_name) && (lockfd = lock_file(lpath)) >= 0 ) {
+                // A lock file left by a crashed run, which is not held.
+                unlock_file(lpath, lockfd);
+            }
+            continue;
+        }
+        if ( !S_ISDIR(st.st_mode) ) continue;
+        if ( snprintf(jname, sizeof(jname), "%s.journal", ep->d_name) >= (int)sizeof(jname) ||
+             !faccessat(fd, jname, F_OK, AT_SYMLINK_NOFOLLOW) ) {
+            continue;
+        }
+        if ( n == capacity ) {
+            capacity = ( capacity ) ? capacity * 2 : 16;
+            if ( (tmp = realloc(tasks, capacity * sizeof(*tasks))) == NULL ) break;
+            tasks = tmp;
+        }
+        if ( join_path(tasks[n].fpath, stage, ep->d_name) ||
+             snprintf(tasks[n].lpath, PATH_MAX, "%s" JOURNAL_LOCK, tasks[n].fpath) >= PATH_MAX ||
+             (tasks[n].lockfd = lock_file(tasks[n].lpath)) < 0 ) {
+            continue;
+        }
+        tasks[n++].nremoved = 0;
+    }
+    closedir(dp);
+    for ( size_t i = 0; i < n; ++i ) {
+        if ( pool == NULL || pool_submit(pool, &batch, purge_stage, &tasks[i]) ) purge_stage(&tasks[i]);
+    }
+    if ( pool ) pool_wait(pool, &batch);
+    for ( size_t i = 0; i < n; ++i ) {
+        if ( tasks[i].nremoved > 0 ) nfiles += tasks[i].nremoved;
+    }
+    free(tasks);
+    if ( n ) {
+        snprintf(msgbuff, sizeof(msgbuff), "Removed %zu stale stages (%d files), left by earlier runs.",
+                 n, nfiles);
+        print_ok(msgbuff);
+    }
+    return (int)n;
+}
+
+/**
+    Lock the job's stage for the duration of the job.
+
+    An exclusive lock is taken on the stage's lock file (<stage>.lock),
+    so two processes (e.g. a --watch daemon and a manual run) never
+    unpack, recover or remove the same stage at once. The lock is
+    released by journal_unlock().
+
+    @param[in]  job     Pointer to the (initialised) job.
+
+    @return             0 if the lock was taken, otherwise 1 if the stage
+                        is locked by another process, or on error.
+*/
+int journal_lock(struct job *job) {
+
+    char    lpath[PATH_MAX];
+    char    msgbuff[PATH_MAX + 128];
+
+    if ( snprintf(lpath, sizeof(lpath), "%s" JOURNAL_LOCK, job->stage) >= (int)sizeof(lpath) ) {
+        reporterror("The path to the stage's lock file is too long.", false, false);
+        return EXIT_FAILURE;
+    }
+    if ( (job->lockfd = lock_file(lpath)) < 0 ) {
+        if ( errno == EWOULDBLOCK ) {
+            snprintf(msgbuff, sizeof(msgbuff), "The archive is being unpacked by another process: %s",
+                     job->stage);
+        } else {
+            snprintf(msgbuff, sizeof(msgbuff), "The stage could not be locked: %s", lpath);
+        }
+        reporterror(msgbuff, false, false);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+    Release the lock taken on the job's stage by journal_lock(), if any.
+
+    @param[in]  job     Pointer to the job.
+*/
+void journal_unlock(struct job *job) {
+
+    char    lpath[PATH_MAX];
+
+    if ( job->lockfd < 0 ) return;
+    // The path was built by journal_lock(), so is not truncated.
+    if ( snprintf(lpath, sizeof(lpath), "%s" JOURNAL_LOCK, job->stage) < (int)sizeof(lpath) ) unlink(lpath);
+    close(job->lockfd);
+    job->lockfd = -1;
+}
@@ -0,0 +1,123 @@
+/**
+    Header file for the journal.c module.
+*/
+
+#ifndef _JOURNAL_H
+#define _JOURNAL_H
+
+struct job;
+struct pool;
+
+/**
+    Publish a verified job's staged files into the repo, as a single
+    transaction.
+
+    The job's stage *must* reside on the repo's file system (see
+    verify_stage), so the publish is a batch of rename(2) calls.
+
+    The steps are:
+
+        1. Any repo file which is about to be replaced is hard linked
+           into the stage's .prev directory, as a rollback copy.
+        2. The journal, which lists the files to be published, is
+           written and flushed to a temporary name, then renamed into
+           place. From this point, the commit is rolled forward on
+           restart (see journal_recover).
+        3. The staged files are moved into the repo by movefiles(), as
+           listed in the job's entry table; the stage is not read,
+           and the files are not flushed again.
+        4. The stage is removed, then the journal.
+        5. The published files are recorded in the job's catalog.
+
+    Entries which are already present in the repo (see the catalog) are
+    neither journalled nor published.
+
+    If step 3 fails, the published files are moved back into the stage,
+    the replaced files are restored from the rollback copies, and the
+    journal is removed.
+
+    @param[in]  job     Pointer to the verified job.
+    @param[in]  repo    Explicit path to the repo directory.
+
+    @return             0 if the files were published successfully,
+                        otherwise 1.
+*/
+int journal_commit(struct job *job, const char *repo);
+
+/**
+    Lock the job's stage for the duration of the job.
+
+    An exclusive lock is taken on the stage's lock file (<stage>.lock),
+    so two processes (e.g. a --watch daemon and a manual run) never
+    unpack, recover or remove the same stage at once. The lock is
+    released by journal_unlock().
+
+    @param[in]  job     Pointer to the (initialised) job.
+
+    @return             0 if the lock was taken, otherwise 1 if the stage
+                        is locked by another process, or on error.
+*/
+int journal_lock(struct job *job);
+
+/**
+    Remove the stale stages left in the staging directory by earlier
+    (crashed) runs.
+
+    A stage is stale if it has no journal, and has not been modified for
+    the given age; so it is an incomplete (unverified) extraction, and
+    not a stage being written by another run. A stage which is locked by
+    another run (see journal_lock) is never removed. A stage with a
+    journal is kept, and its commit is rolled forward when its archive is
+    re-run. The stale temporary journals, and the stale lock files, are
+    also removed. The hidden entries (e.g. the catalog) are never
+    removed, and no stage is removed if the staging directory is the
+    repo itself.
+
+    The stale temporary files (.<name>.ppk-move.XXXXXX) left in the repo
+    by an interrupted cross-file system move are also removed.
+
+    The stages are removed concurrently, one stage per task.
+
+    @param[in]  stage   Explicit path to the staging directory.
+    @param[in]  repo    Explicit path to the repo directory.
+    @param[in]  age     Minimum age of a stale stage, in seconds.
+    @param[in]  pool    Worker pool, or NULL to remove the stages in turn.
+
+    @return             Number of stale stages removed.
+*/
+int journal_purge(const char *stage, const char *repo, time_t age, struct pool *pool);
+
+/**
+    Recover an interrupted commit for a job, if any.
+
+    - If a journal exists for the job, the interrupted commit is rolled
+      forward; the archive was verified before the journal was written,
+      so it is not decrypted or verified again. The job's entry table is
+      populated from the journal. If a published file then does not
+      match the journal, the repo is rolled back from the rollback
+      copies, and the commit is discarded.
+    - Otherwise, if a stage exists for the job, it is an incomplete
+      (unverified) extraction, and is removed.
+
+    The job's stage *must* be locked by the caller (see journal_lock), so
+    a stage being written by another process is never removed.
+
+    @param[in]  job     Pointer to the (initialised) job.
+    @param[in]  repo    Explicit path to the repo directory.
+
+    @return             - 0 if there was nothing to recover.
+                        - 1 if an interrupted commit was completed.
+                        - -1 if an interrupted commit could not be
+                          completed. The journal is retained, unless the
+                          repo was rolled back.
+*/
+int journal_recover(struct job *job, const char *repo);
+
+/**
+    Release the lock taken on the job's stage by journal_lock(), if any.
+
+    @param[in]  job     Pointer to the job.
+*/
+void journal_unlock(struct job *job);
+
+#endif /* _JOURNAL_H */
@@ -0,0 +1,305 @@
+/**
+    Purpose:    This module provides the streaming verify-while-extract
+                pipeline, which unpacks, hashes and verifies an archive
+                in a single pass.
+    
+    Developer:  J Berendt
+    Email:      development@s3dev.uk
+
+    Comments:   n/a
+
+    Copyright (C) 73rd Street Development
+    This file is part of the ppk project's upack program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "base.h"
+#include "archive.h"
+#include "catalog.h"
+#include "checks.h"
+#include "filesys.h"
+#include "hash.h"
+#include "job.h"
+#include "ui.h"
+#include "utils.h"
+
+// Maximum size of a .key or .log file retained in memory.
+#define PIPELINE_MAX_BUFFSZ (64*1024*1024)
+
+/**
+    State for the pipeline's archive sink.
+*/
+struct pipeline_ctx {
+    struct job          *job;
+    struct job_entry    *entry;     // Entry currently being decoded.
+    enum job_role       role;      // Role of the entry currently being decoded.
+    char                fpath[PATH_MAX];
+    int                 fd;
+    unsigned char       *buff;      // In-memory copy of a .key or .log file.
+    size_t              buffsz;
+    struct hash         sha;
+    bool                skip;       // The entry is already in the repo; its data is discarded.
+};
+
+// Function prototypes
+int pipeline_run(struct job *job);
+
+/**
+    Test if an entry is already in the repo, identical to the file listed
+    in the (verified) log, so it need not be staged.
+*/
+static bool entry_present(struct job *job, const struct archive_entry *entry) {
+
+    enum job_role       role = job_classify(entry->name);
+    struct job_manifest *row;
+
+    // Only the packages are cached; the verification files are always staged.
+    if ( !job->verified || job->catalog == NULL ) return false;
+    if ( role == ROLE_KEY || role == ROLE_LOG ) return false;
+    if ( (row = job_find_manifest(job, entry->name)) == NULL || row->size != entry->size ) return false;
+    return catalog_contains(job->catalog, row->name, row->size, row->sha256);
+}
+
+/**
+    Archive sink callback: report whether an entry is already present in
+    the repo, so its folder need not be decoded.
+*/
+static bool pipeline_skip(void *ctx, const struct archive_entry *entry) {
+    return entry_present(((struct pipeline_ctx *)ctx)->job, entry);
+}
+
+/**
+    Archive sink callback: create the staged file for an entry and add
+    the entry to the job's entry table.
+
+    @return     0 on success, otherwise 1.
+*/
+static int pipeline_open(void *ctx, const struct archive_entry *entry) {
+
+    char                msgbuff[PATH_MAX + 256];
+    struct pipeline_ctx *p = ctx;
+
+    // The entry names are flattened by the archive reader; reject anything else.
+    if ( !*entry->name || !strcmp(entry->name, ".") || !strcmp(entry->name, "..") ) {
+        reporterror("The archive contains an invalid file name.", false, false);
+        return EXIT_FAILURE;
+    }
+    if ( snprintf(p->fpath, sizeof(p->fpath), "%s/%s", p->job->stage, entry->name) >= (int)sizeof(p->fpath) ) {
+        reporterror("The archive contains a file name which is too long.", false, false);
+        return EXIT_FAILURE;
+    }
+    if ( (p->entry = job_add_entry(p->job, entry->name, entry->size)) == NULL ) {
+        reporterror("Error occurred while allocating memory for the entry table.", false, false);
+        return EXIT_FAILURE;
+    }
+    // A file already in the repo is not staged; the log's digest is recorded.
+    if ( (p->skip = (entry->skipped || entry_present(p->job, entry))) ) {
+        memcpy(p->entry->sha256, job_find_manifest(p->job, entry->name)->sha256, DIGEST_SIZE);
+        p->entry->present = true;
+        ++p->job->npresent;
+        return EXIT_SUCCESS;
+    }
+    // The verification files (classified as the entry was added) are retained in memory.
+    p->role = p->entry->role;
+    if ( p->role == ROLE_KEY || p->role == ROLE_LOG ) {
+        if ( p->job->nroles[p->role] > 1 ) {
+            reporterror("The archive contains more than one .key or .log file.", false, false);
+            return EXIT_FAILURE;
+        }
+        if ( entry->size > PIPELINE_MAX_BUFFSZ || (p->buff = malloc(entry->size + 1)) == NULL ) {
+            reporterror("The archive's .key or .log file is too large.", false, false);
+            return EXIT_FAILURE;
+        }
+        p->buffsz = 0;
+    }
+    if ( (p->fd = open(p->fpath, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0 ) {
+        snprintf(msgbuff, sizeof(msgbuff), "An error occured creating the file: %s\n"
+                 "\t - %s", p->fpath, strerror(errno));
+        reporterror(msgbuff, false, false);
+        return EXIT_FAILURE;
+    }
+    if ( hash_init(&p->sha) ) {
+        reporterror("Error occurred while initialising the hash.", false, false);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+    Archive sink callback: hash and write a block of decoded data to the
+    entry's staged file.
+
+    @return     0 on success, otherwise 1.
+*/
+static int pipeline_write(void *ctx, const unsigned char *buff, size_t size) {
+
+    char                msgbuff[PATH_MAX + 256];
+    ssize_t             n;
+    struct pipeline_ctx *p = ctx;
+
+    if ( p->skip ) return EXIT_SUCCESS;
+    if ( hash_update(&p->sha, buff, size) ) return EXIT_FAILURE;
+    if ( p->buff ) {
+        memcpy(p->buff + p->buffsz, buff, size);
+        p->buffsz += size;
+    }
+    while ( size ) {
+        if ( (n = write(p->fd, buff, size)) < 0 ) {
+            if ( errno == EINTR ) continue;
+            snprintf(msgbuff, sizeof(msgbuff), "An error occurred while writing: %s\n"
+                     "\t - %s", p->fpath, strerror(errno));
+            reporterror(msgbuff, false, false);
+            return EXIT_FAILURE;
+        }
+        buff += n;
+        size -= n;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+    Archive sink callback: flush and close the entry's staged file, and
+    record its digest.
+
+    If this entry completes the pair of .key and .log files, the
+    verification tests are run. A test failure aborts the extraction.
+
+    @return     0 if the file was written and flushed, passed its CRC
+                check and (where run) the verification tests passed,
+                otherwise 1.
+*/
+static int pipeline_close(void *ctx, const struct archive_entry *entry, bool crc_ok) {
+
+    char                msgbuff[PATH_MAX + 256];
+    int64_t             secs;
+    struct job          *job;
+    struct timespec     times[2];
+    struct pipeline_ctx *p = ctx;
+
+    job = p->job;
+    if ( p->skip ) {
+        p->skip = false;
+        return EXIT_SUCCESS;
+    }
+    if ( hash_final(&p->sha, p->entry->sha256) ) crc_ok = false;
+    if ( entry->has_mtime ) {
+        // Convert from FILETIME (100ns intervals since 1601-01-01).
+        secs = (int64_t)(entry->mtime / 10000000) - 11644473600LL;
+        times[0].tv_sec = times[1].tv_sec = secs;
+        times[0].tv_nsec = times[1].tv_nsec = (entry->mtime % 10000000) * 100;
+        futimens(p->fd, times);
+    }
+    // Flush the data; once the journal is written, the staged file is rolled forward on restart.
+    if ( crc_ok && fdatasync(p->fd) ) {
+        snprintf(msgbuff, sizeof(msgbuff), "Error occurred while flushing the unpacked file: %s", entry->name);
+        reporterror(msgbuff, false, false);
+        close(p->fd);
+        p->fd = -1;
+        return EXIT_FAILURE;
+    }
+    if ( close(p->fd) ) crc_ok = false;
+    p->fd = -1;
+    if ( !crc_ok ) {
+        snprintf(msgbuff, sizeof(msgbuff), "CRC check failed for: %s", entry->name);
+        reporterror(msgbuff, false, false);
+        return EXIT_FAILURE;
+    }
+    // Hand the in-memory verification files over to the job.
+    if ( p->role == ROLE_KEY ) {
+        job->key = p->buff;
+        job->keysz = p->buffsz;
+    } else if ( p->role == ROLE_LOG ) {
+        job->log = p->buff;
+        job->logsz = p->buffsz;
+        memcpy(job->log_sha256, p->entry->sha256, DIGEST_SIZE);
+    }
+    p->buff = NULL;
+    // Verify as soon as the verification files are available.
+    if ( job->key && job->log && !job->tested ) {
+        if ( run_tests(job) ) return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+    Unpack, hash and verify the job's archive in a single pass.
+
+    Each archive entry is decoded, SHA-256 hashed and written to the
+    job's staging directory as it is decoded, and recorded in the job's
+    entry table. The .key and .log files are also retained in memory.
+
+    As soon as both the .key and .log files have been decoded, the
+    verification tests are run. If the tests fail, the extraction is
+    aborted immediately, rather than after the whole archive has been
+    written to disk.
+
+    Once the archive is verified, any package which the job's catalog
+    reports is already in the repo (with the log's digest) is neither
+    staged nor, where its whole folder is present, decoded.
+
+    @param[in]  job     Pointer to the job to be processed.
+
+    @return             0 if the archive is unpacked and verified
+                        successfully, otherwise 1.
+*/
+int pipeline_run(struct job *job) {
+
+    char                hash[DIGEST_SIZE * 2 + 1];
+    int                 excode;
+    uint64_t            bytes = 0;
+    uint64_t            files = 0;
+    uint64_t            start = clock_ns();
+    uint64_t            tests = job->timing[PHASE_TESTS].ns;
+    struct pipeline_ctx ctx = { .job = job, .fd = -1 };
+    struct archive_sink sink = { .open = pipeline_open, .write = pipeline_write, .close = pipeline_close,
+                                 .skip = pipeline_skip, .ctx = &ctx };
+
+    sha256_digest(basename((char *)job->fpath), hash);
+    print_start("Unpacking and verifying the archive ...");
+    makedir(job->stage, 0700, 0);
+    excode = archive_extract(job->fpath, hash, &sink);
+    if ( ctx.fd >= 0 ) close(ctx.fd);
+    hash_free(&ctx.sha);
+    free(ctx.buff);
+    for ( size_t i = 0; i < job->nentries; ++i ) bytes += job->entries[i].size;
+    // The tests run as soon as the verification files are decoded; they are timed separately.
+    job_time(job, PHASE_UNPACK, start + (job->timing[PHASE_TESTS].ns - tests), bytes, job->nentries);
+    if ( excode ) {
+        // A test failure has already been reported by run_tests().
+        if ( !job->tested ) reporterror("An error occurred while unpacking the .7z file.", false, false);
+        return EXIT_FAILURE;
+    }
+    // The archive did not contain a complete pair of verification files.
+    if ( !job->tested && run_tests(job) ) return EXIT_FAILURE;
+    // Verify each unpacked file against the (now verified) log.
+    bytes = 0;
+    for ( size_t i = 0; i < job->nentries; ++i ) {
+        if ( job->entries[i].present ) continue;
+        bytes += job->entries[i].size;
+        ++files;
+    }
+    start = clock_ns();
+    excode = test_manifest(job);
+    job_time(job, PHASE_MANIFEST, start, bytes, files);
+    if ( excode ) return EXIT_FAILURE;
+    print_done(0);
+    return EXIT_SUCCESS;
+}
+
@@ -0,0 +1,30 @@
+/**
+    Header file for the pipeline.c module.
+*/
+
+#ifndef _PIPELINE_H
+#define _PIPELINE_H
+
+struct job;
+
+/**
+    Unpack, hash and verify the job's archive in a single pass.
+
+    Each archive entry is decoded, SHA-256 hashed and written to the
+    job's staging directory as it is decoded, and recorded in the job's
+    entry table. The .key and .log files are also retained in memory.
+
+    As soon as both the .key and .log files have been decoded, the
+    verification tests are run. If the tests fail, the extraction is
+    aborted immediately, rather than after the whole archive has been
+    written to disk.
+
+    @param[in]  job     Pointer to the job to be processed.
+
+    @return             0 if the archive is unpacked and verified
+                        successfully, otherwise 1.
+*/
+int pipeline_run(struct job *job);
+
+#endif /* _PIPELINE_H */
+
@@ -0,0 +1,230 @@
+/**
+    Purpose:    This module provides a bounded thread pool, with a FIFO
+                task queue and batch (task group) waits.
+    
+    Developer:  J Berendt
+    Email:      development@s3dev.uk
+
+    Comments:   n/a
+
+    Copyright (C) 73rd Street Development
+    This file is part of the ppk project's upack program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <pthread.h>
+#include <unistd.h>
+#include "base.h"
+#include "pool.h"
+
+struct pool_task {
+    void                (*fn)(void *);
+    void                *arg;
+    struct pool_batch   *batch;
+    struct pool_task    *next;
+};
+
+struct pool {
+    pthread_mutex_t     lock;
+    pthread_cond_t      queued;     // Signalled when a task is queued, or on shutdown.
+    pthread_cond_t      done;       // Signalled when a task completes.
+    pthread_t           *threads;
+    int                 nthreads;
+    bool                shutdown;
+    struct pool_task    *head;
+    struct pool_task    *tail;
+};
+
+// Function prototypes
+struct pool *pool_create(int nworkers);
+void pool_destroy(struct pool *pool);
+int pool_ncpus(void);
+int pool_submit(struct pool *pool, struct pool_batch *batch, void (*fn)(void *), void *arg);
+void pool_wait(struct pool *pool, struct pool_batch *batch);
+
+/**
+    Run a task taken from the queue and mark it as complete.
+
+    Note: The pool's lock must be held on entry, and is held on return.
+*/
+static void run_task(struct pool *pool, struct pool_task *task) {
+    pthread_mutex_unlock(&pool->lock);
+    task->fn(task->arg);
+    pthread_mutex_lock(&pool->lock);
+    --task->batch->pending;
+    pthread_cond_broadcast(&pool->done);
+    free(task);
+}
+
+/**
+    Remove and return the task at the head of the queue, if any.
+
+    Note: The pool's lock must be held.
+*/
+static struct pool_task *pop_task(struct pool *pool) {
+
+    struct pool_task *task = pool->head;
+
+    if ( task ) {
+        pool->head = task->next;
+        if ( pool->head == NULL ) pool->tail = NULL;
+    }
+    return task;
+}
+
+/**
+    Worker thread entry-point.
+*/
+static void *worker(void *arg) {
+
+    struct pool         *pool = arg;
+    struct pool_task    *task;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while ( pool->head == NULL && !pool->shutdown ) {
+            pthread_cond_wait(&pool->queued, &pool->lock);
+        }
+        if ( (task = pop_task(pool)) == NULL ) break;  // Shutdown, with an empty queue.
+        run_task(pool, task);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/**
+    Create a thread pool.
+
+    @param[in]  nworkers    Number of worker threads. If less than 1, the
+                            number of online CPUs is used.
+
+    @return                 Pointer to the new pool, or NULL on error.
+                            The pool must be released by pool_destroy().
+*/
+struct pool *pool_create(int nworkers) {
+
+    struct pool *pool;
+
+    if ( nworkers < 1 ) nworkers = pool_ncpus();
+    if ( (pool = calloc(1, sizeof(struct pool))) == NULL ) return NULL;
+    if ( (pool->threads = calloc(nworkers, sizeof(pthread_t))) == NULL ) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->queued, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    for ( int i = 0; i < nworkers; ++i ) {
+        if ( pthread_create(&pool->threads[i], NULL, worker, pool) ) break;
+        ++pool->nthreads;
+    }
+    if ( pool->nthreads == 0 ) {
+        pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+/**
+    Wait for all outstanding tasks, stop the workers and release the
+    pool.
+
+    @param[in]  pool    Pointer to the pool to be destroyed.
+*/
+void pool_destroy(struct pool *pool) {
+    if ( pool == NULL ) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->queued);
+    pthread_mutex_unlock(&pool->lock);
+    for ( int i = 0; i < pool->nthreads; ++i ) pthread_join(pool->threads[i], NULL);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->queued);
+    pthread_cond_destroy(&pool->done);
+    free(pool->threads);
+    free(pool);
+}
+
+/**
+    Return the number of online CPUs; used as the default worker count.
+
+    @return     The number of online CPUs, or 1 if this cannot be
+                determined.
+*/
+int pool_ncpus(void) {
+
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return ( n > 0 ) ? (int)n : 1;
+}
+
+/**
+    Submit a task to the pool.
+
+    @param[in]  pool    Pointer to the pool.
+    @param[in]  batch   Batch to which the task belongs.
+    @param[in]  fn      Function to be called by a worker.
+    @param[in]  arg     Argument passed to the function.
+
+    @return             0 on success, otherwise 1 if the task could not
+                        be queued.
+*/
+int pool_submit(struct pool *pool, struct pool_batch *batch, void (*fn)(void *), void *arg) {
+
+    struct pool_task *task;
+
+    if ( (task = malloc(sizeof(struct pool_task))) == NULL ) return EXIT_FAILURE;
+    task->fn = fn;
+    task->arg = arg;
+    task->batch = batch;
+    task->next = NULL;
+    pthread_mutex_lock(&pool->lock);
+    ++batch->pending;
+    if ( pool->tail ) {
+        pool->tail->next = task;
+    } else {
+        pool->head = task;
+    }
+    pool->tail = task;
+    pthread_cond_signal(&pool->queued);
+    pthread_mutex_unlock(&pool->lock);
+    return EXIT_SUCCESS;
+}
+
+/**
+    Wait for all tasks in a batch to complete.
+
+    While waiting, the calling thread also runs queued tasks. Therefore,
+    it is safe for a task to submit (and wait for) a nested batch of
+    tasks on the same pool.
+
+    @param[in]  pool    Pointer to the pool.
+    @param[in]  batch   Batch to be waited upon.
+*/
+void pool_wait(struct pool *pool, struct pool_batch *batch) {
+
+    struct pool_task *task;
+
+    pthread_mutex_lock(&pool->lock);
+    while ( batch->pending ) {
+        if ( (task = pop_task(pool)) ) {
+            run_task(pool, task);
+        } else {
+            pthread_cond_wait(&pool->done, &pool->lock);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
@@ -0,0 +1,70 @@
+/**
+    Header file for the pool.c module.
+*/
+
+#ifndef _POOL_H
+#define _POOL_H
+
+struct pool;
+
+/**
+    A batch of tasks, which can be waited upon as a group.
+*/
+struct pool_batch {
+    size_t  pending;    // Number of submitted tasks not yet complete.
+};
+
+/**
+    Create a thread pool.
+
+    @param[in]  nworkers    Number of worker threads. If less than 1, the
+                            number of online CPUs is used.
+
+    @return                 Pointer to the new pool, or NULL on error.
+                            The pool must be released by pool_destroy().
+*/
+struct pool *pool_create(int nworkers);
+
+/**
+    Wait for all outstanding tasks, stop the workers and release the
+    pool.
+
+    @param[in]  pool    Pointer to the pool to be destroyed.
+*/
+void pool_destroy(struct pool *pool);
+
+/**
+    Return the number of online CPUs; used as the default worker count.
+
+    @return     The number of online CPUs, or 1 if this cannot be
+                determined.
+*/
+int pool_ncpus(void);
+
+/**
+    Submit a task to the pool.
+
+    @param[in]  pool    Pointer to the pool.
+    @param[in]  batch   Batch to which the task belongs.
+    @param[in]  fn      Function to be called by a worker.
+    @param[in]  arg     Argument passed to the function.
+
+    @return             0 on success, otherwise 1 if the task could not
+                        be queued.
+*/
+int pool_submit(struct pool *pool, struct pool_batch *batch, void (*fn)(void *), void *arg);
+
+/**
+    Wait for all tasks in a batch to complete.
+
+    While waiting, the calling thread also runs queued tasks. Therefore,
+    it is safe for a task to submit (and wait for) a nested batch of
+    tasks on the same pool.
+
+    @param[in]  pool    Pointer to the pool.
+    @param[in]  batch   Batch to be waited upon.
+*/
+void pool_wait(struct pool *pool, struct pool_batch *batch);
+
+#endif /* _POOL_H */
+
@@ -0,0 +1,172 @@
+/**
+    Purpose:    This module provides the machine-readable run report
+                (--report); the time spent in each phase of each job,
+                with the files and bytes processed, and the file move
+                method counts, written as JSON.
+
+    Developer:  J Berendt
+    Email:      development@s3dev.uk
+
+    Comments:   The report is in the format:
+
+                    {
+                      "program": "upack", "version": "...",
+                      "workers": N, "seconds": S, "index_seconds": S,
+                      "archives": [
+                        {
+                          "archive": "...", "result": "pass" | "fail",
+                          "files": N, "present": N,
+                          "renamed": N, "copied": N,
+                          "phases": {
+                            "<phase>": { "seconds": S, "files": N,
+                                         "bytes": N, "mb_per_sec": R },
+                            ...
+                          }
+                        },
+                        ...
+                      ],
+                      "totals": { ... as for an archive ... }
+                    }
+
+                The phases are: recover, unpack, tests, manifest, commit
+                and cleanup. All times are measured by the monotonic
+                clock. Where the archives are processed concurrently,
+                the phase totals are the sum of the archives' times,
+                and may exceed the run's elapsed time.
+
+    Copyright (C) 73rd Street Development
+    This file is part of the ppk project's upack program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <inttypes.h>
+#include <unistd.h>
+#include "base.h"
+#include "job.h"
+#include "report.h"
+#include "utils.h"
+
+static const char *phase_names[PHASE_COUNT] = { "recover", "unpack", "tests", "manifest", "commit", "cleanup" };
+
+// Function prototypes
+int report_write(const char *fpath, const struct job *jobs, int njobs, int nworkers, uint64_t elapsed,
+                 uint64_t index_ns);
+
+/**
+    Write a string as a JSON string literal.
+*/
+static void write_string(FILE *fp, const char *s) {
+    fputc('"', fp);
+    for ( ; *s; ++s ) {
+        if ( *s == '"' || *s == '\\' ) {
+            fprintf(fp, "\\%c", *s);
+        } else if ( (unsigned char)*s < 0x20 ) {
+            fprintf(fp, "\\u%04x", (unsigned char)*s);
+        } else {
+            fputc(*s, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+/**
+    Write the counts and the phase timings of an archive (or the totals).
+*/
+static void write_phases(FILE *fp, const struct job_timing *timing, size_t nfiles, size_t npresent,
+                         size_t nomitted, uint64_t nrenamed, uint64_t ncopied) {
+
+    double  secs;
+
+    fprintf(fp, "\"files\": %zu, \"present\": %zu, \"omitted\": %zu, \"renamed\": %" PRIu64
+                ", \"copied\": %" PRIu64 ",\n      \"phases\": {", nfiles, npresent, nomitted, nrenamed, ncopied);
+    for ( int i = 0; i < PHASE_COUNT; ++i ) {
+        secs = timing[i].ns / 1e9;
+        fprintf(fp, "%s\n        \"%s\": {\"seconds\": %.6f, \"files\": %" PRIu64 ", \"bytes\": %" PRIu64
+                    ", \"mb_per_sec\": %.2f}",
+                ( i ) ? "," : "", phase_names[i], secs, timing[i].files, timing[i].bytes,
+                ( secs > 0 ) ? timing[i].bytes / 1e6 / secs : 0.0);
+    }
+    fprintf(fp, "\n      }");
+}
+
+/**
+    Write the run report, as JSON.
+
+    The report is written to a temporary file, then renamed into place,
+    so a monitoring process never reads a partial report.
+
+    @param[in]  fpath       Explicit path to the report file.
+    @param[in]  jobs        Array of completed jobs.
+    @param[in]  njobs       Number of jobs.
+    @param[in]  nworkers    Number of workers in the pool.
+    @param[in]  elapsed     Elapsed (monotonic) time of the run, in
+                            nanoseconds.
+    @param[in]  index_ns    Time spent updating the simple index, in
+                            nanoseconds.
+
+    @return                 0 on success, otherwise 1.
+*/
+int report_write(const char *fpath, const struct job *jobs, int njobs, int nworkers, uint64_t elapsed,
+                 uint64_t index_ns) {
+
+    char                msgbuff[PATH_MAX + 128];
+    char                tmp[PATH_MAX];
+    size_t              nfiles = 0;
+    size_t              npresent = 0;
+    size_t              nomitted = 0;
+    uint64_t            nrenamed = 0;
+    uint64_t            ncopied = 0;
+    struct job_timing   totals[PHASE_COUNT] = {{0}};
+    FILE                *fp;
+
+    if ( snprintf(tmp, sizeof(tmp), "%s.%d.tmp", fpath, (int)getpid()) >= (int)sizeof(tmp) ||
+         (fp = fopen(tmp, "w")) == NULL ) {
+        snprintf(msgbuff, sizeof(msgbuff), "The run report could not be written: %s", fpath);
+        reporterror(msgbuff, false, false);
+        return EXIT_FAILURE;
+    }
+    fprintf(fp, "{\n  \"program\": \"%s\", \"version\": \"%s\",\n"
+                "  \"workers\": %d, \"seconds\": %.6f, \"index_seconds\": %.6f,\n"
+                "  \"archives\": [",
+            _APP_NAME, _VERSION, nworkers, elapsed / 1e9, index_ns / 1e9);
+    for ( int i = 0; i < njobs; ++i ) {
+        fprintf(fp, "%s\n    {\n      \"archive\": ", ( i ) ? "," : "");
+        write_string(fp, jobs[i].label);
+        fprintf(fp, ", \"result\": \"%s\",\n      ", ( jobs[i].excode ) ? "fail" : "pass");
+        write_phases(fp, jobs[i].timing, jobs[i].nentries, jobs[i].npresent, jobs[i].nomitted, jobs[i].nrenamed,
+                     jobs[i].ncopied);
+        fprintf(fp, "\n    }");
+        for ( int j = 0; j < PHASE_COUNT; ++j ) {
+            totals[j].ns += jobs[i].timing[j].ns;
+            totals[j].bytes += jobs[i].timing[j].bytes;
+            totals[j].files += jobs[i].timing[j].files;
+        }
+        nfiles += jobs[i].nentries;
+        npresent += jobs[i].npresent;
+        nomitted += jobs[i].nomitted;
+        nrenamed += jobs[i].nrenamed;
+        ncopied += jobs[i].ncopied;
+    }
+    fprintf(fp, "\n  ],\n  \"totals\": {\n      ");
+    write_phases(fp, totals, nfiles, npresent, nomitted, nrenamed, ncopied);
+    fprintf(fp, "\n  }\n}\n");
+    if ( fclose(fp) || rename(tmp, fpath) ) {
+        unlink(tmp);
+        snprintf(msgbuff, sizeof(msgbuff), "The run report could not be written: %s", fpath);
+        reporterror(msgbuff, false, false);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
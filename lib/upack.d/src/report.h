@@ -0,0 +1,30 @@
+/**
+    Header file for the report.c module.
+*/
+
+#ifndef _REPORT_H
+#define _REPORT_H
+
+struct job;
+
+/**
+    Write the run report, as JSON.
+
+    The report is written to a temporary file, then renamed into place,
+    so a monitoring process never reads a partial report.
+
+    @param[in]  fpath       Explicit path to the report file.
+    @param[in]  jobs        Array of completed jobs.
+    @param[in]  njobs       Number of jobs.
+    @param[in]  nworkers    Number of workers in the pool.
+    @param[in]  elapsed     Elapsed (monotonic) time of the run, in
+                            nanoseconds.
+    @param[in]  index_ns    Time spent updating the simple index, in
+                            nanoseconds.
+
+    @return                 0 on success, otherwise 1.
+*/
+int report_write(const char *fpath, const struct job *jobs, int njobs, int nworkers, uint64_t elapsed,
+                 uint64_t index_ns);
+
+#endif /* _REPORT_H */
@@ -0,0 +1,420 @@
+/**
+    Purpose:    This module provides an incremental updater for the
+                repo's PEP 503 simple index, which rewrites only the pages
+                of the projects changed by the unpacked archives.
+
+    Developer:  J Berendt
+    Email:      development@s3dev.uk
+
+    Comments:   The index is laid out as:
+
+                    simple/index.html               All projects.
+                    simple/<project>/index.html     A project's files.
+
+                where each file link is relative to the repo directory
+                (../../<file>), and carries a #sha256= fragment.
+
+    Copyright (C) 73rd Street Development
+    This file is part of the ppk project's upack program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ctype.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "base.h"
+#include "catalog.h"
+#include "filesys.h"
+#include "hash.h"
+#include "job.h"
+#include "simple.h"
+#include "ui.h"
+#include "utils.h"
+
+/**
+    A growable list of strings.
+*/
+struct simple_list {
+    char    **items;
+    size_t  n;
+    size_t  capacity;
+};
+
+// Function prototypes
+int simple_project(const char *fname, char *project, size_t size);
+int simple_update(const char *repo, const char *index, struct catalog *cat, const struct job *jobs, int njobs,
+                  const char *changed);
+
+/**
+    Append a copy of a string to the list.
+
+    @return     0 on success, otherwise 1.
+*/
+static int list_add(struct simple_list *l, const char *s) {
+
+    char    **items;
+    size_t  capacity;
+
+    if ( l->n == l->capacity ) {
+        capacity = ( l->capacity ) ? l->capacity * 2 : 256;
+        if ( (items = realloc(l->items, capacity * sizeof(char *))) == NULL ) return EXIT_FAILURE;
+        l->items = items;
+        l->capacity = capacity;
+    }
+    if ( (l->items[l->n] = strdup(s)) == NULL ) return EXIT_FAILURE;
+    ++l->n;
+    return EXIT_SUCCESS;
+}
+
+/**
+    qsort(3) and bsearch(3) comparison callback for the lists.
+*/
+static int compare_items(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/**
+    Sort the list, and remove any duplicates.
+*/
+static void list_sort(struct simple_list *l) {
+
+    size_t  n = 0;
+
+    qsort(l->items, l->n, sizeof(char *), compare_items);
+    for ( size_t i = 0; i < l->n; ++i ) {
+        if ( n && !strcmp(l->items[n - 1], l->items[i]) ) {
+            free(l->items[i]);
+        } else {
+            l->items[n++] = l->items[i];
+        }
+    }
+    l->n = n;
+}
+
+/**
+    Test if a (sorted) list contains a string.
+*/
+static bool list_has(const struct simple_list *l, const char *s) {
+    return ( l->n && bsearch(&s, l->items, l->n, sizeof(char *), compare_items) );
+}
+
+/**
+    Release the list's strings.
+*/
+static void list_free(struct simple_list *l) {
+    for ( size_t i = 0; i < l->n; ++i ) free(l->items[i]);
+    free(l->items);
+    memset(l, 0, sizeof(*l));
+}
+
+/**
+    Write a string as HTML text, escaping the reserved characters.
+*/
+static void write_text(FILE *fp, const char *s) {
+    for ( ; *s; ++s ) {
+        switch ( *s ) {
+            case '&': fputs("&amp;", fp); break;
+            case '<': fputs("&lt;", fp); break;
+            case '>': fputs("&gt;", fp); break;
+            case '"': fputs("&quot;", fp); break;
+            default: fputc(*s, fp);
+        }
+    }
+}
+
+/**
+    Write a filename as a URL path segment, percent encoding all but the
+    unreserved characters.
+*/
+static void write_href(FILE *fp, const char *s) {
+    for ( ; *s; ++s ) {
+        if ( isalnum((unsigned char)*s) || strchr("-._~+!", *s) ) {
+            fputc(*s, fp);
+        } else {
+            fprintf(fp, "%%%02X", (unsigned char)*s);
+        }
+    }
+}
+
+/**
+    Create a page's directory, and open the page's temporary file with
+    its header written.
+
+    @return     The open file, or NULL on error.
+*/
+static FILE *page_open(const char *dpath, const char *title, char *tmp) {
+
+    FILE    *fp;
+
+    if ( makedir(dpath, 0755, 0) && errno != EEXIST ) return NULL;
+    if ( snprintf(tmp, PATH_MAX, "%s/index.html.tmp", dpath) >= PATH_MAX ) return NULL;
+    if ( (fp = fopen(tmp, "w")) == NULL ) return NULL;
+    fprintf(fp, "<!DOCTYPE html>\n<html>\n  <head>\n"
+                "    <meta name=\"pypi:repository-version\" content=\"1.0\">\n    <title>");
+    write_text(fp, title);
+    fprintf(fp, "</title>\n  </head>\n  <body>\n    <h1>");
+    write_text(fp, title);
+    fprintf(fp, "</h1>\n");
+    return fp;
+}
+
+/**
+    Write a page's footer, close it and rename it into place.
+
+    @return     0 on success, otherwise 1.
+*/
+static int page_close(FILE *fp, const char *tmp) {
+
+    char    fpath[PATH_MAX];
+    int     excode = EXIT_SUCCESS;
+    size_t  len = strlen(tmp) - 4;  // Less the .tmp suffix.
+
+    fprintf(fp, "  </body>\n</html>\n");
+    if ( fclose(fp) ) excode = EXIT_FAILURE;
+    memcpy(fpath, tmp, len);
+    fpath[len] = '\0';
+    if ( excode || rename(tmp, fpath) ) {
+        unlink(tmp);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+    Write a project's page, with a link to each of its files.
+
+    @param[in]  links   Sorted list of '<project>/<file>' strings; the
+                        project's links are found by their prefix.
+
+    @return     0 on success, otherwise 1.
+*/
+static int write_project(const char *index, const char *project, const struct simple_list *links,
+                         struct catalog *cat) {
+
+    char            dpath[PATH_MAX];
+    char            hex[DIGEST_SIZE * 2 + 1];
+    char            title[NAME_MAX + 16];
+    char            tmp[PATH_MAX];
+    size_t          lo = 0;
+    size_t          hi = links->n;
+    size_t          len = strlen(project);
+    size_t          mid;
+    const char      *fname;
+    unsigned char   digest[DIGEST_SIZE];
+    FILE            *fp;
+
+    if ( snprintf(dpath, sizeof(dpath), "%s/%s", index, project) >= (int)sizeof(dpath) ) return EXIT_FAILURE;
+    snprintf(title, sizeof(title), "Links for %s", project);
+    if ( (fp = page_open(dpath, title, tmp)) == NULL ) return EXIT_FAILURE;
+    // Find the project's first link; the links sharing a prefix are contiguous.
+    while ( lo < hi ) {
+        mid = lo + (hi - lo) / 2;
+        if ( strncmp(links->items[mid], project, len) < 0 ||
+             (!strncmp(links->items[mid], project, len) && links->items[mid][len] < '/') ) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for ( ; lo < links->n && !strncmp(links->items[lo], project, len) && links->items[lo][len] == '/'; ++lo ) {
+        fname = links->items[lo] + len + 1;
+        fprintf(fp, "    <a href=\"../../");
+        write_href(fp, fname);
+        if ( catalog_digest(cat, fname, digest) == 0 ) {
+            hash_tohex(digest, hex);
+            fprintf(fp, "#sha256=%s", hex);
+        }
+        fprintf(fp, "\">");
+        write_text(fp, fname);
+        fprintf(fp, "</a><br/>\n");
+    }
+    return page_close(fp, tmp);
+}
+
+/**
+    Write the root page, with a link to each project in the repo.
+
+    @return     0 on success, otherwise 1.
+*/
+static int write_root(const char *index, const struct simple_list *projects) {
+
+    char    tmp[PATH_MAX];
+    FILE    *fp;
+
+    if ( (fp = page_open(index, "Simple index", tmp)) == NULL ) return EXIT_FAILURE;
+    for ( size_t i = 0; i < projects->n; ++i ) {
+        fprintf(fp, "    <a href=\"");
+        write_href(fp, projects->items[i]);
+        fprintf(fp, "/\">");
+        write_text(fp, projects->items[i]);
+        fprintf(fp, "</a><br/>\n");
+    }
+    return page_close(fp, tmp);
+}
+
+/**
+    Derive the normalised (PEP 503) project name from a distribution's
+    filename.
+
+    Wheels are named {project}-{version}-...whl, and source
+    distributions {project}-{version}.tar.gz (or .tgz, .tar.bz2, .tar.xz
+    and .zip; see job_sdist_ext), where
+    the version is the part after the last hyphen which is followed by a
+    digit. The name is lower cased, and each run of '-', '_' and '.' is
+    replaced with a single '-'.
+
+    @param[in]  fname   Base filename of the distribution.
+    @param[out] project Buffer to receive the project name.
+    @param[in]  size    Size of the project buffer, in bytes.
+
+    @return             0 on success, otherwise 1 if the file is not a
+                        (recognised) distribution.
+*/
+int simple_project(const char *fname, char *project, size_t size) {
+
+    bool        sep = false;
+    size_t      len = strlen(fname);
+    size_t      n = 0;
+    size_t      extlen;
+    const char  *end = NULL;
+
+    if ( len > 4 && !strcmp(fname + len - 4, ".whl") ) {
+        end = strchr(fname, '-');
+    } else if ( (extlen = job_sdist_ext(fname)) ) {
+        for ( const char *p = fname; p < fname + len - extlen; ++p ) {
+            if ( *p == '-' && isdigit((unsigned char)p[1]) ) end = p;
+        }
+    }
+    if ( end == NULL ) return EXIT_FAILURE;
+    for ( const char *p = fname; p < end; ++p ) {
+        if ( strchr("-_.", *p) ) {
+            sep = true;
+            continue;
+        }
+        if ( n + 2 >= size ) return EXIT_FAILURE;
+        if ( sep && n ) project[n++] = '-';
+        project[n++] = tolower((unsigned char)*p);
+        sep = false;
+    }
+    project[n] = '\0';
+    return ( n ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+    Update the repo's PEP 503 simple index for the projects changed by
+    the successful jobs, rather than regenerating the whole index.
+
+    The repo directory is read once. Only the changed projects'
+    simple/<project>/index.html pages are rewritten, along with the root
+    page, which lists every project in the repo. Each link carries the
+    file's SHA-256 digest, as recorded by the catalog. All pages are
+    written to a temporary file, then renamed into place.
+
+    @param[in]  repo    Explicit path to the repo directory.
+    @param[in]  index   Explicit path to the simple index, or NULL to only
+                        list the changed projects.
+    @param[in]  cat     Pointer to the repo's catalog.
+    @param[in]  jobs    Array of completed jobs.
+    @param[in]  njobs   Number of jobs.
+    @param[in]  changed Explicit path to a file to receive the changed
+                        project names (one per line), or NULL.
+
+    @return             0 on success, otherwise 1.
+*/
+int simple_update(const char *repo, const char *index, struct catalog *cat, const struct job *jobs, int njobs,
+                  const char *changed) {
+
+    char                fpath[PATH_MAX];
+    char                link[PATH_MAX];
+    char                msgbuff[PATH_MAX + 256];
+    char                project[NAME_MAX + 1];
+    int                 excode = EXIT_FAILURE;
+    struct dirent       *ep;
+    struct simple_list  all = {0};
+    struct simple_list  links = {0};
+    struct simple_list  projects = {0};
+    struct stat         st;
+    DIR                 *dp = NULL;
+    FILE                *fp;
+
+    print_start("\nUpdating the simple index ...");
+    // The changed projects are those of the files published by the successful jobs.
+    for ( int i = 0; i < njobs; ++i ) {
+        if ( jobs[i].excode ) continue;
+        for ( size_t j = 0; j < jobs[i].nentries; ++j ) {
+            if ( jobs[i].entries[j].present ) continue;
+            if ( jobs[i].entries[j].role != ROLE_WHEEL && jobs[i].entries[j].role != ROLE_SDIST ) continue;
+            if ( simple_project(jobs[i].entries[j].name, project, sizeof(project)) ) continue;
+            if ( list_add(&projects, project) ) goto nomem;
+        }
+    }
+    list_sort(&projects);
+    if ( changed ) {
+        if ( (fp = fopen(changed, "w")) == NULL ) {
+            snprintf(msgbuff, sizeof(msgbuff), "%s: %s", strerror(errno), changed);
+            reporterror(msgbuff, false, false);
+            goto cleanup;
+        }
+        for ( size_t i = 0; i < projects.n; ++i ) fprintf(fp, "%s\n", projects.items[i]);
+        if ( fclose(fp) ) goto cleanup;
+    }
+    if ( index == NULL || projects.n == 0 ) {
+        excode = EXIT_SUCCESS;
+        goto cleanup;
+    }
+    // A single pass over the repo collects every project, and the changed projects' files.
+    if ( (dp = opendir(repo)) == NULL ) {
+        snprintf(msgbuff, sizeof(msgbuff), "%s: %s", strerror(errno), repo);
+        reporterror(msgbuff, false, false);
+        goto cleanup;
+    }
+    while ( (ep = readdir(dp)) != NULL ) {
+        if ( ep->d_name[0] == '.' || simple_project(ep->d_name, project, sizeof(project)) ) continue;
+        if ( ep->d_type != DT_REG ) {
+            if ( ep->d_type != DT_UNKNOWN ) continue;
+            if ( snprintf(fpath, sizeof(fpath), "%s/%s", repo, ep->d_name) >= (int)sizeof(fpath) ) continue;
+            if ( stat(fpath, &st) || !S_ISREG(st.st_mode) ) continue;
+        }
+        if ( list_add(&all, project) ) goto nomem;
+        if ( list_has(&projects, project) ) {
+            snprintf(link, sizeof(link), "%s/%s", project, ep->d_name);
+            if ( list_add(&links, link) ) goto nomem;
+        }
+    }
+    list_sort(&all);
+    list_sort(&links);
+    if ( makedir(index, 0755, 0) && errno != EEXIST ) goto failed;
+    for ( size_t i = 0; i < projects.n; ++i ) {
+        if ( write_project(index, projects.items[i], &links, cat) ) goto failed;
+    }
+    if ( write_root(index, &all) ) goto failed;
+    print_done(false);
+    excode = EXIT_SUCCESS;
+    goto cleanup;
+nomem:
+    reporterror("Error occurred while allocating memory for the simple index.", false, false);
+    goto cleanup;
+failed:
+    snprintf(msgbuff, sizeof(msgbuff), "An error occurred while writing the simple index: %s\n"
+             "\t - %s", index, strerror(errno));
+    reporterror(msgbuff, false, false);
+cleanup:
+    if ( dp ) closedir(dp);
+    list_free(&all);
+    list_free(&links);
+    list_free(&projects);
+    return excode;
+}
@@ -0,0 +1,54 @@
+/**
+    Header file for the simple.c module.
+*/
+
+#ifndef _SIMPLE_H
+#define _SIMPLE_H
+
+struct catalog;
+struct job;
+
+/**
+    Derive the normalised (PEP 503) project name from a distribution's
+    filename.
+
+    Wheels are named {project}-{version}-...whl, and source
+    distributions {project}-{version}.tar.gz (or .zip, .tar.bz2), where
+    the version is the part after the last hyphen which is followed by a
+    digit. The name is lower cased, and each run of '-', '_' and '.' is
+    replaced with a single '-'.
+
+    @param[in]  fname   Base filename of the distribution.
+    @param[out] project Buffer to receive the project name.
+    @param[in]  size    Size of the project buffer, in bytes.
+
+    @return             0 on success, otherwise 1 if the file is not a
+                        (recognised) distribution.
+*/
+int simple_project(const char *fname, char *project, size_t size);
+
+/**
+    Update the repo's PEP 503 simple index for the projects changed by
+    the successful jobs, rather than regenerating the whole index.
+
+    The repo directory is read once. Only the changed projects'
+    simple/<project>/index.html pages are rewritten, along with the root
+    page, which lists every project in the repo. Each link carries the
+    file's SHA-256 digest, as recorded by the catalog. All pages are
+    written to a temporary file, then renamed into place.
+
+    @param[in]  repo    Explicit path to the repo directory.
+    @param[in]  index   Explicit path to the simple index, or NULL to only
+                        list the changed projects.
+    @param[in]  cat     Pointer to the repo's catalog.
+    @param[in]  jobs    Array of completed jobs.
+    @param[in]  njobs   Number of jobs.
+    @param[in]  changed Explicit path to a file to receive the changed
+                        project names (one per line), or NULL.
+
+    @return             0 on success, otherwise 1.
+*/
+int simple_update(const char *repo, const char *index, struct catalog *cat, const struct job *jobs, int njobs,
+                  const char *changed);
+
+#endif /* _SIMPLE_H */
@@ -25,6 +25,12 @@
 */
 
 #include "base.h"
+#include "ui.h"
+
+// Suppress the progress (start, OK and done) messages.
+static bool _quiet = false;
+// Label prefixed to this thread's warnings and errors (e.g. the archive name).
+static __thread const char *_label = NULL;
 
 /**
     Display an alert message (msg) in red, to stderr.
@@ -32,7 +38,7 @@
     @param[in]  msg     Message to be displayed.
 */
 void print_alert(const char *msg) {
-    fprintf(stderr, ANSI_B_RED "%s\n" ANSI_RST, msg);
+    fprintf(stderr, ANSI_B_RED "%s%s\n" ANSI_RST, ui_prefix(), msg);
 }
 
 /**
@@ -41,6 +47,7 @@ void print_alert(const char *msg) {
     @param[in]  add_newline     Insert a blank line above the message.
 */
 void print_done(bool add_newline) {
+    if ( _quiet ) return;
     char *newline = ( add_newline ) ? "\n" : "";
     printf("%s" ANSI_B_GRN "Done.\n" ANSI_RST, newline);
 }
@@ -73,6 +80,7 @@ void print_notice(void) {
     @param[in]  msg     Message to be displayed.
 */
 void print_ok(const char *msg) {
+    if ( _quiet ) return;
     printf(ANSI_B_GRN "%s\n" ANSI_RST, msg);
 }
 
@@ -82,6 +90,7 @@ void print_ok(const char *msg) {
     @param[in]  msg     Message to be displayed.
 */
 void print_start(const char *msg) {
+    if ( _quiet ) return;
     printf(ANSI_B_CYN "%s\n" ANSI_RST, msg);
 }
 
@@ -91,6 +100,50 @@ void print_start(const char *msg) {
     @param[in]  msg     Message to be displayed.
 */
 void print_warning(const char *msg) {
-    fprintf(stderr, ANSI_B_YLW "%s\n" ANSI_RST, msg);
+    fprintf(stderr, ANSI_B_YLW "%s%s\n" ANSI_RST, ui_prefix(), msg);
+}
+
+/**
+    Return the calling thread's label, as set by ui_set_label().
+
+    @return     The label, or NULL if no label is set.
+*/
+const char *ui_label(void) {
+    return _label;
+}
+
+/**
+    Return the calling thread's message prefix, as set by ui_set_label().
+
+    @return     The prefix string (e.g. "(archive.7z) "), or an empty
+                string if no label is set.
+*/
+const char *ui_prefix(void) {
+
+    static __thread char prefix[288];
+
+    if ( _label == NULL ) return "";
+    snprintf(prefix, sizeof(prefix), "(%s) ", _label);
+    return prefix;
+}
+
+/**
+    Set the label which is prefixed to the calling thread's warning and
+    error messages.
+
+    @param[in]  label   Label to be used (not copied), or NULL to clear.
+*/
+void ui_set_label(const char *label) {
+    _label = label;
+}
+
+/**
+    Enable or disable quiet mode, in which the progress (start, OK and
+    done) messages are suppressed. Warnings and errors are still shown.
+
+    @param[in]  quiet   True to suppress the progress messages.
+*/
+void ui_set_quiet(bool quiet) {
+    _quiet = quiet;
 }
 
@@ -45,5 +45,36 @@ void print_start(const char *msg);
 */
 void print_warning(const char *msg);
 
+/**
+    Return the calling thread's label, as set by ui_set_label().
+
+    @return     The label, or NULL if no label is set.
+*/
+const char *ui_label(void);
+
+/**
+    Return the calling thread's message prefix, as set by ui_set_label().
+
+    @return     The prefix string (e.g. "(archive.7z) "), or an empty
+                string if no label is set.
+*/
+const char *ui_prefix(void);
+
+/**
+    Set the label which is prefixed to the calling thread's warning and
+    error messages.
+
+    @param[in]  label   Label to be used (not copied), or NULL to clear.
+*/
+void ui_set_label(const char *label);
+
+/**
+    Enable or disable quiet mode, in which the progress (start, OK and
+    done) messages are suppressed. Warnings and errors are still shown.
+
+    @param[in]  quiet   True to suppress the progress messages.
+*/
+void ui_set_quiet(bool quiet);
+
 #endif /* _UI_H */
 
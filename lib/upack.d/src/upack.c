@@ -41,11 +41,64 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <libgen.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 #include "base.h"
+#include "advisory.h"
+#include "catalog.h"
 #include "checks.h"
+#include "chunks.h"
+#include "config.h"
 #include "filesys.h"
+#include "inventory.h"
+#include "job.h"
+#include "journal.h"
+#include "pipeline.h"
+#include "pool.h"
+#include "report.h"
+#include "simple.h"
 #include "ui.h"
 #include "utils.h"
+#include "watch.h"
+
+struct options;
+
+// Function prototypes
+int print_summary(const struct job *jobs, int njobs);
+int run_batch(const char **files, int nfiles, int *excodes, void *arg);
+void run_job(void *arg);
+int verify_args(int argc, const char *argv[], struct options *opts);
+int verify_stage(const char *stage);
+
+/**
+    Program options, as parsed from the command line.
+*/
+struct options {
+    const char  **files;    // Archives to be verified and unpacked.
+    int         nfiles;
+    bool        index;      // Update the repo's simple index for the changed projects.
+    const char  *changed;   // File to receive the changed project names, or NULL.
+    const char  *advisories;    // Offline advisory snapshot, or NULL.
+    const char  *report;    // File to receive the run report (JSON), or NULL.
+    const char  *inventory; // File to receive the repo inventory, or NULL.
+    struct chunk    *chunks;    // Chunks listed in the bundle index(es), appended to the files.
+    size_t      nchunks;
+    const char  *watch;     // Directory watched for new archives, or NULL.
+};
+
+/**
+    State shared by each batch of archives; kept warm between the
+    batches of a --watch run.
+*/
+struct session {
+    const struct options    *opts;
+    struct pool             *pool;
+    int                     nworkers;
+    struct catalog          *catalog;
+    struct advisory         *advisories;
+};
 
 /**
     Verify the command line argument(s) are as required.
@@ -54,44 +107,409 @@
     the program. The error reporting and exiting is handled by the
     reporterror function.
 
+    The configuration file (--config, or PATH_CONFIG if present) is
+    loaded first, so the command line options take precedence over its
+    settings. The repo and staging paths, the number of workers and the
+    buffer sizes are stored in the program's configuration (see
+    config_get).
+
     :Tests:
-        - Number of arguments (aside from the program itself), is 1.
-        - The file must have a .7z extension.
-        - The file must exist.
+        - At least one file argument is passed, unless --inventory or
+          --watch is passed.
+        - The --watch option, if passed, is followed by a directory path,
+          and no file argument is passed.
+        - The configuration file, if passed, is valid.
+        - The -j (--jobs) option, if passed, is a positive integer.
+        - The --repo option, if passed, is followed by a directory path.
+        - The --set option, if passed, is followed by a valid KEY=VALUE
+          setting.
+        - The --changed option, if passed, is followed by a file path.
+        - The --advisories option, if passed, is followed by a file path.
+        - The --report option, if passed, is followed by a file path.
+        - The --inventory option, if passed, is followed by a file path.
+        - The --stage option, if passed, is followed by a directory path.
+        - Each file must have a .7z extension, or a .chunks extension
+          for the index of a chunked bundle; whose chunks are appended
+          to the files, and are verified later by chunks_verify().
+        - Each index must be valid.
+        - Each file must exist.
+        - Each file's name must be unique, as it names the file's stage.
 
-    @param[in] argc     Number of arguments passed.
-    @param[in] argv     Array of command line argument strings.
+    @param[in]  argc    Number of arguments passed.
+    @param[in]  argv    Array of command line argument strings.
+    @param[out] opts    Options parsed from the arguments.
 
     @return             0, if the arguments are found as expected.
 */
-int verify_args(int argc, const char *argv[]) {
+int verify_args(int argc, const char *argv[], struct options *opts) {
 
-    char    msgbuff[256];
-    char    *ext;
-    FILE    *fp;
+    char        msgbuff[PATH_MAX + 256];
+    char        setting[PATH_MAX + 64];
+    char        *end;
+    char        *ext;
+    char        *value = NULL;
+    const char  *config = NULL;
+    const char  **files;
+    int         lineno;
+    int         nargs;
+    size_t      n;
+    struct chunk    *chunks;
+    struct chunk    *tmp;
+    FILE        *fp;
 
+    opts->nfiles = 0;
+    opts->index = false;
+    opts->changed = NULL;
+    opts->advisories = NULL;
+    opts->report = NULL;
+    opts->inventory = NULL;
+    opts->chunks = NULL;
+    opts->nchunks = 0;
+    opts->watch = NULL;
+    if ( (opts->files = calloc(argc, sizeof(char *))) == NULL ) {
+        reporterror("Error occurred while allocating memory for the arguments.", false, true);
+    }
+    // The configuration file is loaded before the other options are applied.
+    for ( int i = 1; i < argc; ++i ) {
+        if ( !strcmp(argv[i], "--config") ) {
+            if ( ++i == argc ) reporterror("The --config option requires a file path.", true, true);
+            config = argv[i];
+        }
+    }
+    if ( config == NULL && access(PATH_CONFIG, F_OK) == 0 ) config = PATH_CONFIG;
+    if ( config && (lineno = config_load(config)) ) {
+        if ( lineno < 0 ) {
+            snprintf(msgbuff, sizeof(msgbuff), "%s: %s", strerror(errno), config);
+        } else {
+            snprintf(msgbuff, sizeof(msgbuff), "Invalid configuration setting (%s, line %d).", config, lineno);
+        }
+        reporterror(msgbuff, false, true);
+    }
+    for ( int i = 1; i < argc; ++i ) {
+        // Test for --help argument.
+        if ( (!strcmp(argv[i], "-h" )) || (!strcmp(argv[i], "--help")) ) {
+            usage(true, true);
+        } else if ( !strcmp(argv[i], "--config") ) {
+            ++i;
+        } else if ( (!strcmp(argv[i], "-j" )) || (!strcmp(argv[i], "--jobs")) ) {
+            if ( ++i == argc || strtol(argv[i], &end, 10) < 1 || *end || config_set("jobs", argv[i]) ) {
+                reporterror("The number of jobs must be a positive integer.", true, true);
+            }
+        } else if ( !strcmp(argv[i], "--repo") ) {
+            if ( ++i == argc || config_set("repo", argv[i]) ) {
+                reporterror("The --repo option requires a directory path.", true, true);
+            }
+        } else if ( !strcmp(argv[i], "--set") ) {
+            if ( ++i == argc || snprintf(setting, sizeof(setting), "%s", argv[i]) >= (int)sizeof(setting) ||
+                 (value = strchr(setting, '=')) == NULL ) {
+                reporterror("The --set option requires a KEY=VALUE setting.", true, true);
+            }
+            *value++ = '\0';
+            if ( config_set(setting, value) ) {
+                snprintf(msgbuff, sizeof(msgbuff), "Invalid setting: %s", argv[i]);
+                reporterror(msgbuff, true, true);
+            }
+        } else if ( !strcmp(argv[i], "--index") ) {
+            opts->index = true;
+        } else if ( !strcmp(argv[i], "--changed") ) {
+            if ( ++i == argc ) reporterror("The --changed option requires a file path.", true, true);
+            opts->changed = argv[i];
+        } else if ( !strcmp(argv[i], "--advisories") ) {
+            if ( ++i == argc ) reporterror("The --advisories option requires a file path.", true, true);
+            opts->advisories = argv[i];
+        } else if ( !strcmp(argv[i], "--report") ) {
+            if ( ++i == argc ) reporterror("The --report option requires a file path.", true, true);
+            opts->report = argv[i];
+        } else if ( !strcmp(argv[i], "--inventory") ) {
+            if ( ++i == argc ) reporterror("The --inventory option requires a file path.", true, true);
+            opts->inventory = argv[i];
+        } else if ( !strcmp(argv[i], "--watch") ) {
+            if ( ++i == argc ) reporterror("The --watch option requires a directory path.", true, true);
+            opts->watch = argv[i];
+        } else if ( !strcmp(argv[i], "--stage") ) {
+            if ( ++i == argc || config_set("stage", argv[i]) ) {
+                reporterror("The --stage option requires a directory path.", true, true);
+            }
+        } else if ( (ext = strrchr(argv[i], '.')) && !strcmp(ext, ".chunks") ) {
+            if ( (lineno = chunks_load(argv[i], &chunks, &n)) ) {
+                if ( lineno == -1 ) {
+                    snprintf(msgbuff, sizeof(msgbuff), "%s: %s", strerror(errno), argv[i]);
+                } else if ( lineno == -2 ) {
+                    snprintf(msgbuff, sizeof(msgbuff), "Error occurred while allocating memory for the chunks.");
+                } else if ( lineno == -3 ) {
+                    snprintf(msgbuff, sizeof(msgbuff), "The chunk index has been altered or is incomplete: %s",
+                             argv[i]);
+                } else {
+                    snprintf(msgbuff, sizeof(msgbuff), "Invalid chunk index (%s, line %d).", argv[i], lineno);
+                }
+                reporterror(msgbuff, false, true);
+            }
+            if ( (tmp = realloc(opts->chunks, (opts->nchunks + n) * sizeof(*tmp))) == NULL ) {
+                reporterror("Error occurred while allocating memory for the chunks.", false, true);
+            }
+            memcpy(tmp + opts->nchunks, chunks, n * sizeof(*tmp));
+            free(chunks);
+            opts->chunks = tmp;
+            opts->nchunks += n;
+        } else {
+            opts->files[opts->nfiles++] = argv[i];
+        }
+    }
+    // The chunks are listed after the archives, so the chunks which fail verification can be dropped.
+    nargs = opts->nfiles;
+    if ( opts->nchunks ) {
+        if ( (files = realloc(opts->files, (opts->nfiles + opts->nchunks) * sizeof(char *))) == NULL ) {
+            reporterror("Error occurred while allocating memory for the arguments.", false, true);
+        }
+        opts->files = files;
+        for ( size_t i = 0; i < opts->nchunks; ++i ) opts->files[opts->nfiles++] = opts->chunks[i].fpath;
+    }
     // Test argument count.
-    if ( argc != 2 ) {
+    if ( opts->nfiles == 0 && opts->inventory == NULL && opts->watch == NULL ) {
         reporterror("Invalid number of arguments. Please refer to the program usage.", true, true);
     }
-    // Test for --help argument.
-    if ( (!strcmp(argv[1], "-h" )) || (!strcmp(argv[1], "--help")) ) {
-        usage(true, true);
+    if ( opts->nfiles && opts->watch ) {
+        reporterror("File arguments cannot be passed with the --watch option.", true, true);
     }
-    // Verify the passed file exists.
-    if ( (fp = fopen(argv[1], "r")) == NULL ){
-        sprintf(msgbuff, "%s: %s", strerror(errno), argv[1]);
-        reporterror(msgbuff, false, true);
+    if ( config_resolve() ) reporterror("The repo path is too long.", false, true);
+    // The snapshot installed in the repo is used by default, if present.
+    if ( opts->advisories == NULL && access(config_get()->advisories, F_OK) == 0 ) {
+        opts->advisories = config_get()->advisories;
     }
-    fclose(fp);
+    for ( int i = 0; i < opts->nfiles; ++i ) {
+        // A chunk's extension was verified by its index, and a missing chunk is reported by chunks_verify().
+        if ( i < nargs ) {
+            // Verify the passed file exists.
+            if ( (fp = fopen(opts->files[i], "r")) == NULL ){
+                snprintf(msgbuff, sizeof(msgbuff), "%s: %s", strerror(errno), opts->files[i]);
+                reporterror(msgbuff, false, true);
+            }
+            fclose(fp);
+            // Verify the file has a .7z extension.
+            if ( ((ext = strrchr(opts->files[i], '.')) == NULL) || (strcmp(ext, ".7z")) ) {
+                reporterror("A .7z file is required, please refer to the program usage.", true, true);
+            }
+        }
+        // Verify the filename was not already passed.
+        for ( int j = 0; j < i; ++j ) {
+            if ( !strcmp(basename((char *)opts->files[i]), basename((char *)opts->files[j])) ) {
+                snprintf(msgbuff, sizeof(msgbuff), "The archive was passed more than once: %s", opts->files[i]);
+                reporterror(msgbuff, false, true);
+            }
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+    Verify the staging directory is on the repo's file system.
+
+    The journal publishes a stage with rename(2), and keeps its rollback
+    copies as hard links, so neither is possible across file systems. The
+    stage's file system is identified by its device ID (st_dev), which
+    also detects a stage inside the repo on a separate mount. A stage on
+    another file system is a fatal error, as is a stage which is not a
+    directory.
+
+    @param[in]  stage   Explicit path to the (existing) staging directory.
 
-    // Verify the file has a .7z extension.
-    if ( ((ext = strrchr(argv[1], '.')) == NULL) || (strcmp(ext, ".7z")) ) {
-        reporterror("A .7z file is required, please refer to the program usage.", true, true);
+    @return             0, if the stage is on the repo's file system.
+*/
+int verify_stage(const char *stage) {
+
+    char        msgbuff[PATH_MAX + 128];
+    struct stat st_repo;
+    struct stat st_stage;
+
+    if ( stat(config_get()->repo, &st_repo) || stat(stage, &st_stage) || !S_ISDIR(st_stage.st_mode) ) {
+        snprintf(msgbuff, sizeof(msgbuff), "The staging directory could not be accessed: %s", stage);
+        reporterror(msgbuff, false, true);
+    }
+    if ( st_stage.st_dev != st_repo.st_dev ) {
+        snprintf(msgbuff, sizeof(msgbuff), "The staging directory must be on the repo's file system: %s",
+                 stage);
+        reporterror(msgbuff, false, true);
     }
     return EXIT_SUCCESS;
 }
 
+/**
+    Verify and unpack a single archive into the pip repo.
+
+    Each step requires the successful completion of the previous step.
+    The verified files are published into the repo as a single
+    transaction, by journal_commit(). If a previous run was interrupted
+    while publishing this archive, the commit is completed instead, and
+    the archive is not unpacked again. The job's stage is locked for the
+    duration of the job, and the job fails if another process holds the
+    lock. Otherwise, the stage is deleted regardless of the outcome. The
+    overall result is stored in the job's exit code.
+
+    This function is called directly for a single archive, or as a pool
+    task when several archives are passed.
+
+    @param[in]  arg     Pointer to the job to be run.
+*/
+void run_job(void *arg) {
+
+    char        msgbuff[128];
+    const char  *label = ui_label();  // Restored, as a job may run nested in a pool wait.
+    int         excode;
+    int         nremoved;
+    uint64_t    start = clock_ns();
+    struct job  *job = arg;
+
+    ui_set_label(job->label);
+    // The stage is locked first, so another process's stage is never recovered or removed.
+    if ( journal_lock(job) ) {
+        job->excode = EXIT_FAILURE;
+        ui_set_label(label);
+        return;
+    }
+    excode = journal_recover(job, config_get()->repo);
+    job_time(job, PHASE_RECOVER, start, 0, 0);
+    if ( excode == 0 ) {
+        // Unpack, hash and verify in a single pass over the archive.
+        excode = pipeline_run(job);
+        if ( !excode ) excode = journal_commit(job, config_get()->repo);
+        if ( !excode && job->npresent ) {
+            snprintf(msgbuff, sizeof(msgbuff), "\n%zu of %zu files are already in the repo, and were skipped.",
+                     job->npresent, job->nentries);
+            print_ok(msgbuff);
+        }
+        if ( !excode && job->nomitted ) {
+            snprintf(msgbuff, sizeof(msgbuff), "%zu packages were omitted from the (delta) archive, and are "
+                     "already in the repo.", job->nomitted);
+            print_ok(msgbuff);
+        }
+        // Delete the unpacking area; a successful commit has already done so.
+        if ( excode ) {
+            start = clock_ns();
+            nremoved = removeall(job->stage, 1, 0);
+            job_time(job, PHASE_CLEANUP, start, 0, ( nremoved > 0 ) ? nremoved : 0);
+        }
+    } else if ( excode == 1 ) {
+        excode = EXIT_SUCCESS;
+    }
+    journal_unlock(job);
+    job->excode = excode;
+    ui_set_label(label);
+}
+
+/**
+    Display the per-archive results summary, when several archives have
+    been processed.
+
+    @param[in]  jobs    Array of completed jobs.
+    @param[in]  njobs   Number of jobs.
+
+    @return             Number of jobs which ended in error.
+*/
+int print_summary(const struct job *jobs, int njobs) {
+
+    int nfailed = 0;
+
+    printf("\nSummary:\n");
+    for ( int i = 0; i < njobs; ++i ) {
+        if ( jobs[i].excode ) {
+            ++nfailed;
+            printf("  " ANSI_B_RED "FAIL" ANSI_RST "  %s\n", jobs[i].label);
+        } else {
+            printf("  " ANSI_B_GRN "PASS" ANSI_RST "  %s (%zu files, %zu already present)\n", jobs[i].label,
+                   jobs[i].nentries, jobs[i].npresent);
+        }
+    }
+    printf("\n%d of %d archives unpacked successfully.\n", njobs - nfailed, njobs);
+    return nfailed;
+}
+
+/**
+    Verify and unpack a batch of archives into the pip repo.
+
+    A single archive is unpacked directly. If several archives are
+    passed, each is unpacked into its own staging directory, and the
+    archives are processed concurrently by the session's pool. The
+    progress messages are suppressed, and a per-archive summary is
+    displayed on completion. The repo's simple index, the inventory and
+    the run report are then updated for the batch, as requested.
+
+    This function is called once for the archives passed, or as the
+    watch_run() callback for each batch of archives to arrive.
+
+    @param[in]  files   Explicit paths to the archives.
+    @param[in]  nfiles  Number of archives.
+    @param[out] excodes Receives the exit code of each archive, or NULL.
+    @param[in]  arg     Pointer to the session.
+
+    @return             0 if every archive was unpacked successfully,
+                        otherwise 1.
+*/
+int run_batch(const char **files, int nfiles, int *excodes, void *arg) {
+
+    char                    stage[PATH_MAX];
+    int                     excode = EXIT_SUCCESS;
+    uint64_t                start = clock_ns();
+    uint64_t                index_start;
+    uint64_t                index_ns = 0;
+    struct job              *jobs = NULL;
+    struct pool_batch       batch = {0};
+    const struct session    *s = arg;
+    const struct options    *opts = s->opts;
+    const struct config     *config = config_get();
+
+    if ( nfiles && (jobs = calloc(nfiles, sizeof(struct job))) == NULL ) {
+        reporterror("Error occurred while allocating memory for the jobs.", false, true);
+    }
+    for ( int i = 0; i < nfiles; ++i ) {
+        if ( snprintf(stage, sizeof(stage), "%s/%.*s", config->stage,
+                      (int)strlen(basename((char *)files[i])) - 3,
+                      basename((char *)files[i])) >= (int)sizeof(stage) ||
+             job_init(&jobs[i], files[i], stage) ) {
+            reporterror("The staging directory could not be created.", false, true);
+        }
+        jobs[i].pool = s->pool;
+        jobs[i].catalog = s->catalog;
+        jobs[i].advisories = s->advisories;
+    }
+    if ( nfiles == 1 ) {
+        run_job(&jobs[0]);
+        if ( jobs[0].excode ) excode = EXIT_FAILURE;
+    } else if ( nfiles > 1 ) {
+        printf(ANSI_B_CYN "Unpacking %d archives, using %d workers ...\n" ANSI_RST, nfiles, s->nworkers);
+        ui_set_quiet(true);
+        for ( int i = 0; i < nfiles; ++i ) {
+            if ( pool_submit(s->pool, &batch, run_job, &jobs[i]) ) run_job(&jobs[i]);
+        }
+        pool_wait(s->pool, &batch);
+        ui_set_quiet(false);
+        if ( print_summary(jobs, nfiles) ) excode = EXIT_FAILURE;
+    }
+    // The index is updated once, for all archives; the catalog supplies the digests.
+    if ( opts->index || opts->changed ) {
+        index_start = clock_ns();
+        if ( simple_update(config->repo, ( opts->index ) ? config->index : NULL, s->catalog, jobs, nfiles,
+                           opts->changed) ) {
+            excode = EXIT_FAILURE;
+        }
+        index_ns = clock_ns() - index_start;
+    }
+    // The inventory is exported last, so it lists the files just unpacked.
+    if ( opts->inventory && inventory_export(opts->inventory, config->repo, s->catalog, s->pool) ) {
+        excode = EXIT_FAILURE;
+    }
+    if ( opts->report && report_write(opts->report, jobs, nfiles, s->nworkers, clock_ns() - start, index_ns) ) {
+        excode = EXIT_FAILURE;
+    }
+    // A long-running process saves the catalog after each batch.
+    if ( opts->watch && catalog_save(s->catalog) ) print_warning("The repo's catalog could not be saved.");
+    for ( int i = 0; i < nfiles; ++i ) {
+        if ( excodes ) excodes[i] = jobs[i].excode;
+        job_free(&jobs[i]);
+    }
+    free(jobs);
+    return excode;
+}
+
 /**
     Program entry point and primary process controller.
 
@@ -100,25 +518,89 @@ int verify_args(int argc, const char *argv[]) {
     successful completion, whereas a non-zero exit code signals an error.
 
     More specifically, if any step in the process fails, all subsequent
-    processes are aborted, as each step requires the successful completion
-    of the previous step.
+    processes for that archive are aborted, as each step requires the
+    successful completion of the previous step.
+
+    The archives passed are unpacked as a single batch, by run_batch().
+    Or, with --watch, each batch of archives to arrive in the watched
+    directory is unpacked, using the same pool, catalog and advisory
+    snapshot, until the program is interrupted.
 
     @param[in] argc     Number of arguments passed.
     @param[in] argv     Array of command line argument strings.
 
-    @return             0, if the program completes successfully,
-                        otherwise 1.
+    @return             0, if the program completes successfully (for
+                        all archives), otherwise 1.
 */
 int main(int argc, const char *argv[]) {
 
-    int excode;
+    char                msgbuff[128];
+    int                 excode = EXIT_SUCCESS;
+    size_t              nbad = 0;
+    time_t              created;
+    struct options      opts;
+    struct session      session = {0};
+    const struct config *config = config_get();
 
-    excode = verify_args(argc, argv);
-    if ( !excode ) excode = unzip(argv[1], PATH_TMP_PPK);
-    if ( !excode ) excode = run_tests();
-    if ( !excode ) excode = moveall(PATH_TMP_PPK, PATH_REPO, false);
-    // Delete the unpacking area regardless of the outcome.
-    removeall(PATH_TMP_PPK, 1, 0);
+    verify_args(argc, argv, &opts);
+    session.opts = &opts;
+    // The pool is shared by the archives and their file moves.
+    session.nworkers = ( config->njobs ) ? config->njobs : pool_ncpus();
+    if ( (session.pool = pool_create(session.nworkers)) == NULL ) {
+        reporterror("The worker pool could not be created.", false, true);
+    }
+    // The chunks are verified against their index (concurrently) before any is unpacked.
+    if ( opts.nchunks ) {
+        print_start("\nVerifying the chunks against the bundle's index ...");
+        if ( (nbad = chunks_verify(opts.chunks, opts.nchunks, session.pool)) ) {
+            print_alert("\nChunk failures found. The failed chunks will *not* be unpacked.");
+            excode = EXIT_FAILURE;
+        } else {
+            print_done(0);
+        }
+        // Each chunk is a complete archive, so the verified chunks are still unpacked.
+        opts.nfiles -= opts.nchunks;
+        for ( size_t i = 0; i < opts.nchunks; ++i ) {
+            if ( opts.chunks[i].status == CHUNK_OK ) opts.files[opts.nfiles++] = opts.chunks[i].fpath;
+        }
+    }
+    // Each archive is staged (by name) on the repo's file system, so it can be resumed.
+    makedir(config->meta, 0700, 0);
+    makedir(config->stage, 0700, 0);
+    verify_stage(config->stage);
+    // The stages left by earlier (crashed) runs are purged, other than those with a journal to roll forward.
+    if ( config->stale_stage ) journal_purge(config->stage, config->repo, config->stale_stage, session.pool);
+    // The catalog identifies the packages already in the repo; a missing catalog is rebuilt as used.
+    if ( (session.catalog = catalog_open(config->repo, config->catalog)) == NULL ) {
+        reporterror("Error occurred while allocating memory for the catalog.", false, true);
+    }
+    // The archives are re-checked against the snapshot; an unreadable snapshot is fatal.
+    if ( opts.advisories ) {
+        if ( (session.advisories = advisory_open(opts.advisories)) == NULL ) {
+            reporterror("The advisory snapshot could not be loaded.", false, true);
+        }
+        created = (time_t)advisory_created(session.advisories);
+        strftime(msgbuff, sizeof(msgbuff), "Using the advisory snapshot created on %Y-%m-%d %H:%M UTC.",
+                 gmtime(&created));
+        print_ok(msgbuff);
+    }
+    if ( opts.watch ) {
+        if ( watch_run(opts.watch, session.pool, run_batch, &session) ) excode = EXIT_FAILURE;
+    } else if ( run_batch(opts.files, opts.nfiles, NULL, &session) ) {
+        excode = EXIT_FAILURE;
+    }
+    pool_destroy(session.pool);
+    // The catalog is only a cache, so a failure to save it is not an error.
+    if ( catalog_close(session.catalog) ) print_warning("The repo's catalog could not be saved.");
+    advisory_close(session.advisories);
+    free(opts.files);
+    if ( nbad ) {
+        printf("\nThe following %zu chunks must be transferred again:\n", nbad);
+        for ( size_t i = 0; i < opts.nchunks; ++i ) {
+            if ( opts.chunks[i].status != CHUNK_OK ) printf("  %s\n", basename(opts.chunks[i].fpath));
+        }
+    }
+    free(opts.chunks);
     if ( excode != 0 ) {
         print_warning("\nDone. Ended in error.");
         return EXIT_FAILURE;
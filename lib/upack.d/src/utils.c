@@ -24,16 +24,32 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include <openssl/sha.h>
 #include <string.h>
+#include <time.h>
 #include "base.h"
+#include "hash.h"
 #include "ui.h"
 
 // Function prototypes
+uint64_t clock_ns(void);
 void reporterror(const char *msg, bool show_usage, bool fatal);
-char *sha256_digest(const char *string);
+void sha256_digest(const char *string, char *digest);
 void usage(bool notice, bool exit_zero);
 
+/**
+    Return the time of the monotonic clock, used to time the phases of
+    a job.
+
+    @return     Time, in nanoseconds, since an unspecified point.
+*/
+uint64_t clock_ns(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
 /**
     Display an error message (to stderr) and exit the program if instructed.
 
@@ -48,7 +64,7 @@ void usage(bool notice, bool exit_zero);
     @return                 Void.
 */
 void reporterror(const char *msg, bool show_usage, bool fatal) {
-    fprintf(stderr, "\n" ANSI_B_RED "[ERROR]: " ANSI_RST "%s\n", msg);
+    fprintf(stderr, "\n" ANSI_B_RED "[ERROR]: " ANSI_RST "%s%s\n", ui_prefix(), msg);
     if ( show_usage ) usage(false, false);
     if ( fatal ) {
         fprintf(stderr, "\n" ANSI_B_YLW "Fatal error, exiting." ANSI_RST "\n\n");
@@ -57,39 +73,24 @@ void reporterror(const char *msg, bool show_usage, bool fatal) {
 }
 
 /**
-    Calculate and return the SHA256 hash for a given string.
-
-    Note: The returned pointer **must** be free'd by the caller.
+    Calculate the SHA256 hash for a given string.
 
-    @param[in] string   Pointer to a character array to be hashed.
-
-    @return             A pointer to the SHA256 hash string, as a 
-                        hexidecimal digest.
+    @param[in]  string  Pointer to a character array to be hashed.
+    @param[out] digest  Receives the SHA256 hash string, as a (null
+                        terminated) hexidecimal digest; of at least
+                        DIGEST_SIZE * 2 + 1 bytes.
 
+    @return             Void.
 */
-char *sha256_digest(const char *string) {
+void sha256_digest(const char *string, char *digest) {
 
-    char            *digest;    // malloc 65 bytes (hex + NULL)
-    unsigned char   *hash;      // malloc 32 bytes
-    SHA256_CTX      ctx;
+    unsigned char   hash[DIGEST_SIZE];
 
-    if ( (hash = malloc(SHA256_DIGEST_LENGTH)) == NULL ) {
-        reporterror("Error occurred while allocating memory for the hash.", false, true);
-    }
-    if ( (digest = malloc(SHA256_DIGEST_LENGTH * 2 + 1)) == NULL ) {
-        reporterror("Error occurred while allocating memory for the hex digest.", false, true);
+    // Calculate the hash, and convert into a hex digest string.
+    if ( hash_buffer(string, strlen(string), hash) ) {
+        reporterror("Error occurred while calculating the hash.", false, true);
     }
-    // Calculate the hash.
-    SHA256_Init(&ctx);
-    SHA256_Update(&ctx, string, strlen(string));
-    SHA256_Final(hash, &ctx);
-    // Convert the hash bytes into a hex digest string.
-    for ( int i = 0; i < SHA256_DIGEST_LENGTH; ++i ) {
-        sprintf(digest + (i * 2), "%02x", hash[i]);
-    }
-    digest[SHA256_DIGEST_LENGTH * 2] = '\0';
-    free(hash);
-    return digest;
+    hash_tohex(hash, digest);
 }
 
 /**
@@ -106,7 +107,9 @@ void usage(bool notice, bool exit_zero) {
            "\n%s - v%s\n"
            "%s\n"
            "\n"
-           "Usage: %s [--help] [FILE]\n",
+           "Usage: %s [--help] [--config PATH] [--repo DIR] [--stage DIR] [-j N]\n"
+           "             [--set KEY=VALUE] [--index] [--changed PATH] [--advisories PATH]\n"
+           "             [--report PATH] [--inventory PATH] [--watch DIR] FILE [FILE ...]\n",
            _APP_LONG_NAME,
            _VERSION,
            _APP_DESC,
@@ -115,15 +118,74 @@ void usage(bool notice, bool exit_zero) {
     printf(
            "\n"
            "Required positional arguments:\n"
-           "  FILE          The encrypted .7z file archive (as created by ppk) to be\n"
-           "                verified and unpacked into the pip repository.\n"
+           "  FILE          The encrypted .7z file archive(s) (as created by ppk) to be\n"
+           "                verified and unpacked into the pip repository. Optional if\n"
+           "                --inventory is passed, and not passed with --watch.\n"
+           "                Or, the index (.chunks) of a chunked bundle, whose chunks are\n"
+           "                verified against the index, then unpacked concurrently. A\n"
+           "                chunk which fails is named, and the others are unpacked.\n"
            "\n"
            "Optional arguments:\n"
            "  -h, --help    Display this help and exit.\n"
+           "  --config PATH Load the settings from the configuration file at PATH, which\n"
+           "                are overridden by the command line options. Defaults to\n"
+           "                %s, if present.\n"
+           "  --repo DIR    Unpack into the pip repo at DIR. Defaults to %s.\n"
+           "  --stage DIR   Stage the archives in DIR, which must be on the repo's file\n"
+           "                system, so the files are renamed (not copied) into the repo.\n"
+           "                Defaults to the repo's hidden %s directory.\n"
+           "  -j, --jobs N  Number of worker threads, used to unpack several archives\n"
+           "                concurrently and to move the files into the repo.\n"
+           "                Defaults to the number of CPUs.\n"
+           "  --set KEY=VALUE\n"
+           "                Set a configuration file setting; for example, the buffer\n"
+           "                sizes: read_buffer, copy_buffer or hash_buffer (e.g. 4M).\n"
+           "  --index       Update the repo's PEP 503 simple index, rewriting only the\n"
+           "                pages of the projects changed by the archive(s).\n"
+           "  --changed PATH\n"
+           "                Write the names of the changed projects (one per line) to\n"
+           "                PATH.\n"
+           "  --advisories PATH\n"
+           "                Re-check the archive's packages against the offline advisory\n"
+           "                snapshot at PATH, as exported by the packer. Defaults to the\n"
+           "                snapshot installed in the repo, as %s, if present.\n"
+           "  --report PATH Write a JSON report of the time spent in each phase of each\n"
+           "                archive, with the files and bytes processed, and the number of\n"
+           "                files renamed and copied into the repo, to PATH.\n"
+           "  --inventory PATH\n"
+           "                Once the archive(s) are unpacked, write the repo's inventory\n"
+           "                (the name, size and SHA-256 digest of each file) to PATH, as\n"
+           "                xz compressed text. Passed to the packer as --inventory, so\n"
+           "                it builds a delta archive of only the files the repo lacks.\n"
+           "  --watch DIR   Run until interrupted, unpacking each .7z archive as it is\n"
+           "                written (or moved) into DIR. The archives which arrive\n"
+           "                together are unpacked as a batch, then moved into DIR's\n"
+           "                .done or .failed directory. A chunked bundle is unpacked\n"
+           "                once its .chunks index and each of its chunks arrive.\n"
            "\n"
            "Example: To verify and unpack a .7z file archive:\n"
            "  $ %s /path/to/things/library-0.0.7-cp311-cp311-manylinux2014_x86_64.7z\n"
+           "\n"
+           "Example: To verify and unpack several archives, four at a time:\n"
+           "  $ %s -j 4 /path/to/things/*.7z\n"
+           "\n"
+           "Example: To verify and unpack a chunked bundle:\n"
+           "  $ %s /path/to/things/library-0.0.7-cp311-cp311-manylinux2014_x86_64.chunks\n"
+           "\n"
+           "Example: To export the repo's inventory, for the packer:\n"
+           "  $ %s --inventory /path/to/media/repo.inventory.xz\n"
+           "\n"
+           "Example: To unpack each archive copied into the transfer directory:\n"
+           "  $ %s --index --watch /path/to/transfer\n"
            "\n",
+           PATH_CONFIG,
+           PATH_REPO,
+           DIR_META,
+           DIR_META "/" NAME_ADVISORIES,
+           _APP_NAME,
+           _APP_NAME,
+           _APP_NAME,
+           _APP_NAME,
            _APP_NAME
     );
     if ( notice ) print_notice();
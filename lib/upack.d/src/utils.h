@@ -5,6 +5,14 @@
 #ifndef _UTILS_H
 #define _UTILS_H
 
+/**
+    Return the time of the monotonic clock, used to time the phases of
+    a job.
+
+    @return     Time, in nanoseconds, since an unspecified point.
+*/
+uint64_t clock_ns(void);
+
 /**
     Display an error message (to stderr) and exit the program if instructed.
 
@@ -21,17 +29,16 @@
 void reporterror(const char *msg, int show_usage, int fatal);
 
 /**
-    Calculate and return the SHA256 hash for a given string.
-
-    Note: The returned pointer **must** be free'd by the caller.
-
-    @param[in] string   Pointer to a character array to be hashed.
+    Calculate the SHA256 hash for a given string.
 
-    @return             A pointer to the SHA256 hash string, as a 
-                        hexidecimal digest.
+    @param[in]  string  Pointer to a character array to be hashed.
+    @param[out] digest  Receives the SHA256 hash string, as a (null
+                        terminated) hexidecimal digest; of at least
+                        DIGEST_SIZE * 2 + 1 bytes.
 
+    @return             Void.
 */
-char *sha256_digest(const char *string);
+void sha256_digest(const char *string, char *digest);
 
 /**
     Display the program's usage statement.
@@ -0,0 +1,498 @@
+/**
+    Purpose:    This module provides the watch folder mode (--watch); a
+                long-running upack, which unpacks each archive as it
+                arrives in a directory, rather than being run by hand for
+                each archive.
+
+    Developer:  J Berendt
+    Email:      development@s3dev.uk
+
+    Comments:   The directory is watched with inotify(7). An archive is
+                only queued once its writer has closed it, or once it has
+                been renamed into the directory, so a partly copied
+                archive is never unpacked.
+
+                The process state (the worker pool, the repo's catalog
+                and the advisory snapshot) is kept between batches by the
+                caller, so each batch starts warm.
+
+                The .7z archives, and the indexes (.chunks) of chunked
+                bundles, are watched. A bundle waits in the queue until
+                each of its chunks has arrived (with the size listed in
+                its index); the chunks are then verified against the
+                index, unpacked, and moved with it. A chunk is never
+                queued alone.
+
+    Copyright (C) 73rd Street Development
+    This file is part of the ppk project's upack program.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Required for pipe2(2).
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "base.h"
+#include "chunks.h"
+#include "filesys.h"
+#include "ui.h"
+#include "utils.h"
+#include "watch.h"
+
+#define WATCH_DONE      ".done"     // Subdirectory for the unpacked archives.
+#define WATCH_FAILED    ".failed"   // Subdirectory for the archives which failed.
+#define WATCH_INDEX     ".chunks"   // Extension of a chunked bundle's index.
+#define WATCH_MAX_BATCH 64          // Maximum number of archives per batch.
+#define WATCH_SETTLE_MS 500         // Quiet time before a batch is started.
+
+/**
+    Queue of archives (and bundle indexes) waiting to be unpacked.
+*/
+struct watch_queue {
+    char            fpaths[WATCH_MAX_BATCH][PATH_MAX];
+    struct chunk    *chunks[WATCH_MAX_BATCH];   // Chunks of a ready bundle, per its index; otherwise NULL.
+    size_t          nchunks[WATCH_MAX_BATCH];
+    bool            ready[WATCH_MAX_BATCH];     // False for a bundle still waiting for its chunks.
+    int             excodes[WATCH_MAX_BATCH];
+    int             n;
+    bool            waiting;    // Only bundles waiting for their chunks are queued.
+};
+
+static volatile sig_atomic_t _stop = 0;
+static int _wakefd = -1;    // Write end of the self-pipe, which wakes the poll on a signal.
+
+// Function prototypes
+int watch_run(const char *dpath, struct pool *pool, watch_batch batch, void *ctx);
+
+/**
+    Signal handler; stop once the current batch is complete.
+
+    The signal may be delivered to any of the pool's threads, so the
+    main thread's poll is woken by the self-pipe.
+*/
+static void on_signal(int signum) {
+
+    int errsv = errno;
+
+    (void)signum;
+    _stop = 1;
+    if ( write(_wakefd, "", 1) < 0 ) {}
+    errno = errsv;
+}
+
+/**
+    Test if a file is the index of a chunked bundle.
+*/
+static bool is_index(const char *fpath) {
+
+    const char  *ext = strrchr(fpath, '.');
+
+    return ( ext && !strcmp(ext, WATCH_INDEX) );
+}
+
+/**
+    Test if a filename is that of a chunk, as named by the packer; i.e.
+    <name>.partNNN.7z.
+*/
+static bool is_chunk(const char *name) {
+
+    const char  *p = name + strlen(name) - 3;
+    const char  *digits;
+
+    if ( p < name || strcmp(p, ".7z") ) return false;
+    for ( digits = p; digits > name && isdigit((unsigned char)digits[-1]); --digits );
+    return ( digits < p && digits - name >= 5 && !strncmp(digits - 5, ".part", 5) );
+}
+
+/**
+    Test if a file is queued when it arrives; i.e. it is a .7z file
+    (other than a chunk) or a bundle index.
+*/
+static bool is_queued(const char *name) {
+
+    const char  *ext;
+
+    if ( name[0] == '.' || (ext = strrchr(name, '.')) == NULL ) return false;
+    // A chunk is unpacked with its bundle, once the bundle's index has arrived.
+    return ( (!strcmp(ext, ".7z") && !is_chunk(name)) || !strcmp(ext, WATCH_INDEX) );
+}
+
+/**
+    Test if a file has settled; i.e. it has not been modified for
+    WATCH_SETTLE_MS, so it is not still being written.
+*/
+static bool is_settled(const struct stat *st) {
+
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    return ( (now.tv_sec - st->st_mtim.tv_sec) * 1000 + (now.tv_nsec - st->st_mtim.tv_nsec) / 1000000 >=
+             WATCH_SETTLE_MS );
+}
+
+/**
+    Queue an archive, if it is a .7z file (other than a chunk) or a
+    bundle index, which is not already queued.
+
+    @return     0 if the archive was queued or ignored, otherwise 1 if the
+                queue is full.
+*/
+static int queue_add(struct watch_queue *q, const char *dpath, const char *name) {
+
+    if ( !is_queued(name) ) return EXIT_SUCCESS;
+    if ( q->n == WATCH_MAX_BATCH ) return EXIT_FAILURE;
+    if ( snprintf(q->fpaths[q->n], PATH_MAX, "%s/%s", dpath, name) >= PATH_MAX ) return EXIT_SUCCESS;
+    for ( int i = 0; i < q->n; ++i ) {
+        if ( !strcmp(q->fpaths[i], q->fpaths[q->n]) ) return EXIT_SUCCESS;
+    }
+    q->chunks[q->n] = NULL;
+    q->nchunks[q->n] = 0;
+    ++q->n;
+    return EXIT_SUCCESS;
+}
+
+/**
+    Queue the archives already in the directory.
+
+    An archive which was modified within WATCH_SETTLE_MS may still be
+    being written (or copied in), and is not queued; it is queued by its
+    IN_CLOSE_WRITE event, or by the next scan.
+
+    @param[in]  q           Pointer to the queue.
+    @param[in]  dpath       Explicit path to the watched directory.
+    @param[out] unsettled   Set to true if an archive was not queued, as
+                            it has not yet settled.
+
+    @return     0 if every settled archive was queued, otherwise 1 if the
+                queue is full; so the directory must be scanned again.
+*/
+static int queue_existing(struct watch_queue *q, const char *dpath, bool *unsettled) {
+
+    char            fpath[PATH_MAX];
+    int             full = 0;
+    struct dirent   *ep;
+    struct stat     st;
+    DIR             *dp;
+
+    if ( (dp = opendir(dpath)) == NULL ) return 0;
+    while ( (ep = readdir(dp)) != NULL ) {
+        if ( snprintf(fpath, sizeof(fpath), "%s/%s", dpath, ep->d_name) >= (int)sizeof(fpath) ) continue;
+        if ( !is_queued(ep->d_name) || stat(fpath, &st) || !S_ISREG(st.st_mode) ) continue;
+        if ( !is_settled(&st) ) {
+            *unsettled = true;
+            continue;
+        }
+        // The remainder are queued by the next scan, once this batch is retired.
+        if ( (full = queue_add(q, dpath, ep->d_name)) ) break;
+    }
+    closedir(dp);
+    return full;
+}
+
+/**
+    Read the pending inotify events, and queue the archives.
+
+    @return     0 on success, otherwise 1 if the queue is full, or events
+                were lost; so the directory must be scanned.
+*/
+static int queue_events(struct watch_queue *q, const char *dpath, int fd) {
+
+    char                            buff[16 * (sizeof(struct inotify_event) + NAME_MAX + 1)]
+                                    __attribute__((aligned(__alignof__(struct inotify_event))));
+    int                             full = 0;
+    ssize_t                         len;
+    const struct inotify_event      *ev;
+
+    while ( (len = read(fd, buff, sizeof(buff))) > 0 ) {
+        for ( char *p = buff; p < buff + len; p += sizeof(*ev) + ev->len ) {
+            ev = (const struct inotify_event *)p;
+            if ( ev->mask & IN_Q_OVERFLOW ) full = 1;
+            if ( ev->len && (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) && queue_add(q, dpath, ev->name) ) {
+                full = 1;
+            }
+        }
+    }
+    return full;
+}
+
+/**
+    Mark each queued entry which is ready to be unpacked.
+
+    An archive is always ready. A bundle is ready once each chunk listed
+    in its index is present, with the listed size; its chunks are then
+    verified against the index, and only the verified chunks are
+    unpacked. A bundle whose index is invalid, or with a failed chunk,
+    is failed. A bundle whose chunks have not all arrived is left
+    waiting in the queue.
+
+    @return     Number of files to be unpacked; the archives, and the
+                verified chunks of the ready bundles.
+*/
+static size_t queue_ready(struct watch_queue *q, struct pool *pool) {
+
+    char        msgbuff[PATH_MAX + 128];
+    size_t      nfiles = 0;
+    struct stat st;
+
+    for ( int i = 0; i < q->n; ++i ) {
+        q->ready[i] = true;
+        q->excodes[i] = EXIT_SUCCESS;
+        if ( !is_index(q->fpaths[i]) ) {
+            ++nfiles;
+            continue;
+        }
+        if ( chunks_load(q->fpaths[i], &q->chunks[i], &q->nchunks[i]) ) {
+            snprintf(msgbuff, sizeof(msgbuff), "The bundle's index is invalid: %s", q->fpaths[i]);
+            print_warning(msgbuff);
+            q->excodes[i] = EXIT_FAILURE;
+            continue;
+        }
+        for ( size_t j = 0; j < q->nchunks[i] && q->ready[i]; ++j ) {
+            q->ready[i] = ( !stat(q->chunks[i][j].fpath, &st) && (uint64_t)st.st_size == q->chunks[i][j].size );
+        }
+        if ( !q->ready[i] ) {
+            free(q->chunks[i]);
+            q->chunks[i] = NULL;
+            q->nchunks[i] = 0;
+            continue;
+        }
+        print_start("\nVerifying the chunks against the bundle's index ...");
+        if ( chunks_verify(q->chunks[i], q->nchunks[i], pool) ) {
+            print_alert("\nChunk failures found. The failed chunks will *not* be unpacked.");
+            q->excodes[i] = EXIT_FAILURE;
+        } else {
+            print_done(0);
+        }
+        for ( size_t j = 0; j < q->nchunks[i]; ++j ) {
+            if ( q->chunks[i][j].status == CHUNK_OK ) ++nfiles;
+        }
+    }
+    return nfiles;
+}
+
+/**
+    Move a file from the watched directory into the given subdirectory.
+*/
+static void retire_file(const char *fpath, const char *dpath, const char *subdir) {
+
+    char    msgbuff[PATH_MAX + 128];
+    char    dst[PATH_MAX];
+
+    if ( snprintf(dst, sizeof(dst), "%s/%s/%s", dpath, subdir, strrchr(fpath, '/') + 1) >= (int)sizeof(dst) ||
+         rename(fpath, dst) ) {
+        snprintf(msgbuff, sizeof(msgbuff), "The archive could not be moved from the watched directory: %s",
+                 fpath);
+        print_warning(msgbuff);
+    }
+}
+
+/**
+    Move each ready archive (or bundle, with its chunks) of a batch into
+    the done or failed subdirectory. The waiting bundles are kept in the
+    queue.
+*/
+static void retire(struct watch_queue *q, const char *dpath) {
+
+    const char  *subdir;
+    int         n = 0;
+
+    for ( int i = 0; i < q->n; ++i ) {
+        if ( !q->ready[i] ) {
+            if ( i != n ) memcpy(q->fpaths[n], q->fpaths[i], PATH_MAX);
+            ++n;
+            continue;
+        }
+        subdir = ( q->excodes[i] ) ? WATCH_FAILED : WATCH_DONE;
+        for ( size_t j = 0; j < q->nchunks[i]; ++j ) retire_file(q->chunks[i][j].fpath, dpath, subdir);
+        retire_file(q->fpaths[i], dpath, subdir);
+        free(q->chunks[i]);
+        q->chunks[i] = NULL;
+        q->nchunks[i] = 0;
+    }
+    q->n = n;
+    q->waiting = ( n > 0 );
+}
+
+/**
+    Unpack the ready archives and bundles of the queue, as a single
+    batch, then retire them.
+*/
+static void run_queue(struct watch_queue *q, const char *dpath, struct pool *pool, watch_batch batch,
+                      void *ctx) {
+
+    size_t      k = 0;
+    size_t      nfiles = queue_ready(q, pool);
+    int         *excodes;
+    const char  **files;
+
+    files = malloc((nfiles + 1) * sizeof(*files));
+    excodes = calloc(nfiles + 1, sizeof(*excodes));
+    if ( files == NULL || excodes == NULL ) {
+        reporterror("Error occurred while allocating memory for the batch.", false, true);
+    }
+    for ( int i = 0; i < q->n; ++i ) {
+        if ( !q->ready[i] ) continue;
+        if ( !is_index(q->fpaths[i]) ) {
+            files[k++] = q->fpaths[i];
+            continue;
+        }
+        for ( size_t j = 0; j < q->nchunks[i]; ++j ) {
+            if ( q->chunks[i][j].status == CHUNK_OK ) files[k++] = q->chunks[i][j].fpath;
+        }
+    }
+    if ( nfiles ) batch(files, (int)nfiles, excodes, ctx);
+    // A bundle fails if any of its chunks fails.
+    k = 0;
+    for ( int i = 0; i < q->n; ++i ) {
+        if ( !q->ready[i] ) continue;
+        if ( !is_index(q->fpaths[i]) ) {
+            q->excodes[i] = excodes[k++];
+            continue;
+        }
+        for ( size_t j = 0; j < q->nchunks[i]; ++j ) {
+            if ( q->chunks[i][j].status == CHUNK_OK && excodes[k++] ) q->excodes[i] = EXIT_FAILURE;
+        }
+    }
+    free(files);
+    free(excodes);
+    retire(q, dpath);
+}
+
+/**
+    Watch a directory for new archives, and unpack them in batches,
+    until interrupted (SIGINT or SIGTERM).
+
+    The archives already in the directory are unpacked first; those which
+    are still being written are left until they settle. Then, an
+    archive is queued once it is fully written (IN_CLOSE_WRITE), or
+    moved into the directory (IN_MOVED_TO). The queue is passed to the
+    callback once no further archives arrive for WATCH_SETTLE_MS, so
+    the archives copied together are unpacked together. Each archive is
+    then moved into the directory's WATCH_DONE or WATCH_FAILED
+    subdirectory, so it is not unpacked again.
+
+    A chunked bundle is queued by its index, and waits in the queue
+    until each of its chunks has arrived. Its chunks are then verified
+    against the index, unpacked with the batch, and moved with the
+    index.
+
+    @param[in]  dpath   Explicit path to the watched directory.
+    @param[in]  pool    Worker pool used to verify the chunks, or NULL.
+    @param[in]  batch   Callback which unpacks each batch of archives.
+    @param[in]  ctx     Context passed to the callback.
+
+    @return             0 when interrupted, otherwise 1 if the directory
+                        could not be watched; in which case an error is
+                        reported.
+*/
+int watch_run(const char *dpath, struct pool *pool, watch_batch batch, void *ctx) {
+
+    char                msgbuff[PATH_MAX + 128];
+    char                subdir[PATH_MAX];
+    char                drain[16];
+    bool                rescan = true;
+    bool                unsettled = false;   // The last scan left an archive which was still being written.
+    int                 excode = EXIT_SUCCESS;
+    int                 fd;
+    int                 full = 0;
+    int                 nready;
+    int                 pipefd[2] = {-1, -1};
+    struct pollfd       pfd[2];
+    struct sigaction    sa = {0};
+    struct watch_queue  *q;
+
+    if ( (q = calloc(1, sizeof(*q))) == NULL ) {
+        reporterror("Error occurred while allocating memory for the watch queue.", false, false);
+        return EXIT_FAILURE;
+    }
+    if ( (fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0 ||
+         inotify_add_watch(fd, dpath, IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR) < 0 ||
+         pipe2(pipefd, O_NONBLOCK | O_CLOEXEC) ) {
+        snprintf(msgbuff, sizeof(msgbuff), "The directory could not be watched: %s: %s", strerror(errno), dpath);
+        reporterror(msgbuff, false, false);
+        if ( fd >= 0 ) close(fd);
+        if ( pipefd[0] >= 0 ) close(pipefd[0]);
+        free(q);
+        return EXIT_FAILURE;
+    }
+    _wakefd = pipefd[1];
+    snprintf(subdir, sizeof(subdir), "%s/" WATCH_DONE, dpath);
+    makedir(subdir, 0700, 0);
+    snprintf(subdir, sizeof(subdir), "%s/" WATCH_FAILED, dpath);
+    makedir(subdir, 0700, 0);
+    // The interrupted reads and writes of a running batch are restarted; poll(2) never is.
+    sa.sa_handler = on_signal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    pfd[0].fd = fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = pipefd[0];
+    pfd[1].events = POLLIN;
+    snprintf(msgbuff, sizeof(msgbuff), "Watching for archives in %s (Ctrl+C to stop) ...", dpath);
+    print_ok(msgbuff);
+    while ( !_stop ) {
+        // The directory is scanned on start, and whenever the queue was too full to hold every archive.
+        if ( rescan ) {
+            unsettled = false;
+            if ( queue_existing(q, dpath, &unsettled) ) full = 1;
+            rescan = false;
+        }
+        /* Wait (indefinitely, while empty or waiting on chunks) for an archive, then until arrivals settle.
+           An unsettled archive is picked up by a timed rescan, as its event may have been lost. */
+        nready = poll(pfd, 2, ( (q->n && !q->waiting) || unsettled ) ? WATCH_SETTLE_MS : -1);
+        if ( nready < 0 ) {
+            if ( errno == EINTR ) continue;
+            snprintf(msgbuff, sizeof(msgbuff), "The directory could not be watched: %s: %s", strerror(errno),
+                     dpath);
+            reporterror(msgbuff, false, false);
+            excode = EXIT_FAILURE;
+            break;
+        }
+        if ( pfd[1].revents ) {
+            while ( read(pipefd[0], drain, sizeof(drain)) > 0 );
+            continue;
+        }
+        if ( nready > 0 ) {
+            // Any arrival (including a chunk) may complete a waiting bundle.
+            q->waiting = false;
+            if ( queue_events(q, dpath, fd) ) full = 1;
+            if ( !full ) continue;
+        }
+        if ( unsettled ) rescan = true;
+        if ( q->n == 0 ) continue;
+        run_queue(q, dpath, pool, batch, ctx);
+        rescan = rescan || full;
+        full = 0;
+    }
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    _wakefd = -1;
+    close(pipefd[0]);
+    close(pipefd[1]);
+    close(fd);
+    free(q);
+    print_ok("\nStopped watching for archives.");
+    return excode;
+}
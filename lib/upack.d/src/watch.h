@@ -0,0 +1,50 @@
+/**
+    Header file for the watch.c module.
+*/
+
+#ifndef _WATCH_H
+#define _WATCH_H
+
+struct pool;
+
+/**
+    Callback which unpacks a batch of archives.
+
+    @param[in]  files   Explicit paths to the archives.
+    @param[in]  nfiles  Number of archives.
+    @param[out] excodes Receives the exit code of each archive.
+    @param[in]  ctx     The context passed to watch_run().
+
+    @return             0 if every archive was unpacked, otherwise 1.
+*/
+typedef int (*watch_batch)(const char **files, int nfiles, int *excodes, void *ctx);
+
+/**
+    Watch a directory for new archives, and unpack them in batches,
+    until interrupted (SIGINT or SIGTERM).
+
+    The archives already in the directory are unpacked first. Then, an
+    archive is queued once it is fully written (IN_CLOSE_WRITE), or
+    moved into the directory (IN_MOVED_TO). The queue is passed to the
+    callback once no further archives arrive for WATCH_SETTLE_MS, so
+    the archives copied together are unpacked together. Each archive is
+    then moved into the directory's WATCH_DONE or WATCH_FAILED
+    subdirectory, so it is not unpacked again.
+
+    A chunked bundle is queued by its index, and waits in the queue
+    until each of its chunks has arrived. Its chunks are then verified
+    against the index, unpacked with the batch, and moved with the
+    index.
+
+    @param[in]  dpath   Explicit path to the watched directory.
+    @param[in]  pool    Worker pool used to verify the chunks, or NULL.
+    @param[in]  batch   Callback which unpacks each batch of archives.
+    @param[in]  ctx     Context passed to the callback.
+
+    @return             0 when interrupted, otherwise 1 if the directory
+                        could not be watched; in which case an error is
+                        reported.
+*/
+int watch_run(const char *dpath, struct pool *pool, watch_batch batch, void *ctx);
+
+#endif /* _WATCH_H */
@@ -12,6 +12,33 @@
             which is designed to be called by the base ``ppk.py``
             program, after the call unpack.
 
+            If the ``pip_index_incremental`` config key is set, the
+            ``upack`` program updates the repo's simple index itself,
+            rewriting only the pages of the projects it changed.
+
+            If the ``advisory_snapshot`` config key is set, the archive's
+            packages are re-checked against that offline advisory
+            snapshot. Otherwise, ``upack`` uses the snapshot installed in
+            the repo, if present.
+
+            If the ``upack_report`` config key is set, ``upack`` writes
+            a JSON report of the time spent in each phase of the unpack
+            to that path, for monitoring.
+
+            If the ``upack_config`` config key is set, ``upack`` loads
+            its settings (e.g. the repo path, workers and buffer sizes)
+            from that configuration file, rather than from
+            ``/etc/ppk/upack.conf``.
+
+            If the ``upack_inventory`` config key is set, ``upack``
+            writes the repo inventory to that path on each run, to be
+            carried back to the packer for its next (delta) archive.
+
+            If the ``upack_stage`` config key is set, ``upack`` stages
+            the archive in that directory, rather than in the repo's
+            hidden ``.ppk`` directory. The directory must be on the
+            repo's file system.
+
 :Platform:  Linux/Windows | Python 3.6+
 :Developer: J Berendt
 :Email:     development@s3dev.uk
@@ -24,6 +51,7 @@
 import os
 import shutil
 import subprocess as sp
+import tempfile
 import traceback
 from utils4.user_interface import ui
 # locals
@@ -42,7 +70,7 @@ class PPKUnPacker:
 
     Args:
         fpath (str): Full path to the ``.7z`` file to be tested and
-            unpacked.
+            unpacked, or to the ``.chunks`` index of a chunked archive.
 
     """
 
@@ -52,13 +80,26 @@ class PPKUnPacker:
     def __init__(self, fpath: str):
         """Unpacker class initialiser."""
         self._fpath = fpath
+        self._changed = []
 
     def refresh(self) -> int:
         """Refresh the environment's local pip repository.
 
         Using the ``pip_refresh_prog`` key in the ``config.json`` file,
-        if that program exists, it is called. Otherwise a warning
-        message is displayed to the user.
+        if that program exists, it is called. If the
+        ``pip_refresh_changed`` key is set, the names of the changed
+        projects are passed as its arguments; so it may limit its work
+        to those projects. Otherwise a warning message is displayed to
+        the user.
+
+        If the ``pip_index_incremental`` key is set, the index has
+        already been updated by ``upack`` for the changed projects.
+        Therefore, if no refresh program is configured, nothing further
+        is required.
+
+        .. versionchanged: 0.3.0.dev1
+            Added the incremental index update, and the (optional)
+            changed project names argument to the refresh program.
 
         Returns:
             int: The exit code from the pip-refresh shell script.
@@ -66,9 +107,13 @@ class PPKUnPacker:
 
         """
         prog = config.pip_refresh_prog
+        if not prog and getattr(config, 'pip_index_incremental', False):
+            return 0
         if shutil.which(prog) is not None:
             try:
                 cmd = [prog]
+                if getattr(config, 'pip_refresh_changed', False):
+                    cmd.extend(self._changed)
                 excode = self._subprocess_call(cmd=cmd)
                 return excode
             except Exception as err:
@@ -86,13 +131,35 @@ class PPKUnPacker:
     def run(self) -> int:
         """Call the unpacker with the provided file path.
 
+        The names of the projects changed by the unpack are retained
+        for :meth:`refresh`.
+
         Returns:
             int: Return the exit code from the ``upack`` program.
 
         """
         msg = f'\nVerifying and unpacking: {os.path.basename(self._fpath)} ...'
-        cmd = [os.path.join(self._DIR_UPACK, 'upack'), self._fpath]
-        excode = self._subprocess_call(cmd=cmd, msg=msg)
+        fd, changed = tempfile.mkstemp(prefix='ppk-changed-', suffix='.txt')
+        os.close(fd)
+        try:
+            cmd = [os.path.join(self._DIR_UPACK, 'upack'), '--changed', changed, self._fpath]
+            if getattr(config, 'pip_index_incremental', False):
+                cmd.insert(1, '--index')
+            if getattr(config, 'advisory_snapshot', ''):
+                cmd[1:1] = ['--advisories', os.path.expanduser(config.advisory_snapshot)]
+            if getattr(config, 'upack_report', ''):
+                cmd[1:1] = ['--report', os.path.expanduser(config.upack_report)]
+            if getattr(config, 'upack_config', ''):
+                cmd[1:1] = ['--config', os.path.expanduser(config.upack_config)]
+            if getattr(config, 'upack_inventory', ''):
+                cmd[1:1] = ['--inventory', os.path.expanduser(config.upack_inventory)]
+            if getattr(config, 'upack_stage', ''):
+                cmd[1:1] = ['--stage', os.path.expanduser(config.upack_stage)]
+            excode = self._subprocess_call(cmd=cmd, msg=msg)
+            with open(changed, 'r', encoding='utf-8') as f:
+                self._changed = f.read().split()
+        finally:
+            os.unlink(changed)
         return excode
 
     def _subprocess_call(self, cmd: list, msg: str=None, show_stdout: bool=False) -> int:
@@ -13,15 +13,118 @@
 """
 # pylint: disable=wrong-import-order
 
+import json
 import os
 import requests
 import sys
 import sysconfig
+import threading
+import time
+# locals
+from lib.config import config
+from lib.profiler import TimedAdapter, profiler, record_response
+
+_tls = threading.local()  # Per-thread state (e.g. the HTTP session).
+_locks = {}               # A lock per cache key, so each key is fetched once.
+_locks_lock = threading.Lock()
 
 
 class Utilities:
     """General utility functions wrapper class."""
 
+    @staticmethod
+    def fetch(url: str, key: str, timeout: int=5, refresh: bool=False) -> tuple:
+        """Perform a GET request, using the on-disk response cache.
+
+        Responses are cached (by key) in the ``cache_dir`` directory, and
+        shared across runs. A cached response younger than ``cache_ttl``
+        seconds is returned without a request. An older response is
+        revalidated using its ``ETag`` and ``Last-Modified`` headers, so
+        an unchanged resource is not downloaded again. Both keys are read
+        from ``config.json``.
+
+        Only successful (200) responses are cached. Concurrent requests
+        for the same key (e.g. several wheels of the same project) are
+        serialised, so the key is fetched once.
+
+        Each lookup is timed, and counted as a cache hit, revalidation
+        or miss, by the first part of its key (see :mod:`lib.profiler`).
+
+        Args:
+            url (str): URL to be requested.
+            key (str): Cache key, as a relative path; for example
+                ``pypi/numpy``.
+            timeout (int, optional): Request timeout, in seconds.
+                Defaults to 5.
+            refresh (bool, optional): Revalidate a cached response,
+                regardless of its age. Defaults to False.
+
+        Returns:
+            tuple: A tuple containing the response's status code and
+            text.
+
+        """
+        kind = key.split('/', 1)[0]
+        with profiler.timer(name=f'fetch/{kind}', label=key):
+            return Utilities._fetch(url=url, key=key, kind=kind, timeout=timeout, refresh=refresh)
+
+    @staticmethod
+    def _fetch(url: str, key: str, kind: str, timeout: int, refresh: bool) -> tuple:
+        """Perform a GET request, using the on-disk response cache.
+
+        See :meth:`fetch`, which times this method.
+
+        """
+        path = os.path.join(Utilities.get_cache_dir(), f'{key}.json')
+        with _locks_lock:
+            lock = _locks.setdefault(key, threading.Lock())
+        with lock:
+            try:
+                with open(path, 'r', encoding='utf-8') as f:
+                    entry = json.load(f)
+            except (OSError, ValueError):
+                entry = None
+            now = time.time()
+            if entry and not refresh and now - entry['fetched'] < getattr(config, 'cache_ttl', 86400):
+                profiler.count(name=f'cache/{kind}/hit')
+                return 200, entry['text']
+            headers = {}
+            if entry and entry.get('etag'):
+                headers['If-None-Match'] = entry['etag']
+            if entry and entry.get('last_modified'):
+                headers['If-Modified-Since'] = entry['last_modified']
+            with Utilities.session().get(url, timeout=timeout, headers=headers) as r:
+                if r.status_code == 304 and entry:
+                    profiler.count(name=f'cache/{kind}/revalidated')
+                    entry['fetched'] = now
+                elif r.status_code == 200:
+                    profiler.count(name=f'cache/{kind}/miss')
+                    entry = {'url': url,
+                             'etag': r.headers.get('ETag'),
+                             'last_modified': r.headers.get('Last-Modified'),
+                             'fetched': now,
+                             'text': r.text}
+                else:
+                    return r.status_code, r.text
+            # Written to a temporary file, then replaced, so readers never see a partial entry.
+            os.makedirs(os.path.dirname(path), exist_ok=True)
+            tmp = f'{path}.{os.getpid()}.{threading.get_ident()}.tmp'
+            with open(tmp, 'w', encoding='utf-8') as f:
+                json.dump(entry, f)
+            os.replace(tmp, path)
+            return 200, entry['text']
+
+    @staticmethod
+    def get_cache_dir() -> str:
+        """Return the path to the response cache directory.
+
+        Returns:
+            str: The ``cache_dir`` value from ``config.json`` if set,
+            otherwise ``~/.cache/ppk``.
+
+        """
+        return os.path.expanduser(getattr(config, 'cache_dir', '') or '~/.cache/ppk')
+
     @staticmethod
     def get_desktop() -> str:
         """Get the path to the user's Desktop. Works for Linux or Windows.
@@ -62,33 +165,63 @@ class Utilities:
         return os.environ.get('USER')
 
     @staticmethod
-    def query_pypi(pkg: str) -> dict:
-        """Query the PyPI API and get the JSON for the specific package.
+    def session() -> requests.Session:
+        """Return the calling thread's HTTP session.
+
+        Each thread is given its own :class:`requests.Session`, so
+        connections (and TLS handshakes) to PyPI and Snyk are reused
+        across requests, while the sessions are never shared between the
+        verification workers. When profiling, the phases of each request
+        are timed by the session's :class:`~lib.profiler.TimedAdapter`,
+        and its :func:`~lib.profiler.record_response` hook.
+
+        Returns:
+            requests.Session: The calling thread's session.
+
+        """
+        if getattr(_tls, 'session', None) is None:
+            _tls.session = requests.Session()
+            if profiler.enabled:
+                for prefix in ('http://', 'https://'):
+                    _tls.session.mount(prefix, TimedAdapter())
+                _tls.session.hooks['response'].append(record_response)
+        return _tls.session
+
+    @staticmethod
+    def query_pypi(pkg: str, version: str, refresh: bool=False) -> dict:
+        """Query the PyPI API and get the JSON for a specific release.
 
         The PyPI API is queried to obtain the data for the requested
-        package. If successful, the returned data (in JSON format) is
-        stored into the class' ``_json`` variable.
+        release of the package. The response is cached on disk, by
+        project and version, and shared across runs (see :meth:`fetch`).
+        A release's data is keyed by its version, so a release published
+        after the cache entry was written is never looked up in it.
 
         A timeout of N seconds is setup on the GET request, in the event
         the remote server fails to respond.
 
         Args:
             pkg (str): Name of the package to be queried.
+            version (str): Version of the release to be queried.
+            refresh (bool, optional): Revalidate a cached response,
+                regardless of its age; for example, if a file was
+                uploaded to the release after it was cached. Defaults to
+                False.
 
         Returns:
             dict: The results of the query in JSON format.
 
+        .. versionchanged: 0.3.0.dev1
+           The release's response is cached, and revalidated once stale.
+
         """
-        data = None
-        url = f'https://pypi.org/pypi/{pkg}/json'
-        with requests.get(url, timeout=5) as r:
-            if r.status_code == 200:
-                data = r.json()
-            else:
-                msg = (f'\nThe request for ({pkg}) failed with status code: {r.status_code}\n'
-                       'Perhaps the package has a different name?')
-                raise RuntimeWarning(msg)
-        return data
+        url = f'https://pypi.org/pypi/{pkg}/{version}/json'
+        status, text = Utilities.fetch(url=url, key=f'pypi/{pkg.lower()}/{version}', refresh=refresh)
+        if status != 200:
+            msg = (f'\nThe request for ({pkg}) failed with status code: {status}\n'
+                   'Perhaps the package has a different name?')
+            raise RuntimeWarning(msg)
+        return json.loads(text)
 
 
 utilities = Utilities()
@@ -6,8 +6,10 @@
             Any wheel which is downloaded from PyPI is subject to the
             following tests, as contained in this module:
 
-                - MD5 checksum verification
-                - Snyk security vulnerability checks
+                - Checksum (SHA256 or MD5) verification
+                - Security vulnerability checks, using the reported
+                  vulnerabilities from an advisory provider (see the
+                  :mod:`lib.advisories` module)
 
 :Platform:  Linux/Windows | Python 3.6+
 :Developer: J Berendt
@@ -23,10 +25,10 @@
 # pylint: disable=import-error
 
 import os
-import requests
 from bs4 import BeautifulSoup
 from utils4.crypto import crypto
 # locals
+from lib.profiler import profiler
 from lib.utilities import utilities
 
 
@@ -36,43 +38,63 @@ class Tests:
     # pylint: disable=unused-argument
 
     @staticmethod
-    def md5(fpath: str, name: str, version: str, **kwargs) -> tuple:
-        """Perform an MD5 check against the PyPI database to verify
+    def md5(fpath: str, name: str, version: str, sha256: str=None, **kwargs) -> tuple:
+        """Perform a digest check against the PyPI database to verify
         integrity.
 
+        If the file's SHA256 digest was calculated as it was downloaded,
+        it is compared with the SHA256 digest published by PyPI, and the
+        file is not re-read. Otherwise, the file's MD5 digest is
+        calculated and compared with the MD5 digest published by PyPI.
+
         Args:
             fpath (str): Complete path to the package (wheel) to be
                 verified.
             name (str): Package name.
             version (str): Package version to be tested.
+            sha256 (str, optional): SHA256 digest of the file, as
+                calculated while it was downloaded. Defaults to None.
 
         :Keyword Arguments:
             None
 
         Returns:
             tuple: A tuple containig the verification flag. True if the
-            MD5 hashes match, otherwise False.
+            hashes match, otherwise False.
 
             The second element of the tuple is empty, but used for
             consistency in test return values.
 
+        .. versionchanged: 0.3.0.dev1
+           Added the SHA256 check, using the digest calculated while
+           downloading.
+           The digests are read from the release's own PyPI data, which
+           is revalidated if the file is not listed.
+
         """
-        md5p = None
+        digp = None
+        algo = 'sha256' if sha256 else 'md5'
         fname = os.path.basename(fpath)
-        data = utilities.query_pypi(pkg=name)
-        # Iterate until the specific file is found.
-        for record in data['releases'][version]:
-            if record['filename'] == fname:
-                md5p = record['digests']['md5']
-                break  # Stop after file is found.
-        # Generate own md5 and verify.
-        md5c = crypto.checksum_md5(path=fpath)
-        if md5c == md5p:
+        # A file missing from the cached release was uploaded since; revalidate once.
+        for refresh in (False, True):
+            data = utilities.query_pypi(pkg=name, version=version, refresh=refresh)
+            # Iterate until the specific file is found.
+            for record in data['urls']:
+                if record['filename'] == fname:
+                    digp = record['digests'][algo]
+                    break  # Stop after file is found.
+            if digp:
+                break
+        # Use (or generate) own digest and verify.
+        if not sha256:
+            profiler.count(name='hash/bytes', n=os.path.getsize(fpath))
+        digc = sha256 or crypto.checksum_md5(path=fpath)
+        if digc == digp:
             return (True,)
         return (False,)
 
     @staticmethod
-    def snyk(name: str, version: str, verbose: bool=True, **kwargs) -> tuple:
+    def snyk(name: str, version: str, verbose: bool=True, report: list=None, **kwargs) -> tuple:
         """Use Snyk.io to test for reported vulnerabilities.
 
         If a package has reported direct vulnerabilities, these are
@@ -86,6 +108,10 @@ class Tests:
             version (str): Package version to be tested.
             verbose (bool, optional): Print all reported vulnerabilities to
                 the terminal on test completion. Defaults to True.
+            report (list, optional): If provided, the report lines are
+                appended to this list rather than printed; used when the
+                tests are run concurrently, so the caller can print each
+                package's report in order. Defaults to None.
 
         :Keyword Arguments:
             None
@@ -109,8 +135,9 @@ class Tests:
         # version = '1.8.0'
         # --|
         url = f'https://security.snyk.io/package/pip/{name}'
-        with requests.get(url, timeout=3) as r:
-            soup = BeautifulSoup(r.text, 'html.parser')
+        # The pages are cached on disk; by project, and by version.
+        _, text = utilities.fetch(url=url, key=f'snyk/{name.lower()}', timeout=3)
+        soup = BeautifulSoup(text, 'html.parser')
         # Find the table and rows.
         div = soup.find('div', attrs={'class': 'package-versions-table__table'})
         rows = div.findAll('tr', attrs={'class': 'vue--table__row'})
@@ -132,8 +159,10 @@ class Tests:
                     vuln_n = list(map(int, vuln[::2]))  # Numeric vulnerabilities
                     # If any direct vulnerabilities are found, capture them.
                     if any(vuln_n):
-                        with requests.get(f'{url}/{version}', timeout=10) as r:
-                            soup = BeautifulSoup(r.text, 'html.parser')
+                        _, text = utilities.fetch(url=f'{url}/{version}',
+                                                  key=f'snyk/{name.lower()}/{version}',
+                                                  timeout=10)
+                        soup = BeautifulSoup(text, 'html.parser')
                         # soup = soupv  # Read from file -- DEV ONLY.
                         div = soup.find('div', attrs={'class': 'vulns-table__wrapper'})
                         rows = div.findAll('tr', attrs={'class': 'vue--table__row'})
@@ -147,14 +176,54 @@ class Tests:
         # End of processing summary.
         if verbose and dvset:
             tmpl = '{:10}{:40}{:25}'
-            print(f'\n{name} v{version} has the following reported direct vulnerabilities:',
-                  '',
-                  tmpl.format('Severity', 'Title', 'Versions'),
-                  tmpl.format('--------', '-----', '--------'),
-                  sep='\n')
-            for i in dvset:
-                print(tmpl.format(*i))
-            print()
+            lines = [f'\n{name} v{version} has the following reported direct vulnerabilities:',
+                     '',
+                     tmpl.format('Severity', 'Title', 'Versions'),
+                     tmpl.format('--------', '-----', '--------'),
+                     *(tmpl.format(*i) for i in dvset),
+                     '']
+        else:
+            lines = [f'{name} v{version} has no reported direct vulnerabilities.']
+        if report is None:
+            print(*lines, sep='\n')
         else:
-            print(f'{name} v{version} has no reported direct vulnerabilities.')
+            report.extend(lines)
         return (not any(vuln_n[:2]), *vuln_n)  # Pass --> No C(ritical) or H(igh) vulnerabilities.
+
+    @staticmethod
+    def vuln(name: str, version: str, advisories: dict, report: list=None, **kwargs) -> tuple:
+        """Test for reported vulnerabilities, using the advisory lookup.
+
+        The vulnerabilities for every package in the bundle are looked
+        up at once, before the tests are run, by the provider selected
+        in ``config.json`` (see :func:`lib.advisories.get_provider`).
+        This test reads the package's results from that lookup.
+
+        A package is considered 'passing' if no 'Critical' and 'High'
+        vulnerabilities have been reported.
+
+        Args:
+            name (str): Package name.
+            version (str): Package version to be tested.
+            advisories (dict): The results of the provider's lookup.
+            report (list, optional): If provided, the report lines are
+                appended to this list rather than printed. Defaults to
+                None.
+
+        :Keyword Arguments:
+            None
+
+        Returns:
+            tuple: A tuple containing the verification flag, and the
+            number of vulnerabilities found in each category, of
+            descending severity (i.e. C, H, M, L); as for :meth:`snyk`.
+
+        """
+        # pylint: disable=import-outside-toplevel
+        from lib.advisories import Provider
+        counts, lines = advisories.get(Provider.key(name, version), ((0, 0, 0, 0), []))
+        if report is None:
+            print(*lines, sep='\n')
+        else:
+            report.extend(lines)
+        return (not any(counts[:2]), *counts)  # Pass --> No C(ritical) or H(igh) vulnerabilities.